@@ -0,0 +1,72 @@
+// Измеряет время построения дерева разбора большой программы, её выполнения и удаления дерева.
+// Узлы дерева и их списки размещаются в арене, которой владеет программа (ast::NodeArena), поэтому
+// удаление освобождает блоки арены, не обходя дерево.
+// Сборка из корня репозитория:
+//   g++ -std=c++17 -O2 -I. bench/ast_arena_bench.cpp node_arena.cpp parse.cpp lexer.cpp lexer_scan.cpp runtime.cpp statement.cpp symbol.cpp token_buffer.cpp -o ast_arena_bench
+
+#include "bench/benchmark.h"
+#include "lexer.h"
+#include "parse.h"
+#include "statement.h"
+
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+    using Clock = chrono::steady_clock;
+
+    // Программа из классов с методами и длинных выражений над переменными и константами
+    string MakeProgram(size_t size) {
+        string program;
+        for (size_t i = 0; program.size() < size; ++i) {
+            const string index = to_string(i);
+            program += "class Point"s + index + ":\n"s
+                + "  def __init__(x, y):\n"s
+                + "    self.x = x\n"s
+                + "    self.y = y\n"s
+                + "  def norm():\n"s
+                + "    return self.x * self.x + self.y * self.y - (self.x - 1) / 2\n"s
+                + "p"s + index + " = Point"s + index + "(" + index + ", 2)\n"s
+                + "n = p"s + index + ".norm() + 1 + 2 * 3 - 4\n"s
+                + "if n > 10 and not n == 11:\n"s
+                + "  s = 'norm ' + str(n)\n"s;
+        }
+        return program + "print n\n"s;
+    }
+
+    double Milliseconds(Clock::duration duration) {
+        return chrono::duration<double, milli>(duration).count();
+    }
+
+}  // namespace
+
+int main() {
+    for (size_t size : { 1U << 20, 4U << 20, 16U << 20 }) {
+        const string program = MakeProgram(size);
+
+        const auto start = Clock::now();
+        parse::Lexer lexer{ string_view(program) };
+        auto tree = ParseProgram(lexer);
+        const auto parsed = Clock::now();
+
+        ostringstream output;
+        runtime::SimpleContext context{ output };
+        {
+            runtime::Closure closure;
+            tree->Execute(closure, context);
+        }
+        const auto executed = Clock::now();
+
+        tree.reset();
+        const auto destroyed = Clock::now();
+
+        bench::DoNotOptimize(output.str().size());
+        cout << setw(3) << size / (1024 * 1024) << " MB: parse "s << fixed << setprecision(2)
+             << setw(9) << Milliseconds(parsed - start) << " ms, execute "s
+             << setw(9) << Milliseconds(executed - parsed) << " ms, teardown "s
+             << setw(9) << Milliseconds(destroyed - executed) << " ms"s << endl;
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace bench {
+
+    template <typename T>
+    inline volatile T sink{};
+
+    // Предотвращает удаление компилятором вычислений, результат которых не используется
+    template <typename T>
+    void DoNotOptimize(T value) {
+        sink<T> = value;
+    }
+
+    // Выполняет fn iterations раз и выводит среднее время одной итерации в наносекундах
+    template <typename Fn>
+    double Measure(const std::string& name, size_t iterations, Fn fn) {
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            fn();
+        }
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        const double ns_per_iteration = elapsed.count() / static_cast<double>(iterations);
+        std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(2)
+                  << ns_per_iteration << " ns/iter" << std::endl;
+        return ns_per_iteration;
+    }
+
+    // Выполняет fn iterations раз, обрабатывая за итерацию bytes байт, и выводит скорость обработки в МБ/с
+    template <typename Fn>
+    double MeasureThroughput(const std::string& name, size_t bytes, size_t iterations, Fn fn) {
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            fn();
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        const double mb_per_second
+            = static_cast<double>(bytes) * static_cast<double>(iterations) / (1024.0 * 1024.0) / elapsed.count();
+        std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(2)
+                  << mb_per_second << " MB/s" << std::endl;
+        return mb_per_second;
+    }
+
+}  // namespace bench
@@ -0,0 +1,80 @@
+// Сравнивает время выполнения программы, в выражениях которой много константных подвыражений
+// и унарных минусов, без оптимизации и после свёртки констант (optimizer::FoldConstants),
+// а также время самой свёртки.
+// Сборка из корня репозитория:
+//   g++ -std=c++17 -O2 -I. bench/constant_folding_bench.cpp optimizer.cpp flat_ast.cpp bytecode.cpp vm.cpp node_arena.cpp parse.cpp lexer.cpp lexer_scan.cpp runtime.cpp statement.cpp symbol.cpp token_buffer.cpp -o constant_folding_bench
+
+#include "bench/benchmark.h"
+#include "bytecode.h"
+#include "flat_ast.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "statement.h"
+#include "vm.h"
+
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+    // count инструкций с арифметикой над константами, отрицаниями и сложением строк
+    string MakeProgram(size_t count) {
+        string program = "x = 3\ns = 0\nt = ''\n"s;
+        for (size_t i = 0; i < count; ++i) {
+            program += "s = s + x * (2 * 3 - 1) - -4 + (60 / 12) * 1 - (x - 1) * 1 + -(-(x * 2))\n"s;
+            if (i % 10 == 0) {
+                program += "t = 'result: ' + str(24 * 60) + ', ' + str(-7)\n"s;
+            }
+        }
+        return program + "print s, t\n"s;
+    }
+
+    ast::StatementPtr Parse(const string& program) {
+        parse::Lexer lexer{ string_view(program) };
+        return ParseProgram(lexer);
+    }
+
+    void Compare(const string& name, ast::Statement& program, size_t iterations) {
+        const flat::Program flat_program = flat::Flatten(program);
+        const bytecode::Chunk chunk = bytecode::Compile(program);
+        bench::Measure("  "s + name + " tree walker"s, iterations, [&] {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            program.Execute(closure, context);
+            bench::DoNotOptimize(context.output.str().size());
+        });
+        bench::Measure("  "s + name + " flat evaluator"s, iterations, [&] {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            flat::Evaluator(context).Run(flat_program, closure);
+            bench::DoNotOptimize(context.output.str().size());
+        });
+        bench::Measure("  "s + name + " virtual machine"s, iterations, [&] {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            bytecode::VirtualMachine(context).Run(chunk, closure);
+            bench::DoNotOptimize(context.output.str().size());
+        });
+    }
+
+}  // namespace
+
+int main() {
+    const string source = MakeProgram(20000);
+    auto plain = Parse(source);
+    auto folded = Parse(source);
+    cout << "rewritten nodes: "s << optimizer::FoldConstants(folded) << endl;
+
+    Compare("plain"s, *plain, 20);
+    Compare("folded"s, *folded, 20);
+    bench::Measure("  fold constants"s, 20, [&] {
+        auto program = Parse(source);
+        bench::DoNotOptimize(optimizer::FoldConstants(program));
+    });
+    bench::Measure("  parse only"s, 20, [&] {
+        bench::DoNotOptimize(Parse(source).get());
+    });
+}
@@ -0,0 +1,112 @@
+// Сравнивает время выполнения программы с ветками, зависящими от флагов (if DEBUG:, if not TRACE:),
+// и инструкциями if, условия которых - сравнения, без оптимизации и после подстановки констант,
+// удаления невыполнимых веток и упрощения условий (optimizer::PropagateConstants,
+// optimizer::EliminateDeadBranches, optimizer::FuseConditions), а также время самих проходов.
+// Сборка из корня репозитория:
+//   g++ -std=c++17 -O2 -I. bench/dead_branch_bench.cpp optimizer.cpp flat_ast.cpp bytecode.cpp vm.cpp node_arena.cpp parse.cpp lexer.cpp lexer_scan.cpp runtime.cpp statement.cpp symbol.cpp token_buffer.cpp -o dead_branch_bench
+
+#include "bench/benchmark.h"
+#include "bytecode.h"
+#include "flat_ast.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "statement.h"
+#include "vm.h"
+
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+    // count групп инструкций с ветками по флагам и по сравнениям, в том числе в теле метода
+    string MakeProgram(size_t count) {
+        string program = R"(
+DEBUG = False
+TRACE = 0
+LIMIT = 100 * 2
+
+class Stepper:
+  def step(x):
+    if x < 50:
+      return x + 3
+    if not x >= 75:
+      return x - 40
+    return x - 70
+
+stepper = Stepper()
+s = 0
+t = 0
+)"s;
+        for (size_t i = 0; i < count; ++i) {
+            program += R"(if DEBUG:
+  print 'debug', s, t
+if not TRACE:
+  s = s + 1
+else:
+  print 'trace', s
+if s < LIMIT:
+  s = s + 2
+else:
+  s = s - LIMIT
+t = stepper.step(t)
+)"s;
+        }
+        return program + "print s, t\n"s;
+    }
+
+    ast::StatementPtr Parse(const string& program) {
+        parse::Lexer lexer{ string_view(program) };
+        return ParseProgram(lexer);
+    }
+
+    size_t Optimize(ast::StatementPtr& program) {
+        size_t rewritten = optimizer::PropagateConstants(program);
+        rewritten += optimizer::FoldConstants(program);
+        rewritten += optimizer::EliminateDeadBranches(program);
+        return rewritten + optimizer::FuseConditions(program);
+    }
+
+    void Compare(const string& name, ast::Statement& program, size_t iterations) {
+        const flat::Program flat_program = flat::Flatten(program);
+        const bytecode::Chunk chunk = bytecode::Compile(program);
+        bench::Measure("  "s + name + " tree walker"s, iterations, [&] {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            program.Execute(closure, context);
+            bench::DoNotOptimize(context.output.str().size());
+        });
+        bench::Measure("  "s + name + " flat evaluator"s, iterations, [&] {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            flat::Evaluator(context).Run(flat_program, closure);
+            bench::DoNotOptimize(context.output.str().size());
+        });
+        bench::Measure("  "s + name + " virtual machine"s, iterations, [&] {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            bytecode::VirtualMachine(context).Run(chunk, closure);
+            bench::DoNotOptimize(context.output.str().size());
+        });
+    }
+
+}  // namespace
+
+int main() {
+    const string source = MakeProgram(20000);
+    auto plain = Parse(source);
+    auto optimized = Parse(source);
+    cout << "rewritten nodes: "s << Optimize(optimized) << endl;
+
+    Compare("plain"s, *plain, 20);
+    Compare("optimized"s, *optimized, 20);
+    bench::Measure("  optimizer passes"s, 20, [&] {
+        auto program = Parse(source);
+        bench::DoNotOptimize(Optimize(program));
+    });
+    bench::Measure("  parse only"s, 20, [&] {
+        bench::DoNotOptimize(Parse(source).get());
+    });
+}
@@ -0,0 +1,87 @@
+// Сравнивает время выполнения программы обходом дерева разбора, вычислением её плоской записи
+// (flat::Program) и виртуальной машиной для программы из длинных цепочек арифметических операций
+// и для программы из рекурсивных вызовов метода.
+// Сборка из корня репозитория:
+//   g++ -std=c++17 -O2 -I. bench/flat_ast_bench.cpp flat_ast.cpp bytecode.cpp vm.cpp node_arena.cpp parse.cpp lexer.cpp lexer_scan.cpp runtime.cpp statement.cpp symbol.cpp token_buffer.cpp -o flat_ast_bench
+
+#include "bench/benchmark.h"
+#include "bytecode.h"
+#include "flat_ast.h"
+#include "lexer.h"
+#include "parse.h"
+#include "statement.h"
+#include "vm.h"
+
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+    // count инструкций с цепочками из chain сложений, вычитаний, умножений и делений
+    string MakeExpressionProgram(size_t count, size_t chain) {
+        string program = "x = 3\ns = 0\n"s;
+        for (size_t i = 0; i < count; ++i) {
+            program += "s = s"s;
+            for (size_t j = 0; j < chain; ++j) {
+                program += (j % 2 == 0 ? " + x * "s : " - x / "s) + to_string(j + 1);
+            }
+            program += '\n';
+        }
+        return program + "print s\n"s;
+    }
+
+    // Рекурсивные вызовы метода с условием и сравнением
+    string MakeCallProgram(size_t n) {
+        return R"(
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+f = Fib()
+print f.calc()"s + to_string(n) + ")\n"s;
+    }
+
+    void Compare(const string& name, const string& program, size_t iterations) {
+        parse::Lexer lexer{ string_view(program) };
+        auto tree = ParseProgram(lexer);
+        const flat::Program flat_program = flat::Flatten(*tree);
+        const bytecode::Chunk chunk = bytecode::Compile(*tree);
+
+        cout << name << ": "s << flat_program.nodes.size() << " nodes of "s << sizeof(flat::Node) << " bytes"s
+             << endl;
+        bench::Measure("  tree walker"s, iterations, [&] {
+            ostringstream output;
+            runtime::SimpleContext context{ output };
+            runtime::Closure closure;
+            tree->Execute(closure, context);
+            bench::DoNotOptimize(output.str().size());
+        });
+        bench::Measure("  flat evaluator"s, iterations, [&] {
+            ostringstream output;
+            runtime::SimpleContext context{ output };
+            runtime::Closure closure;
+            flat::Evaluator(context).Run(flat_program, closure);
+            bench::DoNotOptimize(output.str().size());
+        });
+        bench::Measure("  virtual machine"s, iterations, [&] {
+            ostringstream output;
+            runtime::SimpleContext context{ output };
+            runtime::Closure closure;
+            bytecode::VirtualMachine(context).Run(chunk, closure);
+            bench::DoNotOptimize(output.str().size());
+        });
+        bench::Measure("  flatten"s, iterations, [&] {
+            bench::DoNotOptimize(flat::Flatten(*tree).nodes.size());
+        });
+    }
+
+}  // namespace
+
+int main() {
+    Compare("expressions"s, MakeExpressionProgram(2000, 50), 20);
+    Compare("method calls"s, MakeCallProgram(20), 5);
+}
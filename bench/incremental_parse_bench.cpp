@@ -0,0 +1,54 @@
+// Сравнивает время разбора программы целиком с временем обновления дерева разбора
+// после правки одной инструкции (parse::IncrementalParser) для программ разного размера.
+// Сборка из корня репозитория:
+//   g++ -std=c++17 -O2 -I. bench/incremental_parse_bench.cpp incremental_parse.cpp node_arena.cpp parse.cpp lexer.cpp lexer_scan.cpp runtime.cpp statement.cpp symbol.cpp token_buffer.cpp -o incremental_parse_bench
+
+#include "bench/benchmark.h"
+#include "incremental_parse.h"
+#include "lexer.h"
+
+#include <string>
+
+using namespace std;
+
+namespace {
+
+    // Программа из block_count блоков: класс, создание его экземпляра и вызов метода
+    string GenerateProgram(size_t block_count) {
+        string program;
+        for (size_t i = 0; i < block_count; ++i) {
+            const string name = "Counter"s + to_string(i);
+            program += "class "s + name + ":\n"s;
+            program += "  def add(delta):\n"s;
+            program += "    self.value = self.value + delta\n"s;
+            program += "    return self.value\n\n"s;
+            program += "c"s + to_string(i) + " = "s + name + "()\n"s;
+            program += "c"s + to_string(i) + ".value = 10\n"s;
+            program += "print c"s + to_string(i) + ".add(5)\n"s;
+        }
+        return program;
+    }
+
+}  // namespace
+
+int main() {
+    for (size_t block_count : { 100, 1000, 10000 }) {
+        const string program = GenerateProgram(block_count);
+        cout << block_count * 4 << " statements, "s << program.size() / 1024 << " KB"s << endl;
+
+        const size_t iterations = 100000 / block_count;
+        bench::Measure("  parse whole program"s, iterations, [&] {
+            parse::Lexer lexer{ string_view(program) };
+            bench::DoNotOptimize(ParseProgram(lexer).get());
+        });
+
+        // Правка числа в инструкции в середине программы, поочерёдно 10 -> 20 -> 10
+        parse::IncrementalParser parser(program);
+        const size_t offset = program.find("= 10"s, program.size() / 2) + 2;
+        char digit = '2';
+        bench::Measure("  apply one-character edit"s, 1000, [&] {
+            parser.Apply({ offset, 1, string(1, digit) });
+            digit = digit == '1' ? '2' : '1';
+        });
+    }
+}
@@ -0,0 +1,115 @@
+// Сравнивает хранение полей экземпляра в Closure с хранением по смещениям формы (Shape):
+// память, занятую экземпляром с четырьмя полями, и время чтения поля.
+// Сборка из корня репозитория:
+//   g++ -std=c++17 -O2 -I. bench/instance_layout_bench.cpp runtime.cpp symbol.cpp -o instance_layout_bench
+
+#include "bench/benchmark.h"
+#include "runtime.h"
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+using namespace std;
+using runtime::ObjectHolder;
+
+namespace {
+
+    // Объём памяти, занятой в куче. Перед каждым блоком хранится его размер
+    size_t live_bytes = 0;
+    constexpr size_t HEADER_SIZE = alignof(max_align_t);
+
+}  // namespace
+
+void* operator new(size_t size) {
+    auto* block = static_cast<char*>(malloc(size + HEADER_SIZE));
+    if (block == nullptr) {
+        throw bad_alloc();
+    }
+    *reinterpret_cast<size_t*>(block) = size;
+    live_bytes += size;
+    return block + HEADER_SIZE;
+}
+
+void operator delete(void* p) noexcept {
+    if (p != nullptr) {
+        char* block = static_cast<char*>(p) - HEADER_SIZE;
+        live_bytes -= *reinterpret_cast<size_t*>(block);
+        free(block);
+    }
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+namespace {
+
+    const vector<string> FIELD_NAMES = { "x"s, "y"s, "width"s, "height"s };
+    const vector<runtime::Symbol> FIELD_SYMBOLS(FIELD_NAMES.begin(), FIELD_NAMES.end());
+
+    // Экземпляр в том виде, в каком он был реализован до появления форм
+    struct ClosureInstance {
+        runtime::Closure fields;
+    };
+
+    template <typename MakeInstance>
+    double MeasureBytesPerInstance(size_t count, MakeInstance make_instance) {
+        const size_t before = live_bytes;
+        auto instances = make_instance(count);
+        return static_cast<double>(live_bytes - before) / static_cast<double>(count);
+    }
+
+}  // namespace
+
+int main() {
+    runtime::Class cls("Rect"s, {}, nullptr);
+    constexpr size_t INSTANCES = 100000;
+
+    auto make_closure_instances = [](size_t count) {
+        vector<ClosureInstance> instances(count);
+        for (auto& instance : instances) {
+            for (const auto& name : FIELD_NAMES) {
+                instance.fields[name] = ObjectHolder::Own(runtime::Number{ 1 });
+            }
+        }
+        return instances;
+    };
+    auto make_shaped_instances = [&cls](size_t count) {
+        vector<ObjectHolder> instances;
+        instances.reserve(count);
+        runtime::FieldCache caches[4];
+        for (size_t i = 0; i < count; ++i) {
+            auto& instance = *instances.emplace_back(ObjectHolder::Own(runtime::ClassInstance{ cls }))
+                                  .TryAs<runtime::ClassInstance>();
+            for (size_t field = 0; field < FIELD_NAMES.size(); ++field) {
+                caches[field].Assign(instance.Fields(), FIELD_SYMBOLS[field], ObjectHolder::Own(runtime::Number{ 1 }));
+            }
+        }
+        return instances;
+    };
+
+    cout << "Closure: "s << MeasureBytesPerInstance(INSTANCES, make_closure_instances) << " bytes/instance"s << endl;
+    cout << "Shape:   "s << MeasureBytesPerInstance(INSTANCES, make_shaped_instances) << " bytes/instance"s << endl;
+
+    auto closure_instances = make_closure_instances(4096);
+    auto shaped_instances = make_shaped_instances(4096);
+    constexpr size_t ITERATIONS = 2000;
+
+    bench::Measure("read field, Closure::find"s, ITERATIONS, [&] {
+        int sum = 0;
+        for (const auto& instance : closure_instances) {
+            sum += instance.fields.find(FIELD_NAMES[3])->second.TryAs<runtime::Number>()->GetValue();
+        }
+        bench::DoNotOptimize(sum);
+    });
+    bench::Measure("read field, FieldCache"s, ITERATIONS, [&] {
+        runtime::FieldCache cache;
+        int sum = 0;
+        for (const auto& instance : shaped_instances) {
+            auto& fields = instance.TryAs<runtime::ClassInstance>()->Fields();
+            sum += cache.Find(fields, FIELD_SYMBOLS[3])->TryAs<runtime::Number>()->GetValue();
+        }
+        bench::DoNotOptimize(sum);
+    });
+}
@@ -0,0 +1,108 @@
+// Измеряет скорость лексического анализа программы, находящейся в памяти, для каждой
+// реализации функций сканирования (parse::scan::ScanLevel), поддерживаемой процессором,
+// а также время создания лексера, разбора короткой программы, сохранения токенов в TokenBuffer
+// и разбора программы в нескольких потоках (LexInParallel).
+// Сборка из корня репозитория:
+//   g++ -std=c++17 -O2 -I. bench/lexer_bench.cpp lexer.cpp lexer_parallel.cpp lexer_scan.cpp symbol.cpp token_buffer.cpp -lpthread -o lexer_bench
+// Чтобы сравнить уровни набора инструкций x86-64, добавьте к команде -march=x86-64-v2 или -march=x86-64-v3:
+// скалярная реализация будет собрана с соответствующими инструкциями, а векторные выбираются во время выполнения
+
+#include "bench/benchmark.h"
+#include "lexer.h"
+#include "lexer_parallel.h"
+#include "token_buffer.h"
+
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+    // Программа из классов с длинными идентификаторами, комментариями и глубокими отступами
+    string GenerateProgram(size_t class_count) {
+        string program;
+        for (size_t i = 0; i < class_count; ++i) {
+            const string name = "GeneratedClassWithLongName"s + to_string(i);
+            program += "# Класс номер "s + to_string(i) + ", комментарий описывает его назначение\n"s;
+            program += "class "s + name + ":\n"s;
+            program += "  def __init__(first_argument, second_argument):\n"s;
+            program += "    self.first_field_value = first_argument      # первое поле\n"s;
+            program += "    self.second_field_value = second_argument\n"s;
+            program += "\n"s;
+            program += "  def compute_something_useful(multiplier):\n"s;
+            program += "    if self.first_field_value > 1234567 and not self.second_field_value:\n"s;
+            program += "      return self.first_field_value * multiplier + 9876543\n"s;
+            program += "    return 'строковая константа без escape-последовательностей'\n"s;
+            program += "\n"s;
+            program += "instance_"s + to_string(i) + " = "s + name + "(42, None)\n"s;
+            program += "print instance_"s + to_string(i) + ".compute_something_useful(100)\n\n"s;
+        }
+        return program;
+    }
+
+    size_t CountTokens(string_view program) {
+        parse::Lexer lexer(program);
+        size_t count = 1;
+        while (!lexer.CurrentToken().Is<parse::token_type::Eof>()) {
+            lexer.NextToken();
+            ++count;
+        }
+        return count;
+    }
+
+}  // namespace
+
+int main() {
+    const string program = GenerateProgram(20000);
+    constexpr size_t ITERATIONS = 20;
+    cout << "Program size: "s << program.size() / 1024 << " KB"s << endl;
+
+    using parse::scan::ScanLevel;
+    for (ScanLevel level : { ScanLevel::Scalar, ScanLevel::Sse2, ScanLevel::Avx2 }) {
+        if (!parse::scan::IsScanLevelSupported(level)) {
+            cout << parse::scan::GetScanLevelName(level) << ": not supported"s << endl;
+            continue;
+        }
+        parse::scan::SetDefaultScanLevel(level);
+        bench::MeasureThroughput("lex, "s + parse::scan::GetScanLevelName(level), program.size(), ITERATIONS, [&] {
+            bench::DoNotOptimize(CountTokens(program));
+        });
+    }
+    parse::scan::SetDefaultScanLevel(parse::scan::GetBestScanLevel());
+
+    // Сохранение всех токенов: вектор вариантов против структуры массивов
+    const size_t token_count = CountTokens(program);
+    cout << "Tokens: "s << token_count << ", vector<Token>: "s << sizeof(parse::Token) + sizeof(parse::SourceSpan)
+         << " bytes/token, TokenBuffer: "s
+         << sizeof(parse::TokenKind) + sizeof(uint32_t) + sizeof(parse::SourceSpan) << " bytes/token"s << endl;
+    bench::MeasureThroughput("lex into vector<Token>"s, program.size(), ITERATIONS, [&] {
+        parse::Lexer lexer{ string_view(program) };
+        vector<pair<parse::Token, parse::SourceSpan>> tokens;
+        while (true) {
+            tokens.emplace_back(lexer.CurrentToken(), lexer.CurrentSpan());
+            if (lexer.CurrentToken().Is<parse::token_type::Eof>()) {
+                break;
+            }
+            lexer.NextToken();
+        }
+        bench::DoNotOptimize(tokens.size());
+    });
+    bench::MeasureThroughput("lex into TokenBuffer"s, program.size(), ITERATIONS, [&] {
+        parse::Lexer lexer{ string_view(program) };
+        bench::DoNotOptimize(parse::TokenBuffer::Read(lexer).size());
+    });
+    for (size_t threads : { size_t{ 2 }, size_t{ 4 }, size_t{ thread::hardware_concurrency() } }) {
+        bench::MeasureThroughput("lex in parallel, "s + to_string(threads) + " threads"s, program.size(), ITERATIONS, [&] {
+            bench::DoNotOptimize(parse::LexInParallel(program, threads).size());
+        });
+    }
+
+    // Пакетная обработка множества коротких программ: стоимость определяется созданием лексера
+    const string small_program = "x = 1\nif x and not None:\n  print 'ok', True\n"s;
+    bench::Measure("lex small program"s, 1000000, [&] {
+        bench::DoNotOptimize(CountTokens(small_program));
+    });
+}
@@ -0,0 +1,104 @@
+// Сравнивает уровни оптимизации (optimizer::OptimizationLevel) по времени подготовки программы
+// (разбор и проходы оптимизатора) и времени её выполнения обходом дерева разбора для двух программ:
+// с ветками по флагам и константными выражениями и с вызовами методов без констант.
+// Также измеряет стоимость проверки дерева после каждого прохода (PassManager::SetVerify).
+// Сборка из корня репозитория:
+//   g++ -std=c++17 -O2 -I. bench/pass_manager_bench.cpp pass_manager.cpp optimizer.cpp node_arena.cpp parse.cpp lexer.cpp lexer_scan.cpp runtime.cpp statement.cpp symbol.cpp token_buffer.cpp -o pass_manager_bench
+
+#include "bench/benchmark.h"
+#include "lexer.h"
+#include "parse.h"
+#include "pass_manager.h"
+#include "statement.h"
+
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+    // count групп инструкций, большая часть которых удаляется или сворачивается оптимизатором
+    string MakeFlagProgram(size_t count) {
+        string program = "DEBUG = False\nSCALE = 60 * 60\ns = 0\n"s;
+        for (size_t i = 0; i < count; ++i) {
+            program += R"(if DEBUG:
+  print 'debug', s
+if not DEBUG:
+  s = s + SCALE * 2 - (SCALE / 60) * 1
+if s > SCALE * 1000:
+  s = 0
+)"s;
+        }
+        return program + "print s\n"s;
+    }
+
+    // count вызовов метода, в котором оптимизатору почти нечего упрощать
+    string MakeCallProgram(size_t count) {
+        string program = R"(
+class Acc:
+  def __init__():
+    self.total = 0
+
+  def add(x):
+    if x < self.total:
+      self.total = self.total - x
+    else:
+      self.total = self.total + x
+    return self.total
+
+a = Acc()
+v = 0
+)"s;
+        for (size_t i = 0; i < count; ++i) {
+            program += "v = a.add(v + "s + to_string(i % 7) + ")\n"s;
+        }
+        return program + "print v\n"s;
+    }
+
+    ast::StatementPtr Parse(const string& program) {
+        parse::Lexer lexer{ string_view(program) };
+        return ParseProgram(lexer);
+    }
+
+    void Compare(const string& name, const string& source, size_t iterations) {
+        cout << name << endl;
+        const pair<string, optimizer::OptimizationLevel> levels[] = {
+            { "-O0"s, optimizer::OptimizationLevel::O0 },
+            { "-O1"s, optimizer::OptimizationLevel::O1 },
+            { "-O2"s, optimizer::OptimizationLevel::O2 },
+        };
+        for (const auto& [level_name, level] : levels) {
+            bench::Measure("  "s + level_name + " parse and optimize"s, iterations, [&] {
+                auto program = Parse(source);
+                bench::DoNotOptimize(optimizer::PassManager(level).Run(program));
+            });
+            auto program = Parse(source);
+            optimizer::PassManager(level).Run(program);
+            bench::Measure("  "s + level_name + " execute"s, iterations, [&] {
+                runtime::DummyContext context;
+                runtime::Closure closure;
+                program->Execute(closure, context);
+                bench::DoNotOptimize(context.output.str().size());
+            });
+        }
+        bench::Measure("  -O2 parse, optimize and verify"s, iterations, [&] {
+            auto program = Parse(source);
+            optimizer::PassManager passes(optimizer::OptimizationLevel::O2);
+            passes.SetVerify(true);
+            bench::DoNotOptimize(passes.Run(program));
+        });
+    }
+
+}  // namespace
+
+int main() {
+    Compare("flags and constants"s, MakeFlagProgram(20000), 10);
+    Compare("method calls"s, MakeCallProgram(50000), 10);
+
+    auto program = Parse(MakeFlagProgram(20000));
+    optimizer::PassManager passes(optimizer::OptimizationLevel::O2);
+    passes.SetCountNodes(true);
+    passes.Run(program);
+    passes.PrintStats(cout);
+}
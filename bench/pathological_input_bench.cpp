@@ -0,0 +1,121 @@
+// Разбирает машинно сгенерированные программы размером в несколько мегабайт: длинные серии
+// пустых строк и комментариев, длинные плоские программы, выражения с наибольшей допустимой
+// вложенностью (MAX_NESTING_DEPTH) и длинные цепочки операций. Для каждой выводит скорость разбора и наибольшую глубину стека,
+// которую использовал разбор (вместе с удалением дерева): она не должна расти вместе с размером программы.
+// Разбор выполняется в потоке POSIX с заранее заполненным образцом стеком, глубина определяется
+// по первому изменённому байту.
+// Сборка из корня репозитория:
+//   g++ -std=c++17 -O2 -I. bench/pathological_input_bench.cpp node_arena.cpp parse.cpp lexer.cpp lexer_scan.cpp runtime.cpp statement.cpp symbol.cpp token_buffer.cpp -lpthread -o pathological_input_bench
+
+#include "bench/benchmark.h"
+#include "lexer.h"
+#include "parse.h"
+#include "statement.h"
+
+#include <pthread.h>
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+    constexpr size_t STACK_SIZE = 8 * 1024 * 1024;
+    constexpr unsigned char STACK_PATTERN = 0xA5;
+
+    // Выполняет fn в потоке со стеком STACK_SIZE и возвращает, сколько байт стека он использовал
+    size_t MeasureStackUsage(const function<void()>& fn) {
+        vector<unsigned char> stack(STACK_SIZE, STACK_PATTERN);
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstack(&attr, stack.data(), stack.size());
+
+        pthread_t thread;
+        auto run = [](void* arg) -> void* {
+            (*static_cast<const function<void()>*>(arg))();
+            return nullptr;
+        };
+        if (pthread_create(&thread, &attr, run, const_cast<function<void()>*>(&fn)) != 0) {
+            throw runtime_error("Failed to start a thread"s);
+        }
+        pthread_join(thread, nullptr);
+        pthread_attr_destroy(&attr);
+
+        // Стек растёт вниз: использованная часть - от первого изменённого байта до конца
+        size_t untouched = 0;
+        while (untouched < stack.size() && stack[untouched] == STACK_PATTERN) {
+            ++untouched;
+        }
+        return stack.size() - untouched;
+    }
+
+    // Повторяет строку line, пока программа не достигнет size байт
+    string Repeat(const string& line, size_t size) {
+        string program;
+        program.reserve(size + line.size());
+        while (program.size() < size) {
+            program += line;
+        }
+        return program;
+    }
+
+    string BlankAndCommentLines(size_t size) {
+        return "x = 1\n"s + Repeat("\n# machine generated\n      \n"s, size) + "print x\n"s;
+    }
+
+    string FlatStatements(size_t size) {
+        return Repeat("x = x + 1\n"s, size);
+    }
+
+    // Выражения с наибольшей допустимой вложенностью скобок и цепочки операций, во много раз более длинные:
+    // длина цепочки не ограничена (см. MAX_NESTING_DEPTH)
+    string DeepExpressions(size_t size) {
+        string nested = "y = "s + string(MAX_NESTING_DEPTH, '(') + "1"s + string(MAX_NESTING_DEPTH, ')') + "\n"s;
+        string chain = "y = 1"s;
+        for (size_t i = 0; i < 100 * MAX_NESTING_DEPTH; ++i) {
+            chain += " + 1"s;
+        }
+        return Repeat(nested + chain + "\n"s, size);
+    }
+
+    void Report(const string& name, const string& program) {
+        chrono::duration<double> elapsed{};
+        const size_t stack = MeasureStackUsage([&] {
+            const auto start = chrono::steady_clock::now();
+            parse::Lexer lexer{ string_view(program) };
+            auto tree = ParseProgram(lexer);
+            bench::DoNotOptimize(tree.get());
+            tree.reset();
+            elapsed = chrono::steady_clock::now() - start;
+        });
+
+        const double megabytes = static_cast<double>(program.size()) / (1024.0 * 1024.0);
+        cout << left << setw(28) << name << right << fixed << setprecision(0) << setw(4) << megabytes << " MB"s
+             << setprecision(2) << setw(10) << megabytes / elapsed.count() << " MB/s"s
+             << setw(8) << stack / 1024 << " KB stack"s << endl;
+    }
+
+}  // namespace
+
+int main() {
+    for (size_t size : { 1U << 20, 4U << 20, 16U << 20 }) {
+        Report("blank and comment lines"s, BlankAndCommentLines(size));
+        Report("flat statements"s, FlatStatements(size));
+        Report("deepest allowed nesting"s, DeepExpressions(size));
+    }
+
+    // Слишком глубокая программа отвергается, не переполняя стек
+    const string too_deep = "y = "s + string(size_t{ 4 } << 20, '(') + "1\n"s;
+    const size_t stack = MeasureStackUsage([&] {
+        try {
+            parse::Lexer lexer{ string_view(too_deep) };
+            bench::DoNotOptimize(ParseProgram(lexer).get());
+        }
+        catch (const ParseError&) {
+        }
+    });
+    cout << "4 MB of nested parentheses rejected, "s << stack / 1024 << " KB stack"s << endl;
+}
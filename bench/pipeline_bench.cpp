@@ -0,0 +1,120 @@
+// Сравнивает последовательное выполнение программы (разбор целиком, затем выполнение)
+// с выполнением по мере разбора (pipeline::RunPipelined) для программ разного размера:
+// время до появления первой строки вывода и время выполнения всей программы.
+// Сборка из корня репозитория:
+//   g++ -std=c++17 -O2 -I. bench/pipeline_bench.cpp pipeline.cpp pass_manager.cpp optimizer.cpp flat_ast.cpp bytecode.cpp vm.cpp node_arena.cpp parse.cpp lexer.cpp lexer_scan.cpp runtime.cpp statement.cpp symbol.cpp token_buffer.cpp -lpthread -o pipeline_bench
+
+#include "bench/benchmark.h"
+#include "lexer.h"
+#include "parse.h"
+#include "pipeline.h"
+#include "statement.h"
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <optional>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+    using Clock = chrono::steady_clock;
+
+    // Буфер вывода, запоминающий время первой записи
+    class FirstOutputBuffer : public stringbuf {
+    public:
+        optional<Clock::time_point> first_output;
+
+    protected:
+        streamsize xsputn(const char* s, streamsize count) override {
+            Mark();
+            return stringbuf::xsputn(s, count);
+        }
+
+        int_type overflow(int_type c) override {
+            Mark();
+            return stringbuf::overflow(c);
+        }
+
+    private:
+        void Mark() {
+            if (!first_output) {
+                first_output = Clock::now();
+            }
+        }
+    };
+
+    // Программа печатает результат первой инструкции, затем выполняет size байт однотипных инструкций
+    string MakeProgram(size_t size) {
+        string program = R"(class Counter:
+  def __init__():
+    self.value = 0
+
+  def add(n):
+    self.value = self.value + n
+
+c = Counter()
+print 'started'
+)"s;
+        while (program.size() < size) {
+            program += "c.add(1)\nx = c.value * 2 + 1\n"s;
+        }
+        return program + "print c.value\n"s;
+    }
+
+    struct Timing {
+        double first_output_ms;
+        double total_ms;
+    };
+
+    template <typename Run>
+    Timing Measure(Run run) {
+#ifdef __GLIBC__
+        // Освобождённое предыдущим измерением дерево разбора не должно учитываться
+        // в первом выделении памяти следующего
+        malloc_trim(0);
+#endif
+        FirstOutputBuffer buffer;
+        ostream output(&buffer);
+        runtime::SimpleContext context{ output };
+        const auto start = Clock::now();
+        run(context);
+        const auto end = Clock::now();
+        bench::DoNotOptimize(buffer.str().size());
+        const chrono::duration<double, milli> first = buffer.first_output.value_or(end) - start;
+        const chrono::duration<double, milli> total = end - start;
+        return { first.count(), total.count() };
+    }
+
+    void Report(const string& name, const Timing& timing) {
+        cout << left << setw(28) << name << right << fixed << setprecision(2) << setw(10) << timing.first_output_ms
+             << " ms to first output"s << setw(10) << timing.total_ms << " ms total"s << endl;
+    }
+
+}  // namespace
+
+int main() {
+    for (size_t size : { 1U << 20, 4U << 20, 16U << 20 }) {
+        const string program = MakeProgram(size);
+        cout << "program of "s << size / (1024 * 1024) << " MB"s << endl;
+
+        Report("  sequential"s, Measure([&](runtime::Context& context) {
+            parse::Lexer lexer{ string_view(program) };
+            auto tree = ParseProgram(lexer);
+            runtime::Closure closure;
+            tree->Execute(closure, context);
+        }));
+        Report("  pipelined, tree walker"s, Measure([&](runtime::Context& context) {
+            parse::Lexer lexer{ string_view(program) };
+            pipeline::RunPipelined(lexer, context, pipeline::Executor::TreeWalker);
+        }));
+        Report("  pipelined, vm"s, Measure([&](runtime::Context& context) {
+            parse::Lexer lexer{ string_view(program) };
+            pipeline::RunPipelined(lexer, context, pipeline::Executor::VirtualMachine);
+        }));
+    }
+}
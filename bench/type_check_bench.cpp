@@ -0,0 +1,96 @@
+// Сравнивает проверку типа объекта по виду (Object::GetKind) с проверкой через dynamic_cast.
+// Сборка из корня репозитория:
+//   g++ -std=c++17 -O2 -I. bench/type_check_bench.cpp runtime.cpp symbol.cpp -o type_check_bench
+
+#include "bench/benchmark.h"
+#include "runtime.h"
+
+#include <vector>
+
+using namespace std;
+using runtime::ObjectHolder;
+
+namespace {
+
+    // IsTrue в том виде, в каком он был реализован до появления видов объектов
+    bool IsTrueDynamicCast(const ObjectHolder& object) {
+        if (auto p = dynamic_cast<runtime::Number*>(object.Get()); p && p->GetValue() != 0) {
+            return true;
+        }
+        if (auto p = dynamic_cast<runtime::String*>(object.Get()); p && !p->GetValue().empty()) {
+            return true;
+        }
+        if (auto p = dynamic_cast<runtime::Bool*>(object.Get()); p && p->GetValue()) {
+            return true;
+        }
+        return false;
+    }
+
+    int SumNumbersDynamicCast(const vector<ObjectHolder>& values) {
+        int sum = 0;
+        for (const auto& value : values) {
+            if (auto* number = dynamic_cast<runtime::Number*>(value.Get())) {
+                sum += number->GetValue();
+            }
+        }
+        return sum;
+    }
+
+    int SumNumbersTryAs(const vector<ObjectHolder>& values) {
+        int sum = 0;
+        for (const auto& value : values) {
+            if (auto* number = value.TryAs<runtime::Number>()) {
+                sum += number->GetValue();
+            }
+        }
+        return sum;
+    }
+
+}  // namespace
+
+int main() {
+    runtime::Class cls("Cls"s, {}, nullptr);
+
+    // Значения разных типов вперемешку, как в стеке интерпретатора
+    vector<ObjectHolder> values;
+    for (int i = 0; i < 4096; ++i) {
+        switch (i % 5) {
+        case 0:
+        case 1:
+            values.push_back(ObjectHolder::Own(runtime::Number{ i }));
+            break;
+        case 2:
+            values.push_back(ObjectHolder::Own(runtime::String{ to_string(i) }));
+            break;
+        case 3:
+            values.push_back(ObjectHolder::Own(runtime::Bool{ i % 2 == 0 }));
+            break;
+        default:
+            values.push_back(ObjectHolder::Own(runtime::ClassInstance{ cls }));
+            break;
+        }
+    }
+
+    constexpr size_t ITERATIONS = 20000;
+
+    bench::Measure("IsTrue, dynamic_cast"s, ITERATIONS, [&] {
+        size_t count = 0;
+        for (const auto& value : values) {
+            count += IsTrueDynamicCast(value);
+        }
+        bench::DoNotOptimize(count);
+    });
+    bench::Measure("IsTrue, object kind"s, ITERATIONS, [&] {
+        size_t count = 0;
+        for (const auto& value : values) {
+            count += runtime::IsTrue(value);
+        }
+        bench::DoNotOptimize(count);
+    });
+    bench::Measure("TryAs<Number>, dynamic_cast"s, ITERATIONS, [&] {
+        bench::DoNotOptimize(SumNumbersDynamicCast(values));
+    });
+    bench::Measure("TryAs<Number>, object kind"s, ITERATIONS, [&] {
+        bench::DoNotOptimize(SumNumbersTryAs(values));
+    });
+}
@@ -0,0 +1,342 @@
+#include "bytecode.h"
+
+#include <limits>
+#include <unordered_map>
+
+using namespace std;
+
+namespace bytecode {
+
+    CompareOp GetCompareOp(const ast::Comparison::Comparator& comparator) {
+        const auto* fn = comparator.target<runtime::CachedComparator::Comparator>();
+        if (fn == nullptr) {
+            return CompareOp::Custom;
+        }
+        if (*fn == &runtime::Equal) {
+            return CompareOp::Equal;
+        }
+        if (*fn == &runtime::NotEqual) {
+            return CompareOp::NotEqual;
+        }
+        if (*fn == &runtime::Less) {
+            return CompareOp::Less;
+        }
+        if (*fn == &runtime::Greater) {
+            return CompareOp::Greater;
+        }
+        if (*fn == &runtime::LessOrEqual) {
+            return CompareOp::LessOrEqual;
+        }
+        if (*fn == &runtime::GreaterOrEqual) {
+            return CompareOp::GreaterOrEqual;
+        }
+        return CompareOp::Custom;
+    }
+
+    namespace {
+        class Compiler : public ast::StatementVisitor {
+        public:
+            Chunk Compile(ast::Statement& statement) {
+                statement.Accept(*this);
+                Emit(OpCode::Return);
+                return std::move(chunk_);
+            }
+
+            void Visit(ast::NumericConst& node) override {
+                EmitConst(runtime::ObjectHolder::Share(node.GetValue()));
+            }
+
+            void Visit(ast::StringConst& node) override {
+                EmitConst(runtime::ObjectHolder::Share(node.GetValue()));
+            }
+
+            void Visit(ast::BoolConst& node) override {
+                EmitConst(runtime::ObjectHolder::Share(node.GetValue()));
+            }
+
+            void Visit(ast::VariableValue& node) override {
+                const auto& ids = node.GetDottedIds();
+                EmitLoad(ids.front(), node.GetSlot());
+                for (size_t i = 1; i < ids.size(); ++i) {
+                    Emit(OpCode::LoadField, AddFieldSite(ids[i]));
+                }
+            }
+
+            void Visit(ast::Assignment& node) override {
+                node.GetRightValue().Accept(*this);
+                if (node.GetSlot() == runtime::Frame::NO_SLOT) {
+                    Emit(OpCode::StoreName, AddName(node.GetVariable()));
+                }
+                else {
+                    Emit(OpCode::StoreLocal, AddLocal(node.GetVariable(), node.GetSlot()));
+                }
+            }
+
+            void Visit(ast::FieldAssignment& node) override {
+                node.GetObject().Accept(*this);
+                size_t skip = EmitJump(OpCode::JumpIfNotInstance);
+                node.GetRightValue().Accept(*this);
+                Emit(OpCode::StoreField, AddFieldSite(node.GetFieldName()));
+                PatchJump(skip);
+            }
+
+            void Visit(ast::None& /*node*/) override {
+                Emit(OpCode::LoadNone);
+            }
+
+            void Visit(ast::Print& node) override {
+                bool first = true;
+                for (const auto& arg : node.GetArguments()) {
+                    if (!first) {
+                        Emit(OpCode::PrintSpace);
+                    }
+                    first = false;
+                    arg->Accept(*this);
+                    Emit(OpCode::PrintValue, AddCallSite(runtime::STR_METHOD_ID));
+                }
+                Emit(OpCode::PrintNewline);
+            }
+
+            void Visit(ast::MethodCall& node) override {
+                for (const auto& arg : node.GetArguments()) {
+                    arg->Accept(*this);
+                }
+                node.GetObject().Accept(*this);
+                Emit(OpCode::CallMethod, AddCallSite(node.GetMethod()), CheckArgCount(node.GetArguments().size()));
+            }
+
+            void Visit(ast::NewInstance& node) override {
+                // Как и NewInstance::Execute, аргументы вычисляются, только если есть подходящий __init__.
+                // Методы класса не меняются после его объявления, поэтому без __init__ экземпляр - константа
+                const auto& args = node.GetArguments();
+                auto instance = runtime::ObjectHolder::Share(node.GetInstance());
+                if (!node.GetInstance().HasMethod(runtime::INIT_METHOD_ID, args.size())) {
+                    EmitConst(std::move(instance));
+                    return;
+                }
+                for (const auto& arg : args) {
+                    arg->Accept(*this);
+                }
+                chunk_.instance_sites.push_back({ std::move(instance), {} });
+                Emit(OpCode::NewInstance, static_cast<std::uint32_t>(chunk_.instance_sites.size() - 1),
+                    CheckArgCount(args.size()));
+            }
+
+            void Visit(ast::Stringify& node) override {
+                node.GetArgument().Accept(*this);
+                Emit(OpCode::Stringify, AddCallSite(runtime::STR_METHOD_ID));
+            }
+
+            void Visit(ast::Add& node) override {
+                if (chain_.VisitLhs(node, *this)) {
+                    node.GetRhs().Accept(*this);
+                    Emit(OpCode::Add, AddCallSite(runtime::ADD_METHOD_ID));
+                }
+            }
+
+            void Visit(ast::Sub& node) override {
+                EmitBinary(node, OpCode::Sub);
+            }
+
+            void Visit(ast::Mult& node) override {
+                EmitBinary(node, OpCode::Mult);
+            }
+
+            void Visit(ast::Div& node) override {
+                EmitBinary(node, OpCode::Div);
+            }
+
+            void Visit(ast::Or& node) override {
+                EmitLogical(node, OpCode::JumpIfTrue);
+            }
+
+            void Visit(ast::And& node) override {
+                EmitLogical(node, OpCode::JumpIfFalse);
+            }
+
+            void Visit(ast::Not& node) override {
+                node.GetArgument().Accept(*this);
+                Emit(OpCode::Not);
+            }
+
+            void Visit(ast::Negate& node) override {
+                node.GetArgument().Accept(*this);
+                Emit(OpCode::Negate);
+            }
+
+            void Visit(ast::Compound& node) override {
+                for (const auto& statement : node.GetStatements()) {
+                    statement->Accept(*this);
+                    Emit(OpCode::Pop);
+                }
+                Emit(OpCode::LoadNone);
+            }
+
+            void Visit(ast::MethodBody& node) override {
+                node.GetBody().Accept(*this);
+                Emit(OpCode::Pop);
+                Emit(OpCode::LoadNone);
+            }
+
+            void Visit(ast::Return& node) override {
+                node.GetStatement().Accept(*this);
+                Emit(OpCode::Return);
+            }
+
+            void Visit(ast::ClassDefinition& node) override {
+                const auto& cls = node.GetClass();
+                EmitConst(cls);
+                Emit(OpCode::StoreName, AddName(cls.TryAs<runtime::Class>()->GetName()));
+                Emit(OpCode::Pop);
+                Emit(OpCode::LoadNone);
+            }
+
+            void Visit(ast::IfElse& node) override {
+                EmitIfElse(node.GetCondition(), node.GetIfBody(), node.GetElseBody());
+            }
+
+            void Visit(ast::CompareAndBranch& node) override {
+                EmitIfElse(node.GetCondition(), node.GetIfBody(), node.GetElseBody());
+            }
+
+            void Visit(ast::Comparison& node) override {
+                if (!chain_.VisitLhs(node, *this)) {
+                    return;
+                }
+                node.GetRhs().Accept(*this);
+
+                const CompareOp op = GetCompareOp(node.GetComparator());
+                chunk_.compare_sites.push_back({ op, op == CompareOp::Custom ? node.GetComparator() : nullptr, {}, {} });
+                Emit(OpCode::Compare, static_cast<std::uint32_t>(chunk_.compare_sites.size() - 1));
+            }
+
+        private:
+            void Emit(OpCode code, std::uint32_t operand = 0, std::uint16_t arg = 0) {
+                chunk_.code.push_back({ code, arg, operand });
+            }
+
+            void EmitLoad(runtime::Symbol name, size_t slot) {
+                if (slot == runtime::Frame::NO_SLOT) {
+                    Emit(OpCode::LoadName, AddName(name));
+                }
+                else {
+                    Emit(OpCode::LoadLocal, AddLocal(name, slot));
+                }
+            }
+
+            void EmitConst(runtime::ObjectHolder value) {
+                Emit(OpCode::LoadConst, AddConst(std::move(value)));
+            }
+
+            // else_body может быть равен nullptr
+            void EmitIfElse(ast::Statement& condition, ast::Statement& if_body, ast::Statement* else_body) {
+                condition.Accept(*this);
+                size_t to_else = EmitJump(OpCode::JumpIfFalse);
+                if_body.Accept(*this);
+                size_t to_end = EmitJump(OpCode::Jump);
+                PatchJump(to_else);
+                if (else_body != nullptr) {
+                    else_body->Accept(*this);
+                }
+                else {
+                    Emit(OpCode::LoadNone);
+                }
+                PatchJump(to_end);
+            }
+
+            void EmitBinary(ast::BinaryOperation& node, OpCode code) {
+                if (chain_.VisitLhs(node, *this)) {
+                    node.GetRhs().Accept(*this);
+                    Emit(code);
+                }
+            }
+
+            // lhs or rhs:  lhs; JumpIfTrue L; rhs; JumpIfTrue L; False; Jump E; L: True; E:
+            // lhs and rhs: lhs; JumpIfFalse L; rhs; JumpIfFalse L; True; Jump E; L: False; E:
+            void EmitLogical(ast::BinaryOperation& node, OpCode short_circuit) {
+                if (!chain_.VisitLhs(node, *this)) {
+                    return;
+                }
+                const bool short_value = short_circuit == OpCode::JumpIfTrue;
+                size_t lhs_jump = EmitJump(short_circuit);
+                node.GetRhs().Accept(*this);
+                size_t rhs_jump = EmitJump(short_circuit);
+                Emit(OpCode::LoadConst, AddBool(!short_value));
+                size_t to_end = EmitJump(OpCode::Jump);
+                PatchJump(lhs_jump);
+                PatchJump(rhs_jump);
+                Emit(OpCode::LoadConst, AddBool(short_value));
+                PatchJump(to_end);
+            }
+
+            // Добавляет инструкцию перехода с пока неизвестным адресом и возвращает её индекс
+            size_t EmitJump(OpCode code) {
+                Emit(code);
+                return chunk_.code.size() - 1;
+            }
+
+            // Направляет переход jump на следующую инструкцию
+            void PatchJump(size_t jump) {
+                chunk_.code[jump].operand = static_cast<std::uint32_t>(chunk_.code.size());
+            }
+
+            std::uint32_t AddConst(runtime::ObjectHolder value) {
+                chunk_.constants.push_back(std::move(value));
+                return static_cast<std::uint32_t>(chunk_.constants.size() - 1);
+            }
+
+            std::uint32_t AddBool(bool value) {
+                auto& index = bool_consts_[value ? 1 : 0];
+                if (!index) {
+                    index = AddConst(runtime::ObjectHolder::Own(runtime::Bool(value))) + 1;
+                }
+                return index - 1;
+            }
+
+            std::uint32_t AddName(runtime::Symbol name) {
+                auto [it, inserted] = name_indices_.emplace(name, static_cast<std::uint32_t>(chunk_.names.size()));
+                if (inserted) {
+                    chunk_.names.push_back(name);
+                }
+                return it->second;
+            }
+
+            std::uint32_t AddCallSite(runtime::MethodId method) {
+                chunk_.call_sites.push_back({ method, {} });
+                return static_cast<std::uint32_t>(chunk_.call_sites.size() - 1);
+            }
+
+            std::uint32_t AddFieldSite(runtime::Symbol name) {
+                chunk_.field_sites.push_back({ name, {} });
+                return static_cast<std::uint32_t>(chunk_.field_sites.size() - 1);
+            }
+
+            std::uint32_t AddLocal(runtime::Symbol name, size_t slot) {
+                if (slot >= chunk_.local_names.size()) {
+                    chunk_.local_names.resize(slot + 1);
+                }
+                chunk_.local_names[slot] = name;
+                return static_cast<std::uint32_t>(slot);
+            }
+
+            static std::uint16_t CheckArgCount(size_t count) {
+                if (count > std::numeric_limits<std::uint16_t>::max()) {
+                    throw CompileError("Too many arguments: "s + std::to_string(count));
+                }
+                return static_cast<std::uint16_t>(count);
+            }
+
+            Chunk chunk_;
+            ast::ChainTraversal chain_;
+            std::unordered_map<runtime::Symbol, std::uint32_t> name_indices_;
+            // Индекс константы True/False, увеличенный на 1 (0 - константа ещё не добавлена)
+            std::uint32_t bool_consts_[2] = { 0, 0 };
+        };
+
+    }  // namespace
+
+    Chunk Compile(ast::Statement& statement) {
+        return Compiler{}.Compile(statement);
+    }
+
+}  // namespace bytecode
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "runtime.h"
+#include "statement.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bytecode {
+
+    // Коды инструкций стековой виртуальной машины.
+    // Каждая инструкция дерева разбора компилируется в последовательность, которая
+    // оставляет на стеке ровно одно значение - результат её Execute
+    enum class OpCode : std::uint8_t {
+        LoadConst,          // кладёт на стек constants[operand]
+        LoadNone,           // кладёт на стек None
+        LoadName,           // кладёт на стек значение переменной names[operand]
+        LoadLocal,          // кладёт на стек значение слота operand кадра метода
+        LoadField,          // заменяет объект на вершине стека значением его поля field_sites[operand]
+        StoreName,          // присваивает переменной names[operand] значение с вершины стека, не снимая его
+        StoreLocal,         // присваивает слоту operand значение с вершины стека, не снимая его
+        StoreField,         // [объект, значение] -> [значение], присваивает значение полю field_sites[operand]
+        Pop,                // снимает значение с вершины стека
+        Add,                // [lhs, rhs] -> [lhs + rhs], метод __add__ ищется через call_sites[operand]
+        Sub,                // [lhs, rhs] -> [lhs - rhs]
+        Mult,               // [lhs, rhs] -> [lhs * rhs]
+        Div,                // [lhs, rhs] -> [lhs / rhs]
+        Not,                // заменяет значение на вершине стека его логическим отрицанием
+        Negate,             // заменяет число на вершине стека противоположным
+        Compare,            // [lhs, rhs] -> [Bool], сравнение compare_sites[operand]
+        Stringify,          // заменяет значение на вершине стека его строковым представлением (__str__ - call_sites[operand])
+        PrintSpace,         // выводит пробел-разделитель аргументов print
+        PrintValue,         // снимает значение с вершины стека и выводит его (__str__ - call_sites[operand])
+        PrintNewline,       // завершает строку вывода print и кладёт на стек None
+        CallMethod,         // [аргументы..., объект] -> [результат], метод call_sites[operand], arg аргументов
+        NewInstance,        // [аргументы...] -> [экземпляр instance_sites[operand]], вызывая __init__ с arg аргументами
+        Jump,               // переходит к инструкции operand
+        JumpIfFalse,        // снимает значение и переходит к инструкции operand, если оно ложно
+        JumpIfTrue,         // снимает значение и переходит к инструкции operand, если оно истинно
+        JumpIfNotInstance,  // если на вершине не экземпляр класса, заменяет его на None и переходит к operand
+        Return,             // завершает выполнение, возвращая значение с вершины стека
+    };
+
+    // Вид сравнения, выполняемого инструкцией Compare
+    enum class CompareOp : std::uint8_t {
+        Equal,
+        NotEqual,
+        Less,
+        Greater,
+        LessOrEqual,
+        GreaterOrEqual,
+        Custom,  // произвольный компаратор CompareSite::comparator
+    };
+
+    // Возвращает вид сравнения, которое выполняет comparator
+    [[nodiscard]] CompareOp GetCompareOp(const ast::Comparison::Comparator& comparator);
+
+    // Место вызова метода: вызываемый метод и встроенный кэш результатов его поиска
+    struct CallSite {
+        runtime::MethodId method;
+        // Кэш заполняется при выполнении, в том числе константного Chunk
+        mutable runtime::MethodCache cache;
+    };
+
+    // Место сравнения: вид сравнения, компаратор для CompareOp::Custom и встроенные кэши
+    // методов __eq__ и __lt__, через которые сравниваются экземпляры пользовательских классов
+    struct CompareSite {
+        CompareOp op;
+        ast::Comparison::Comparator comparator;
+        mutable runtime::MethodCache eq_cache;
+        mutable runtime::MethodCache lt_cache;
+    };
+
+    // Место создания экземпляра класса: экземпляр и встроенный кэш поиска его метода __init__
+    struct InstanceSite {
+        runtime::ObjectHolder instance;
+        mutable runtime::MethodCache init_cache;
+    };
+
+    // Место обращения к полю: имя поля и встроенный кэш его смещения
+    struct FieldSite {
+        runtime::Symbol name;
+        mutable runtime::FieldCache cache;
+    };
+
+    struct Instruction {
+        OpCode code;
+        std::uint16_t arg = 0;
+        std::uint32_t operand = 0;
+    };
+
+    // Скомпилированный фрагмент программы: тело метода либо программа целиком.
+    // Константы ссылаются на значения, принадлежащие дереву разбора, поэтому
+    // Chunk можно использовать, только пока существует дерево, из которого он получен
+    struct Chunk {
+        std::vector<Instruction> code;
+        std::vector<runtime::ObjectHolder> constants;
+        std::vector<runtime::Symbol> names;
+        // Имена переменных, хранящихся в слотах кадра (используются в сообщениях об ошибках)
+        std::vector<runtime::Symbol> local_names;
+        // Места вызова методов, в том числе __add__ инструкции Add и __str__ инструкций PrintValue и Stringify
+        std::vector<CallSite> call_sites;
+        std::vector<CompareSite> compare_sites;
+        std::vector<InstanceSite> instance_sites;
+        std::vector<FieldSite> field_sites;
+    };
+
+    class CompileError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // Компилирует инструкцию statement (программу или тело метода) в байт-код.
+    // Выполнение Chunk возвращает то же значение, что и statement.Execute
+    [[nodiscard]] Chunk Compile(ast::Statement& statement);
+
+}  // namespace bytecode
@@ -0,0 +1,712 @@
+#include "flat_ast.h"
+
+#include <optional>
+#include <sstream>
+
+using namespace std;
+
+namespace flat {
+
+    using runtime::Closure;
+    using runtime::ObjectHolder;
+
+    namespace {
+
+        // Переводит дерево разбора в плоский вид. Visit добавляет узел после всех его дочерних
+        // узлов и оставляет номер добавленного узла в last_
+        class Flattener : public ast::StatementVisitor {
+        public:
+            Program Flatten(ast::Statement& statement) {
+                statement.Accept(*this);
+                return std::move(program_);
+            }
+
+            // Числа и логические значения хранятся в самом узле: их вычисление не обращается
+            // к дереву разбора
+            void Visit(ast::NumericConst& node) override {
+                Add(NodeKind::Number, static_cast<uint32_t>(node.GetValue().GetValue()));
+            }
+
+            void Visit(ast::StringConst& node) override {
+                Add(NodeKind::Const, AddConstant(node.GetValue()));
+            }
+
+            void Visit(ast::BoolConst& node) override {
+                Add(NodeKind::Bool, node.GetValue().GetValue() ? 1 : 0);
+            }
+
+            // Цепочка x.y.z записывается как обращение к полю z значения узла x.y
+            void Visit(ast::VariableValue& node) override {
+                const auto& ids = node.GetDottedIds();
+                Add(NodeKind::Variable, AddName(ids.front()), ToSlot(node.GetSlot()));
+                for (size_t i = 1; i < ids.size(); ++i) {
+                    Add(NodeKind::FieldAccess, last_, AddFieldSite(ids[i]));
+                }
+            }
+
+            void Visit(ast::Assignment& node) override {
+                const auto rv = Child(node.GetRightValue());
+                Add(NodeKind::Assignment, rv, AddName(node.GetVariable()), ToSlot(node.GetSlot()));
+            }
+
+            void Visit(ast::FieldAssignment& node) override {
+                const auto object = Child(node.GetObject());
+                const auto rv = Child(node.GetRightValue());
+                Add(NodeKind::FieldAssignment, object, rv, AddFieldSite(node.GetFieldName()));
+            }
+
+            void Visit(ast::None& /*node*/) override {
+                Add(NodeKind::None);
+            }
+
+            void Visit(ast::Print& node) override {
+                const auto& args = node.GetArguments();
+                const auto first = AddChildren(args);
+                Add(NodeKind::Print, first, Count(args.size()), AddCallSite(runtime::STR_METHOD_ID));
+            }
+
+            void Visit(ast::MethodCall& node) override {
+                // Объект записывается в children сразу за аргументами
+                vector<uint32_t> children = ChildList(node.GetArguments());
+                children.push_back(Child(node.GetObject()));
+                const auto first = AppendChildren(children);
+                Add(NodeKind::MethodCall, first, Count(node.GetArguments().size()), AddCallSite(node.GetMethod()));
+            }
+
+            void Visit(ast::NewInstance& node) override {
+                // Методы класса не меняются после его объявления, поэтому без подходящего __init__
+                // экземпляр - константа, а аргументы, как и в NewInstance::Execute, не вычисляются
+                const auto& args = node.GetArguments();
+                if (!node.GetInstance().HasMethod(runtime::INIT_METHOD_ID, args.size())) {
+                    Add(NodeKind::Const, AddConstant(node.GetInstance()));
+                    return;
+                }
+                const auto first = AddChildren(args);
+                const auto site = Count(program_.instance_sites.size());
+                program_.instance_sites.push_back({ ObjectHolder::Share(node.GetInstance()), {} });
+                Add(NodeKind::NewInstance, site, first, Count(args.size()));
+            }
+
+            void Visit(ast::Stringify& node) override {
+                const auto argument = Child(node.GetArgument());
+                Add(NodeKind::Stringify, argument, AddCallSite(runtime::STR_METHOD_ID));
+            }
+
+            void Visit(ast::Add& node) override {
+                if (AddBinary(node, NodeKind::Add)) {
+                    program_.nodes.back().c = AddCallSite(runtime::ADD_METHOD_ID);
+                }
+            }
+
+            void Visit(ast::Sub& node) override {
+                AddBinary(node, NodeKind::Sub);
+            }
+
+            void Visit(ast::Mult& node) override {
+                AddBinary(node, NodeKind::Mult);
+            }
+
+            void Visit(ast::Div& node) override {
+                AddBinary(node, NodeKind::Div);
+            }
+
+            void Visit(ast::Or& node) override {
+                AddBinary(node, NodeKind::Or);
+            }
+
+            void Visit(ast::And& node) override {
+                AddBinary(node, NodeKind::And);
+            }
+
+            void Visit(ast::Not& node) override {
+                Add(NodeKind::Not, Child(node.GetArgument()));
+            }
+
+            void Visit(ast::Negate& node) override {
+                Add(NodeKind::Negate, Child(node.GetArgument()));
+            }
+
+            void Visit(ast::Compound& node) override {
+                const auto& statements = node.GetStatements();
+                Add(NodeKind::Compound, AddChildren(statements), Count(statements.size()));
+            }
+
+            void Visit(ast::MethodBody& node) override {
+                Add(NodeKind::MethodBody, Child(node.GetBody()));
+            }
+
+            void Visit(ast::Return& node) override {
+                Add(NodeKind::Return, Child(node.GetStatement()));
+            }
+
+            void Visit(ast::ClassDefinition& node) override {
+                const auto& cls = node.GetClass();
+                const auto name = AddName(cls.TryAs<runtime::Class>()->GetName());
+                Add(NodeKind::ClassDefinition, AddConstant(*cls), name);
+            }
+
+            void Visit(ast::IfElse& node) override {
+                AddIfElse(node.GetCondition(), node.GetIfBody(), node.GetElseBody());
+            }
+
+            // Условие-сравнение узла IfElse вычисляется без создания значения Bool (см. Evaluator::IsConditionTrue)
+            void Visit(ast::CompareAndBranch& node) override {
+                AddIfElse(node.GetCondition(), node.GetIfBody(), node.GetElseBody());
+            }
+
+            void Visit(ast::Comparison& node) override {
+                if (!AddBinary(node, NodeKind::Comparison)) {
+                    return;
+                }
+                const auto site = Count(program_.compare_sites.size());
+                const bytecode::CompareOp op = bytecode::GetCompareOp(node.GetComparator());
+                program_.compare_sites.push_back(
+                    { op, op == bytecode::CompareOp::Custom ? node.GetComparator() : nullptr, {}, {} });
+                program_.nodes.back().c = site;
+            }
+
+        private:
+            void Add(NodeKind kind, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+                last_ = Count(program_.nodes.size());
+                program_.nodes.push_back({ kind, a, b, c });
+            }
+
+            void AddIfElse(ast::Statement& condition, ast::Statement& if_body, ast::Statement* else_body) {
+                const auto condition_index = Child(condition);
+                const auto if_index = Child(if_body);
+                const auto else_index = else_body != nullptr ? Child(*else_body) : NO_NODE;
+                Add(NodeKind::IfElse, condition_index, if_index, else_index);
+            }
+
+            // Возвращает false, если node - вершина цепочки операций и уже добавлена при её обходе
+            // (см. ast::ChainTraversal). Иначе добавляет узел операции и возвращает true
+            bool AddBinary(ast::BinaryOperation& node, NodeKind kind) {
+                if (!chain_.VisitLhs(node, *this)) {
+                    return false;
+                }
+                const auto lhs = last_;
+                const auto rhs = Child(node.GetRhs());
+                Add(kind, lhs, rhs);
+                return true;
+            }
+
+            // Добавляет узлы дерева с корнем statement и возвращает номер корня
+            uint32_t Child(ast::Statement& statement) {
+                statement.Accept(*this);
+                return last_;
+            }
+
+            vector<uint32_t> ChildList(const ast::StatementList& statements) {
+                vector<uint32_t> result;
+                result.reserve(statements.size());
+                for (const auto& statement : statements) {
+                    result.push_back(Child(*statement));
+                }
+                return result;
+            }
+
+            // Добавляет узлы statements и возвращает начало списка их номеров в children.
+            // Список записывается после обхода всех узлов, поэтому списки вложенных узлов его не разрывают
+            uint32_t AddChildren(const ast::StatementList& statements) {
+                return AppendChildren(ChildList(statements));
+            }
+
+            uint32_t AppendChildren(const vector<uint32_t>& children) {
+                const auto first = Count(program_.children.size());
+                program_.children.insert(program_.children.end(), children.begin(), children.end());
+                return first;
+            }
+
+            uint32_t AddConstant(runtime::Object& value) {
+                program_.constants.push_back(&value);
+                return Count(program_.constants.size() - 1);
+            }
+
+            uint32_t AddName(runtime::Symbol name) {
+                auto [it, inserted] = name_indices_.try_emplace(name, Count(program_.names.size()));
+                if (inserted) {
+                    program_.names.push_back(name);
+                }
+                return it->second;
+            }
+
+            uint32_t AddCallSite(runtime::MethodId method) {
+                program_.call_sites.push_back({ method, {} });
+                return Count(program_.call_sites.size() - 1);
+            }
+
+            uint32_t AddFieldSite(runtime::Symbol name) {
+                program_.field_sites.push_back({ name, {} });
+                return Count(program_.field_sites.size() - 1);
+            }
+
+            static uint32_t ToSlot(size_t slot) {
+                return slot == runtime::Frame::NO_SLOT ? NO_SLOT : Count(slot);
+            }
+
+            static uint32_t Count(size_t count) {
+                if (count >= NO_NODE) {
+                    throw FlattenError("Program is too large: "s + std::to_string(count) + " items"s);
+                }
+                return static_cast<uint32_t>(count);
+            }
+
+            Program program_;
+            unordered_map<runtime::Symbol, uint32_t> name_indices_;
+            uint32_t last_ = NO_NODE;
+            ast::ChainTraversal chain_;
+        };
+
+        size_t FromSlot(uint32_t slot) {
+            return slot == NO_SLOT ? runtime::Frame::NO_SLOT : slot;
+        }
+
+        // Возвращает последнее имя цепочки, значение которой вычисляет узел Variable или FieldAccess
+        const runtime::Symbol& GetLastName(const Program& program, const Node& node) {
+            return node.kind == NodeKind::Variable ? program.names[node.a] : program.field_sites[node.b].name;
+        }
+
+        // Возвращает true для узлов бинарных операций: их левый аргумент - узел a, правый - узел b
+        bool IsBinary(NodeKind kind) {
+            switch (kind) {
+            case NodeKind::Add:
+            case NodeKind::Sub:
+            case NodeKind::Mult:
+            case NodeKind::Div:
+            case NodeKind::Or:
+            case NodeKind::And:
+            case NodeKind::Comparison:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        // Возвращает true для узлов арифметических операций: Add, Sub, Mult и Div
+        bool IsArithmetic(NodeKind kind) {
+            return kind == NodeKind::Add || kind == NodeKind::Sub || kind == NodeKind::Mult || kind == NodeKind::Div;
+        }
+
+        // Сообщение об ошибке арифметической операции kind над значениями, которые не являются числами.
+        // Совпадает с сообщениями инструкций дерева разбора
+        const char* GetArithmeticError(NodeKind kind) {
+            switch (kind) {
+            case NodeKind::Sub:
+                return "Error in sub";
+            case NodeKind::Mult:
+                return "Error in mult";
+            default:
+                return "Error in division";
+            }
+        }
+
+        // Применяет арифметическую операцию kind к числам lhs и rhs
+        int ApplyArithmetic(NodeKind kind, int lhs, int rhs) {
+            switch (kind) {
+            case NodeKind::Add:
+                return lhs + rhs;
+            case NodeKind::Sub:
+                return lhs - rhs;
+            case NodeKind::Mult:
+                return lhs * rhs;
+            default:
+                if (rhs == 0) {
+                    throw runtime_error("Division by zero"s);
+                }
+                return lhs / rhs;
+            }
+        }
+
+        // Записывает в value значение листа index - числа либо переменной, хранящей число.
+        // Возвращает false для остальных узлов: их вычисляет Evaluator::Evaluate.
+        // Лист вычисляется без побочных эффектов, поэтому при неудаче его можно вычислить заново
+        bool TryGetNumber(const Program& program, uint32_t index, runtime::Frame& frame, int& value) {
+            const Node& node = program.nodes[index];
+            if (node.kind == NodeKind::Number) {
+                value = static_cast<int>(node.a);
+                return true;
+            }
+            if (node.kind != NodeKind::Variable) {
+                return false;
+            }
+            const ObjectHolder* variable = frame.Find(program.names[node.a], FromSlot(node.b));
+            const optional<int> number = variable != nullptr ? variable->TryGetNumber() : nullopt;
+            if (!number) {
+                return false;
+            }
+            value = *number;
+            return true;
+        }
+
+        // Записывает в value результат арифметической операции node над двумя числовыми листами,
+        // не создавая значений. Деление на ноль оставляется Evaluator::Evaluate, который сообщит об ошибке
+        bool TryEvaluateArithmetic(const Program& program, const Node& node, runtime::Frame& frame, int& value) {
+            int lhs = 0;
+            int rhs = 0;
+            if (!TryGetNumber(program, node.a, frame, lhs) || !TryGetNumber(program, node.b, frame, rhs)
+                || (node.kind == NodeKind::Div && rhs == 0)) {
+                return false;
+            }
+            value = ApplyArithmetic(node.kind, lhs, rhs);
+            return true;
+        }
+
+        // Как TryGetNumber, но вычисляет также арифметическую операцию над двумя числовыми листами
+        bool TryEvaluateNumber(const Program& program, uint32_t index, runtime::Frame& frame, int& value) {
+            const Node& node = program.nodes[index];
+            if (IsArithmetic(node.kind)) {
+                return TryEvaluateArithmetic(program, node, frame, value);
+            }
+            return TryGetNumber(program, index, frame, value);
+        }
+
+        // Снимает со стека значения, положенные поверх его исходной вершины, при выходе
+        // из области видимости, в том числе по исключению
+        template <typename T>
+        class StackGuard {
+        public:
+            explicit StackGuard(vector<T>& stack)
+                : stack_(stack)
+                , base_(stack.size()) {
+            }
+
+            StackGuard(const StackGuard&) = delete;
+            StackGuard& operator=(const StackGuard&) = delete;
+
+            ~StackGuard() {
+                stack_.resize(base_);
+            }
+
+            // Возвращает исходную вершину стека
+            [[nodiscard]] size_t GetBase() const {
+                return base_;
+            }
+
+        private:
+            vector<T>& stack_;
+            const size_t base_;
+        };
+
+    }  // namespace
+
+    Program Flatten(ast::Statement& statement) {
+        return Flattener{}.Flatten(statement);
+    }
+
+    Evaluator::Evaluator(runtime::Context& context)
+        : MethodDispatcher(context) {
+    }
+
+    ObjectHolder Evaluator::Run(const Program& program, Closure& closure) {
+        runtime::Frame frame(closure);
+        return Evaluate(program, program.GetRoot(), frame);
+    }
+
+    ObjectHolder Evaluator::Run(const Program& program, runtime::Frame& frame) {
+        return Evaluate(program, program.GetRoot(), frame);
+    }
+
+    void Evaluator::PushArguments(const Program& program, uint32_t first, uint32_t count, runtime::Frame& frame) {
+        for (uint32_t i = first; i < first + count; ++i) {
+            ObjectHolder argument = Evaluate(program, program.children[i], frame);
+            arguments_.push_back(std::move(argument));
+        }
+    }
+
+    ObjectHolder Evaluator::Evaluate(const Program& program, uint32_t index, runtime::Frame& frame) {
+        const Node& node = program.nodes[index];
+        switch (node.kind) {
+        case NodeKind::Number:
+            return ObjectHolder::Own(runtime::Number(static_cast<int>(node.a)));
+
+        case NodeKind::Bool:
+            return ObjectHolder::Own(runtime::Bool(node.a != 0));
+
+        case NodeKind::Const:
+            return ObjectHolder::Share(*program.constants[node.a]);
+
+        case NodeKind::None:
+            return ObjectHolder::None();
+
+        case NodeKind::Variable: {
+            const runtime::Symbol name = program.names[node.a];
+            if (const ObjectHolder* value = frame.Find(name, FromSlot(node.b))) {
+                return *value;
+            }
+            throw runtime_error(name.GetName() + " not found in closure"s);
+        }
+
+        case NodeKind::FieldAccess:
+            return EvaluateFieldAccess(program, node, frame);
+
+        case NodeKind::Assignment:
+            return frame.Assign(program.names[node.b], FromSlot(node.c), Evaluate(program, node.a, frame));
+
+        case NodeKind::FieldAssignment: {
+            ObjectHolder object = Evaluate(program, node.a, frame);
+            auto* instance = object.TryAs<runtime::ClassInstance>();
+            if (instance == nullptr) {
+                return ObjectHolder::None();
+            }
+            const bytecode::FieldSite& site = program.field_sites[node.c];
+            return site.cache.Assign(instance->Fields(), site.name, Evaluate(program, node.b, frame));
+        }
+
+        case NodeKind::Print:
+            return EvaluatePrint(program, node, frame);
+
+        case NodeKind::MethodCall:
+            return EvaluateMethodCall(program, node, frame);
+
+        case NodeKind::NewInstance:
+            return EvaluateNewInstance(program, node, frame);
+
+        case NodeKind::Stringify:
+            return EvaluateStringify(program, node, frame);
+
+        case NodeKind::Add:
+        case NodeKind::Sub:
+        case NodeKind::Mult:
+        case NodeKind::Div:
+        case NodeKind::Or:
+        case NodeKind::And:
+        case NodeKind::Comparison:
+            return EvaluateBinary(program, node, frame);
+
+        case NodeKind::Not:
+            return ObjectHolder::Own(runtime::Bool(!runtime::IsTrue(Evaluate(program, node.a, frame))));
+
+        case NodeKind::Negate:
+            return EvaluateNegate(program, node, frame);
+
+        case NodeKind::Compound:
+            for (uint32_t i = node.a; i < node.a + node.b; ++i) {
+                ObjectHolder result = Evaluate(program, program.children[i], frame);
+                if (frame.IsReturning()) {
+                    return result;
+                }
+            }
+            return ObjectHolder::None();
+
+        case NodeKind::MethodBody: {
+            ObjectHolder result = Evaluate(program, node.a, frame);
+            if (frame.TakeReturning()) {
+                return result;
+            }
+            return ObjectHolder::None();
+        }
+
+        case NodeKind::Return: {
+            ObjectHolder result = Evaluate(program, node.a, frame);
+            frame.SetReturning();
+            return result;
+        }
+
+        case NodeKind::ClassDefinition:
+            frame.Assign(program.names[node.b], runtime::Frame::NO_SLOT, ObjectHolder::Share(*program.constants[node.a]));
+            return ObjectHolder::None();
+
+        case NodeKind::IfElse:
+            if (IsConditionTrue(program, node.a, frame)) {
+                return Evaluate(program, node.b, frame);
+            }
+            if (node.c != NO_NODE) {
+                return Evaluate(program, node.c, frame);
+            }
+            return ObjectHolder::None();
+        }
+        throw runtime_error("Unknown node kind"s);
+    }
+
+    ObjectHolder Evaluator::EvaluateFieldAccess(const Program& program, const Node& node, runtime::Frame& frame) {
+        ObjectHolder object = Evaluate(program, node.a, frame);
+        auto* instance = object.TryAs<runtime::ClassInstance>();
+        if (instance == nullptr) {
+            throw runtime_error(GetLastName(program, program.nodes[node.a]).GetName() + " can't access fields"s);
+        }
+        const bytecode::FieldSite& site = program.field_sites[node.b];
+        if (const ObjectHolder* field = site.cache.Find(instance->Fields(), site.name)) {
+            return *field;
+        }
+        throw runtime_error(site.name.GetName() + " not found in closure"s);
+    }
+
+    ObjectHolder Evaluator::EvaluatePrint(const Program& program, const Node& node, runtime::Frame& frame) {
+        ostream& out = context_.GetOutputStream();
+        for (uint32_t i = 0; i < node.b; ++i) {
+            if (i > 0) {
+                out << ' ';
+            }
+            if (ObjectHolder value = Evaluate(program, program.children[node.a + i], frame)) {
+                PrintValue(value, out, program.call_sites[node.c].cache);
+            }
+            else {
+                out << "None"sv;
+            }
+        }
+        out << '\n';
+        return ObjectHolder::None();
+    }
+
+    ObjectHolder Evaluator::EvaluateMethodCall(const Program& program, const Node& node, runtime::Frame& frame) {
+        const StackGuard<ObjectHolder> args(arguments_);
+        PushArguments(program, node.a, node.b, frame);
+        ObjectHolder object = Evaluate(program, program.children[node.a + node.b], frame);
+        if (object.TryAs<runtime::ClassInstance>() == nullptr) {
+            return ObjectHolder::None();
+        }
+        const bytecode::CallSite& site = program.call_sites[node.c];
+        return CallMethod(object, site.method, arguments_.data() + args.GetBase(), node.b, site.cache);
+    }
+
+    ObjectHolder Evaluator::EvaluateNewInstance(const Program& program, const Node& node, runtime::Frame& frame) {
+        const bytecode::InstanceSite& site = program.instance_sites[node.a];
+        const StackGuard<ObjectHolder> args(arguments_);
+        PushArguments(program, node.b, node.c, frame);
+        CallMethod(site.instance, runtime::INIT_METHOD_ID, arguments_.data() + args.GetBase(), node.c, site.init_cache);
+        return site.instance;
+    }
+
+    ObjectHolder Evaluator::EvaluateStringify(const Program& program, const Node& node, runtime::Frame& frame) {
+        ObjectHolder value = Evaluate(program, node.a, frame);
+        string result = "None"s;
+        if (value) {
+            ostringstream out;
+            PrintValue(value, out, program.call_sites[node.b].cache);
+            result = out.str();
+        }
+        return ObjectHolder::Own(runtime::String(std::move(result)));
+    }
+
+    ObjectHolder Evaluator::EvaluateBinary(const Program& program, const Node& node, runtime::Frame& frame) {
+        // Операция над числовыми листами вычисляется без создания значений аргументов
+        int number = 0;
+        if (IsArithmetic(node.kind) && TryEvaluateArithmetic(program, node, frame, number)) {
+            return ObjectHolder::Own(runtime::Number(number));
+        }
+        if (!IsBinary(program.nodes[node.a].kind)) {
+            return ApplyBinary(program, node, Evaluate(program, node.a, frame), frame);
+        }
+        // Цепочка операций, каждая из которых - левый аргумент следующей, вычисляется циклом.
+        // Цепочки, вычисляемые в правых аргументах и вызванных методах, кладут свои операции
+        // в chain_ поверх и снимают их при выходе, в том числе по исключению
+        const StackGuard<const Node*> chain(chain_);
+        chain_.push_back(&node);
+        uint32_t lhs = node.a;
+        for (; IsBinary(program.nodes[lhs].kind); lhs = program.nodes[lhs].a) {
+            chain_.push_back(&program.nodes[lhs]);
+        }
+        ObjectHolder value = Evaluate(program, lhs, frame);
+        for (size_t i = chain_.size(); i-- > chain.GetBase();) {
+            value = ApplyBinary(program, *chain_[i], std::move(value), frame);
+        }
+        return value;
+    }
+
+    ObjectHolder Evaluator::ApplyBinary(const Program& program, const Node& node, ObjectHolder lhs,
+        runtime::Frame& frame) {
+        switch (node.kind) {
+        case NodeKind::Add:
+            return EvaluateAdd(program, node, lhs, frame);
+        case NodeKind::Or:
+            return ObjectHolder::Own(runtime::Bool(runtime::IsTrue(lhs)
+                || runtime::IsTrue(Evaluate(program, node.b, frame))));
+        case NodeKind::And:
+            return ObjectHolder::Own(runtime::Bool(runtime::IsTrue(lhs)
+                && runtime::IsTrue(Evaluate(program, node.b, frame))));
+        case NodeKind::Comparison:
+            return ObjectHolder::Own(runtime::Bool(
+                Compare(program.compare_sites[node.c], lhs, Evaluate(program, node.b, frame))));
+        default:
+            return EvaluateArithmetic(program, node, lhs, frame);
+        }
+    }
+
+    ObjectHolder Evaluator::EvaluateAdd(const Program& program, const Node& node, const ObjectHolder& lhs,
+        runtime::Frame& frame) {
+        auto lhs_number = lhs.TryGetNumber();
+        int rhs_value = 0;
+        if (lhs_number && TryEvaluateNumber(program, node.b, frame, rhs_value)) {
+            return ObjectHolder::Own(runtime::Number(*lhs_number + rhs_value));
+        }
+        ObjectHolder rhs = Evaluate(program, node.b, frame);
+        auto rhs_number = rhs.TryGetNumber();
+        if (lhs_number && rhs_number) {
+            return ObjectHolder::Own(runtime::Number(*lhs_number + *rhs_number));
+        }
+        auto* lhs_string = lhs.TryAs<runtime::String>();
+        auto* rhs_string = rhs.TryAs<runtime::String>();
+        if (lhs_string != nullptr && rhs_string != nullptr) {
+            return ObjectHolder::Own(runtime::String(lhs_string->GetValue() + rhs_string->GetValue()));
+        }
+        if (lhs.TryAs<runtime::ClassInstance>() != nullptr) {
+            return CallMethod(lhs, runtime::ADD_METHOD_ID, &rhs, 1, program.call_sites[node.c].cache);
+        }
+        throw runtime_error("Error in add"s);
+    }
+
+    ObjectHolder Evaluator::EvaluateArithmetic(const Program& program, const Node& node, const ObjectHolder& lhs,
+        runtime::Frame& frame) {
+        auto lhs_number = lhs.TryGetNumber();
+        int rhs_value = 0;
+        if (!lhs_number || !TryEvaluateNumber(program, node.b, frame, rhs_value)) {
+            ObjectHolder rhs = Evaluate(program, node.b, frame);
+            auto rhs_number = rhs.TryGetNumber();
+            if (!lhs_number || !rhs_number) {
+                throw runtime_error(GetArithmeticError(node.kind));
+            }
+            rhs_value = *rhs_number;
+        }
+        return ObjectHolder::Own(runtime::Number(ApplyArithmetic(node.kind, *lhs_number, rhs_value)));
+    }
+
+    ObjectHolder Evaluator::EvaluateNegate(const Program& program, const Node& node, runtime::Frame& frame) {
+        ObjectHolder argument = Evaluate(program, node.a, frame);
+        auto number = argument.TryGetNumber();
+        if (!number) {
+            throw runtime_error("Error in negation"s);
+        }
+        return ObjectHolder::Own(runtime::Number(-*number));
+    }
+
+    bool Evaluator::EvaluateCompare(const Program& program, const Node& node, runtime::Frame& frame) {
+        const bytecode::CompareSite& site = program.compare_sites[node.c];
+        int lhs_value = 0;
+        int rhs_value = 0;
+        if (site.op != bytecode::CompareOp::Custom && TryEvaluateNumber(program, node.a, frame, lhs_value)
+            && TryEvaluateNumber(program, node.b, frame, rhs_value)) {
+            return bytecode::CompareNumbers(site.op, lhs_value, rhs_value);
+        }
+        ObjectHolder lhs = Evaluate(program, node.a, frame);
+        ObjectHolder rhs = Evaluate(program, node.b, frame);
+        return Compare(site, lhs, rhs);
+    }
+
+    bool Evaluator::IsConditionTrue(const Program& program, uint32_t index, runtime::Frame& frame) {
+        const Node& node = program.nodes[index];
+        if (node.kind == NodeKind::Comparison) {
+            return EvaluateCompare(program, node, frame);
+        }
+        return runtime::IsTrue(Evaluate(program, index, frame));
+    }
+
+    const Program* Evaluator::GetMethodBody(const runtime::Method& method) {
+        if (&method == last_method_) {
+            return last_program_;
+        }
+        auto [it, inserted] = method_programs_.try_emplace(&method);
+        if (inserted) {
+            if (auto* body = dynamic_cast<ast::Statement*>(method.body.get())) {
+                it->second = make_unique<Program>(Flatten(*body));
+            }
+        }
+        last_method_ = &method;
+        last_program_ = it->second.get();
+        return last_program_;
+    }
+
+    ObjectHolder Evaluator::RunMethodBody(const Program& program, runtime::Frame& frame) {
+        return Evaluate(program, program.GetRoot(), frame);
+    }
+
+}  // namespace flat
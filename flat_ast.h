@@ -0,0 +1,148 @@
+#pragma once
+
+#include "bytecode.h"
+#include "method_dispatch.h"
+#include "runtime.h"
+#include "statement.h"
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace flat {
+
+    // Вид узла плоского дерева. Соответствует классу узла дерева разбора
+    enum class NodeKind : std::uint8_t {
+        Number,           // число a (биты int)
+        Bool,             // логическое значение a
+        Const,            // значение constants[a] (строка)
+        None,             // None
+        Variable,         // переменная names[a], b - слот
+        FieldAccess,      // поле field_sites[b] объекта - значения узла a
+        Assignment,       // names[b] = узел a, c - слот
+        FieldAssignment,  // узел a.field_sites[c] = узел b
+        Print,            // print children[a..a + b), __str__ ищется через call_sites[c]
+        MethodCall,       // children[a + b].call_sites[c](children[a..a + b))
+        NewInstance,      // экземпляр instance_sites[a], аргументы __init__ - children[b..b + c)
+        Stringify,        // str(узел a), __str__ ищется через call_sites[b]
+        Add,              // узел a + узел b, __add__ ищется через call_sites[c]
+        Sub,              // узел a - узел b
+        Mult,             // узел a * узел b
+        Div,              // узел a / узел b
+        Or,               // узел a or узел b
+        And,              // узел a and узел b
+        Not,              // not узел a
+        Negate,           // -узел a
+        Compound,         // инструкции children[a..a + b)
+        MethodBody,       // тело метода, состоящее из узла a
+        Return,           // return узел a
+        ClassDefinition,  // names[b] = класс constants[a]
+        IfElse,           // if узел a: узел b else: узел c (NO_NODE - ветки else нет)
+        Comparison,       // сравнение compare_sites[c] узлов a и b
+    };
+
+    // Узел плоского дерева: вид и до трёх операндов, смысл которых задаёт вид (см. NodeKind).
+    // Операнды-узлы - номера узлов в Program::nodes
+    struct Node {
+        NodeKind kind;
+        std::uint32_t a = 0;
+        std::uint32_t b = 0;
+        std::uint32_t c = 0;
+    };
+
+    // Номер отсутствующего узла (например, ветки else)
+    inline constexpr std::uint32_t NO_NODE = std::numeric_limits<std::uint32_t>::max();
+    // Слот переменной, не получившей слот при разборе (runtime::Frame::NO_SLOT)
+    inline constexpr std::uint32_t NO_SLOT = std::numeric_limits<std::uint32_t>::max();
+
+    // Дерево разбора, записанное в плоский массив узлов в обратном порядке обхода:
+    // дочерние узлы предшествуют родителю, а корень - последний узел. Узлы ссылаются
+    // на дочерние узлы 32-битными номерами, списки дочерних узлов (аргументы, инструкции
+    // Compound) лежат подряд в children. Как и bytecode::Chunk, константы ссылаются на значения,
+    // принадлежащие дереву разбора, поэтому Program можно использовать, только пока оно существует
+    struct Program {
+        std::vector<Node> nodes;
+        std::vector<std::uint32_t> children;
+        std::vector<runtime::Object*> constants;
+        std::vector<runtime::Symbol> names;
+        std::vector<bytecode::FieldSite> field_sites;
+        std::vector<bytecode::CallSite> call_sites;
+        std::vector<bytecode::CompareSite> compare_sites;
+        std::vector<bytecode::InstanceSite> instance_sites;
+
+        [[nodiscard]] std::uint32_t GetRoot() const {
+            return static_cast<std::uint32_t>(nodes.size() - 1);
+        }
+    };
+
+    class FlattenError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // Записывает инструкцию statement (программу или тело метода) в плоский массив узлов.
+    // Вычисление Program возвращает то же значение, что и statement.Execute
+    [[nodiscard]] Program Flatten(ast::Statement& statement);
+
+    // Вычисляет плоские деревья, выбирая действие для узла по его виду.
+    // Тела методов переводятся в плоский вид при первом вызове. Методы, тела которых не являются
+    // узлами дерева разбора, выполняются через ClassInstance::Call (см. bytecode::MethodDispatcher)
+    class Evaluator : private bytecode::MethodDispatcher<Evaluator> {
+    public:
+        explicit Evaluator(runtime::Context& context);
+
+        // Вычисляет program, храня переменные верхнего уровня в closure
+        runtime::ObjectHolder Run(const Program& program, runtime::Closure& closure);
+        // Вычисляет program в кадре frame. Если выполнена инструкция return из программы,
+        // отмечает это в кадре (Frame::SetReturning), как и Execute инструкций дерева разбора
+        runtime::ObjectHolder Run(const Program& program, runtime::Frame& frame);
+
+    private:
+        runtime::ObjectHolder Evaluate(const Program& program, std::uint32_t index, runtime::Frame& frame);
+
+        // Вычисляют узлы, которые встречаются реже арифметики и обращений к переменным.
+        // Вынесены из Evaluate, чтобы её кадр стека оставался небольшим
+        runtime::ObjectHolder EvaluateFieldAccess(const Program& program, const Node& node, runtime::Frame& frame);
+        runtime::ObjectHolder EvaluatePrint(const Program& program, const Node& node, runtime::Frame& frame);
+        runtime::ObjectHolder EvaluateMethodCall(const Program& program, const Node& node, runtime::Frame& frame);
+        runtime::ObjectHolder EvaluateNewInstance(const Program& program, const Node& node, runtime::Frame& frame);
+        runtime::ObjectHolder EvaluateStringify(const Program& program, const Node& node, runtime::Frame& frame);
+        // Вычисляет бинарную операцию, в том числе цепочку операций, каждая из которых - левый аргумент следующей
+        runtime::ObjectHolder EvaluateBinary(const Program& program, const Node& node, runtime::Frame& frame);
+        // Вычисляет бинарную операцию по уже вычисленному значению левого аргумента lhs
+        runtime::ObjectHolder ApplyBinary(const Program& program, const Node& node, runtime::ObjectHolder lhs,
+            runtime::Frame& frame);
+        runtime::ObjectHolder EvaluateAdd(const Program& program, const Node& node, const runtime::ObjectHolder& lhs,
+            runtime::Frame& frame);
+        runtime::ObjectHolder EvaluateArithmetic(const Program& program, const Node& node,
+            const runtime::ObjectHolder& lhs, runtime::Frame& frame);
+        runtime::ObjectHolder EvaluateNegate(const Program& program, const Node& node, runtime::Frame& frame);
+        bool EvaluateCompare(const Program& program, const Node& node, runtime::Frame& frame);
+
+        // Вычисляет условие index узла IfElse. Результат сравнения используется напрямую,
+        // без создания значения Bool
+        bool IsConditionTrue(const Program& program, std::uint32_t index, runtime::Frame& frame);
+
+        // Вычисляет узлы children[first..first + count) программы program и кладёт их значения в arguments_
+        void PushArguments(const Program& program, std::uint32_t first, std::uint32_t count, runtime::Frame& frame);
+
+        friend class bytecode::MethodDispatcher<Evaluator>;
+
+        // Возвращает плоскую запись тела method или nullptr, если тело не является узлом дерева разбора
+        const Program* GetMethodBody(const runtime::Method& method);
+        runtime::ObjectHolder RunMethodBody(const Program& program, runtime::Frame& frame);
+
+        std::unordered_map<const runtime::Method*, std::unique_ptr<Program>> method_programs_;
+        // Последний найденный в method_programs_ метод: рекурсивные вызовы и циклы обходятся без поиска
+        const runtime::Method* last_method_ = nullptr;
+        const Program* last_program_ = nullptr;
+        // Операции вычисляемых цепочек (см. EvaluateBinary)
+        std::vector<const Node*> chain_;
+        // Аргументы вызываемых методов: вызов кладёт их поверх аргументов внешних вызовов
+        // и снимает при выходе, поэтому вызов не выделяет память под аргументы
+        std::vector<runtime::ObjectHolder> arguments_;
+    };
+
+}  // namespace flat
@@ -0,0 +1,283 @@
+#include "flat_ast.h"
+#include "statement.h"
+#include "test_runner_p.h"
+
+#include <map>
+
+using namespace std;
+
+namespace flat {
+
+    using runtime::Closure;
+    using runtime::ObjectHolder;
+
+    namespace {
+
+        // Результат выполнения инструкции: её значение либо текст исключения, вывод программы
+        // и значения переменных верхнего уровня
+        struct Outcome {
+            string value;
+            string output;
+            string variables;
+        };
+
+        string PrintToString(const ObjectHolder& object, runtime::Context& context) {
+            if (!object) {
+                return "None"s;
+            }
+            ostringstream out;
+            object->Print(out, context);
+            return out.str();
+        }
+
+        // Выполняет statement над копией closure обходом дерева (flat = false) либо в плоском виде
+        Outcome Execute(ast::Statement& statement, Closure closure, bool flat) {
+            runtime::DummyContext context;
+            Outcome outcome;
+            try {
+                ObjectHolder result;
+                if (flat) {
+                    const Program program = Flatten(statement);
+                    result = Evaluator(context).Run(program, closure);
+                }
+                else {
+                    result = statement.Execute(closure, context);
+                }
+                outcome.value = PrintToString(result, context);
+            }
+            catch (const exception& e) {
+                outcome.value = "error: "s + e.what();
+            }
+            map<string, string> variables;
+            for (const auto& [name, value] : closure) {
+                variables[name.GetName()] = PrintToString(value, context);
+            }
+            for (const auto& [name, value] : variables) {
+                outcome.variables += name + '=' + value + ';';
+            }
+            outcome.output = context.output.str();
+            return outcome;
+        }
+
+        // Выполняет statement обходом дерева и в плоском виде, проверяет, что значения, исключения,
+        // вывод и переменные совпадают, и возвращает значение, полученное обходом дерева
+        string AssertSameOutcome(ast::Statement& statement, const Closure& closure = {}) {
+            const Outcome tree = Execute(statement, closure, false);
+            const Outcome flat = Execute(statement, closure, true);
+            ASSERT_EQUAL(flat.value, tree.value);
+            ASSERT_EQUAL(flat.output, tree.output);
+            ASSERT_EQUAL(flat.variables, tree.variables);
+            return tree.value;
+        }
+
+        bool IsError(const string& value) {
+            return value.rfind("error: "s, 0) == 0;
+        }
+
+        void TestPostOrderLayout() {
+            // print x + 2 * 3
+            ast::Print print(make_unique<ast::Add>(make_unique<ast::VariableValue>("x"s),
+                make_unique<ast::Mult>(make_unique<ast::NumericConst>(2), make_unique<ast::NumericConst>(3))));
+            const Program program = Flatten(print);
+
+            ASSERT_EQUAL(program.nodes.size(), 6U);
+            const vector<NodeKind> kinds = { NodeKind::Variable, NodeKind::Number, NodeKind::Number, NodeKind::Mult,
+                NodeKind::Add, NodeKind::Print };
+            for (size_t i = 0; i < kinds.size(); ++i) {
+                ASSERT(program.nodes[i].kind == kinds[i]);
+            }
+            ASSERT_EQUAL(program.GetRoot(), 5U);
+            ASSERT_EQUAL(program.nodes[1].a, 2U);
+            ASSERT(program.constants.empty());
+            const Node& mult = program.nodes[3];
+            ASSERT_EQUAL(mult.a, 1U);
+            ASSERT_EQUAL(mult.b, 2U);
+            const Node& add = program.nodes[4];
+            ASSERT_EQUAL(add.a, 0U);
+            ASSERT_EQUAL(add.b, 3U);
+            const Node& root = program.nodes[5];
+            ASSERT_EQUAL(root.b, 1U);
+            ASSERT_EQUAL(program.children[root.a], 4U);
+            ASSERT_EQUAL(sizeof(Node), 16U);
+        }
+
+        void TestValuesAndVariables() {
+            runtime::Number num(42);
+            runtime::String word("Hello"s);
+            const Closure closure = { {"x"s, ObjectHolder::Share(num)}, {"w"s, ObjectHolder::Share(word)} };
+
+            ast::NumericConst number(runtime::Number(57));
+            ASSERT_EQUAL(AssertSameOutcome(number), "57"s);
+            ast::StringConst str(runtime::String("Hello!"s));
+            ASSERT_EQUAL(AssertSameOutcome(str), "Hello!"s);
+            ast::BoolConst boolean(runtime::Bool(true));
+            ASSERT_EQUAL(AssertSameOutcome(boolean), "True"s);
+            ast::None none;
+            ASSERT_EQUAL(AssertSameOutcome(none), "None"s);
+
+            ast::VariableValue x("x"s);
+            ASSERT_EQUAL(AssertSameOutcome(x, closure), "42"s);
+            ast::VariableValue w("w"s);
+            ASSERT_EQUAL(AssertSameOutcome(w, closure), "Hello"s);
+            ast::VariableValue unknown("unknown"s);
+            ASSERT_EQUAL(AssertSameOutcome(unknown, closure), "error: unknown not found in closure"s);
+        }
+
+        void TestAssignment() {
+            const Closure closure = { {"y"s, ObjectHolder::Own(runtime::Number(42))} };
+
+            ast::Assignment assign_x("x"s, make_unique<ast::NumericConst>(57));
+            ASSERT_EQUAL(AssertSameOutcome(assign_x, closure), "57"s);
+            ast::Assignment assign_y("y"s, make_unique<ast::StringConst>("Hello"s));
+            ASSERT_EQUAL(AssertSameOutcome(assign_y, closure), "Hello"s);
+            ast::Assignment copy("z"s, make_unique<ast::VariableValue>("y"s));
+            ASSERT_EQUAL(AssertSameOutcome(copy, closure), "42"s);
+        }
+
+        void TestFieldAssignment() {
+            runtime::Class empty("Empty"s, {}, nullptr);
+            runtime::ClassInstance object{ empty };
+            const Closure closure = { {"self"s, ObjectHolder::Share(object)} };
+
+            ast::FieldAssignment assign_x(ast::VariableValue{ "self"s }, "x"s, make_unique<ast::NumericConst>(57));
+            ASSERT_EQUAL(AssertSameOutcome(assign_x, closure), "57"s);
+            ast::FieldAssignment assign_y(ast::VariableValue{ "self"s }, "y"s, make_unique<ast::NewInstance>(empty));
+            AssertSameOutcome(assign_y, closure);
+            ast::FieldAssignment assign_yz(ast::VariableValue{ vector<string>{"self"s, "y"s} }, "z"s,
+                make_unique<ast::StringConst>(runtime::String("Hooray"s)));
+            ASSERT_EQUAL(AssertSameOutcome(assign_yz, closure), "Hooray"s);
+
+            ast::VariableValue yz(vector<string>{ "self"s, "y"s, "z"s });
+            ASSERT_EQUAL(AssertSameOutcome(yz, closure), "Hooray"s);
+            ast::VariableValue missing(vector<string>{ "self"s, "w"s });
+            ASSERT(IsError(AssertSameOutcome(missing, closure)));
+        }
+
+        void TestPrintAndStringify() {
+            runtime::String hello("hello"s);
+            const Closure closure = { {"word"s, ObjectHolder::Share(hello)}, {"empty"s, ObjectHolder::None()} };
+
+            vector<unique_ptr<ast::Statement>> args;
+            args.push_back(make_unique<ast::VariableValue>("word"s));
+            args.push_back(make_unique<ast::NumericConst>(57));
+            args.push_back(make_unique<ast::VariableValue>("empty"s));
+            ast::Print print(std::move(args));
+            AssertSameOutcome(print, closure);
+            ASSERT_EQUAL(Execute(print, closure, true).output, "hello 57 None\n"s);
+
+            vector<runtime::Method> methods;
+            methods.push_back({ "__str__"s, {}, make_unique<ast::NumericConst>(842) });
+            runtime::Class cls("BoxedValue"s, std::move(methods), nullptr);
+            ast::Print print_instance(make_unique<ast::NewInstance>(cls));
+            AssertSameOutcome(print_instance);
+            ast::Stringify boxed(make_unique<ast::NewInstance>(cls));
+            ASSERT_EQUAL(AssertSameOutcome(boxed), "842"s);
+
+            ast::Stringify number(make_unique<ast::NumericConst>(57));
+            ASSERT_EQUAL(AssertSameOutcome(number), "57"s);
+            ast::Stringify none(make_unique<ast::None>());
+            ASSERT_EQUAL(AssertSameOutcome(none), "None"s);
+        }
+
+        void TestArithmetic() {
+            ast::Add numbers(make_unique<ast::NumericConst>(23), make_unique<ast::NumericConst>(34));
+            ASSERT_EQUAL(AssertSameOutcome(numbers), "57"s);
+            ast::Add strings(make_unique<ast::StringConst>("23"s), make_unique<ast::StringConst>("34"s));
+            ASSERT_EQUAL(AssertSameOutcome(strings), "2334"s);
+            ast::Add bad(make_unique<ast::NumericConst>(42), make_unique<ast::StringConst>("4"s));
+            ASSERT(IsError(AssertSameOutcome(bad)));
+
+            const Closure closure = { {"x"s, ObjectHolder::Own(runtime::Number(6))},
+                {"zero"s, ObjectHolder::Own(runtime::Number(0))} };
+            // (x - 1) * (x + 1) / 5
+            ast::Div expression(make_unique<ast::Mult>(
+                make_unique<ast::Sub>(make_unique<ast::VariableValue>("x"s), make_unique<ast::NumericConst>(1)),
+                make_unique<ast::Add>(make_unique<ast::VariableValue>("x"s), make_unique<ast::NumericConst>(1))),
+                make_unique<ast::NumericConst>(5));
+            ASSERT_EQUAL(AssertSameOutcome(expression, closure), "7"s);
+            ast::Div by_zero(make_unique<ast::VariableValue>("x"s), make_unique<ast::VariableValue>("zero"s));
+            ASSERT(IsError(AssertSameOutcome(by_zero, closure)));
+            ast::Sub mismatched(make_unique<ast::VariableValue>("x"s), make_unique<ast::StringConst>("a"s));
+            ASSERT(IsError(AssertSameOutcome(mismatched, closure)));
+            ast::Negate negate(make_unique<ast::VariableValue>("x"s));
+            ASSERT_EQUAL(AssertSameOutcome(negate, closure), "-6"s);
+            ast::Negate negate_string(make_unique<ast::StringConst>("a"s));
+            ASSERT(IsError(AssertSameOutcome(negate_string)));
+
+            vector<runtime::Method> methods;
+            methods.push_back({ "__add__"s, {"value_"s},
+                make_unique<ast::Add>(make_unique<ast::StringConst>("hello, "s),
+                    make_unique<ast::VariableValue>("value_"s)) });
+            runtime::Class cls("BoxedValue"s, std::move(methods), nullptr);
+            ast::Add instance(make_unique<ast::NewInstance>(cls), make_unique<ast::StringConst>("world"s));
+            ASSERT_EQUAL(AssertSameOutcome(instance), "hello, world"s);
+
+            runtime::Class no_add("Empty"s, {}, nullptr);
+            ast::Add without_method(make_unique<ast::NewInstance>(no_add), make_unique<ast::StringConst>("x"s));
+            ASSERT(IsError(AssertSameOutcome(without_method)));
+        }
+
+        void TestCompoundAndReturn() {
+            ast::Compound compound{
+                make_unique<ast::Assignment>("x"s, make_unique<ast::StringConst>("one"s)),
+                make_unique<ast::Assignment>("z"s, make_unique<ast::VariableValue>("x"s)),
+            };
+            ASSERT_EQUAL(AssertSameOutcome(compound), "None"s);
+
+            // if x: return 'if' / print 'after if' / return 'end' / print 'unreachable'
+            auto if_body = make_unique<ast::Compound>(make_unique<ast::Return>(make_unique<ast::StringConst>("if"s)));
+            ast::MethodBody body(make_unique<ast::Compound>(
+                make_unique<ast::IfElse>(make_unique<ast::VariableValue>("x"s), std::move(if_body), nullptr),
+                make_unique<ast::Print>(make_unique<ast::StringConst>("after if"s)),
+                make_unique<ast::Return>(make_unique<ast::StringConst>("end"s)),
+                make_unique<ast::Print>(make_unique<ast::StringConst>("unreachable"s))));
+
+            ASSERT_EQUAL(AssertSameOutcome(body, { {"x"s, ObjectHolder::Own(runtime::Bool(true))} }), "if"s);
+            ASSERT_EQUAL(AssertSameOutcome(body, { {"x"s, ObjectHolder::Own(runtime::Bool(false))} }), "end"s);
+        }
+
+        void TestLogicalOperationsAndComparisons() {
+            for (bool lhs : { false, true }) {
+                for (bool rhs : { false, true }) {
+                    ast::Or or_statement{ make_unique<ast::BoolConst>(lhs), make_unique<ast::BoolConst>(rhs) };
+                    ast::And and_statement{ make_unique<ast::BoolConst>(lhs), make_unique<ast::BoolConst>(rhs) };
+                    AssertSameOutcome(or_statement);
+                    AssertSameOutcome(and_statement);
+                }
+                ast::Not not_statement{ make_unique<ast::BoolConst>(lhs) };
+                AssertSameOutcome(not_statement);
+            }
+
+            // Второй аргумент не вычисляется, если результат известен по первому
+            ast::Or short_circuit{ make_unique<ast::BoolConst>(true),
+                make_unique<ast::Div>(make_unique<ast::NumericConst>(1), make_unique<ast::NumericConst>(0)) };
+            ASSERT_EQUAL(AssertSameOutcome(short_circuit), "True"s);
+
+            const Closure closure = { {"x"s, ObjectHolder::Own(runtime::Number(3))} };
+            for (auto comparator : { runtime::Equal, runtime::NotEqual, runtime::Less, runtime::Greater,
+                     runtime::LessOrEqual, runtime::GreaterOrEqual }) {
+                ast::Comparison numbers(comparator, make_unique<ast::VariableValue>("x"s),
+                    make_unique<ast::NumericConst>(4));
+                AssertSameOutcome(numbers, closure);
+                ast::Comparison strings(comparator, make_unique<ast::StringConst>("abc"s),
+                    make_unique<ast::StringConst>("abd"s));
+                AssertSameOutcome(strings);
+            }
+            ast::Comparison with_none(runtime::Less, make_unique<ast::VariableValue>("x"s), make_unique<ast::None>());
+            ASSERT(IsError(AssertSameOutcome(with_none, closure)));
+        }
+
+    }  // namespace
+
+    void RunFlatAstTests(TestRunner& tr) {
+        RUN_TEST(tr, flat::TestPostOrderLayout);
+        RUN_TEST(tr, flat::TestValuesAndVariables);
+        RUN_TEST(tr, flat::TestAssignment);
+        RUN_TEST(tr, flat::TestFieldAssignment);
+        RUN_TEST(tr, flat::TestPrintAndStringify);
+        RUN_TEST(tr, flat::TestArithmetic);
+        RUN_TEST(tr, flat::TestCompoundAndReturn);
+        RUN_TEST(tr, flat::TestLogicalOperationsAndComparisons);
+    }
+
+}  // namespace flat
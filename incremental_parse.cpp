@@ -0,0 +1,333 @@
+#include "incremental_parse.h"
+
+#include "lexer.h"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <unordered_set>
+
+using namespace std;
+
+namespace parse {
+
+    namespace {
+
+        // Может ли инструкция верхнего уровня начинаться в позиции position, с которой начинается строка
+        bool IsStatementStart(std::string_view source, size_t position) {
+            const char c = source[position];
+            if (c == ' ' || c == '\n' || c == '#') {
+                return false;
+            }
+            // Ветка else продолжает инструкцию if
+            constexpr std::string_view ELSE = "else"sv;
+            return source.compare(position, ELSE.size(), ELSE) != 0
+                || (position + ELSE.size() < source.size() && scan::IsIdChar(source[position + ELSE.size()]));
+        }
+
+        // Дописывает в starts начала инструкций верхнего уровня в тексте source[begin, end), который
+        // начинается с инструкции вне строковой константы. Строки и комментарии распознаются так же,
+        // как их распознаёт Lexer. Возвращает false, если end оказался внутри строковой константы
+        bool FindStatementStarts(std::string_view source, size_t begin, size_t end, std::vector<size_t>& starts) {
+            if (begin < end) {
+                starts.push_back(begin);
+            }
+            char quote = 0;
+            for (size_t i = begin; i < end; ++i) {
+                const char c = source[i];
+                if (quote != 0) {
+                    if (c == '\\') {
+                        ++i;
+                    }
+                    else if (c == quote) {
+                        quote = 0;
+                    }
+                }
+                else if (c == '#') {
+                    // Комментарий продолжается до конца строки
+                    i = std::min(source.find('\n', i), end) - 1;
+                }
+                else if (c == '\'' || c == '"') {
+                    quote = c;
+                }
+                else if (c == '\n' && i + 1 < end && IsStatementStart(source, i + 1)) {
+                    starts.push_back(i + 1);
+                }
+            }
+            return quote == 0;
+        }
+
+    }  // namespace
+
+    IncrementalParser::IncrementalParser(std::string source) {
+        Update(std::move(source), 0, 0, 0, 0);
+    }
+
+    void IncrementalParser::Apply(const TextEdit& edit) {
+        if (edit.offset > source_.size() || edit.removed > source_.size() - edit.offset) {
+            throw std::out_of_range("Edit is out of range: offset "s + std::to_string(edit.offset) + ", removed "s
+                + std::to_string(edit.removed) + ", program size "s + std::to_string(source_.size()));
+        }
+
+        // Заново разбираются фрагменты с символом перед правкой и символом после неё: правка в начале
+        // строки может присоединить эту строку к предыдущей инструкции
+        const size_t edit_begin = edit.offset > 0 ? edit.offset - 1 : 0;
+        const size_t edit_end = edit.offset + edit.removed;
+        size_t first = 0;
+        size_t begin = 0;
+        while (first < segments_.size() && begin + segments_[first].length <= edit_begin) {
+            begin += segments_[first].length;
+            ++first;
+        }
+        size_t last = first;
+        size_t end = begin;
+        while (last < segments_.size() && end <= edit_end) {
+            end += segments_[last].length;
+            ++last;
+        }
+
+        std::string text = source_.substr(begin, edit.offset - begin);
+        text += edit.inserted;
+        text.append(source_, edit_end, end - edit_end);
+        Update(std::move(text), first, last - first, begin, end);
+    }
+
+    void IncrementalParser::Update(std::string text, size_t first, size_t count, size_t begin, size_t end) {
+        // Если новый текст заканчивается внутри строковой константы, к нему присоединяются
+        // следующие фрагменты
+        std::vector<size_t> starts;
+        while (!FindStatementStarts(text, 0, text.size(), starts) && first + count < segments_.size()) {
+            text.append(source_, end, segments_[first + count].length);
+            end += segments_[first + count].length;
+            ++count;
+            starts.clear();
+        }
+        starts.push_back(text.size());
+        const size_t suffix = first + count;
+
+        // Пока разбор не завершён, фрагменты упорядочены по позициям: прежний фрагмент i находится
+        // в позиции 2i+1, новые фрагменты правки - в позиции 2·first, после фрагментов до first
+        // и перед следующими за заменёнными
+        auto old_position = [](size_t index) {
+            return 2 * index + 1;
+        };
+
+        // Прежние фрагменты, которые будут заменены, и классы, объявленные в новых фрагментах,
+        // с позициями объявивших их фрагментов
+        std::unordered_set<const SegmentClasses*> replaced;
+        std::unordered_map<std::string, std::pair<size_t, runtime::ObjectHolder>> new_classes;
+        for (size_t i = first; i < suffix; ++i) {
+            replaced.insert(segments_[i].classes.get());
+        }
+
+        // Класс с именем name, видимый из фрагмента в позиции position после правки
+        auto find_class = [&](const std::string& name, size_t position) -> const runtime::Class* {
+            if (auto it = new_classes.find(name); it != new_classes.end()) {
+                const auto& [owner_position, cls] = it->second;
+                return owner_position <= position ? cls.TryAs<runtime::Class>() : nullptr;
+            }
+            auto it = class_owners_.find(name);
+            if (it == class_owners_.end() || replaced.count(it->second) > 0
+                || old_position(it->second->index) >= position) {
+                return nullptr;
+            }
+            for (const auto& [own_name, cls] : it->second->declared) {
+                if (own_name == name) {
+                    return cls.TryAs<runtime::Class>();
+                }
+            }
+            return nullptr;
+        };
+
+        // Прежние фрагменты после заменённых, которые искали классы, объявленные теперь иначе.
+        // Они проверяются по порядку: повторный разбор фрагмента может изменить объявленные в нём
+        // классы, и тогда проверяются фрагменты, зависящие от них
+        std::set<size_t> to_check;
+        size_t unchecked = suffix;
+        auto class_changed = [&](const std::string& name) {
+            if (auto it = dependents_.find(name); it != dependents_.end()) {
+                for (const SegmentClasses* dependent : it->second) {
+                    if (dependent->index >= unchecked) {
+                        to_check.insert(dependent->index);
+                    }
+                }
+            }
+        };
+
+        // Заново разобранный фрагмент и его инструкции. Инструкции объявлены после фрагмента,
+        // поэтому удаляются раньше его арены
+        struct Parsed {
+            Segment segment;
+            ast::StatementList statements;
+        };
+        auto parse_segment = [&](std::string_view segment_text, size_t position) {
+            DeclaredClasses declared;
+            declared.find_previous = [&](const std::string& name) {
+                return find_class(name, position);
+            };
+            Lexer lexer(segment_text);
+            Parsed result;
+            result.segment.classes = std::make_unique<SegmentClasses>();
+            SegmentClasses& classes = *result.segment.classes;
+            ParseProgram(lexer, declared, classes.arena, [&result](ast::StatementPtr statement) {
+                result.statements.push_back(std::move(statement));
+                return true;
+            });
+            result.segment.length = segment_text.size();
+            result.segment.statement_count = result.statements.size();
+
+            classes.lookups = std::move(declared.lookups);
+            // Класс объявлен во фрагменте, если разбор не нашёл его, но после разбора он есть
+            for (const auto& [name, cls] : classes.lookups) {
+                auto it = declared.classes.find(name);
+                if (cls == nullptr && it != declared.classes.end() && new_classes.count(name) == 0) {
+                    classes.declared.emplace_back(name, it->second);
+                    new_classes.emplace(name, std::pair{ position, it->second });
+                    class_changed(name);
+                }
+            }
+            return result;
+        };
+
+        // Фрагмент можно не разбирать заново, если все искавшиеся им классы, кроме его собственных,
+        // означают те же объекты
+        auto can_reuse = [&](const SegmentClasses& classes) {
+            return std::all_of(classes.lookups.begin(), classes.lookups.end(), [&](const auto& lookup) {
+                const auto& [name, cls] = lookup;
+                const bool is_own = cls != nullptr
+                    && std::any_of(classes.declared.begin(), classes.declared.end(), [cls = cls](const auto& own) {
+                           return own.second.Get() == cls;
+                       });
+                return is_own || find_class(name, old_position(classes.index)) == cls;
+            });
+        };
+
+        // Классы заменяемых фрагментов объявлены теперь иначе либо не объявлены вовсе
+        for (size_t i = first; i < suffix; ++i) {
+            for (const auto& [name, cls] : segments_[i].classes->declared) {
+                class_changed(name);
+            }
+        }
+        std::vector<Parsed> region;
+        for (size_t i = 0; i + 1 < starts.size(); ++i) {
+            const std::string_view segment_text = std::string_view(text).substr(starts[i], starts[i + 1] - starts[i]);
+            region.push_back(parse_segment(segment_text, 2 * first));
+        }
+
+        // Заново разобранные фрагменты после заменённых
+        std::map<size_t, Parsed> reparsed;
+        size_t offset = end;
+        size_t next_offset_index = suffix;
+        while (!to_check.empty()) {
+            const size_t index = *to_check.begin();
+            to_check.erase(to_check.begin());
+            unchecked = index + 1;
+            for (; next_offset_index < index; ++next_offset_index) {
+                offset += segments_[next_offset_index].length;
+            }
+            const Segment& segment = segments_[index];
+            if (can_reuse(*segment.classes)) {
+                continue;
+            }
+            replaced.insert(segment.classes.get());
+            for (const auto& [name, cls] : segment.classes->declared) {
+                class_changed(name);
+            }
+            reparsed.emplace(index,
+                parse_segment(std::string_view(source_).substr(offset, segment.length), old_position(index)));
+        }
+
+        // Разбор удался: в дереве и списке фрагментов заменяются только изменившиеся части.
+        // Заменённые фрагменты удаляются последними, так как индексы ссылаются на них
+        std::vector<std::unique_ptr<SegmentClasses>> dropped;
+        size_t reparsed_count = 0;
+        auto drop_segment = [&](Segment& segment) {
+            const SegmentClasses* classes = segment.classes.get();
+            for (const auto& [name, cls] : classes->declared) {
+                if (auto it = class_owners_.find(name); it != class_owners_.end() && it->second == classes) {
+                    class_owners_.erase(it);
+                }
+            }
+            for (const auto& [name, cls] : classes->lookups) {
+                if (auto it = dependents_.find(name); it != dependents_.end()) {
+                    auto& dependents = it->second;
+                    dependents.erase(std::remove(dependents.begin(), dependents.end(), classes), dependents.end());
+                    if (dependents.empty()) {
+                        dependents_.erase(it);
+                    }
+                }
+            }
+            dropped.push_back(std::move(segment.classes));
+        };
+        auto add_segment = [&](Parsed& parsed, size_t index) {
+            SegmentClasses* classes = parsed.segment.classes.get();
+            classes->index = index;
+            for (const auto& [name, cls] : classes->declared) {
+                class_owners_[name] = classes;
+            }
+            for (const auto& [name, cls] : classes->lookups) {
+                auto& dependents = dependents_[name];
+                if (std::find(dependents.begin(), dependents.end(), classes) == dependents.end()) {
+                    dependents.push_back(classes);
+                }
+            }
+            reparsed_count += parsed.segment.statement_count;
+            return std::move(parsed.segment);
+        };
+
+        size_t statement = 0;
+        for (size_t i = 0; i < first; ++i) {
+            statement += segments_[i].statement_count;
+        }
+        const size_t first_statement = statement;
+        for (size_t i = first; i < suffix; ++i) {
+            statement += segments_[i].statement_count;
+        }
+
+        // Фрагменты после заменённых разобраны из того же текста, что и прежде, поэтому число
+        // их инструкций не изменилось и они заменяются на месте
+        auto next_reparsed = reparsed.begin();
+        for (size_t i = suffix; next_reparsed != reparsed.end(); ++i) {
+            if (next_reparsed->first == i) {
+                Parsed& parsed = next_reparsed->second;
+                program_.ReplaceStatements(statement, segments_[i].statement_count, std::move(parsed.statements));
+                drop_segment(segments_[i]);
+                segments_[i] = add_segment(parsed, i);
+                ++next_reparsed;
+            }
+            statement += segments_[i].statement_count;
+        }
+
+        ast::StatementList region_statements;
+        std::vector<Segment> region_segments;
+        size_t replaced_statements = 0;
+        for (size_t i = first; i < suffix; ++i) {
+            replaced_statements += segments_[i].statement_count;
+            drop_segment(segments_[i]);
+        }
+        for (Parsed& parsed : region) {
+            std::move(parsed.statements.begin(), parsed.statements.end(), std::back_inserter(region_statements));
+            region_segments.push_back(add_segment(parsed, first + region_segments.size()));
+        }
+        program_.ReplaceStatements(first_statement, replaced_statements, std::move(region_statements));
+        // Следующие фрагменты сдвигаются, только если изменилось число фрагментов
+        const auto position = segments_.begin() + static_cast<std::ptrdiff_t>(first);
+        if (region_segments.size() == count) {
+            std::move(region_segments.begin(), region_segments.end(), position);
+        }
+        else {
+            segments_.erase(position, position + static_cast<std::ptrdiff_t>(count));
+            segments_.insert(segments_.begin() + static_cast<std::ptrdiff_t>(first),
+                std::make_move_iterator(region_segments.begin()), std::make_move_iterator(region_segments.end()));
+            for (size_t i = first + region_segments.size(); i < segments_.size(); ++i) {
+                segments_[i].classes->index = i;
+            }
+        }
+
+        source_.replace(begin, end - begin, text);
+        reparsed_count_ = reparsed_count;
+    }
+
+}  // namespace parse
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "parse.h"
+#include "statement.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace parse {
+
+    // Правка текста программы: removed байт, начиная со смещения offset, заменяются текстом inserted
+    struct TextEdit {
+        size_t offset = 0;
+        size_t removed = 0;
+        std::string inserted;
+    };
+
+    // Синтаксический анализатор программы, которую правят по частям. Программа делится на фрагменты
+    // по началам инструкций верхнего уровня: строкам без отступа, которые не пусты, не являются
+    // комментарием, не начинаются с else и не находятся внутри строковой константы. Каждый фрагмент
+    // содержит одну инструкцию и разбирается отдельно. После правки заново разбираются только
+    // фрагменты, текст которых изменился, и фрагменты, которые искали классы, объявленные иначе,
+    // чем при их разборе. Деревья остальных инструкций переиспользуются, поэтому время обновления
+    // зависит от размера правки и числа зависящих от неё инструкций, а не от размера программы
+    class IncrementalParser {
+    public:
+        // Разбирает программу source целиком
+        explicit IncrementalParser(std::string source);
+
+        IncrementalParser(const IncrementalParser&) = delete;
+        IncrementalParser& operator=(const IncrementalParser&) = delete;
+
+        // Применяет правку и обновляет дерево разбора. Если правка выходит за пределы текста или
+        // после неё программа не разбирается, выбрасывает исключение, не меняя ни текст, ни дерево
+        void Apply(const TextEdit& edit);
+
+        [[nodiscard]] const std::string& GetSource() const {
+            return source_;
+        }
+
+        // Дерево разбора программы. Инструкции, не затронутые правкой, остаются теми же объектами.
+        // Узлы инструкции размещены в арене её фрагмента и удаляются вместе с фрагментом
+        [[nodiscard]] ast::Compound& GetProgram() {
+            return program_;
+        }
+
+        // Количество инструкций, разобранных при последнем вызове Apply или в конструкторе
+        [[nodiscard]] size_t GetReparsedCount() const {
+            return reparsed_count_;
+        }
+
+    private:
+        // Классы, которые искал разбор фрагмента, и классы, объявленные в нём, и арена его узлов.
+        // Хранятся по указателю, чтобы индексы ниже не зависели от перемещения фрагментов
+        struct SegmentClasses {
+            // Арена узлов фрагмента. Объявлена первой, поэтому удаляется после его классов
+            ast::NodeArena arena;
+            // Номер фрагмента в программе
+            size_t index = 0;
+            // См. DeclaredClasses::lookups
+            std::vector<std::pair<std::string, const runtime::Class*>> lookups;
+            std::vector<std::pair<std::string, runtime::ObjectHolder>> declared;
+        };
+
+        // Фрагмент программы и результат его разбора
+        struct Segment {
+            size_t length = 0;
+            size_t statement_count = 0;
+            std::unique_ptr<SegmentClasses> classes;
+        };
+
+        // Заменяет фрагменты [first, first + count), занимающие текст [begin, end), текстом text
+        // и обновляет дерево
+        void Update(std::string text, size_t first, size_t count, size_t begin, size_t end);
+
+        std::string source_;
+        std::vector<Segment> segments_;
+        // Фрагмент, в котором объявлен класс с данным именем
+        std::unordered_map<std::string, SegmentClasses*> class_owners_;
+        // Фрагменты, разбор которых искал класс с данным именем
+        std::unordered_map<std::string, std::vector<SegmentClasses*>> dependents_;
+        ast::Compound program_;
+        size_t reparsed_count_ = 0;
+    };
+
+}  // namespace parse
@@ -1,14 +1,82 @@
 #include "lexer.h"
+#include "token_buffer.h"
 
 #include <algorithm>
 #include <charconv>
-#include <unordered_map>
 #include <iostream>
+#include <limits>
 
 using namespace std;
 
 namespace parse {
 
+    namespace {
+
+        template <typename T>
+        Token MakeToken() {
+            return T{};
+        }
+
+        struct Keyword {
+            std::string_view word;
+            Token (*make_token)() = nullptr;
+        };
+
+        constexpr Keyword KEYWORDS[] = {
+            {"class"sv, MakeToken<token_type::Class>},
+            {"return"sv, MakeToken<token_type::Return>},
+            {"if"sv, MakeToken<token_type::If>},
+            {"else"sv, MakeToken<token_type::Else>},
+            {"def"sv, MakeToken<token_type::Def>},
+            {"print"sv, MakeToken<token_type::Print>},
+            {"or"sv, MakeToken<token_type::Or>},
+            {"None"sv, MakeToken<token_type::None>},
+            {"and"sv, MakeToken<token_type::And>},
+            {"not"sv, MakeToken<token_type::Not>},
+            {"True"sv, MakeToken<token_type::True>},
+            {"False"sv, MakeToken<token_type::False>},
+        };
+
+        constexpr size_t KEYWORD_TABLE_SIZE = 16;
+
+        // Совершенная хеш-функция ключевых слов: разные ключевые слова попадают в разные ячейки таблицы.
+        // word не должно быть пустым
+        constexpr size_t KeywordHash(std::string_view word) {
+            return (2 * word.size() + 3 * static_cast<unsigned char>(word.front())
+                       + static_cast<unsigned char>(word.back()))
+                   % KEYWORD_TABLE_SIZE;
+        }
+
+        constexpr bool IsPerfectKeywordHash() {
+            std::array<bool, KEYWORD_TABLE_SIZE> used{};
+            for (const Keyword& keyword : KEYWORDS) {
+                if (used[KeywordHash(keyword.word)]) {
+                    return false;
+                }
+                used[KeywordHash(keyword.word)] = true;
+            }
+            return true;
+        }
+
+        static_assert(IsPerfectKeywordHash(), "Keywords collide, choose other KeywordHash coefficients");
+
+        // Таблица ключевых слов, построенная при компиляции. Ключевое слово находится в ячейке KeywordHash
+        constexpr std::array<Keyword, KEYWORD_TABLE_SIZE> KEYWORD_TABLE = [] {
+            std::array<Keyword, KEYWORD_TABLE_SIZE> table{};
+            for (const Keyword& keyword : KEYWORDS) {
+                table[KeywordHash(keyword.word)] = keyword;
+            }
+            return table;
+        }();
+
+        // Возвращает ключевое слово word либо nullptr, если word - не ключевое слово
+        const Keyword* FindKeyword(std::string_view word) {
+            const Keyword& keyword = KEYWORD_TABLE[KeywordHash(word)];
+            return keyword.make_token != nullptr && keyword.word == word ? &keyword : nullptr;
+        }
+
+    }  // namespace
+
     bool operator==(const Token& lhs, const Token& rhs) {
         using namespace token_type;
 
@@ -76,211 +144,371 @@ namespace parse {
         return os << "Unknown token :("sv;
     }
 
-    Lexer::Lexer(std::istream& input) : input_(input) {
-        while (input_) {
-            auto token = FindNextToken();
-            tokens_.push_back(token);
+    std::ostream& operator<<(std::ostream& os, const TokenText& text) {
+        return os << text.GetView();
+    }
+
+    namespace {
+        // SourceSpan хранит смещения в 32 битах
+        constexpr size_t MAX_SOURCE_SIZE = std::numeric_limits<std::uint32_t>::max();
+    }  // namespace
+
+    Lexer::Lexer(std::istream& input)
+        : input_(&input)
+        , chunk_(STREAM_CHUNK_SIZE, '\0')
+        , position_(chunk_.data())
+        , end_(chunk_.data())
+        , chunk_begin_(chunk_.data()) {
+        ReadToken();
+    }
+
+    Lexer::Lexer(std::string_view source)
+        : position_(source.data())
+        , end_(source.data() + source.size())
+        , chunk_begin_(source.data()) {
+        if (source.size() > MAX_SOURCE_SIZE) {
+            throw LexerError("Program is too large: "s + std::to_string(source.size()) + " bytes"s);
+        }
+        ReadToken();
+    }
+
+    Lexer::Lexer(const TokenBuffer& tokens)
+        : replay_(&tokens) {
+        if (tokens.empty() || !tokens.Is<token_type::Eof>(tokens.size() - 1)) {
+            throw LexerError("Token buffer must end with Eof"s);
         }
+        ReadToken();
+    }
 
+    Lexer::Lexer(TokenSource& source)
+        : replay_(&source.NextBatch())
+        , token_source_(&source) {
+        if (replay_->empty()) {
+            throw LexerError("Token batch is empty"s);
+        }
+        ReadToken();
     }
 
     const Token& Lexer::CurrentToken() const {
-        return tokens_.at(token_current_index_);
+        return lookahead_[lookahead_begin_];
     }
 
-    Token Lexer::NextToken() {
-        token_current_index_++;
-        if (token_current_index_ >= tokens_.size())  return token_type::Eof{};
+    const SourceSpan& Lexer::CurrentSpan() const {
+        return lookahead_spans_[lookahead_begin_];
+    }
+
+    const Token& Lexer::NextToken() {
+        Advance();
         return CurrentToken();
+    }
+
+    const Token& Lexer::PeekToken(size_t offset) {
+        if (offset >= LOOKAHEAD_CAPACITY) {
+            throw LexerError("Lookahead is limited to "s + std::to_string(LOOKAHEAD_CAPACITY) + " tokens"s);
+        }
+        while (lookahead_size_ <= offset) {
+            ReadToken();
+        }
+        return lookahead_[(lookahead_begin_ + offset) % LOOKAHEAD_CAPACITY];
+    }
 
-        throw std::logic_error("Not implemented"s);
+    void Lexer::Advance() {
+        if (lookahead_size_ > 1) {
+            lookahead_begin_ = (lookahead_begin_ + 1) % LOOKAHEAD_CAPACITY;
+            --lookahead_size_;
+        }
+        else {
+            lookahead_[lookahead_begin_] = ProduceToken(lookahead_spans_[lookahead_begin_]);
+        }
     }
 
+    void Lexer::ReadToken() {
+        const size_t slot = (lookahead_begin_ + lookahead_size_) % LOOKAHEAD_CAPACITY;
+        lookahead_[slot] = ProduceToken(lookahead_spans_[slot]);
+        ++lookahead_size_;
+    }
 
-    Token Lexer::FindNextToken() {
-        //find end of file
-        if (IsEof()) {
-            if (indent_ > 0) {
-                for (int i = indent_; i > 0; i -= 2) {
-                    tokens_.push_back(token_type::Dedent{});
+    Token Lexer::ProduceToken(SourceSpan& span) {
+        if (replay_ != nullptr) {
+            // Буфер, поступающий частями, заканчивается не на Eof, пока не получена последняя часть
+            if (replay_position_ == replay_->size()) {
+                replay_ = &token_source_->NextBatch();
+                replay_position_ = 0;
+                if (replay_->empty()) {
+                    throw LexerError("Token batch is empty"s);
                 }
             }
-
-            if (!tokens_.empty()) {
-                if (tokens_.back() != token_type::Newline{} && tokens_.back() != token_type::Dedent{} && tokens_.back() != token_type::Indent{}) {
-                    tokens_.push_back(token_type::Newline{});
-                }
+            // Токен Eof выдаётся повторно
+            const size_t index = replay_position_;
+            if (!replay_->Is<token_type::Eof>(index)) {
+                ++replay_position_;
             }
+            span = replay_->GetSpan(index);
+            return replay_->Get(index);
+        }
 
+        if (pending_indents_ != 0) {
+            MarkTokenStart();
+            span = token_start_;
+            last_token_ = LastToken::Indentation;
+            if (pending_indents_ > 0) {
+                --pending_indents_;
+                return token_type::Indent{};
+            }
+            ++pending_indents_;
+            return token_type::Dedent{};
+        }
 
-            return token_type::Eof{};
+        Token token = FindNextToken();
+        span = token_start_;
+        span.length = static_cast<std::uint32_t>(GetOffset() - token_start_.offset);
+        if (token.Is<token_type::Newline>()) {
+            last_token_ = LastToken::Newline;
+        }
+        else if (token.Is<token_type::Indent>() || token.Is<token_type::Dedent>()) {
+            last_token_ = LastToken::Indentation;
+        }
+        else if (!token.Is<token_type::Eof>()) {
+            last_token_ = LastToken::Other;
         }
-        char token;
+        return token;
+    }
+
 
-        //find indent and dedent
-        if (is_new_line_) {
-            is_new_line_ = false;
+    void Lexer::MarkTokenStart() {
+        const size_t offset = GetOffset();
+        token_start_.offset = static_cast<std::uint32_t>(offset);
+        token_start_.length = 0;
+        token_start_.line = line_;
+        token_start_.column = static_cast<std::uint32_t>(offset - line_offset_ + 1);
+    }
 
-            int spaces = 0;
+    Token Lexer::FindNextToken() {
+        // Пробелы, комментарии и пустые строки пропускаются в цикле, поэтому глубина стека
+        // не зависит от их количества
+        for (;;) {
+            MarkTokenStart();
+
+            //find end of file
+            if (IsEof()) {
+                if (!eof_) {
+                    eof_ = true;
+                    // Незакрытые блоки закрываются, а последняя строка завершается, только если
+                    // после неё не нужно выдавать Dedent
+                    if (indent_ > 0) {
+                        pending_indents_ = -((indent_ + 1) / 2 - 1);
+                        indent_ = 0;
+                        return token_type::Dedent{};
+                    }
+                    if (last_token_ == LastToken::Other) {
+                        return token_type::Newline{};
+                    }
+                }
 
-            while (input_ && input_.peek() == ' ') {
-                ++spaces;
-                input_.get();
+                return token_type::Eof{};
             }
 
-            if (input_.peek() != '\n') {
-                int delta = spaces - indent_;
-                indent_ = spaces;
+            //find indent and dedent
+            if (is_new_line_) {
+                is_new_line_ = false;
 
-                if (delta == 0) {
+                int spaces = static_cast<int>(SkipWhile(kernels_->count_spaces));
 
+                if (Peek() == '\n') {
+                    continue;
                 }
-                else if (delta > 0) {
-                    for (int i = 0; i < delta - 2; i += 2) {
-                        tokens_.push_back(token_type::Indent{});
-                    }
+                int delta = spaces - indent_;
+                indent_ = spaces;
+
+                if (delta > 0) {
+                    // Каждые два пробела (или их остаток) дают Indent: первый выдаётся сразу,
+                    // остальные откладываются
+                    pending_indents_ = (delta + 1) / 2 - 1;
                     return token_type::Indent{};
                 }
-                else {
-                    for (int i = delta; i + 2 < 0; i += 2) {
-                        tokens_.push_back(token_type::Dedent{});
-                    }
+                if (delta < 0) {
+                    pending_indents_ = -((-delta + 1) / 2 - 1);
                     return token_type::Dedent{};
                 }
-            }
-            else {
-                return FindNextToken();
-            }
-
-
-        }
-
-        token = input_.peek();
-
-        //find spaces
-        if (token == ' ') {
-            input_.get();
-            while (input_ && input_.peek() == ' ') {
-                input_.get();
+                // Лексема начинается после отступа
+                MarkTokenStart();
             }
 
-            return FindNextToken();
-        }
+            int token = Peek();
 
-        //find comments
-        if (token == '#') {
-            input_.get();
-            while (input_ && input_.peek() != '\n') {
-                input_.get();
+            // Строка из одних пробелов в конце входных данных
+            if (token == END_OF_INPUT) {
+                continue;
             }
 
-            return FindNextToken();
-        }
-
-        //find strings
-        if (IsString(token)) {
-            char quote = input_.get();
-
-            std::string str;
-            while (input_ && input_.peek() != quote) {
-                if (input_.peek() == '\\') {
-                    input_.get();
-                    if (input_.peek() == '\'') {
-                        input_.get();
-                        str += '\'';
-                        continue;
-                    }
-                    if (input_.peek() == '\"') {
-                        input_.get();
-                        str += '\"';
-                        continue;
-                    }
-                    if (input_.peek() == 'n') {
-                        input_.get();
-                        str += '\n';
-                        continue;
-                    }
-                    if (input_.peek() == 't') {
-                        input_.get();
-                        str += '\t';
-                        continue;
-                    }
-                    if (input_.peek() == '\\') {
-                        input_.get();
-                        str += '\\';
-                        continue;
-                    }
+            // Вид токена определяется классом его первого символа
+            switch (scan::GetCharClass(static_cast<char>(token))) {
+            //find spaces
+            case scan::CharClass::Space:
+                SkipWhile(kernels_->count_spaces);
+                continue;
+
+            //find comments
+            case scan::CharClass::Comment:
+                SkipWhile(kernels_->count_until_newline);
+                continue;
+
+            //find strings
+            case scan::CharClass::Quote:
+                return token_type::String{ ScanString(Get()) };
+
+            //find numbers
+            case scan::CharClass::Digit: {
+                TokenText digits = ScanWhile(kernels_->count_digits);
+                std::string_view number = digits.GetView();
+
+                int value = 0;
+                if (std::from_chars(number.data(), number.data() + number.size(), value).ec != std::errc{}) {
+                    throw LexerError("Number is out of range: "s + std::string(number));
                 }
-                str += input_.get();
+                return token_type::Number{ value };
             }
-            input_.get();
-            return token_type::String{ str };
-        }
-
 
+            //fine end of line
+            case scan::CharClass::Newline:
+                Get();
+                StartLine();
+                is_new_line_ = true;
 
-        //find numbers
-        if (IsNumber(token)) {
-            char c = input_.get();
+                // Пустые строки и строки в начале программы не дают Newline
+                if (last_token_ == LastToken::None || last_token_ == LastToken::Newline) {
+                    continue;
+                }
+                return token_type::Newline{};
 
-            std::string number{ c };
-            while (IsNumber(input_.peek())) {
-                c = input_.get();
-                number += c;
+            //find special words
+            case scan::CharClass::Letter: {
+                TokenText word = ScanWhile(kernels_->count_id_chars);
 
+                if (const Keyword* keyword = FindKeyword(word.GetView())) {
+                    return keyword->make_token();
+                }
+                return token_type::Id{ runtime::Symbol(word.GetView()) };
             }
 
-            return token_type::Number{ std::stoi(number) };
+            case scan::CharClass::Other:
+                break;
+            }
+            break;
         }
 
-        //fine end of line
-        if (token == '\n') {
-            input_.get();
-            is_new_line_ = true;
+        //find symbols
+        char c = Get();
+        if (c == '=' && Peek() == '=') {
+            Get();
+            return token_type::Eq{};
+        }
+        if (c == '!' && Peek() == '=') {
+            Get();
+            return token_type::NotEq{};
+        }
+        if (c == '<' && Peek() == '=') {
+            Get();
+            return token_type::LessOrEq{};
+        }
+        if (c == '>' && Peek() == '=') {
+            Get();
+            return token_type::GreaterOrEq{};
+        }
+        return token_type::Char{ c };
+    }
 
-            if (tokens_.empty()) return FindNextToken();
+    bool Lexer::Refill() {
+        if (input_ == nullptr || !*input_) {
+            return false;
+        }
+        chunk_offset_ += static_cast<size_t>(end_ - chunk_begin_);
+        input_->read(chunk_.data(), static_cast<std::streamsize>(chunk_.size()));
+        position_ = chunk_begin_ = chunk_.data();
+        end_ = position_ + input_->gcount();
+        if (chunk_offset_ + static_cast<size_t>(end_ - position_) > MAX_SOURCE_SIZE) {
+            throw LexerError("Program is too large: more than "s + std::to_string(MAX_SOURCE_SIZE) + " bytes"s);
+        }
+        return position_ != end_;
+    }
 
-            if (tokens_.back() != token_type::Newline{}) {
-                return token_type::Newline{};
-            }
-            else
-                return FindNextToken();
+    TokenText Lexer::ScanWhile(scan::ScanFunction count) {
+        const char* start = position_;
+        if (input_ == nullptr) {
+            position_ += count(position_, end_);
+            return TokenText::View({ start, static_cast<size_t>(position_ - start) });
         }
 
-        //find special words
-        if (IsId(input_.peek())) {
-            std::string word;
-            while (IsId(input_.peek())) {
-                char c = input_.get();
-                word += c;
+        // Текст может продолжаться в следующем блоке потока
+        std::string text;
+        while (true) {
+            position_ += count(position_, end_);
+            text.append(start, position_);
+            if (position_ != end_ || !Refill()) {
+                break;
             }
+            start = position_;
+        }
+        return text;
+    }
 
-            if (keywords_.count(word) > 0) {
-                return keywords_.at(word);
+    size_t Lexer::SkipWhile(scan::ScanFunction count) {
+        size_t skipped = 0;
+        while (true) {
+            const size_t n = count(position_, end_);
+            position_ += n;
+            skipped += n;
+            if (position_ != end_ || !Refill()) {
+                return skipped;
             }
-            return token_type::Id{ word };
         }
+    }
 
+    TokenText Lexer::ScanString(char quote) {
+        const char* start = position_;
+        // Строка копируется, если она читается из потока или содержит escape-последовательности
+        bool copy = input_ != nullptr;
+        std::string str;
 
-        //find symbols
-        char c = input_.get();
-        if (c == '=' && input_.peek() == '=') {
-            input_.get();
-            return token_type::Eq{};
-        }
-        if (c == '!' && input_.peek() == '=') {
-            input_.get();
-            return token_type::NotEq{};
+        while (Peek() != END_OF_INPUT && Peek() != quote) {
+            char c = Get();
+            if (c == '\n') {
+                StartLine();
+            }
+            if (c == '\\' && Peek() != END_OF_INPUT) {
+                if (!copy) {
+                    str.assign(start, position_ - 1);
+                    copy = true;
+                }
+                c = Get();
+                if (c == '\n') {
+                    StartLine();
+                }
+                switch (c) {
+                case 'n':
+                    c = '\n';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                default:
+                    // \', \", \\ и неизвестные последовательности дают сам символ
+                    break;
+                }
+            }
+            if (copy) {
+                str += c;
+            }
         }
-        if (c == '<' && input_.peek() == '=') {
-            input_.get();
-            return token_type::LessOrEq{};
+
+        const char* stop = position_;
+        if (Peek() != END_OF_INPUT) {
+            Get();
         }
-        if (c == '>' && input_.peek() == '=') {
-            input_.get();
-            return token_type::GreaterOrEq{};
+        if (copy) {
+            return str;
         }
-        return token_type::Char{ c };
+        return TokenText::View({ start, static_cast<size_t>(stop - start) });
     }
 
 }  // namespace parse
\ No newline at end of file
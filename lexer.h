@@ -1,24 +1,99 @@
 #pragma once
 
+#include "lexer_scan.h"
+#include "symbol.h"
+
+#include <array>
+#include <cstdint>
 #include <iosfwd>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <variant>
-#include <unordered_map>
 #include <unordered_set>
-#include <queue>
 
 namespace parse {
 
+    // Текст лексемы. Лексер, разбирающий программу из буфера в памяти, не копирует текст,
+    // а ссылается на фрагмент буфера, поэтому буфер должен жить дольше токенов. Собственную
+    // копию текст хранит, только если он отличается от исходного (строка с escape-
+    // последовательностями) или прочитан из потока
+    class TokenText {
+    public:
+        TokenText() = default;
+
+        TokenText(std::string text)
+            : owned_(std::move(text)) {
+        }
+
+        TokenText(const char* text)
+            : owned_(text) {
+        }
+
+        // Создаёт текст, ссылающийся на фрагмент text, не копируя его
+        [[nodiscard]] static TokenText View(std::string_view text) {
+            TokenText result;
+            result.view_ = text.data();
+            result.size_ = text.size();
+            return result;
+        }
+
+        [[nodiscard]] std::string_view GetView() const {
+            return view_ != nullptr ? std::string_view(view_, size_) : std::string_view(owned_);
+        }
+
+        // Ссылается ли текст на исходный буфер
+        [[nodiscard]] bool IsView() const {
+            return view_ != nullptr;
+        }
+
+        operator std::string_view() const {
+            return GetView();
+        }
+
+        operator std::string() const {
+            return std::string(GetView());
+        }
+
+    private:
+        std::string owned_;
+        const char* view_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    inline bool operator==(const TokenText& lhs, const TokenText& rhs) {
+        return lhs.GetView() == rhs.GetView();
+    }
+
+    inline bool operator==(const TokenText& lhs, const std::string& rhs) {
+        return lhs.GetView() == rhs;
+    }
+
+    inline bool operator==(const TokenText& lhs, std::string_view rhs) {
+        return lhs.GetView() == rhs;
+    }
+
+    inline bool operator==(const TokenText& lhs, const char* rhs) {
+        return lhs.GetView() == rhs;
+    }
+
+    template <typename T>
+    bool operator!=(const TokenText& lhs, const T& rhs) {
+        return !(lhs == rhs);
+    }
+
+    std::ostream& operator<<(std::ostream& os, const TokenText& text);
+
     namespace token_type {
         struct Number {  // Лексема «число»
             int value;   // число
         };
 
-        struct Id {             // Лексема «идентификатор»
-            std::string value;  // Имя идентификатора
+        struct Id {                 // Лексема «идентификатор»
+            runtime::Symbol value;  // Имя идентификатора, зарегистрированное в таблице символов
         };
 
         struct Char {    // Лексема «символ»
@@ -26,7 +101,7 @@ namespace parse {
         };
 
         struct String {  // Лексема «строковая константа»
-            std::string value;
+            TokenText value;
         };
 
         struct Class {};    // Лексема «class»
@@ -59,9 +134,45 @@ namespace parse {
         token_type::Eq, token_type::NotEq, token_type::LessOrEq, token_type::GreaterOrEq,
         token_type::None, token_type::True, token_type::False, token_type::Eof>;
 
+    // Вид токена - индекс его альтернативы в TokenBase. Занимает один байт, поэтому в TokenBuffer
+    // виды токенов хранятся плотным массивом
+    enum class TokenKind : std::uint8_t {
+        Number, Id, Char, String,
+        Class, Return, If, Else,
+        Def, Newline, Print, Indent,
+        Dedent, And, Or, Not,
+        Eq, NotEq, LessOrEq, GreaterOrEq,
+        None, True, False, Eof,
+    };
+
+    static_assert(static_cast<size_t>(TokenKind::Eof) + 1 == std::variant_size_v<TokenBase>,
+        "TokenKind must list every TokenBase alternative");
+
+    namespace detail {
+        template <typename T, typename... Types>
+        constexpr size_t AlternativeIndex(const std::variant<Types...>*) {
+            size_t index = 0;
+            (void)((std::is_same_v<T, Types> ? false : (++index, true)) && ...);
+            return index;
+        }
+    }  // namespace detail
+
+    // Вид токена типа T
+    template <typename T>
+    inline constexpr TokenKind TOKEN_KIND
+        = static_cast<TokenKind>(detail::AlternativeIndex<T>(static_cast<const TokenBase*>(nullptr)));
+
+    static_assert(TOKEN_KIND<token_type::String> == TokenKind::String && TOKEN_KIND<token_type::Dedent> == TokenKind::Dedent
+            && TOKEN_KIND<token_type::Eof> == TokenKind::Eof,
+        "TokenKind order must match TokenBase");
+
     struct Token : TokenBase {
         using TokenBase::TokenBase;
 
+        [[nodiscard]] TokenKind GetKind() const {
+            return static_cast<TokenKind>(index());
+        }
+
         template <typename T>
         [[nodiscard]] bool Is() const {
             return std::holds_alternative<T>(*this);
@@ -83,20 +194,70 @@ namespace parse {
 
     std::ostream& operator<<(std::ostream& os, const Token& rhs);
 
+    // Положение лексемы в исходном тексте. Строки и столбцы нумеруются с единицы, столбец
+    // отсчитывается в байтах. Отложенные Indent и Dedent, а также лексемы, выданные в конце
+    // программы, имеют нулевую длину
+    struct SourceSpan {
+        std::uint32_t offset = 0;  // смещение первого байта лексемы от начала программы
+        std::uint32_t length = 0;
+        std::uint32_t line = 1;
+        std::uint32_t column = 1;
+    };
+
+    class TokenBuffer;
+
+    // Источник токенов, поступающих частями (например, из другого потока)
+    class TokenSource {
+    public:
+        virtual ~TokenSource() = default;
+
+        // Возвращает следующую непустую часть токенов. Последняя часть заканчивается токеном Eof.
+        // Возвращённая часть должна оставаться действительной до следующего вызова
+        virtual const TokenBuffer& NextBatch() = 0;
+    };
+
     class LexerError : public std::runtime_error {
     public:
         using std::runtime_error::runtime_error;
     };
 
+    // Лексический анализатор. Выделяет токены по мере того, как они запрашиваются, поэтому
+    // расходует память, не зависящую от размера программы, и позволяет начать разбор
+    // до того, как программа прочитана целиком
     class Lexer {
     public:
+        // Количество токенов, которые можно просмотреть вперёд, включая текущий
+        static constexpr size_t LOOKAHEAD_CAPACITY = 4;
+        // Размер блока, которым читается входной поток
+        static constexpr size_t STREAM_CHUNK_SIZE = 64 * 1024;
+
+        // Читает программу из потока input блоками по STREAM_CHUNK_SIZE байт.
+        // Текст токенов копируется из блока, так как блок перезаписывается следующим
         explicit Lexer(std::istream& input);
+        // Разбирает программу, целиком находящуюся в памяти (например, в отображённом файле).
+        // Строки без escape-последовательностей ссылаются на source, который должен жить
+        // дольше токенов
+        explicit Lexer(std::string_view source);
+        // Выдаёт токены, ранее сохранённые в tokens, не разбирая текст заново.
+        // tokens должен заканчиваться токеном Eof и жить дольше лексера
+        explicit Lexer(const TokenBuffer& tokens);
+        // Выдаёт токены, которые частями поступают из source, до токена Eof включительно
+        explicit Lexer(TokenSource& source);
 
         // Возвращает ссылку на текущий токен или token_type::Eof, если поток токенов закончился
         [[nodiscard]] const Token& CurrentToken() const;
 
-        // Возвращает следующий токен, либо token_type::Eof, если поток токенов закончился
-        Token NextToken();
+        // Положение текущего токена в исходном тексте
+        [[nodiscard]] const SourceSpan& CurrentSpan() const;
+
+        // Переходит к следующему токену и возвращает ссылку на него, либо token_type::Eof,
+        // если поток токенов закончился. Ссылка действительна до следующего перехода
+        const Token& NextToken();
+
+        // Возвращает токен, отстоящий от текущего на offset позиций, не переходя к нему.
+        // PeekToken(0) совпадает с CurrentToken(). offset должен быть меньше LOOKAHEAD_CAPACITY,
+        // иначе метод выбрасывает исключение LexerError
+        const Token& PeekToken(size_t offset = 1);
 
         // Если текущий токен имеет тип T, метод возвращает ссылку на него.
         // В противном случае метод выбрасывает исключение LexerError
@@ -126,7 +287,7 @@ namespace parse {
         // В противном случае метод выбрасывает исключение LexerError
         template <typename T>
         const T& ExpectNext() {
-            token_current_index_++;
+            Advance();
             return Expect<T>();
         }
 
@@ -134,64 +295,113 @@ namespace parse {
         // В противном случае метод выбрасывает исключение LexerError
         template <typename T, typename U>
         void ExpectNext(const U& value) {
-            token_current_index_++;
+            Advance();
             return Expect<T>(value);
         }
 
     private:
-        // Реализуйте приватную часть самостоятельно
-        std::istream& input_;
-        bool is_new_line_ = true;
-        int indent_ = 0;
-
-        std::vector<Token> tokens_;
-        size_t token_current_index_ = 0;
-
-
-        const std::unordered_map<std::string_view, Token> keywords_ = {
-                {"class", token_type::Class{}},
-                {"return", token_type::Return{}},
-                {"if", token_type::If{}},
-                {"else", token_type::Else{}},
-                {"def", token_type::Def{}},
-                {"print", token_type::Print{}},
-                {"or", token_type::Or{}},
-                {"None", token_type::None{}},
-                {"and", token_type::And{}},
-                {"not", token_type::Not{}},
-                {"True", token_type::True{}},
-                {"False", token_type::False{}},
+        // Последний выданный токен, от которого зависит обработка концов строк
+        enum class LastToken {
+            None,         // токенов ещё не было
+            Newline,
+            Indentation,  // Indent или Dedent
+            Other,
         };
 
+        // Переходит к следующему токену
+        void Advance();
 
-        Token FindNextToken();
+        // Читает из потока очередной токен и дописывает его в конец кольца просмотра
+        void ReadToken();
 
-        bool IsNumber(char token) {
-            return std::isdigit(token);
+        // Возвращает следующий токен потока: отложенный Indent/Dedent либо прочитанный из input_,
+        // и записывает в span его положение
+        Token ProduceToken(SourceSpan& span);
+
+        // Смещение очередного символа входных данных от начала программы
+        [[nodiscard]] size_t GetOffset() const {
+            return chunk_offset_ + static_cast<size_t>(position_ - chunk_begin_);
         }
 
-        bool IsId(char token) {
-            if (std::isalpha(token) || std::isdigit(token) || token == '_') return true;
-            return false;
+        // Запоминает положение начала лексемы, которую выделяет FindNextToken
+        void MarkTokenStart();
+
+        // Отмечает, что очередной символ начинает новую строку
+        void StartLine() {
+            ++line_;
+            line_offset_ = GetOffset();
         }
 
-        bool IsString(char token) {
-            if (token == '\'' || token == '\"') return true;
-            return false;
+        // Значение, которое Peek возвращает в конце входных данных
+        static constexpr int END_OF_INPUT = -1;
+
+        // Возвращает очередной символ входных данных, не извлекая его, либо END_OF_INPUT
+        int Peek() {
+            if (position_ == end_ && !Refill()) {
+                return END_OF_INPUT;
+            }
+            return static_cast<unsigned char>(*position_);
         }
 
+        // Извлекает очередной символ. Перед вызовом Peek должен вернуть не END_OF_INPUT
+        char Get() {
+            return *position_++;
+        }
 
+        // Читает из потока следующий блок. Возвращает false, если данные закончились
+        bool Refill();
+
+        // Извлекает символы, пока их распознаёт функция count, и возвращает их текст
+        TokenText ScanWhile(scan::ScanFunction count);
+
+        // Пропускает символы, пока их распознаёт функция count, и возвращает их количество
+        size_t SkipWhile(scan::ScanFunction count);
+
+        TokenText ScanString(char quote);
+
+        // Поток, из которого читается программа, либо nullptr, если программа находится в памяти
+        std::istream* input_ = nullptr;
+        std::string chunk_;
+        // Непрочитанная часть текущего блока либо программы в памяти
+        const char* position_ = nullptr;
+        const char* end_ = nullptr;
+        // Начало текущего блока и его смещение от начала программы
+        const char* chunk_begin_ = nullptr;
+        size_t chunk_offset_ = 0;
+        // Номер текущей строки и смещение её первого символа
+        std::uint32_t line_ = 1;
+        size_t line_offset_ = 0;
+        // Положение лексемы, которую выделяет FindNextToken
+        SourceSpan token_start_;
+        // Функции, которыми выделяются пробелы, комментарии, числа и идентификаторы
+        const scan::ScanKernels* kernels_ = &scan::GetDefaultScanKernels();
 
-        bool IsEof() {
-            if (!input_) return true;
-            char c = input_.get();
+        bool is_new_line_ = true;
+        int indent_ = 0;
 
-            if (input_.eof()) {
-                input_.putback(c);
-                return true;
-            }
-            input_.putback(c);
-            return false;
+        // Количество Indent (если положительно) либо Dedent (если отрицательно), которые нужно
+        // выдать перед тем, как продолжить чтение потока
+        int pending_indents_ = 0;
+        LastToken last_token_ = LastToken::None;
+        bool eof_ = false;
+
+        // Кольцо просмотра вперёд: текущий токен и уже прочитанные токены после него
+        std::array<Token, LOOKAHEAD_CAPACITY> lookahead_;
+        std::array<SourceSpan, LOOKAHEAD_CAPACITY> lookahead_spans_;
+        size_t lookahead_begin_ = 0;
+        size_t lookahead_size_ = 0;
+
+        // Буфер, токены которого выдаёт лексер, либо nullptr, если лексер разбирает текст
+        const TokenBuffer* replay_ = nullptr;
+        size_t replay_position_ = 0;
+        // Источник следующих частей буфера либо nullptr, если буфер содержит все токены
+        TokenSource* token_source_ = nullptr;
+
+
+        Token FindNextToken();
+
+        bool IsEof() {
+            return Peek() == END_OF_INPUT;
         }
 
     };
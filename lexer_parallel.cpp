@@ -0,0 +1,148 @@
+#include "lexer_parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <limits>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace parse {
+
+    namespace {
+
+        // Фрагментов больше, чем потоков, чтобы потоки, закончившие раньше, брали следующие
+        constexpr size_t CHUNKS_PER_THREAD = 4;
+
+        // Можно ли начать фрагмент с позиции position: это начало строки без отступа,
+        // а строка не пустая и не комментарий
+        bool IsSplitPoint(std::string_view source, size_t position) {
+            if (position == 0 || position >= source.size() || source[position - 1] != '\n') {
+                return false;
+            }
+            const char c = source[position];
+            return c != ' ' && c != '\n' && c != '#';
+        }
+
+        // Возвращает позицию первой границы фрагмента, не меньшей from, либо source.size()
+        size_t FindSplitPoint(std::string_view source, size_t from) {
+            for (size_t newline = source.find('\n', from > 0 ? from - 1 : 0); newline != std::string_view::npos;
+                 newline = source.find('\n', newline + 1)) {
+                if (IsSplitPoint(source, newline + 1)) {
+                    return newline + 1;
+                }
+            }
+            return source.size();
+        }
+
+        // Заканчивается ли text внутри строковой константы, если он начинается вне её.
+        // Строки и комментарии распознаются так же, как их распознаёт Lexer
+        bool EndsInsideString(std::string_view text) {
+            char quote = 0;
+            for (size_t i = 0; i < text.size(); ++i) {
+                const char c = text[i];
+                if (quote != 0) {
+                    if (c == '\\') {
+                        ++i;
+                    }
+                    else if (c == quote) {
+                        quote = 0;
+                    }
+                }
+                else if (c == '#') {
+                    i = text.find('\n', i);
+                    if (i == std::string_view::npos) {
+                        return false;
+                    }
+                }
+                else if (c == '\'' || c == '"') {
+                    quote = c;
+                }
+            }
+            return quote != 0;
+        }
+
+        struct ChunkTokens {
+            TokenBuffer tokens;
+            bool ends_inside_string = false;
+            // Ошибка разбора. Её нужно выбросить, только если граница фрагмента оказалась верной
+            std::exception_ptr error;
+        };
+
+        ChunkTokens LexChunk(std::string_view chunk) {
+            ChunkTokens result;
+            try {
+                Lexer lexer(chunk);
+                result.tokens = TokenBuffer::Read(lexer);
+            }
+            catch (...) {
+                result.error = std::current_exception();
+            }
+            result.ends_inside_string = EndsInsideString(chunk);
+            return result;
+        }
+
+    }  // namespace
+
+    TokenBuffer LexInParallel(std::string_view source, size_t thread_count, size_t min_chunk_size) {
+        if (source.size() > std::numeric_limits<std::uint32_t>::max()) {
+            throw LexerError("Program is too large: "s + std::to_string(source.size()) + " bytes"s);
+        }
+
+        thread_count = std::max<size_t>(thread_count, 1);
+        const size_t chunk_size = std::max({ source.size() / (thread_count * CHUNKS_PER_THREAD), min_chunk_size, size_t{ 1 } });
+        std::vector<size_t> bounds{ 0 };
+        while (bounds.back() < source.size()) {
+            bounds.push_back(FindSplitPoint(source, bounds.back() + chunk_size));
+        }
+        if (bounds.size() <= 2 || thread_count == 1) {
+            Lexer lexer(source);
+            return TokenBuffer::Read(lexer);
+        }
+
+        const size_t chunk_count = bounds.size() - 1;
+        std::vector<ChunkTokens> chunks(chunk_count);
+        std::atomic<size_t> next_chunk = 0;
+        auto work = [&] {
+            for (size_t i = next_chunk++; i < chunk_count; i = next_chunk++) {
+                chunks[i] = LexChunk(source.substr(bounds[i], bounds[i + 1] - bounds[i]));
+            }
+        };
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < std::min(thread_count, chunk_count); ++i) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        // Токены фрагментов склеиваются, Eof остаётся только у последнего
+        TokenBuffer tokens;
+        std::uint32_t line = 1;
+        for (size_t first = 0; first < chunk_count;) {
+            size_t last = first + 1;
+            ChunkTokens* chunk = &chunks[first];
+            ChunkTokens merged;
+            // Граница last находится внутри строки: фрагмент продолжается до следующей границы
+            while (last < chunk_count && chunk->ends_inside_string) {
+                ++last;
+                merged = LexChunk(source.substr(bounds[first], bounds[last] - bounds[first]));
+                chunk = &merged;
+            }
+            if (chunk->error) {
+                std::rethrow_exception(chunk->error);
+            }
+
+            const TokenBuffer& chunk_tokens = chunk->tokens;
+            const size_t count = last == chunk_count ? chunk_tokens.size() : chunk_tokens.size() - 1;
+            tokens.Append(chunk_tokens, count, static_cast<std::uint32_t>(bounds[first]), line);
+            line += chunk_tokens.GetSpan(chunk_tokens.size() - 1).line - 1;
+            first = last;
+        }
+        return tokens;
+    }
+
+}  // namespace parse
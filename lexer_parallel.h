@@ -0,0 +1,23 @@
+#pragma once
+
+#include "token_buffer.h"
+
+#include <string_view>
+
+namespace parse {
+
+    // Минимальный размер фрагмента программы, который лексер разбирает в отдельном потоке
+    inline constexpr size_t DEFAULT_MIN_LEXING_CHUNK_SIZE = 256 * 1024;
+
+    // Выделяет токены программы source в thread_count потоках и возвращает их в том же виде,
+    // что и TokenBuffer::Read(Lexer(source)): токены, их значения и положения совпадают.
+    // Программа делится на фрагменты не короче min_chunk_size байт по началам строк без отступа,
+    // которые не являются комментариями. Каждый фрагмент разбирается отдельным лексером:
+    // в начале такой строки лексер закрывает все блоки, поэтому Dedent, выданные в конце
+    // фрагмента, совпадают с теми, что выдал бы лексер всей программы. Если граница оказалась
+    // внутри многострочной строковой константы, соседние фрагменты разбираются заново вместе.
+    // Строки, как и у Lexer(std::string_view), ссылаются на source
+    [[nodiscard]] TokenBuffer LexInParallel(std::string_view source, size_t thread_count,
+        size_t min_chunk_size = DEFAULT_MIN_LEXING_CHUNK_SIZE);
+
+}  // namespace parse
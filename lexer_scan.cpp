@@ -0,0 +1,241 @@
+#include "lexer_scan.h"
+
+#include <atomic>
+#include <initializer_list>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define MYTHON_SCAN_SSE2 1
+// AVX2-функции компилируются с атрибутом target и вызываются только после проверки процессора
+#if defined(__GNUC__)
+#define MYTHON_SCAN_AVX2 1
+#endif
+#endif
+
+namespace parse::scan {
+
+    namespace {
+
+        template <typename Predicate>
+        size_t CountScalar(const char* begin, const char* end, Predicate predicate) {
+            const char* p = begin;
+            while (p != end && predicate(*p)) {
+                ++p;
+            }
+            return static_cast<size_t>(p - begin);
+        }
+
+        size_t CountSpacesScalar(const char* begin, const char* end) {
+            return CountScalar(begin, end, [](char c) {
+                return c == ' ';
+            });
+        }
+
+        size_t CountUntilNewlineScalar(const char* begin, const char* end) {
+            return CountScalar(begin, end, [](char c) {
+                return c != '\n';
+            });
+        }
+
+        size_t CountIdCharsScalar(const char* begin, const char* end) {
+            return CountScalar(begin, end, IsIdChar);
+        }
+
+        size_t CountDigitsScalar(const char* begin, const char* end) {
+            return CountScalar(begin, end, IsDigit);
+        }
+
+        constexpr ScanKernels SCALAR_KERNELS = {
+            CountSpacesScalar,
+            CountUntilNewlineScalar,
+            CountIdCharsScalar,
+            CountDigitsScalar,
+        };
+
+#ifdef MYTHON_SCAN_SSE2
+
+        // Векторные функции возвращают для каждого байта блока 0xFF, если байт относится к классу
+
+        __m128i MatchSpaces(__m128i chars) {
+            return _mm_cmpeq_epi8(chars, _mm_set1_epi8(' '));
+        }
+
+        __m128i MatchNotNewline(__m128i chars) {
+            return _mm_xor_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')), _mm_set1_epi8(-1));
+        }
+
+        // Байты больше 0x7F отрицательны при знаковом сравнении и не попадают ни в один диапазон
+        __m128i MatchRange(__m128i chars, char first, char last) {
+            return _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(static_cast<char>(first - 1))),
+                _mm_cmplt_epi8(chars, _mm_set1_epi8(static_cast<char>(last + 1))));
+        }
+
+        __m128i MatchDigits(__m128i chars) {
+            return MatchRange(chars, '0', '9');
+        }
+
+        __m128i MatchIdChars(__m128i chars) {
+            // Установка бита 0x20 переводит заглавные буквы в строчные
+            const __m128i letters = MatchRange(_mm_or_si128(chars, _mm_set1_epi8(0x20)), 'a', 'z');
+            const __m128i underscores = _mm_cmpeq_epi8(chars, _mm_set1_epi8('_'));
+            return _mm_or_si128(_mm_or_si128(letters, underscores), MatchDigits(chars));
+        }
+
+        template <__m128i (*Match)(__m128i), bool (*Scalar)(char)>
+        size_t CountSse2(const char* begin, const char* end) {
+            const char* p = begin;
+            while (end - p >= 16) {
+                const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                const unsigned mismatches = ~static_cast<unsigned>(_mm_movemask_epi8(Match(chars))) & 0xFFFFu;
+                if (mismatches != 0) {
+                    return static_cast<size_t>(p - begin) + static_cast<size_t>(__builtin_ctz(mismatches));
+                }
+                p += 16;
+            }
+            return static_cast<size_t>(p - begin) + CountScalar(p, end, Scalar);
+        }
+
+        bool IsSpace(char c) {
+            return c == ' ';
+        }
+
+        bool IsNotNewline(char c) {
+            return c != '\n';
+        }
+
+        constexpr ScanKernels SSE2_KERNELS = {
+            CountSse2<MatchSpaces, IsSpace>,
+            CountSse2<MatchNotNewline, IsNotNewline>,
+            CountSse2<MatchIdChars, IsIdChar>,
+            CountSse2<MatchDigits, IsDigit>,
+        };
+
+#endif
+
+#ifdef MYTHON_SCAN_AVX2
+
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+
+        AVX2_FUNCTION __m256i MatchSpaces256(__m256i chars) {
+            return _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(' '));
+        }
+
+        AVX2_FUNCTION __m256i MatchNotNewline256(__m256i chars) {
+            return _mm256_xor_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\n')), _mm256_set1_epi8(-1));
+        }
+
+        AVX2_FUNCTION __m256i MatchRange256(__m256i chars, char first, char last) {
+            return _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8(static_cast<char>(first - 1))),
+                _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(last + 1)), chars));
+        }
+
+        AVX2_FUNCTION __m256i MatchDigits256(__m256i chars) {
+            return MatchRange256(chars, '0', '9');
+        }
+
+        AVX2_FUNCTION __m256i MatchIdChars256(__m256i chars) {
+            const __m256i letters = MatchRange256(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)), 'a', 'z');
+            const __m256i underscores = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('_'));
+            return _mm256_or_si256(_mm256_or_si256(letters, underscores), MatchDigits256(chars));
+        }
+
+        template <__m256i (*Match)(__m256i), bool (*Scalar)(char)>
+        AVX2_FUNCTION size_t CountAvx2(const char* begin, const char* end) {
+            const char* p = begin;
+            while (end - p >= 32) {
+                const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+                const unsigned mismatches = ~static_cast<unsigned>(_mm256_movemask_epi8(Match(chars)));
+                if (mismatches != 0) {
+                    return static_cast<size_t>(p - begin) + static_cast<size_t>(__builtin_ctz(mismatches));
+                }
+                p += 32;
+            }
+            return static_cast<size_t>(p - begin) + CountScalar(p, end, Scalar);
+        }
+
+#undef AVX2_FUNCTION
+
+        constexpr ScanKernels AVX2_KERNELS = {
+            CountAvx2<MatchSpaces256, IsSpace>,
+            CountAvx2<MatchNotNewline256, IsNotNewline>,
+            CountAvx2<MatchIdChars256, IsIdChar>,
+            CountAvx2<MatchDigits256, IsDigit>,
+        };
+
+#endif
+
+        std::atomic<const ScanKernels*>& DefaultKernels() {
+            static std::atomic<const ScanKernels*> kernels{ &GetScanKernels(GetBestScanLevel()) };
+            return kernels;
+        }
+
+    }  // namespace
+
+    bool IsScanLevelSupported(ScanLevel level) {
+        switch (level) {
+        case ScanLevel::Scalar:
+            return true;
+        case ScanLevel::Sse2:
+#ifdef MYTHON_SCAN_SSE2
+            return true;
+#else
+            return false;
+#endif
+        case ScanLevel::Avx2:
+#ifdef MYTHON_SCAN_AVX2
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+        }
+        return false;
+    }
+
+    ScanLevel GetBestScanLevel() {
+        for (ScanLevel level : { ScanLevel::Avx2, ScanLevel::Sse2 }) {
+            if (IsScanLevelSupported(level)) {
+                return level;
+            }
+        }
+        return ScanLevel::Scalar;
+    }
+
+    const ScanKernels& GetScanKernels(ScanLevel level) {
+        if (!IsScanLevelSupported(level)) {
+            return SCALAR_KERNELS;
+        }
+        switch (level) {
+#ifdef MYTHON_SCAN_SSE2
+        case ScanLevel::Sse2:
+            return SSE2_KERNELS;
+#endif
+#ifdef MYTHON_SCAN_AVX2
+        case ScanLevel::Avx2:
+            return AVX2_KERNELS;
+#endif
+        default:
+            return SCALAR_KERNELS;
+        }
+    }
+
+    const ScanKernels& GetDefaultScanKernels() {
+        return *DefaultKernels().load(std::memory_order_relaxed);
+    }
+
+    void SetDefaultScanLevel(ScanLevel level) {
+        DefaultKernels().store(&GetScanKernels(level), std::memory_order_relaxed);
+    }
+
+    const char* GetScanLevelName(ScanLevel level) {
+        switch (level) {
+        case ScanLevel::Scalar:
+            return "scalar";
+        case ScanLevel::Sse2:
+            return "sse2";
+        case ScanLevel::Avx2:
+            return "avx2";
+        }
+        return "unknown";
+    }
+
+}  // namespace parse::scan
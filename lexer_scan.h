@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace parse::scan {
+
+    // Класс символа, по которому лексер определяет, какой токен начинается с этого символа.
+    // Классы не зависят от локали: буквами считаются только буквы латинского алфавита
+    enum class CharClass : std::uint8_t {
+        Other,    // одиночный символ либо начало составного оператора (==, !=, <=, >=)
+        Space,    // ' '
+        Newline,  // '\n'
+        Digit,
+        Letter,   // буква латинского алфавита либо '_', с которых начинается идентификатор
+        Quote,    // ' либо ", с которых начинается строка
+        Comment,  // '#'
+    };
+
+    namespace detail {
+
+        constexpr std::array<CharClass, 256> MakeCharClasses() {
+            std::array<CharClass, 256> classes{};
+            for (int c = 0; c < 256; ++c) {
+                CharClass cls = CharClass::Other;
+                if (c >= '0' && c <= '9') {
+                    cls = CharClass::Digit;
+                }
+                else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') {
+                    cls = CharClass::Letter;
+                }
+                else if (c == ' ') {
+                    cls = CharClass::Space;
+                }
+                else if (c == '\n') {
+                    cls = CharClass::Newline;
+                }
+                else if (c == '\'' || c == '"') {
+                    cls = CharClass::Quote;
+                }
+                else if (c == '#') {
+                    cls = CharClass::Comment;
+                }
+                classes[c] = cls;
+            }
+            return classes;
+        }
+
+    }  // namespace detail
+
+    // Классы всех 256 значений байта, вычисленные при компиляции
+    inline constexpr std::array<CharClass, 256> CHAR_CLASSES = detail::MakeCharClasses();
+
+    constexpr CharClass GetCharClass(char c) {
+        return CHAR_CLASSES[static_cast<unsigned char>(c)];
+    }
+
+    constexpr bool IsDigit(char c) {
+        return GetCharClass(c) == CharClass::Digit;
+    }
+
+    // Символ, который может входить в идентификатор
+    constexpr bool IsIdChar(char c) {
+        const CharClass cls = GetCharClass(c);
+        return cls == CharClass::Letter || cls == CharClass::Digit;
+    }
+
+    // Функция сканирования: возвращает количество символов в начале диапазона [begin, end),
+    // относящихся к классу, который распознаёт функция
+    using ScanFunction = size_t (*)(const char* begin, const char* end);
+
+    // Набор функций сканирования, которыми лексер находит границы токенов
+    struct ScanKernels {
+        ScanFunction count_spaces;       // пробелы ' '
+        ScanFunction count_until_newline;  // любые символы, кроме '\n'
+        ScanFunction count_id_chars;     // буквы латинского алфавита, цифры и '_'
+        ScanFunction count_digits;       // цифры
+    };
+
+    // Реализация функций сканирования. Векторные реализации обрабатывают 16 (SSE2) или 32 (AVX2)
+    // байта за одну итерацию, остаток диапазона обрабатывается скалярным кодом
+    enum class ScanLevel {
+        Scalar,  // переносимая реализация, обрабатывающая по одному символу
+        Sse2,
+        Avx2,
+    };
+
+    // Возвращает true, если процессор и компилятор поддерживают реализацию level
+    [[nodiscard]] bool IsScanLevelSupported(ScanLevel level);
+
+    // Возвращает наилучшую реализацию, поддерживаемую процессором
+    [[nodiscard]] ScanLevel GetBestScanLevel();
+
+    // Возвращает функции реализации level. Если она не поддерживается, возвращает скалярные функции
+    [[nodiscard]] const ScanKernels& GetScanKernels(ScanLevel level);
+
+    // Возвращает функции, которые используют вновь создаваемые лексеры.
+    // По умолчанию это функции наилучшей поддерживаемой реализации
+    [[nodiscard]] const ScanKernels& GetDefaultScanKernels();
+
+    // Задаёт реализацию, которую будут использовать вновь создаваемые лексеры
+    // (например, чтобы сравнить реализации в бенчмарке)
+    void SetDefaultScanLevel(ScanLevel level);
+
+    [[nodiscard]] const char* GetScanLevelName(ScanLevel level);
+
+}  // namespace parse::scan
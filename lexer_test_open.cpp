@@ -1,5 +1,7 @@
 #include "lexer.h"
+#include "lexer_parallel.h"
 #include "test_runner_p.h"
+#include "token_buffer.h"
 
 #include <sstream>
 #include <string>
@@ -40,6 +42,25 @@ void TestKeywords() {
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::False{}));
 }
 
+void TestKeywordLookalikes() {
+    // Идентификаторы, совпадающие с ключевыми словами по длине, первой или последней букве
+    const string ids[] = {"classy"s, "clas"s, "cLass"s, "If"s, "fi"s, "of"s, "none"s, "Nune"s, "dee"s,
+        "print_"s, "_if"s, "True1"s, "false"s, "an"s, "nod"s, "returns"s, "elsE"s, "x"s, "_"s};
+    for (const string& id : ids) {
+        istringstream input(id);
+        Lexer lexer(input);
+        ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{id}));
+    }
+
+    // Классы символов не зависят от локали: буквами считаются только буквы латинского алфавита
+    ASSERT(scan::GetCharClass('_') == scan::CharClass::Letter);
+    ASSERT(scan::GetCharClass('Z') == scan::CharClass::Letter);
+    ASSERT(scan::GetCharClass('7') == scan::CharClass::Digit);
+    ASSERT(scan::GetCharClass('\'') == scan::CharClass::Quote);
+    ASSERT(scan::GetCharClass('\t') == scan::CharClass::Other);
+    ASSERT(scan::GetCharClass(static_cast<char>(0xE9)) == scan::CharClass::Other);
+}
+
 void TestNumbers() {
     istringstream input("42 15 -53"s);
     Lexer lexer(input);
@@ -351,11 +372,327 @@ abc#
         ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
     }
 }
+void TestTokensAreReadOnDemand() {
+    string program;
+    for (int i = 0; i < 1000; ++i) {
+        program += "x = x + 1\n"s;
+    }
+    istringstream input(program);
+    Lexer lexer(input);
+
+    // Лексер прочитал только первую строку программы
+    ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{"x"s}));
+    ASSERT(input.tellg() < 16);
+
+    size_t newlines = 0;
+    for (Token token = lexer.CurrentToken(); !token.Is<token_type::Eof>(); token = lexer.NextToken()) {
+        newlines += token.Is<token_type::Newline>();
+    }
+    ASSERT_EQUAL(newlines, 1000U);
+}
+
+void TestPeekToken() {
+    istringstream input("if x:\n  y\n"s);
+    Lexer lexer(input);
+
+    ASSERT_EQUAL(lexer.PeekToken(0), Token(token_type::If{}));
+    ASSERT_EQUAL(lexer.PeekToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.PeekToken(3), Token(token_type::Newline{}));
+    ASSERT_THROWS(lexer.PeekToken(Lexer::LOOKAHEAD_CAPACITY), LexerError);
+    ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::If{}));
+
+    // Просмотренные токены выдаются по порядку, после них чтение потока продолжается
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{':'}));
+    ASSERT_EQUAL(lexer.PeekToken(3), Token(token_type::Id{"y"s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"y"s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+    ASSERT_EQUAL(lexer.PeekToken(3), Token(token_type::Eof{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Dedent{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
+}
+void TestLexingFromMemory() {
+    const string source = "x = 'abc' + \"a\\tb\" + 'a\\'b'\nprint x, 12\n"s;
+    auto is_inside_source = [&source](string_view text) {
+        return text.data() >= source.data() && text.data() + text.size() <= source.data() + source.size();
+    };
+    Lexer lexer{ string_view(source) };
+
+    // Идентификаторы регистрируются в таблице символов
+    ASSERT_EQUAL(lexer.Expect<token_type::Id>().value, runtime::Symbol("x"s));
+
+    // Строки без escape-последовательностей ссылаются на исходный текст
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
+    const auto& abc = lexer.ExpectNext<token_type::String>();
+    ASSERT(abc.value.IsView() && is_inside_source(abc.value.GetView()));
+    ASSERT_EQUAL(abc.value, "abc"s);
+
+    // Строки с escape-последовательностями копируются
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'+'}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{"a\tb"s}));
+    ASSERT(!lexer.CurrentToken().As<token_type::String>().value.IsView());
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'+'}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{"a'b"s}));
+
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Print{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{','}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{12}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
+
+    // Из потока текст токенов копируется, так как блок потока перезаписывается
+    istringstream input(source);
+    Lexer stream_lexer(input);
+    stream_lexer.NextToken();
+    ASSERT(!stream_lexer.ExpectNext<token_type::String>().value.IsView());
+}
+
+void TestTokensCrossStreamChunks() {
+    // Идентификатор начинается в одном блоке потока и заканчивается в следующем
+    const string long_id(Lexer::STREAM_CHUNK_SIZE + 10, 'a');
+    istringstream input("xy "s + long_id + " 'str'\n"s);
+    Lexer lexer(input);
+
+    ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{"xy"s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{long_id}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{"str"s}));
+    // Смещения отсчитываются от начала программы, а не блока
+    ASSERT_EQUAL(lexer.CurrentSpan().offset, long_id.size() + 4);
+    ASSERT_EQUAL(lexer.CurrentSpan().column, long_id.size() + 5);
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
+}
+
+void TestLongBlankAndCommentRuns() {
+    // Пропуск пробелов, комментариев и пустых строк не углубляет стек
+    string source = "x = 1\n"s;
+    for (int i = 0; i < 20000; ++i) {
+        source += "\n# comment\n    \n"s;
+    }
+    source += "print x\n"s;
+    Lexer lexer(source);
+
+    for (int i = 0; i < 4; ++i) {
+        lexer.NextToken();
+    }
+    ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Print{}));
+    ASSERT_EQUAL(lexer.CurrentSpan().line, 60002U);
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
+}
+
+bool SpanIs(const SourceSpan& span, size_t offset, size_t length, size_t line, size_t column) {
+    return span.offset == offset && span.length == length && span.line == line && span.column == column;
+}
+
+void TestTokenSpans() {
+    const string source = "x = 'a\nb'\nif x:\n  print 12 # c\n"s;
+    istringstream input(source);
+    Lexer stream_lexer(input);
+    Lexer memory_lexer{ string_view(source) };
+
+    for (Lexer* lexer : { &stream_lexer, &memory_lexer }) {
+        ASSERT(SpanIs(lexer->CurrentSpan(), 0, 1, 1, 1));   // x
+        lexer->NextToken();
+        ASSERT(SpanIs(lexer->CurrentSpan(), 2, 1, 1, 3));   // =
+        // Строка занимает две строки программы
+        lexer->NextToken();
+        ASSERT(SpanIs(lexer->CurrentSpan(), 4, 5, 1, 5));
+        lexer->NextToken();
+        ASSERT(SpanIs(lexer->CurrentSpan(), 9, 1, 2, 3));   // Newline
+        lexer->NextToken();
+        ASSERT(SpanIs(lexer->CurrentSpan(), 10, 2, 3, 1));  // if
+        lexer->NextToken();
+        lexer->NextToken();
+        lexer->NextToken();
+        ASSERT(SpanIs(lexer->CurrentSpan(), 15, 1, 3, 6));  // Newline
+        // Indent покрывает отступ
+        ASSERT_EQUAL(lexer->NextToken(), Token(token_type::Indent{}));
+        ASSERT(SpanIs(lexer->CurrentSpan(), 16, 2, 4, 1));
+        lexer->NextToken();
+        ASSERT(SpanIs(lexer->CurrentSpan(), 18, 5, 4, 3));  // print
+        lexer->NextToken();
+        ASSERT(SpanIs(lexer->CurrentSpan(), 24, 2, 4, 9));  // 12
+        ASSERT_EQUAL(lexer->NextToken(), Token(token_type::Newline{}));
+        ASSERT(SpanIs(lexer->CurrentSpan(), 30, 1, 4, 15));
+        ASSERT_EQUAL(lexer->NextToken(), Token(token_type::Dedent{}));
+        ASSERT(SpanIs(lexer->CurrentSpan(), 31, 0, 5, 1));
+        ASSERT_EQUAL(lexer->NextToken(), Token(token_type::Eof{}));
+        ASSERT(SpanIs(lexer->CurrentSpan(), 31, 0, 5, 1));
+    }
+}
+
+void TestTokenBuffer() {
+    const string source = "class A:\n  def f(x):\n    return 'a\\tb' + 'c'\n\nprint A().f(-5), None\n"s;
+    Lexer lexer{ string_view(source) };
+    const TokenBuffer tokens = TokenBuffer::Read(lexer);
+    ASSERT(lexer.CurrentToken().Is<token_type::Eof>());
+
+    // Токены буфера совпадают с токенами, выделенными из текста
+    Lexer expected{ string_view(source) };
+    for (size_t i = 0; i < tokens.size(); ++i, expected.NextToken()) {
+        ASSERT_EQUAL(tokens.Get(i), expected.CurrentToken());
+        ASSERT(tokens.GetKind(i) == expected.CurrentToken().GetKind());
+        ASSERT(SpanIs(tokens.GetSpan(i), expected.CurrentSpan().offset, expected.CurrentSpan().length,
+            expected.CurrentSpan().line, expected.CurrentSpan().column));
+    }
+    ASSERT(tokens.Is<token_type::Class>(0) && tokens.Is<token_type::Id>(1) && tokens.Is<token_type::Eof>(tokens.size() - 1));
+    // Строка без escape-последовательностей по-прежнему ссылается на исходный текст
+    ASSERT(tokens.Get(16).As<token_type::String>().value.IsView());
+
+    // Лексер, читающий буфер, поддерживает тот же интерфейс и повторяет Eof
+    Lexer replay(tokens);
+    replay.Expect<token_type::Class>();
+    replay.ExpectNext<token_type::Id>(runtime::Symbol("A"s));
+    ASSERT_EQUAL(replay.PeekToken(3), Token(token_type::Indent{}));
+    ASSERT(SpanIs(replay.CurrentSpan(), 6, 1, 1, 7));
+    while (!replay.CurrentToken().Is<token_type::Eof>()) {
+        replay.NextToken();
+    }
+    ASSERT_EQUAL(replay.NextToken(), Token(token_type::Eof{}));
+
+    ASSERT_THROWS(Lexer{ TokenBuffer{} }, LexerError);
+}
+
+// Проверяет, что LexInParallel выделяет из source те же токены, что и Lexer
+void CheckParallelLexing(const string& source, size_t thread_count, size_t min_chunk_size) {
+    Lexer lexer{ string_view(source) };
+    const TokenBuffer expected = TokenBuffer::Read(lexer);
+    const TokenBuffer tokens = LexInParallel(source, thread_count, min_chunk_size);
+
+    ASSERT_EQUAL(tokens.size(), expected.size());
+    size_t mismatches = 0;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        const SourceSpan& span = expected.GetSpan(i);
+        if (tokens.Get(i) != expected.Get(i)
+            || !SpanIs(tokens.GetSpan(i), span.offset, span.length, span.line, span.column)) {
+            ++mismatches;
+        }
+    }
+    ASSERT_EQUAL(mismatches, 0u);
+}
+
+void TestParallelLexing() {
+    const string program = R"(class A:
+  def f(x):
+    if x:
+      return 'a' + "b\"
+c"
+    return 1
+# комментарий без отступа
+class B(A):
+  def g():
+    return 'многострочная
+x = 1
+строка'
+
+x = A()
+print x.f(1), """, 'y'
+  z = 2
+if z:
+  print 1)"s;
+
+    // Чем меньше фрагменты, тем больше границ, в том числе внутри строк
+    for (size_t min_chunk_size : { 1u, 7u, 30u, 1000u }) {
+        CheckParallelLexing(program, 4, min_chunk_size);
+        CheckParallelLexing(program + "\n"s, 3, min_chunk_size);
+    }
+    CheckParallelLexing(""s, 4, 1);
+    CheckParallelLexing("\n\n  \n"s, 4, 1);
+
+    // Число вне диапазона внутри строки не является ошибкой, а вне строки - является
+    CheckParallelLexing("s = '\n99999999999\n'\nprint s\n"s, 4, 1);
+    ASSERT_THROWS(static_cast<void>(LexInParallel("x = 1\ny = 99999999999\nz = 2\n"s, 4, 1)), LexerError);
+}
+
+void TestScanKernels() {
+    using scan::ScanLevel;
+
+    const scan::ScanKernels& scalar = scan::GetScanKernels(ScanLevel::Scalar);
+    for (ScanLevel level : {ScanLevel::Sse2, ScanLevel::Avx2}) {
+        if (!scan::IsScanLevelSupported(level)) {
+            continue;
+        }
+        const scan::ScanKernels& kernels = scan::GetScanKernels(level);
+        const pair<scan::ScanFunction, scan::ScanFunction> functions[] = {
+            {kernels.count_spaces, scalar.count_spaces},
+            {kernels.count_until_newline, scalar.count_until_newline},
+            {kernels.count_id_chars, scalar.count_id_chars},
+            {kernels.count_digits, scalar.count_digits},
+        };
+        const string fillers = " x_Z9"s;
+
+        // Любой байт в начале, середине и конце блока и байты на границах классов в любой позиции
+        // блока и его остатка, обрабатываемого скалярным кодом
+        const string boundaries = "\0\n /09:@AZ[_`az{\x7f\x80\xff"s;
+        for (auto [function, expected] : functions) {
+            for (char filler : fillers) {
+                for (size_t size : {1, 15, 16, 17, 31, 32, 33, 70}) {
+                    // ASSERT_EQUAL в цикле слишком дорог, поэтому проверяется количество расхождений
+                    size_t mismatches = 0;
+                    string buffer(size, filler);
+                    auto check = [&, function = function, expected = expected](size_t pos, char c) {
+                        buffer[pos] = c;
+                        const char* begin = buffer.data();
+                        mismatches += function(begin, begin + size) != expected(begin, begin + size) ? 1 : 0;
+                        buffer[pos] = filler;
+                    };
+                    for (size_t pos : {size_t{0}, size / 2, size - 1}) {
+                        for (int c = 0; c < 256; ++c) {
+                            check(pos, static_cast<char>(c));
+                        }
+                    }
+                    for (size_t pos = 0; pos < size; ++pos) {
+                        for (char c : boundaries) {
+                            check(pos, c);
+                        }
+                    }
+                    ASSERT_EQUAL(mismatches, 0U);
+                }
+            }
+            ASSERT_EQUAL(function(nullptr, nullptr), 0U);
+        }
+    }
+
+    // Все реализации выделяют одинаковые токены
+    const string program = "class A:\n  def f(x):  # "s + string(40, '#') + "\n    return x_1 + 1234567890\n"s;
+    for (ScanLevel level : {ScanLevel::Scalar, ScanLevel::Sse2, ScanLevel::Avx2}) {
+        scan::SetDefaultScanLevel(level);
+        Lexer lexer(string_view{program});
+        scan::SetDefaultScanLevel(scan::GetBestScanLevel());
+
+        ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Class{}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"A"s}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{':'}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Def{}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"f"s}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'('}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x"s}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{')'}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{':'}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Return{}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x_1"s}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'+'}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{1234567890}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+    }
+}
 }  // namespace
 
 void RunOpenLexerTests(TestRunner& tr) {
     RUN_TEST(tr, parse::TestSimpleAssignment);
     RUN_TEST(tr, parse::TestKeywords);
+    RUN_TEST(tr, parse::TestKeywordLookalikes);
     RUN_TEST(tr, parse::TestNumbers);
     RUN_TEST(tr, parse::TestIds);
     RUN_TEST(tr, parse::TestStrings);
@@ -367,6 +704,15 @@ void RunOpenLexerTests(TestRunner& tr) {
     RUN_TEST(tr, parse::TestMythonProgram);
     RUN_TEST(tr, parse::TestAlwaysEmitsNewlineAtTheEndOfNonemptyLine);
     RUN_TEST(tr, parse::TestCommentsAreIgnored);
+    RUN_TEST(tr, parse::TestTokensAreReadOnDemand);
+    RUN_TEST(tr, parse::TestPeekToken);
+    RUN_TEST(tr, parse::TestLexingFromMemory);
+    RUN_TEST(tr, parse::TestTokensCrossStreamChunks);
+    RUN_TEST(tr, parse::TestLongBlankAndCommentRuns);
+    RUN_TEST(tr, parse::TestTokenSpans);
+    RUN_TEST(tr, parse::TestTokenBuffer);
+    RUN_TEST(tr, parse::TestParallelLexing);
+    RUN_TEST(tr, parse::TestScanKernels);
 }
 
 }  // namespace parse
\ No newline at end of file
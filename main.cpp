@@ -1,10 +1,18 @@
-﻿#include "lexer.h"
+﻿#include "flat_ast.h"
+#include "lexer.h"
+#include "lexer_parallel.h"
+#include "mapped_file.h"
 #include "parse.h"
+#include "pass_manager.h"
+#include "pipeline.h"
 #include "runtime.h"
 #include "statement.h"
 #include "test_runner_p.h"
+#include "vm.h"
 
+#include <charconv>
 #include <iostream>
+#include <string_view>
 
 using namespace std;
 
@@ -19,18 +27,69 @@ namespace runtime {
     void RunObjectHolderTests(TestRunner& tr);
     void RunObjectsTests(TestRunner& tr);
 }  // namespace runtime
+namespace bytecode {
+    void RunVirtualMachineTests(TestRunner& tr);
+}  // namespace bytecode
+namespace flat {
+    void RunFlatAstTests(TestRunner& tr);
+}  // namespace flat
+namespace optimizer {
+    void RunOptimizerTests(TestRunner& tr);
+    void RunPassManagerTests(TestRunner& tr);
+}  // namespace optimizer
 
 void TestParseProgram(TestRunner& tr);
 
 namespace {
 
-    void RunMythonProgram(istream& input, ostream& output) {
-        parse::Lexer lexer(input);
-        auto program = ParseProgram(lexer);
-
+    // Способ выполнения программы
+    enum class Engine {
+        TreeWalker,  // рекурсивный обход дерева разбора (эталонная реализация)
+        Bytecode,    // компиляция в байт-код и выполнение виртуальной машиной
+        Flat,        // вычисление дерева, записанного в плоский массив узлов
+    };
+
+    // Выполняет программу. Если pipelined равен true, инструкции выполняются по мере разбора
+    // программы в других потоках (см. pipeline::RunPipelined). Если passes не равен nullptr,
+    // перед выполнением над деревом разбора выполняются проходы оптимизатора passes
+    void RunMythonProgram(parse::Lexer& lexer, ostream& output, Engine engine = Engine::TreeWalker,
+        bool pipelined = false, optimizer::PassManager* passes = nullptr) {
         runtime::SimpleContext context{ output };
+        if (pipelined) {
+            pipeline::Executor executor = pipeline::Executor::TreeWalker;
+            if (engine == Engine::Bytecode) {
+                executor = pipeline::Executor::VirtualMachine;
+            }
+            else if (engine == Engine::Flat) {
+                executor = pipeline::Executor::FlatEvaluator;
+            }
+            pipeline::RunPipelined(lexer, context, executor, passes);
+            return;
+        }
+
+        auto program = ParseProgram(lexer);
+        if (passes != nullptr) {
+            passes->Run(program);
+        }
         runtime::Closure closure;
-        program->Execute(closure, context);
+        if (engine == Engine::Bytecode) {
+            bytecode::Chunk chunk = bytecode::Compile(*program);
+            bytecode::VirtualMachine vm(context);
+            vm.Run(chunk, closure);
+        }
+        else if (engine == Engine::Flat) {
+            const flat::Program flat_program = flat::Flatten(*program);
+            flat::Evaluator(context).Run(flat_program, closure);
+        }
+        else {
+            program->Execute(closure, context);
+        }
+    }
+
+    void RunMythonProgram(istream& input, ostream& output, Engine engine = Engine::TreeWalker,
+        bool pipelined = false, optimizer::PassManager* passes = nullptr) {
+        parse::Lexer lexer(input);
+        RunMythonProgram(lexer, output, engine, pipelined, passes);
     }
 
     void TestSimplePrints() {
@@ -118,6 +177,10 @@ print y.value
         runtime::RunObjectsTests(tr);
         ast::RunUnitTests(tr);
         TestParseProgram(tr);
+        bytecode::RunVirtualMachineTests(tr);
+        flat::RunFlatAstTests(tr);
+        optimizer::RunOptimizerTests(tr);
+        optimizer::RunPassManagerTests(tr);
 
         RUN_TEST(tr, TestSimplePrints);
         RUN_TEST(tr, TestAssignments);
@@ -125,13 +188,154 @@ print y.value
         RUN_TEST(tr, TestVariablesArePointers);
     }
 
+    struct Options {
+        Engine engine = Engine::TreeWalker;
+        // Вывести в std::cerr счётчики встроенных кэшей методов после выполнения программы
+        bool cache_stats = false;
+        // Количество потоков, в которых выделяются токены программы из файла
+        size_t lex_threads = 1;
+        // Выполнять инструкции программы по мере её разбора в других потоках
+        bool pipeline = false;
+        // Файл с программой. Если не задан, программа читается из стандартного ввода
+        string script_path;
+        // Уровень оптимизации. По умолчанию программа не оптимизируется
+        optimizer::OptimizationLevel opt_level = optimizer::OptimizationLevel::O0;
+        // Проходы оптимизатора через запятую. Если заданы, выполняются вместо проходов уровня opt_level
+        string passes;
+        // Проверять дерево разбора после каждого прохода оптимизатора
+        bool verify_ast = false;
+        // Вывести в std::cerr время и результаты проходов оптимизатора
+        bool opt_stats = false;
+    };
+
+    // Создаёт менеджер проходов, заданных параметрами командной строки
+    optimizer::PassManager MakePassManager(const Options& options) {
+        optimizer::PassManager passes(options.opt_level);
+        if (!options.passes.empty()) {
+            passes = optimizer::PassManager();
+            for (optimizer::Pass& pass : optimizer::ParsePassList(options.passes)) {
+                passes.AddPass(std::move(pass));
+            }
+        }
+        passes.SetVerify(options.verify_ast);
+        passes.SetCountNodes(options.opt_stats);
+        return passes;
+    }
+
+    // Разбирает аргументы командной строки:
+    //   --engine=tree  выполнять программу обходом дерева разбора (по умолчанию)
+    //   --engine=vm    выполнять программу виртуальной машиной
+    //   --engine=flat  выполнять программу, записанную в плоский массив узлов
+    //   --cache-stats  вывести статистику встроенных кэшей методов
+    //   --lex-threads=N  выделять токены программы из файла в N потоках
+    //   --pipeline     выделять токены и разбирать программу в отдельных потоках, выполняя
+    //                  каждую инструкцию верхнего уровня сразу после разбора. Ошибка разбора
+    //                  сообщается после выполнения инструкций, предшествующих ей
+    //   -O0, -O1, -O2  уровень оптимизации (optimizer::OptimizationLevel), по умолчанию -O0
+    //   --passes=P1,P2 выполнить перечисленные проходы оптимизатора вместо проходов уровня
+    //   --verify-ast   проверять дерево разбора после каждого прохода оптимизатора
+    //   --opt-stats    вывести время и количество заменённых и удалённых узлов каждого прохода
+    //   <файл>         выполнить программу из файла вместо стандартного ввода
+    Options ParseOptions(int argc, char* argv[]) {
+        Options options;
+        for (int i = 1; i < argc; ++i) {
+            string_view arg = argv[i];
+            if (arg == "--engine=tree"sv) {
+                options.engine = Engine::TreeWalker;
+            }
+            else if (arg == "--engine=vm"sv) {
+                options.engine = Engine::Bytecode;
+            }
+            else if (arg == "--engine=flat"sv) {
+                options.engine = Engine::Flat;
+            }
+            else if (arg == "--cache-stats"sv) {
+                options.cache_stats = true;
+            }
+            else if (arg == "--pipeline"sv) {
+                options.pipeline = true;
+            }
+            else if (arg == "-O0"sv) {
+                options.opt_level = optimizer::OptimizationLevel::O0;
+            }
+            else if (arg == "-O1"sv) {
+                options.opt_level = optimizer::OptimizationLevel::O1;
+            }
+            else if (arg == "-O2"sv) {
+                options.opt_level = optimizer::OptimizationLevel::O2;
+            }
+            else if (constexpr auto prefix = "--passes="sv; arg.substr(0, prefix.size()) == prefix) {
+                options.passes = arg.substr(prefix.size());
+                if (options.passes.empty()) {
+                    throw invalid_argument("Empty optimizer pass list"s);
+                }
+            }
+            else if (arg == "--verify-ast"sv) {
+                options.verify_ast = true;
+            }
+            else if (arg == "--opt-stats"sv) {
+                options.opt_stats = true;
+            }
+            else if (constexpr auto prefix = "--lex-threads="sv; arg.substr(0, prefix.size()) == prefix) {
+                const string_view value = arg.substr(prefix.size());
+                const auto [end, ec] = from_chars(value.data(), value.data() + value.size(), options.lex_threads);
+                if (ec != errc{} || end != value.data() + value.size() || options.lex_threads == 0) {
+                    throw invalid_argument("Invalid thread count: "s + string(arg));
+                }
+            }
+            else if (!arg.empty() && arg[0] != '-' && options.script_path.empty()) {
+                options.script_path = arg;
+            }
+            else {
+                throw invalid_argument("Unknown option: "s + string(arg));
+            }
+        }
+        return options;
+    }
+
+    void PrintCacheStats(const runtime::MethodCacheStats& stats, ostream& out) {
+        const uint64_t lookups = stats.hits + stats.misses;
+        out << "Method cache: "sv << stats.hits << " hits, "sv << stats.misses << " misses"sv;
+        if (lookups > 0) {
+            out << ", hit rate "sv << 100.0 * static_cast<double>(stats.hits) / static_cast<double>(lookups) << '%';
+        }
+        out << endl;
+    }
+
 }  // namespace
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
+        Options options = ParseOptions(argc, argv);
+        optimizer::PassManager passes = MakePassManager(options);
+
         TestAll();
 
-        RunMythonProgram(cin, cout);
+        // Учитываются только обращения к кэшам при выполнении программы, но не в тестах
+        const runtime::MethodCacheStats before = runtime::MethodCache::GetTotalStats();
+        if (options.script_path.empty()) {
+            RunMythonProgram(cin, cout, options.engine, options.pipeline, &passes);
+        }
+        else {
+            // Файл отображается в память, и лексер разбирает его без копирования
+            parse::MappedFile script(options.script_path);
+            if (options.lex_threads > 1) {
+                const parse::TokenBuffer tokens = parse::LexInParallel(script.GetContents(), options.lex_threads);
+                parse::Lexer lexer(tokens);
+                RunMythonProgram(lexer, cout, options.engine, options.pipeline, &passes);
+            }
+            else {
+                parse::Lexer lexer(script.GetContents());
+                RunMythonProgram(lexer, cout, options.engine, options.pipeline, &passes);
+            }
+        }
+        if (options.opt_stats) {
+            passes.PrintStats(cerr);
+        }
+        if (options.cache_stats) {
+            const runtime::MethodCacheStats& after = runtime::MethodCache::GetTotalStats();
+            PrintCacheStats({ after.hits - before.hits, after.misses - before.misses }, cerr);
+        }
     }
     catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
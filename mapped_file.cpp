@@ -0,0 +1,82 @@
+#include "mapped_file.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MYTHON_HAS_MMAP 1
+#endif
+
+using namespace std;
+
+namespace parse {
+
+    namespace {
+        string DescribeError(const string& path, const char* action) {
+            return "Can't "s + action + ' ' + path + ": "s + strerror(errno);
+        }
+    }  // namespace
+
+#ifdef MYTHON_HAS_MMAP
+
+    MappedFile::MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw MappedFileError(DescribeError(path, "open"));
+        }
+
+        struct stat info {};
+        if (fstat(fd, &info) != 0) {
+            string message = DescribeError(path, "stat");
+            close(fd);
+            throw MappedFileError(message);
+        }
+
+        // Пустой файл отобразить нельзя, он остаётся пустой строкой
+        if (info.st_size > 0) {
+            void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                string message = DescribeError(path, "map");
+                close(fd);
+                throw MappedFileError(message);
+            }
+            // Лексер читает файл от начала до конца
+            madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+            data_ = static_cast<const char*>(data);
+            size_ = static_cast<size_t>(info.st_size);
+            mapped_ = true;
+        }
+        close(fd);
+    }
+
+    MappedFile::~MappedFile() {
+        if (mapped_) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+    }
+
+#else
+
+    MappedFile::MappedFile(const std::string& path) {
+        ifstream input(path, ios::binary);
+        if (!input) {
+            throw MappedFileError(DescribeError(path, "open"));
+        }
+        ostringstream contents;
+        contents << input.rdbuf();
+        contents_ = contents.str();
+        data_ = contents_.data();
+        size_ = contents_.size();
+    }
+
+    MappedFile::~MappedFile() = default;
+
+#endif
+
+}  // namespace parse
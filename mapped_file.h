@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace parse {
+
+    class MappedFileError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // Файл, отображённый в память только для чтения. Содержимое файла можно разбирать
+    // лексером parse::Lexer без копирования, пока существует объект MappedFile.
+    // На платформах без mmap содержимое файла читается в память целиком
+    class MappedFile {
+    public:
+        // Отображает в память файл path. При ошибке выбрасывает исключение MappedFileError
+        explicit MappedFile(const std::string& path);
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile();
+
+        [[nodiscard]] std::string_view GetContents() const {
+            return { data_, size_ };
+        }
+
+    private:
+        const char* data_ = "";
+        size_t size_ = 0;
+        bool mapped_ = false;
+        // Содержимое файла, если он не был отображён в память
+        std::string contents_;
+    };
+
+}  // namespace parse
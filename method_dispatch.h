@@ -0,0 +1,163 @@
+#pragma once
+
+#include "bytecode.h"
+#include "runtime.h"
+
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace bytecode {
+
+    // Возвращает метод method с arg_count параметрами, если object - экземпляр класса с таким методом.
+    // Метод ищется через кэш места операции cache
+    inline const runtime::Method* FindMethod(const runtime::ObjectHolder& object, runtime::MethodId method,
+        size_t arg_count, runtime::MethodCache& cache) {
+        auto* instance = object.TryAs<runtime::ClassInstance>();
+        return instance != nullptr ? cache.Lookup(instance->GetClass(), method, arg_count) : nullptr;
+    }
+
+    // Сравнивает числа: сравнение двух чисел не вызывает методов и не зависит от контекста
+    inline bool CompareNumbers(CompareOp op, int lhs, int rhs) {
+        switch (op) {
+        case CompareOp::Equal:
+            return lhs == rhs;
+        case CompareOp::NotEqual:
+            return lhs != rhs;
+        case CompareOp::Less:
+            return lhs < rhs;
+        case CompareOp::Greater:
+            return lhs > rhs;
+        case CompareOp::LessOrEqual:
+            return lhs <= rhs;
+        case CompareOp::GreaterOrEqual:
+        case CompareOp::Custom:
+            break;
+        }
+        return lhs >= rhs;
+    }
+
+    // Вызов методов пользовательских классов, сравнение и вывод значений, общие для исполнителей
+    // скомпилированных программ: виртуальной машины и вычислителя плоских деревьев (flat::Evaluator).
+    // Исполнитель Executor наследует MethodDispatcher<Executor> и определяет методы
+    //   const Body* GetMethodBody(const runtime::Method& method) - скомпилированное тело метода
+    //       либо nullptr, если тело не является узлом дерева разбора;
+    //   runtime::ObjectHolder RunMethodBody(const Body& body, runtime::Frame& frame) - выполняет тело в кадре frame.
+    // Методы, тела которых не являются узлами дерева разбора, выполняются через ClassInstance::Call
+    template <typename Executor>
+    class MethodDispatcher {
+    protected:
+        explicit MethodDispatcher(runtime::Context& context)
+            : context_(context) {
+        }
+
+        // Вызывает у экземпляра класса self метод method с аргументами args[0..count).
+        // Метод ищется через кэш места вызова cache. Аргументы перемещаются в кадр метода до его
+        // выполнения, поэтому args может указывать на вершину стека, который растёт при выполнении
+        runtime::ObjectHolder CallMethod(const runtime::ObjectHolder& self, runtime::MethodId method,
+            runtime::ObjectHolder* args, size_t count, runtime::MethodCache& cache) {
+            const runtime::Class& cls = self.TryAs<runtime::ClassInstance>()->GetClass();
+            const runtime::Method* m = cache.Lookup(cls, method, count);
+            if (m == nullptr) {
+                throw std::runtime_error(cls.GetName() + " does not have method " + method.GetName()
+                    + " or method is incorrect");
+            }
+            return Invoke(self, *m, args, count);
+        }
+
+        // Вызывает у экземпляра класса self уже найденный метод m, как CallMethod.
+        // Как и ClassInstance::Call, метод получает заимствованную ссылку на self: экземпляр
+        // живёт, пока вызывающий владеет self
+        runtime::ObjectHolder Invoke(const runtime::ObjectHolder& self, const runtime::Method& m,
+            runtime::ObjectHolder* args, size_t count) {
+            Executor& executor = static_cast<Executor&>(*this);
+            auto& instance = *self.TryAs<runtime::ClassInstance>();
+            const auto* body = executor.GetMethodBody(m);
+            if (body == nullptr) {
+                std::vector<runtime::ObjectHolder> call_args(std::make_move_iterator(args),
+                    std::make_move_iterator(args + count));
+                return instance.Call(m, call_args, context_);
+            }
+
+            if (m.frame_size > 0) {
+                runtime::Frame frame(m.frame_size);
+                frame.Bind(runtime::Frame::SELF_SLOT, runtime::ObjectHolder::Share(instance));
+                for (size_t i = 0; i < count; ++i) {
+                    frame.Bind(runtime::Frame::SELF_SLOT + 1 + i, std::move(args[i]));
+                }
+                return executor.RunMethodBody(*body, frame);
+            }
+
+            runtime::Closure locals = { {runtime::SELF_SYMBOL, runtime::ObjectHolder::Share(instance)} };
+            for (size_t i = 0; i < count; ++i) {
+                locals[m.formal_params[i]] = std::move(args[i]);
+            }
+            runtime::Frame frame(locals);
+            return executor.RunMethodBody(*body, frame);
+        }
+
+        // Сравнения места site. Числа сравниваются без обращения к кэшам, методы __eq__ и __lt__
+        // ищутся через кэши этого места
+        bool Compare(const CompareSite& site, const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs) {
+            auto lhs_number = lhs.TryGetNumber();
+            auto rhs_number = rhs.TryGetNumber();
+            if (lhs_number && rhs_number && site.op != CompareOp::Custom) {
+                return CompareNumbers(site.op, *lhs_number, *rhs_number);
+            }
+            switch (site.op) {
+            case CompareOp::Equal:
+                return Equal(site, lhs, rhs);
+            case CompareOp::NotEqual:
+                return !Equal(site, lhs, rhs);
+            case CompareOp::Less:
+                return Less(site, lhs, rhs);
+            case CompareOp::Greater:
+                return !Less(site, lhs, rhs) && !Equal(site, lhs, rhs);
+            case CompareOp::LessOrEqual:
+                return Less(site, lhs, rhs) || Equal(site, lhs, rhs);
+            case CompareOp::GreaterOrEqual:
+                return !Less(site, lhs, rhs);
+            case CompareOp::Custom:
+                break;
+            }
+            return site.comparator(lhs, rhs, context_);
+        }
+
+        bool Equal(const CompareSite& site, const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs) {
+            if (const runtime::Method* method = FindMethod(lhs, runtime::EQ_METHOD_ID, 1, site.eq_cache)) {
+                runtime::ObjectHolder arg = rhs;
+                return runtime::IsTrue(Invoke(lhs, *method, &arg, 1));
+            }
+            return runtime::Equal(lhs, rhs, context_);
+        }
+
+        bool Less(const CompareSite& site, const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs) {
+            if (const runtime::Method* method = FindMethod(lhs, runtime::LT_METHOD_ID, 1, site.lt_cache)) {
+                runtime::ObjectHolder arg = rhs;
+                return runtime::IsTrue(Invoke(lhs, *method, &arg, 1));
+            }
+            return runtime::Less(lhs, rhs, context_);
+        }
+
+        // Выводит значение в os, вызывая __str__ пользовательских классов средствами исполнителя.
+        // Метод __str__ ищется через кэш места вывода str_cache
+        void PrintValue(const runtime::ObjectHolder& value, std::ostream& os, runtime::MethodCache& str_cache) {
+            if (const runtime::Method* method = FindMethod(value, runtime::STR_METHOD_ID, 0, str_cache)) {
+                runtime::ObjectHolder str = Invoke(value, *method, nullptr, 0);
+                if (str) {
+                    PrintValue(str, os, str_cache);
+                }
+                else {
+                    os << "None";
+                }
+                return;
+            }
+            value.Print(os, context_);
+        }
+
+        runtime::Context& context_;
+    };
+
+}  // namespace bytecode
@@ -0,0 +1,69 @@
+#include "node_arena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+namespace ast {
+
+    namespace {
+
+        constexpr std::size_t ALIGNMENT = alignof(std::max_align_t);
+
+        constexpr std::size_t INITIAL_BLOCK_SIZE = 4 * 1024;
+        constexpr std::size_t MAX_BLOCK_SIZE = 64 * 1024;
+
+        thread_local NodeArena* current_arena = nullptr;
+        std::atomic<std::size_t> arena_count{ 0 };
+
+        constexpr std::size_t AlignUp(std::size_t size) {
+            return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        }
+
+    }  // namespace
+
+    NodeArena::Scope::Scope(NodeArena* arena) noexcept
+        : previous_(std::exchange(current_arena, arena)) {
+    }
+
+    NodeArena::Scope::~Scope() {
+        current_arena = previous_;
+    }
+
+    NodeArena::NodeArena()
+        : next_block_size_(INITIAL_BLOCK_SIZE) {
+        arena_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    NodeArena::~NodeArena() {
+        // Объекты удаляются в порядке, обратном созданию: экземпляр класса - раньше объявления класса
+        for (auto it = finalizers_.rbegin(); it != finalizers_.rend(); ++it) {
+            it->finalize(it->object);
+        }
+        arena_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    NodeArena* NodeArena::GetCurrent() noexcept {
+        return current_arena;
+    }
+
+    void* NodeArena::Allocate(std::size_t size) {
+        const std::size_t required = AlignUp(size);
+        if (static_cast<std::size_t>(end_ - position_) < required) {
+            const std::size_t block_size = std::max(next_block_size_, required);
+            // Блок не заполняется нулями: каждый фрагмент инициализирует его владелец
+            blocks_.emplace_back(new std::byte[block_size]);
+            position_ = blocks_.back().get();
+            end_ = position_ + block_size;
+            next_block_size_ = std::min(next_block_size_ * 2, MAX_BLOCK_SIZE);
+        }
+        std::byte* fragment = position_;
+        position_ += required;
+        return fragment;
+    }
+
+    std::size_t NodeArena::GetArenaCount() {
+        return arena_count.load(std::memory_order_relaxed);
+    }
+
+}  // namespace ast
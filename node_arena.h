@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ast {
+
+    // Арена, в которой размещаются узлы дерева разбора одной программы и их списки.
+    // Память выделяется последовательно из блоков, размер которых растёт вдвое, и не освобождается
+    // по одному выделению: деструктор арены освобождает все блоки сразу. Узлы арены не удаляются
+    // по одному, поэтому удаление программы не обходит её дерево (см. ast::Compound::SetArena).
+    // Объекты, владеющие ресурсами вне арены, регистрируются в ней (см. AddFinalizer).
+    // Арена не синхронизирована: выделять память и удалять её узлы может один поток одновременно
+    class NodeArena {
+    public:
+        // Делает арену текущей для потока на время своей жизни. Узлы дерева разбора и их списки,
+        // создаваемые потоком в это время, размещаются в этой арене
+        class Scope {
+        public:
+            // Если arena равна nullptr, узлы на время жизни Scope размещаются в куче
+            explicit Scope(NodeArena* arena) noexcept;
+            ~Scope();
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+        private:
+            NodeArena* previous_;
+        };
+
+        NodeArena();
+        // Удаляет зарегистрированные объекты в порядке, обратном регистрации, и освобождает блоки
+        ~NodeArena();
+
+        NodeArena(const NodeArena&) = delete;
+        NodeArena& operator=(const NodeArena&) = delete;
+
+        // Возвращает текущую арену потока либо nullptr
+        [[nodiscard]] static NodeArena* GetCurrent() noexcept;
+
+        // Выделяет size байт, выровненных как std::max_align_t
+        [[nodiscard]] void* Allocate(std::size_t size);
+
+        // Регистрирует объект, размещённый в арене и владеющий ресурсами вне её: арена вызовет
+        // его деструктор при освобождении
+        template <typename T>
+        void AddFinalizer(T* object) {
+            finalizers_.push_back({ object, [](void* pointer) noexcept {
+                static_cast<T*>(pointer)->~T();
+            } });
+        }
+
+        // Возвращает количество существующих арен
+        [[nodiscard]] static std::size_t GetArenaCount();
+
+    private:
+        struct Finalizer {
+            void* object;
+            void (*finalize)(void* object) noexcept;
+        };
+
+        std::vector<std::unique_ptr<std::byte[]>> blocks_;
+        std::byte* position_ = nullptr;
+        std::byte* end_ = nullptr;
+        std::size_t next_block_size_;
+        std::vector<Finalizer> finalizers_;
+    };
+
+    // Значение типа T, принадлежащее узлу дерева разбора. Узлы арены удаляются без вызова
+    // деструкторов, поэтому значение узла арены удаляет сама арена, если Finalize равно true
+    // (значение владеет ресурсами вне арены), а значение узла из кучи - деструктор узла вызовом Destroy
+    template <typename T, bool Finalize = !std::is_trivially_destructible_v<T>>
+    class NodeValue {
+    public:
+        // arena - арена, в которой размещён узел, либо nullptr
+        template <typename... Args>
+        explicit NodeValue(NodeArena* arena, Args&&... args) {
+            T* value = new (&storage_) T(std::forward<Args>(args)...);
+            if (Finalize && arena != nullptr) {
+                arena->AddFinalizer(value);
+            }
+        }
+
+        NodeValue(const NodeValue&) = delete;
+        NodeValue& operator=(const NodeValue&) = delete;
+
+        // Удаляет значение, если им не владеет арена
+        void Destroy(NodeArena* arena) noexcept {
+            if (!Finalize || arena == nullptr) {
+                Get().~T();
+            }
+        }
+
+        [[nodiscard]] T& Get() noexcept {
+            return *std::launder(reinterpret_cast<T*>(&storage_));
+        }
+
+        [[nodiscard]] const T& Get() const noexcept {
+            return *std::launder(reinterpret_cast<const T*>(&storage_));
+        }
+
+    private:
+        alignas(T) std::byte storage_[sizeof(T)];
+    };
+
+    // Распределитель памяти для списков, принадлежащих узлам дерева разбора. Список размещается
+    // в арене, текущей при его создании, либо в куче. Память в арене освобождается вместе с ней
+    template <typename T>
+    class NodeAllocator {
+    public:
+        using value_type = T;
+        // Память списка принадлежит арене его распределителя, поэтому распределитель переносится вместе с ней
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        NodeAllocator() noexcept
+            : arena_(NodeArena::GetCurrent()) {
+        }
+
+        template <typename U>
+        NodeAllocator(const NodeAllocator<U>& other) noexcept  // NOLINT(google-explicit-constructor)
+            : arena_(other.GetArena()) {
+        }
+
+        // Копия списка размещается в арене, текущей при копировании
+        [[nodiscard]] NodeAllocator select_on_container_copy_construction() const noexcept {
+            return {};
+        }
+
+        [[nodiscard]] T* allocate(std::size_t count) {
+            if (arena_ != nullptr) {
+                return static_cast<T*>(arena_->Allocate(count * sizeof(T)));
+            }
+            return static_cast<T*>(::operator new(count * sizeof(T)));
+        }
+
+        void deallocate(T* pointer, std::size_t /*count*/) noexcept {
+            if (arena_ == nullptr) {
+                ::operator delete(pointer);
+            }
+        }
+
+        [[nodiscard]] NodeArena* GetArena() const noexcept {
+            return arena_;
+        }
+
+        template <typename U>
+        bool operator==(const NodeAllocator<U>& other) const noexcept {
+            return arena_ == other.GetArena();
+        }
+
+        template <typename U>
+        bool operator!=(const NodeAllocator<U>& other) const noexcept {
+            return arena_ != other.GetArena();
+        }
+
+    private:
+        NodeArena* arena_;
+    };
+
+    // Список, который размещается в арене вместе с узлом-владельцем
+    template <typename T>
+    using NodeVector = std::vector<T, NodeAllocator<T>>;
+
+}  // namespace ast
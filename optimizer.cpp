@@ -0,0 +1,551 @@
+#include "optimizer.h"
+
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace optimizer {
+
+    using runtime::ObjectHolder;
+
+    namespace {
+
+        // Возвращает значение узла-константы либо nullopt, если node - не константа
+        optional<ObjectHolder> GetConstant(ast::Statement& node) {
+            if (auto* number = TryAs<ast::NumericConst>(node)) {
+                return ObjectHolder::Share(number->GetValue());
+            }
+            if (auto* str = TryAs<ast::StringConst>(node)) {
+                return ObjectHolder::Share(str->GetValue());
+            }
+            if (auto* boolean = TryAs<ast::BoolConst>(node)) {
+                return ObjectHolder::Share(boolean->GetValue());
+            }
+            if (TryAs<ast::None>(node) != nullptr) {
+                return ObjectHolder::None();
+            }
+            return nullopt;
+        }
+
+        // Возвращает значение числовой константы либо nullopt, если node - не числовая константа
+        optional<int> GetNumber(ast::Statement& node) {
+            if (auto* number = TryAs<ast::NumericConst>(node)) {
+                return number->GetValue().GetValue();
+            }
+            return nullopt;
+        }
+
+        // Возвращает true, если значение node - всегда число: вычисление такого узла
+        // либо возвращает число, либо выбрасывает исключение
+        bool IsNumeric(ast::Statement& node) {
+            return TryAs<ast::NumericConst>(node) != nullptr || TryAs<ast::Sub>(node) != nullptr
+                || TryAs<ast::Mult>(node) != nullptr || TryAs<ast::Div>(node) != nullptr
+                || TryAs<ast::Negate>(node) != nullptr;
+        }
+
+        // Возвращает true, если умножение на factor не меняет абсолютной величины числа
+        bool IsUnit(optional<int> factor) {
+            return factor == 1 || factor == -1;
+        }
+
+        // Возвращает выражение, равное произведению числа operand на factor, равный 1 или -1
+        ast::StatementPtr Scale(int factor, ast::StatementPtr operand) {
+            if (factor == 1) {
+                return operand;
+            }
+            return ast::MakeNode<ast::Negate>(std::move(operand));
+        }
+
+        // Создаёт константу со значением value либо возвращает nullptr, если значение
+        // не записывается константой (например, экземпляр класса)
+        ast::StatementPtr MakeConstant(const ObjectHolder& value) {
+            if (!value) {
+                return ast::MakeNode<ast::None>();
+            }
+            if (auto number = value.TryGetNumber()) {
+                return ast::MakeNode<ast::NumericConst>(*number);
+            }
+            if (auto* str = value.TryAs<runtime::String>()) {
+                return ast::MakeNode<ast::StringConst>(str->GetValue());
+            }
+            if (auto boolean = value.TryGetBool()) {
+                return ast::MakeNode<ast::BoolConst>(runtime::Bool(*boolean));
+            }
+            return nullptr;
+        }
+
+        // Базовый класс проходов, заменяющих узлы. Обходит дерево снизу вверх: к моменту посещения узла
+        // его дочерние узлы уже обработаны. Visit записывает замену посещённого узла в replacement_.
+        // Тела методов объявленных классов обрабатываются, но сами не заменяются
+        class RewritingVisitor : public ast::StatementVisitor {
+        public:
+            void Rewrite(ast::StatementPtr& node) {
+                auto* operation = dynamic_cast<ast::BinaryOperation*>(node.get());
+                if (operation != nullptr && operation->GetLhsOperation() != nullptr) {
+                    RewriteChain(node, *operation);
+                    return;
+                }
+                node->RewriteChildren(rewrite_children_);
+                Replace(node);
+            }
+
+            [[nodiscard]] size_t GetRewrittenCount() const {
+                return rewritten_;
+            }
+
+            void Visit(ast::NumericConst& /*node*/) override {
+            }
+
+            void Visit(ast::StringConst& /*node*/) override {
+            }
+
+            void Visit(ast::BoolConst& /*node*/) override {
+            }
+
+            void Visit(ast::VariableValue& /*node*/) override {
+            }
+
+            void Visit(ast::Assignment& /*node*/) override {
+            }
+
+            void Visit(ast::FieldAssignment& /*node*/) override {
+            }
+
+            void Visit(ast::None& /*node*/) override {
+            }
+
+            void Visit(ast::Print& /*node*/) override {
+            }
+
+            void Visit(ast::MethodCall& /*node*/) override {
+            }
+
+            void Visit(ast::NewInstance& /*node*/) override {
+            }
+
+            void Visit(ast::Stringify& /*node*/) override {
+            }
+
+            void Visit(ast::Add& /*node*/) override {
+            }
+
+            void Visit(ast::Sub& /*node*/) override {
+            }
+
+            void Visit(ast::Mult& /*node*/) override {
+            }
+
+            void Visit(ast::Div& /*node*/) override {
+            }
+
+            void Visit(ast::Or& /*node*/) override {
+            }
+
+            void Visit(ast::And& /*node*/) override {
+            }
+
+            void Visit(ast::Not& /*node*/) override {
+            }
+
+            void Visit(ast::Negate& /*node*/) override {
+            }
+
+            void Visit(ast::Compound& /*node*/) override {
+            }
+
+            void Visit(ast::MethodBody& /*node*/) override {
+            }
+
+            void Visit(ast::Return& /*node*/) override {
+            }
+
+            void Visit(ast::ClassDefinition& node) override {
+                auto* cls = node.GetClass().TryAs<runtime::Class>();
+                for (runtime::Method& method : cls->GetOwnMethods()) {
+                    if (auto* body = dynamic_cast<ast::Statement*>(method.body.get())) {
+                        body->RewriteChildren(rewrite_children_);
+                    }
+                }
+            }
+
+            void Visit(ast::IfElse& /*node*/) override {
+            }
+
+            void Visit(ast::Comparison& /*node*/) override {
+            }
+
+            void Visit(ast::CompareAndBranch& /*node*/) override {
+            }
+
+        protected:
+            ~RewritingVisitor() = default;
+
+            ast::StatementPtr replacement_;
+
+        private:
+            // Посещает node и заменяет её, если Visit записал замену
+            void Replace(ast::StatementPtr& node) {
+                node->Accept(*this);
+                if (replacement_) {
+                    node = std::move(replacement_);
+                    ++rewritten_;
+                }
+            }
+
+            // Обходит цепочку операций с вершиной top (см. ast::BinaryOperation) циклом: операция
+            // посещается после своих аргументов, начиная с самой внутренней
+            void RewriteChain(ast::StatementPtr& top, ast::BinaryOperation& operation) {
+                vector<ast::BinaryOperation*> chain;
+                for (auto* link = &operation; link != nullptr; link = link->GetLhsOperation()) {
+                    chain.push_back(link);
+                }
+                chain.back()->RewriteLhs(rewrite_children_);
+                for (size_t i = chain.size() - 1; i > 0; --i) {
+                    chain[i]->RewriteRhs(rewrite_children_);
+                    chain[i - 1]->RewriteLhs(replace_);
+                }
+                operation.RewriteRhs(rewrite_children_);
+                Replace(top);
+            }
+
+            size_t rewritten_ = 0;
+            const ast::ChildRewriter rewrite_children_ = [this](ast::StatementPtr& child) {
+                Rewrite(child);
+            };
+            const ast::ChildRewriter replace_ = [this](ast::StatementPtr& child) {
+                Replace(child);
+            };
+        };
+
+        // Заменяет константные подвыражения их значениями (см. FoldConstants)
+        class ConstantFolder final : public RewritingVisitor {
+        public:
+            void Visit(ast::Stringify& node) override {
+                FoldIfConstant(node, node.GetArgument());
+            }
+
+            void Visit(ast::Add& node) override {
+                if (FoldIfConstant(node, node.GetLhs(), node.GetRhs())) {
+                    return;
+                }
+                if (GetNumber(node.GetRhs()) == 0 && IsNumeric(node.GetLhs())) {
+                    replacement_ = node.TakeLhs();
+                }
+                else if (GetNumber(node.GetLhs()) == 0 && IsNumeric(node.GetRhs())) {
+                    replacement_ = node.TakeRhs();
+                }
+            }
+
+            void Visit(ast::Sub& node) override {
+                if (FoldIfConstant(node, node.GetLhs(), node.GetRhs())) {
+                    return;
+                }
+                if (GetNumber(node.GetRhs()) == 0 && IsNumeric(node.GetLhs())) {
+                    replacement_ = node.TakeLhs();
+                }
+                else if (GetNumber(node.GetLhs()) == 0 && IsNumeric(node.GetRhs())) {
+                    replacement_ = ast::MakeNode<ast::Negate>(node.TakeRhs());
+                }
+            }
+
+            void Visit(ast::Mult& node) override {
+                if (FoldIfConstant(node, node.GetLhs(), node.GetRhs())) {
+                    return;
+                }
+                if (const optional<int> factor = GetNumber(node.GetRhs()); IsUnit(factor) && IsNumeric(node.GetLhs())) {
+                    replacement_ = Scale(*factor, node.TakeLhs());
+                }
+                else if (const optional<int> factor = GetNumber(node.GetLhs());
+                         IsUnit(factor) && IsNumeric(node.GetRhs())) {
+                    replacement_ = Scale(*factor, node.TakeRhs());
+                }
+            }
+
+            void Visit(ast::Div& node) override {
+                if (FoldIfConstant(node, node.GetLhs(), node.GetRhs())) {
+                    return;
+                }
+                if (const optional<int> factor = GetNumber(node.GetRhs()); IsUnit(factor) && IsNumeric(node.GetLhs())) {
+                    replacement_ = Scale(*factor, node.TakeLhs());
+                }
+            }
+
+            void Visit(ast::Or& node) override {
+                const optional<ObjectHolder> lhs = GetConstant(node.GetLhs());
+                if (lhs && runtime::IsTrue(*lhs)) {
+                    replacement_ = ast::MakeNode<ast::BoolConst>(runtime::Bool(true));
+                    return;
+                }
+                FoldIfConstant(node, node.GetLhs(), node.GetRhs());
+            }
+
+            void Visit(ast::And& node) override {
+                const optional<ObjectHolder> lhs = GetConstant(node.GetLhs());
+                if (lhs && !runtime::IsTrue(*lhs)) {
+                    replacement_ = ast::MakeNode<ast::BoolConst>(runtime::Bool(false));
+                    return;
+                }
+                FoldIfConstant(node, node.GetLhs(), node.GetRhs());
+            }
+
+            void Visit(ast::Not& node) override {
+                FoldIfConstant(node, node.GetArgument());
+            }
+
+            void Visit(ast::Negate& node) override {
+                if (FoldIfConstant(node, node.GetArgument())) {
+                    return;
+                }
+                auto* inner = TryAs<ast::Negate>(node.GetArgument());
+                if (inner != nullptr && IsNumeric(inner->GetArgument())) {
+                    replacement_ = inner->TakeArgument();
+                }
+            }
+
+            void Visit(ast::Comparison& node) override {
+                // Пользовательский компаратор может выполнять произвольные действия
+                const auto* comparator = node.GetComparator().target<runtime::CachedComparator::Comparator>();
+                if (comparator != nullptr && runtime::CachedComparator::Find(*comparator) != nullptr) {
+                    FoldIfConstant(node, node.GetLhs(), node.GetRhs());
+                }
+            }
+
+        private:
+            // Если все operands - константы, заменяет node значением, которое она вычисляет.
+            // Возвращает true, если узел заменён
+            template <typename... Operands>
+            bool FoldIfConstant(ast::Statement& node, Operands&... operands) {
+                if ((GetConstant(operands) && ...)) {
+                    replacement_ = Evaluate(node);
+                }
+                return replacement_ != nullptr;
+            }
+
+            // Вычисляет узел, все операнды которого - константы. Возвращает nullptr, если
+            // вычисление завершилось ошибкой: тогда узел остаётся в дереве и сообщает о ней при выполнении
+            ast::StatementPtr Evaluate(ast::Statement& node) {
+                runtime::Closure closure;
+                runtime::Frame frame(closure);
+                try {
+                    return MakeConstant(node.Evaluate(frame, context_));
+                }
+                catch (const runtime_error&) {
+                    return nullptr;
+                }
+            }
+
+            runtime::DummyContext context_;
+        };
+
+        // Считает присваивания каждой переменной в коде верхнего уровня. Объявление класса
+        // присваивает переменной с именем класса. В тела методов обход не заходит
+        class AssignmentCounter final : public ast::RecursiveStatementVisitor {
+        public:
+            void Visit(ast::Assignment& node) override {
+                ++counts_[node.GetVariable()];
+                ast::RecursiveStatementVisitor::Visit(node);
+            }
+
+            void Visit(ast::ClassDefinition& node) override {
+                ++counts_[runtime::Symbol(node.GetClass().TryAs<runtime::Class>()->GetName())];
+            }
+
+            [[nodiscard]] size_t GetCount(runtime::Symbol name) const {
+                const auto it = counts_.find(name);
+                return it != counts_.end() ? it->second : 0;
+            }
+
+        private:
+            unordered_map<runtime::Symbol, size_t> counts_;
+        };
+
+        // Заменяет обращения к переменным из constants_ их значениями. В тела методов
+        // обход не заходит: переменные верхнего уровня в них не видны
+        class ConstantPropagator final : public RewritingVisitor {
+        public:
+            void AddConstant(runtime::Symbol name, ObjectHolder value) {
+                constants_.emplace(name, std::move(value));
+            }
+
+            void Visit(ast::VariableValue& node) override {
+                const auto& ids = node.GetDottedIds();
+                if (ids.size() != 1) {
+                    return;
+                }
+                if (const auto it = constants_.find(ids.front()); it != constants_.end()) {
+                    replacement_ = MakeConstant(it->second);
+                }
+            }
+
+            void Visit(ast::ClassDefinition& /*node*/) override {
+            }
+
+        private:
+            unordered_map<runtime::Symbol, ObjectHolder> constants_;
+        };
+
+        // Проверяет, объявляется ли класс в инструкции или вложенных в неё инструкциях
+        class ClassDefinitionFinder final : public ast::RecursiveStatementVisitor {
+        public:
+            static bool Contains(ast::Statement* statement) {
+                ClassDefinitionFinder finder;
+                if (statement != nullptr) {
+                    statement->Accept(finder);
+                }
+                return finder.found_;
+            }
+
+            void Visit(ast::ClassDefinition& /*node*/) override {
+                found_ = true;
+            }
+
+        private:
+            bool found_ = false;
+        };
+
+        // Заменяет инструкции if с константным условием выбранной веткой и встраивает
+        // получившиеся составные инструкции в объемлющие (см. EliminateDeadBranches)
+        class DeadBranchEliminator final : public RewritingVisitor {
+        public:
+            void Visit(ast::IfElse& node) override {
+                const optional<ObjectHolder> condition = GetConstant(node.GetCondition());
+                if (!condition) {
+                    return;
+                }
+                // Объявление класса владеет классом, а узлы NewInstance в остальной программе
+                // ссылаются на него, поэтому ветку с объявлением класса удалять нельзя
+                const bool take_if_body = runtime::IsTrue(*condition);
+                if (ClassDefinitionFinder::Contains(take_if_body ? node.GetElseBody() : &node.GetIfBody())) {
+                    return;
+                }
+                if (take_if_body) {
+                    replacement_ = node.TakeIfBody();
+                }
+                else if (node.GetElseBody() != nullptr) {
+                    replacement_ = node.TakeElseBody();
+                }
+                else {
+                    replacement_ = ast::MakeNode<ast::None>();
+                }
+            }
+
+            // Compound выполняет вложенные инструкции по порядку и передаёт наверх результат return,
+            // поэтому вложенную составную инструкцию можно заменить её содержимым, а None - удалить
+            void Visit(ast::Compound& node) override {
+                const auto& statements = node.GetStatements();
+                if (none_of(statements.begin(), statements.end(), [](const auto& statement) {
+                        return IsSpliced(*statement);
+                    })) {
+                    return;
+                }
+                for (auto& statement : node.TakeStatements()) {
+                    if (auto* nested = TryAs<ast::Compound>(*statement)) {
+                        // Вложенные составные инструкции уже обработаны и не содержат Compound и None
+                        for (auto& nested_statement : nested->TakeStatements()) {
+                            node.AddStatement(std::move(nested_statement));
+                        }
+                    }
+                    else if (TryAs<ast::None>(*statement) == nullptr) {
+                        node.AddStatement(std::move(statement));
+                    }
+                }
+            }
+
+        private:
+            static bool IsSpliced(ast::Statement& statement) {
+                return TryAs<ast::Compound>(statement) != nullptr || TryAs<ast::None>(statement) != nullptr;
+            }
+        };
+
+        // Упрощает условия инструкций if (см. FuseConditions)
+        class ConditionFuser final : public RewritingVisitor {
+        public:
+            void Visit(ast::IfElse& node) override {
+                ast::StatementPtr condition;
+                ast::StatementPtr if_body;
+                ast::StatementPtr else_body;
+                if (auto* negation = TryAs<ast::Not>(node.GetCondition())) {
+                    condition = negation->TakeArgument();
+                    if_body = node.GetElseBody() != nullptr ? node.TakeElseBody() : ast::MakeNode<ast::Compound>();
+                    else_body = node.TakeIfBody();
+                }
+                else if (TryAs<ast::Comparison>(node.GetCondition()) != nullptr) {
+                    condition = node.TakeCondition();
+                    if_body = node.TakeIfBody();
+                    else_body = node.TakeElseBody();
+                }
+                else {
+                    return;
+                }
+
+                if (TryAs<ast::Comparison>(*condition) != nullptr) {
+                    ast::NodePtr<ast::Comparison> comparison(static_cast<ast::Comparison*>(condition.release()));
+                    replacement_ = ast::MakeNode<ast::CompareAndBranch>(
+                        std::move(comparison), std::move(if_body), std::move(else_body));
+                }
+                else {
+                    replacement_ = ast::MakeNode<ast::IfElse>(
+                        std::move(condition), std::move(if_body), std::move(else_body));
+                }
+            }
+        };
+
+    }  // namespace
+
+    size_t FoldConstants(ast::StatementPtr& program) {
+        // Новые узлы размещаются в арене программы и удаляются вместе с ней
+        ast::NodeArena::Scope arena(ast::GetTreeArena(*program));
+        ConstantFolder folder;
+        folder.Rewrite(program);
+        return folder.GetRewrittenCount();
+    }
+
+    size_t PropagateConstants(ast::StatementPtr& program) {
+        auto* top_level = TryAs<ast::Compound>(*program);
+        if (top_level == nullptr) {
+            return 0;
+        }
+        AssignmentCounter counter;
+        program->Accept(counter);
+
+        ast::NodeArena::Scope arena(ast::GetTreeArena(*program));
+        ConstantPropagator propagator;
+        ConstantFolder folder;
+        const ast::ChildRewriter fold = [&folder](ast::StatementPtr& node) {
+            folder.Rewrite(node);
+        };
+        // Константа подставляется только в инструкции, следующие за её присваиванием: код верхнего
+        // уровня выполняется по порядку, и к их выполнению переменная уже получила значение
+        top_level->RewriteChildren([&](ast::StatementPtr& statement) {
+            propagator.Rewrite(statement);
+            if (auto* assignment = TryAs<ast::Assignment>(*statement);
+                assignment != nullptr && counter.GetCount(assignment->GetVariable()) == 1) {
+                // Правая часть может стать константой после подстановки (например, LIMIT = N * 2)
+                assignment->RewriteChildren(fold);
+                if (optional<ObjectHolder> value = GetConstant(assignment->GetRightValue())) {
+                    propagator.AddConstant(assignment->GetVariable(), std::move(*value));
+                }
+            }
+        });
+        return propagator.GetRewrittenCount() + folder.GetRewrittenCount();
+    }
+
+    size_t EliminateDeadBranches(ast::StatementPtr& program) {
+        ast::NodeArena::Scope arena(ast::GetTreeArena(*program));
+        DeadBranchEliminator eliminator;
+        eliminator.Rewrite(program);
+        return eliminator.GetRewrittenCount();
+    }
+
+    size_t FuseConditions(ast::StatementPtr& program) {
+        ast::NodeArena::Scope arena(ast::GetTreeArena(*program));
+        ConditionFuser fuser;
+        fuser.Rewrite(program);
+        return fuser.GetRewrittenCount();
+    }
+
+}  // namespace optimizer
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "statement.h"
+
+#include <cstddef>
+#include <memory>
+#include <typeinfo>
+
+namespace optimizer {
+
+    // Возвращает node как узел типа T либо nullptr. У классов узлов дерева разбора нет наследников,
+    // поэтому достаточно сравнить typeid: это дешевле, чем неудачный dynamic_cast
+    template <typename T>
+    T* TryAs(ast::Statement& node) {
+        return typeid(node) == typeid(T) ? static_cast<T*>(&node) : nullptr;
+    }
+
+    /*
+    Сворачивает константные подвыражения дерева разбора program, включая тела методов
+    объявленных в нём классов:
+      - арифметические операции, сравнения, логические операции и str() над константами
+        заменяются их значением (например, "a" + "b" - строкой "ab", -5 - числом -5);
+      - or/and с константным левым операндом, определяющим результат, заменяются этим результатом;
+      - x * 1, 1 * x, x + 0, 0 + x, x - 0, x / 1 заменяются на x, а x * -1, -1 * x, x / -1, 0 - x
+        и -(-x) - на отрицание x, если значение x всегда является числом.
+    Операция над константами, вычисление которой завершается ошибкой (например, 1 / 0), остаётся
+    в дереве и выбрасывает исключение в том же месте выполнения программы, что и без оптимизации.
+    Вывод программы не меняется. Возвращает количество заменённых узлов
+    */
+    std::size_t FoldConstants(ast::StatementPtr& program);
+
+    /*
+    Подставляет значения переменных верхнего уровня, которым в программе присваивается константа
+    ровно один раз (например, DEBUG = False), в инструкции верхнего уровня, следующие за присваиванием.
+    Правая часть такого присваивания предварительно сворачивается, поэтому подставляются и значения
+    переменных, вычисляемых из уже подставленных (например, LIMIT = N * 2).
+    Переменная, которой значение присваивается ещё где-либо, в том числе внутри ветки if,
+    либо имя которой совпадает с именем класса, не подставляется. В тела методов значения
+    не подставляются: переменные верхнего уровня в них не видны.
+    Работает только для программы целиком (program - составная инструкция), иначе ничего не делает.
+    Возвращает количество заменённых обращений к переменным и свёрнутых узлов правых частей
+    */
+    std::size_t PropagateConstants(ast::StatementPtr& program);
+
+    /*
+    Удаляет из program, включая тела методов, ветки инструкций if, которые никогда не выполняются:
+    инструкция if с константным условием заменяется выбранной веткой либо удаляется, если
+    выбранной ветки нет. Содержимое оставшейся ветки встраивается в объемлющую составную инструкцию.
+    Инструкция if, невыполнимая ветка которой объявляет класс, не изменяется: экземпляры этого класса
+    могут создаваться в других местах программы.
+    Условия вида not DEBUG становятся константами после PropagateConstants и FoldConstants.
+    Возвращает количество заменённых инструкций if
+    */
+    std::size_t EliminateDeadBranches(ast::StatementPtr& program);
+
+    /*
+    Упрощает условия инструкций if в program, включая тела методов:
+      - if not c: a else: b заменяется на if c: b else: a;
+      - if, условие которого - сравнение, заменяется на ast::CompareAndBranch, выбирающую ветку
+        по результату сравнения без создания значения Bool.
+    Возвращает количество заменённых инструкций if
+    */
+    std::size_t FuseConditions(ast::StatementPtr& program);
+
+}  // namespace optimizer
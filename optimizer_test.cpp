@@ -0,0 +1,507 @@
+#include "bytecode.h"
+#include "flat_ast.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "pass_manager.h"
+#include "statement.h"
+#include "test_runner_p.h"
+#include "vm.h"
+
+using namespace std;
+
+namespace optimizer {
+
+    namespace {
+
+        ast::StatementPtr Parse(const string& program) {
+            istringstream input(program);
+            parse::Lexer lexer(input);
+            return ParseProgram(lexer);
+        }
+
+        // Возвращает правую часть присваивания - index-й инструкции программы
+        ast::Statement& GetRightValue(ast::Statement& program, size_t index) {
+            const auto& statements = dynamic_cast<ast::Compound&>(program).GetStatements();
+            return dynamic_cast<ast::Assignment&>(*statements.at(index)).GetRightValue();
+        }
+
+        template <typename T>
+        T& As(ast::Statement& statement) {
+            auto* result = dynamic_cast<T*>(&statement);
+            ASSERT(result != nullptr);
+            return *result;
+        }
+
+        string Run(ast::Statement& program) {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            program.Execute(closure, context);
+            return context.output.str();
+        }
+
+        // Выполняет программу без оптимизации и после свёртки констант, проверяет,
+        // что вывод совпадает, и возвращает его
+        string RunFolded(const string& source) {
+            auto program = Parse(source);
+            const string expected = Run(*program);
+            auto folded = Parse(source);
+            FoldConstants(folded);
+            ASSERT_EQUAL(Run(*folded), expected);
+            return expected;
+        }
+
+        // Применяет проходы в том же порядке, что и при запуске интерпретатора
+        void Optimize(ast::StatementPtr& program) {
+            PropagateConstants(program);
+            FoldConstants(program);
+            EliminateDeadBranches(program);
+            FuseConditions(program);
+        }
+
+        // Выполняет программу без оптимизации и после всех проходов оптимизатора деревом разбора,
+        // плоским вычислителем и виртуальной машиной, проверяет, что вывод совпадает, и возвращает его
+        string RunOptimized(const string& source) {
+            auto program = Parse(source);
+            const string expected = Run(*program);
+            auto optimized = Parse(source);
+            Optimize(optimized);
+            ASSERT_EQUAL(Run(*optimized), expected);
+            {
+                runtime::DummyContext context;
+                runtime::Closure closure;
+                flat::Evaluator(context).Run(flat::Flatten(*optimized), closure);
+                ASSERT_EQUAL(context.output.str(), expected);
+            }
+            {
+                runtime::DummyContext context;
+                runtime::Closure closure;
+                bytecode::VirtualMachine(context).Run(bytecode::Compile(*optimized), closure);
+                ASSERT_EQUAL(context.output.str(), expected);
+            }
+            return expected;
+        }
+
+        const ast::StatementList& GetStatements(ast::Statement& program) {
+            return As<ast::Compound>(program).GetStatements();
+        }
+
+        void TestFoldsArithmetic() {
+            auto program = Parse("a = 2 * 3 + 4\nb = (10 - 4) / 3\nc = x + 2 * 3\n"s);
+            ASSERT_EQUAL(FoldConstants(program), 5U);
+            ASSERT_EQUAL(As<ast::NumericConst>(GetRightValue(*program, 0)).GetValue().GetValue(), 10);
+            ASSERT_EQUAL(As<ast::NumericConst>(GetRightValue(*program, 1)).GetValue().GetValue(), 2);
+            auto& add = As<ast::Add>(GetRightValue(*program, 2));
+            As<ast::VariableValue>(add.GetLhs());
+            ASSERT_EQUAL(As<ast::NumericConst>(add.GetRhs()).GetValue().GetValue(), 6);
+        }
+
+        void TestFoldsStrings() {
+            auto program = Parse("a = 'x' + 'y' + str(1 + 2)\nb = str(None) + str(True)\nc = str('q')\n"s);
+            FoldConstants(program);
+            ASSERT_EQUAL(As<ast::StringConst>(GetRightValue(*program, 0)).GetValue().GetValue(), "xy3"s);
+            ASSERT_EQUAL(As<ast::StringConst>(GetRightValue(*program, 1)).GetValue().GetValue(), "NoneTrue"s);
+            ASSERT_EQUAL(As<ast::StringConst>(GetRightValue(*program, 2)).GetValue().GetValue(), "q"s);
+        }
+
+        void TestNegation() {
+            auto program = Parse("a = -x\nb = -5\nc = -(-(x * 2))\nd = --x\n"s);
+            As<ast::Negate>(GetRightValue(*program, 0));
+            FoldConstants(program);
+            As<ast::VariableValue>(As<ast::Negate>(GetRightValue(*program, 0)).GetArgument());
+            ASSERT_EQUAL(As<ast::NumericConst>(GetRightValue(*program, 1)).GetValue().GetValue(), -5);
+            As<ast::Mult>(GetRightValue(*program, 2));
+            // Значение x может не быть числом: тогда -(-x) выбрасывает исключение
+            As<ast::Negate>(As<ast::Negate>(GetRightValue(*program, 3)).GetArgument());
+
+            ASSERT_EQUAL(RunFolded("x = 7\nprint -x, -(-x), -(2 * x), 0 - x * 1, --x\n"s), "-7 7 -14 -7 7\n"s);
+            ASSERT_THROWS(RunFolded("x = 'a'\nprint -x\n"s), runtime_error);
+        }
+
+        void TestIdentities() {
+            auto program = Parse("a = x * 2 * 1\nb = x * 1\nc = (x - 1) + 0\nd = 0 - x * 3\ne = 1 * (x / 2) / -1\n"
+                "f = x + 0\n"s);
+            FoldConstants(program);
+            As<ast::Mult>(GetRightValue(*program, 0));
+            // Для экземпляра класса x * 1 выбрасывает исключение, а не возвращает x
+            As<ast::Mult>(GetRightValue(*program, 1));
+            As<ast::Sub>(GetRightValue(*program, 2));
+            As<ast::Mult>(As<ast::Negate>(GetRightValue(*program, 3)).GetArgument());
+            As<ast::Div>(As<ast::Negate>(GetRightValue(*program, 4)).GetArgument());
+            // Для строки x + 0 выбрасывает исключение, а для экземпляра класса вызывает __add__
+            As<ast::Add>(GetRightValue(*program, 5));
+
+            ASSERT_EQUAL(RunFolded("x = 6\nprint x * 2 * 1, (x - 1) + 0, 0 - x * 3, 1 * (x / 2) / -1\n"s),
+                "12 5 -18 -3\n"s);
+        }
+
+        void TestLogicalOperations() {
+            auto program = Parse("a = True or x\nb = 0 and x\nc = x or True\nd = not 0\ne = 1 < 2 and 'b' >= 'a'\n"s);
+            FoldConstants(program);
+            ASSERT(As<ast::BoolConst>(GetRightValue(*program, 0)).GetValue().GetValue());
+            ASSERT(!As<ast::BoolConst>(GetRightValue(*program, 1)).GetValue().GetValue());
+            As<ast::Or>(GetRightValue(*program, 2));
+            ASSERT(As<ast::BoolConst>(GetRightValue(*program, 3)).GetValue().GetValue());
+            ASSERT(As<ast::BoolConst>(GetRightValue(*program, 4)).GetValue().GetValue());
+        }
+
+        void TestErrorsStayAtExecutionPoint() {
+            auto program = Parse("a = 1 / 0\nb = 1 < 'a'\nc = 'a' - 1\nd = -'a'\n"s);
+            ASSERT_EQUAL(FoldConstants(program), 0U);
+            As<ast::Div>(GetRightValue(*program, 0));
+            As<ast::Comparison>(GetRightValue(*program, 1));
+            As<ast::Sub>(GetRightValue(*program, 2));
+            As<ast::Negate>(GetRightValue(*program, 3));
+
+            auto failing = Parse("print 'before'\nprint 2 * 3 / (1 - 1)\nprint 'after'\n"s);
+            FoldConstants(failing);
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            ASSERT_THROWS(failing->Execute(closure, context), runtime_error);
+            ASSERT_EQUAL(context.output.str(), "before\n"s);
+        }
+
+        void TestMethodBodiesAreFolded() {
+            const string source = R"(
+class Circle:
+  def __init__(r):
+    self.r = r
+
+  def area():
+    return self.r * self.r * (314 / 100) * 1
+
+  def __str__():
+    return 'Circle of radius ' + str(2 - 1) + str(self.r)
+
+c = Circle(3)
+print c, c.area(), 'area: ' + str(c.area())
+)"s;
+            auto program = Parse(source);
+            ASSERT_EQUAL(FoldConstants(program), 5U);
+            ASSERT_EQUAL(RunFolded(source), "Circle of radius 13 27 area: 27\n"s);
+        }
+
+        void TestPropagatesConstants() {
+            auto program = Parse("DEBUG = False\nn = 3\nprint n * 2, DEBUG\nm = n + 1\nk = 1\nk = 2\nprint k, m\n"
+                "if m > 0:\n  w = 5\nprint w\n"s);
+            // n и DEBUG в print, n в m = n + 1 и свёрнутое затем 3 + 1, m в print и в условии
+            ASSERT_EQUAL(PropagateConstants(program), 6U);
+            FoldConstants(program);
+            const auto& print = As<ast::Print>(*GetStatements(*program).at(2));
+            ASSERT_EQUAL(As<ast::NumericConst>(*print.GetArguments().at(0)).GetValue().GetValue(), 6);
+            As<ast::BoolConst>(*print.GetArguments().at(1));
+            // k присваивается дважды, w - внутри ветки if
+            const auto& second = As<ast::Print>(*GetStatements(*program).at(6));
+            As<ast::VariableValue>(*second.GetArguments().at(0));
+            As<ast::NumericConst>(*second.GetArguments().at(1));
+            As<ast::VariableValue>(*As<ast::Print>(*GetStatements(*program).at(8)).GetArguments().at(0));
+
+            // Обращение до присваивания остаётся ошибкой, а тела методов не меняются
+            auto early = Parse("print x\nx = 1\n"s);
+            ASSERT_EQUAL(PropagateConstants(early), 0U);
+            ASSERT_THROWS(Run(*early), runtime_error);
+            auto method = Parse("x = 1\nclass A:\n  def f():\n    return x\nA = 2\nprint A\n"s);
+            ASSERT_EQUAL(PropagateConstants(method), 0U);
+
+            ASSERT_EQUAL(RunOptimized("s = 'a'\nt = s + 'b'\nprint t, s + t, str(t)\n"s), "ab aab ab\n"s);
+        }
+
+        void TestEliminatesDeadBranches() {
+            const string source = R"(
+DEBUG = False
+VERBOSE = 1
+if DEBUG:
+  print 'debug'
+if not DEBUG:
+  print 'release'
+  if VERBOSE:
+    print 'verbose'
+  else:
+    print 'quiet'
+else:
+  print 'never'
+if VERBOSE > 2:
+  print 'very verbose'
+print 'done'
+)"s;
+            auto program = Parse(source);
+            Optimize(program);
+            // Остались присваивания и три инструкции print
+            const auto& statements = GetStatements(*program);
+            ASSERT_EQUAL(statements.size(), 5U);
+            for (size_t i = 2; i < statements.size(); ++i) {
+                As<ast::Print>(*statements[i]);
+            }
+            ASSERT_EQUAL(RunOptimized(source), "release\nverbose\ndone\n"s);
+
+            auto methods = Parse("class A:\n  def f(x):\n    if True:\n      return x\n    return 0\n"
+                "a = A()\nprint a.f(2)\n"s);
+            ASSERT_EQUAL(EliminateDeadBranches(methods), 1U);
+            ASSERT_EQUAL(RunOptimized("class A:\n  def f(x):\n    if 1 > 2:\n      return 0\n    return x\n"
+                "a = A()\nprint a.f(2)\n"s), "2\n"s);
+
+            // Невыполнимая ветка с объявлением класса остаётся: A() ссылается на класс, которым владеет объявление
+            const string class_in_dead_branch = "if False:\n  class A:\n    def f():\n      return 1\nx = A()\nprint x.f()\n"s;
+            auto with_class = Parse(class_in_dead_branch);
+            ASSERT_EQUAL(EliminateDeadBranches(with_class), 0U);
+            ASSERT_EQUAL(RunOptimized(class_in_dead_branch), "1\n"s);
+            ASSERT_EQUAL(RunOptimized("if True:\n  print 0\nelse:\n  class B:\n    def f():\n      return 2\n"
+                "b = B()\nprint b.f()\n"s), "0\n2\n"s);
+        }
+
+        void TestFusesConditions() {
+            auto program = Parse("if x < 2:\n  print 1\nif not x:\n  print 2\nif not x >= 3:\n  print 3\n"
+                "else:\n  print 4\nif x:\n  print 5\n"s);
+            ASSERT_EQUAL(FuseConditions(program), 3U);
+            const auto& statements = GetStatements(*program);
+            As<ast::CompareAndBranch>(*statements.at(0));
+            auto& negated = As<ast::IfElse>(*statements.at(1));
+            As<ast::VariableValue>(negated.GetCondition());
+            ASSERT(negated.GetElseBody() != nullptr);
+            auto& swapped = As<ast::CompareAndBranch>(*statements.at(2));
+            As<ast::Print>(*As<ast::Compound>(swapped.GetIfBody()).GetStatements().at(0));
+            As<ast::IfElse>(*statements.at(3));
+
+            const string source = R"(
+class Counter:
+  def __init__():
+    self.n = 0
+
+  def __lt__(other):
+    self.n = self.n + 1
+    return self.n < other
+
+  def run(limit):
+    if not limit > 3:
+      return 'small'
+    if 'a' < 'b':
+      print 'strings'
+    return 'large'
+
+c = Counter()
+if c < 5:
+  print 'first', c.n
+if not c < 1:
+  print 'second', c.n
+else:
+  print 'third'
+print c.run(2), c.run(7)
+)"s;
+            ASSERT_EQUAL(RunOptimized(source), "first 1\nsecond 2\nsmall strings\nlarge\n"s);
+            ASSERT_THROWS(RunOptimized("x = 'a'\nif x < 1:\n  print x\n"s), runtime_error);
+        }
+
+        void TestLongChains() {
+            // Цепочки операций длиннее MAX_NESTING_DEPTH проходы, проверка дерева и все способы
+            // выполнения обходят без рекурсии по длине цепочки
+            const size_t terms = 20000;
+            auto chain = [terms](const string& first, const string& link) {
+                string result = first;
+                for (size_t i = 0; i < terms; ++i) {
+                    result += link;
+                }
+                return result;
+            };
+            const string source = "x = 2\ny = 1\ny = y + 1\n"s
+                + "print "s + chain("1"s, " + 1"s) + ", "s + chain("y"s, " - x * 1"s) + "\n"s
+                + "if "s + chain("y"s, " + 0"s) + " < 5 or "s + chain("False"s, " or False"s) + ":\n  print 'lt'\n"s
+                + "class C:\n  def f(a):\n    return "s + chain("a"s, " * 1"s) + " + 1\n"s
+                + "c = C()\nprint c.f(y)\n"s;
+            ASSERT_EQUAL(RunOptimized(source), to_string(terms + 1) + " "s + to_string(2 - 2 * static_cast<int>(terms))
+                + "\nlt\n3\n"s);
+
+            auto program = Parse(source);
+            ASSERT_EQUAL(VerifyTree(*program), VerifyTree(*Parse(source)));
+            Optimize(program);
+            VerifyTree(*program);
+        }
+
+        vector<string> GetPassNames(const PassManager& passes) {
+            vector<string> names;
+            for (const PassStats& stats : passes.GetStats()) {
+                names.push_back(stats.name);
+            }
+            return names;
+        }
+
+        // Возвращает сообщение исключения VerificationError, выброшенного при выполнении проходов
+        string GetVerificationError(PassManager& passes, ast::StatementPtr& program) {
+            try {
+                passes.Run(program);
+            }
+            catch (const VerificationError& e) {
+                return e.what();
+            }
+            return {};
+        }
+
+        const string PROGRAM = R"(
+DEBUG = False
+LIMIT = 2 * 5
+class Counter:
+  def __init__():
+    self.n = 0
+
+  def add(k):
+    if not k < 0:
+      self.n = self.n + k * 1
+    return self.n
+
+c = Counter()
+if DEBUG:
+  print 'debug'
+print c.add(LIMIT), c.add(-1), c.add(3)
+)"s;
+
+        void TestLevels() {
+            ASSERT(PassManager(OptimizationLevel::O0).GetStats().empty());
+            ASSERT_EQUAL(GetPassNames(PassManager(OptimizationLevel::O1)),
+                (vector<string>{ "fold-constants"s, "eliminate-dead-branches"s }));
+            ASSERT_EQUAL(GetPassNames(PassManager(OptimizationLevel::O2)),
+                (vector<string>{ "propagate-constants"s, "fold-constants"s, "eliminate-dead-branches"s,
+                    "fuse-conditions"s }));
+            ASSERT_EQUAL(FindPass("fuse-conditions"sv).name, "fuse-conditions"s);
+            ASSERT_THROWS(FindPass("inline-everything"sv), invalid_argument);
+
+            for (auto level : { OptimizationLevel::O0, OptimizationLevel::O1, OptimizationLevel::O2 }) {
+                auto program = Parse(PROGRAM);
+                PassManager passes(level);
+                passes.SetVerify(true);
+                passes.Run(program);
+                ASSERT_EQUAL(Run(*program), "10 10 13\n"s);
+            }
+        }
+
+        void TestStatistics() {
+            auto program = Parse(PROGRAM);
+            const size_t nodes = VerifyTree(*program);
+            PassManager passes(OptimizationLevel::O2);
+            passes.SetCountNodes(true);
+            const size_t rewritten = passes.Run(program);
+
+            const auto& stats = passes.GetStats();
+            ASSERT_EQUAL(stats.size(), 4U);
+            size_t total = 0;
+            for (const PassStats& pass : stats) {
+                ASSERT_EQUAL(pass.runs, 1U);
+                total += pass.rewritten;
+            }
+            ASSERT_EQUAL(total, rewritten);
+            // DEBUG и LIMIT, а также 2 * 5 в правой части присваивания LIMIT
+            ASSERT_EQUAL(stats[0].rewritten, 3U);
+            ASSERT_EQUAL(stats[0].nodes_before, nodes);
+            // not False. k * 1 не сворачивается: значение k может не быть числом
+            ASSERT_EQUAL(stats[1].rewritten, 1U);
+            // Удалены if DEBUG с телом, а print внутри if not DEBUG встроен в программу
+            ASSERT_EQUAL(stats[2].rewritten, 1U);
+            ASSERT_EQUAL(stats[2].nodes_before - stats[2].nodes_after, 5U);
+            // if not k < 0 в методе
+            ASSERT_EQUAL(stats[3].rewritten, 1U);
+            ASSERT_EQUAL(stats[3].nodes_after, VerifyTree(*program));
+
+            ostringstream out;
+            passes.PrintStats(out);
+            ASSERT(out.str().find("eliminate-dead-branches"s) != string::npos);
+            ASSERT(out.str().find("5 nodes removed"s) != string::npos);
+
+            // Статистика накапливается за все вызовы Run, например по инструкциям при выполнении по мере разбора
+            auto other = Parse("print 1 + 2\n"s);
+            passes.Run(other);
+            ASSERT_EQUAL(passes.GetStats()[1].runs, 2U);
+            ASSERT_EQUAL(passes.GetStats()[1].rewritten, 2U);
+        }
+
+        void TestCustomPasses() {
+            PassManager passes;
+            size_t calls = 0;
+            passes.AddPass({ "count-calls"s, [&calls](ast::StatementPtr& /*program*/) {
+                ++calls;
+                return size_t{ 0 };
+            } });
+            passes.AddPass(FindPass("fold-constants"sv));
+            auto program = Parse("x = 'a' + 'b'\n"s);
+            ASSERT_EQUAL(passes.Run(program), 1U);
+            ASSERT_EQUAL(calls, 1U);
+            ASSERT_EQUAL(GetPassNames(passes), (vector<string>{ "count-calls"s, "fold-constants"s }));
+
+            const vector<Pass> list = ParsePassList("fuse-conditions,fold-constants"sv);
+            ASSERT_EQUAL(list.size(), 2U);
+            ASSERT_EQUAL(list[0].name, "fuse-conditions"s);
+            ASSERT_EQUAL(list[1].name, "fold-constants"s);
+            ASSERT_THROWS(ParsePassList("fold-constants,"sv), invalid_argument);
+            ASSERT_THROWS(ParsePassList(",fold-constants"sv), invalid_argument);
+            ASSERT_THROWS(ParsePassList("fold-constants,,fuse-conditions"sv), invalid_argument);
+            ASSERT_THROWS(ParsePassList(""sv), invalid_argument);
+            ASSERT_THROWS(ParsePassList("fold-constants,inline"sv), invalid_argument);
+        }
+
+        void TestVerifier() {
+            // Compound, присваивание и число, print, сложение, переменная и число
+            ASSERT_EQUAL(VerifyTree(*Parse("x = 1\nprint x + 2\n"s)), 7U);
+            // Узлы тел методов тоже считаются: тело метода, составная инструкция, return и число
+            ASSERT_EQUAL(VerifyTree(*Parse("class A:\n  def f():\n    return 1\n"s)), 6U);
+
+            PassManager passes;
+            passes.AddPass({ "drop-statement"s, [](ast::StatementPtr& program) {
+                auto compound = make_unique<ast::Compound>(std::move(program));
+                compound->AddStatement(nullptr);
+                program = std::move(compound);
+                return size_t{ 1 };
+            } });
+            passes.SetVerify(true);
+            auto program = Parse("print 1\n"s);
+            ASSERT_EQUAL(GetVerificationError(passes, program),
+                "AST verification failed after pass drop-statement: Missing child node"s);
+
+            PassManager slots;
+            slots.AddPass({ "resolve-slot"s, [](ast::StatementPtr& program) {
+                const auto& statements = dynamic_cast<ast::Compound&>(*program).GetStatements();
+                const auto& print = dynamic_cast<ast::Print&>(*statements.front());
+                dynamic_cast<ast::VariableValue&>(*print.GetArguments().front()).SetSlot(0);
+                return size_t{ 1 };
+            } });
+            slots.SetVerify(true);
+            auto variable = Parse("print x\n"s);
+            ASSERT_EQUAL(GetVerificationError(slots, variable),
+                "AST verification failed after pass resolve-slot: Top-level variable x is resolved to a slot"s);
+
+            // Без проверки нарушение не обнаруживается
+            slots.SetVerify(false);
+            auto unchecked = Parse("print x\n"s);
+            ASSERT_EQUAL(GetVerificationError(slots, unchecked), ""s);
+
+            PassManager method_body;
+            method_body.AddPass({ "wrap-in-method"s, [](ast::StatementPtr& program) {
+                program = make_unique<ast::MethodBody>(std::move(program));
+                return size_t{ 1 };
+            } });
+            method_body.SetVerify(true);
+            auto wrapped = Parse("print 1\n"s);
+            ASSERT_EQUAL(GetVerificationError(method_body, wrapped),
+                "AST verification failed after pass wrap-in-method: Method body outside of a method"s);
+        }
+
+    }  // namespace
+
+    void RunOptimizerTests(TestRunner& tr) {
+        RUN_TEST(tr, optimizer::TestFoldsArithmetic);
+        RUN_TEST(tr, optimizer::TestFoldsStrings);
+        RUN_TEST(tr, optimizer::TestNegation);
+        RUN_TEST(tr, optimizer::TestIdentities);
+        RUN_TEST(tr, optimizer::TestLogicalOperations);
+        RUN_TEST(tr, optimizer::TestErrorsStayAtExecutionPoint);
+        RUN_TEST(tr, optimizer::TestMethodBodiesAreFolded);
+        RUN_TEST(tr, optimizer::TestPropagatesConstants);
+        RUN_TEST(tr, optimizer::TestEliminatesDeadBranches);
+        RUN_TEST(tr, optimizer::TestFusesConditions);
+        RUN_TEST(tr, optimizer::TestLongChains);
+    }
+
+    void RunPassManagerTests(TestRunner& tr) {
+        RUN_TEST(tr, optimizer::TestLevels);
+        RUN_TEST(tr, optimizer::TestStatistics);
+        RUN_TEST(tr, optimizer::TestCustomPasses);
+        RUN_TEST(tr, optimizer::TestVerifier);
+    }
+
+}  // namespace optimizer
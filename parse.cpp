@@ -3,6 +3,9 @@
 #include "lexer.h"
 #include "statement.h"
 
+#include <string>
+#include <unordered_map>
+
 using namespace std;
 
 namespace TokenType = parse::token_type;
@@ -17,16 +20,68 @@ namespace {
         return !(token == c);
     }
 
+    // Разрешает имена переменных тела метода в слоты кадра runtime::Frame:
+    // self занимает слот Frame::SELF_SLOT, параметры - следующие за ним слоты,
+    // локальные переменные - слоты после параметров в порядке первого упоминания.
+    // Внутри метода видны только self, параметры и локальные переменные, поэтому
+    // каждое имя в теле метода получает слот
+    class ScopeResolver : public ast::RecursiveStatementVisitor {
+    public:
+        explicit ScopeResolver(const runtime::Method& method) {
+            slots_[runtime::SELF_SYMBOL] = runtime::Frame::SELF_SLOT;
+            for (size_t i = 0; i < method.formal_params.size(); ++i) {
+                slots_[method.formal_params[i]] = runtime::Frame::SELF_SLOT + 1 + i;
+            }
+            frame_size_ = runtime::Frame::SELF_SLOT + 1 + method.formal_params.size();
+        }
+
+        void Visit(ast::VariableValue& node) override {
+            node.SetSlot(Resolve(node.GetDottedIds().front()));
+        }
+
+        void Visit(ast::Assignment& node) override {
+            RecursiveStatementVisitor::Visit(node);
+            node.SetSlot(Resolve(node.GetVariable()));
+        }
+
+        void Visit(ast::ClassDefinition& /*node*/) override {
+            // Класс, объявленный внутри метода, сохраняется в кадре по имени
+            resolvable_ = false;
+        }
+
+        // Возвращает размер кадра либо 0, если тело метода нужно выполнять над Closure
+        [[nodiscard]] size_t GetFrameSize() const {
+            return resolvable_ ? frame_size_ : 0;
+        }
+
+    private:
+        size_t Resolve(runtime::Symbol name) {
+            auto [it, inserted] = slots_.emplace(name, frame_size_);
+            if (inserted) {
+                ++frame_size_;
+            }
+            return it->second;
+        }
+
+        unordered_map<runtime::Symbol, size_t> slots_;
+        size_t frame_size_ = 0;
+        bool resolvable_ = true;
+    };
+
     class Parser {
     public:
-        explicit Parser(parse::Lexer& lexer)
-            : lexer_(lexer) {
+        Parser(parse::Lexer& lexer, DeclaredClasses& declared)
+            : lexer_(lexer)
+            , declared_(declared) {
         }
 
         // Program -> eps
         //          | Statement \n Program
-        unique_ptr<ast::Statement> ParseProgram() {
-            auto result = make_unique<ast::Compound>();
+        ast::StatementPtr ParseProgram() {
+            // Узлы программы размещаются в арене, которой владеет её составная инструкция
+            auto result = ast::MakeNode<ast::Compound>();
+            result->SetArena(make_unique<ast::NodeArena>());
+            ast::NodeArena::Scope arena(result->GetOwnedArena());
             while (!lexer_.CurrentToken().Is<TokenType::Eof>()) {
                 result->AddStatement(ParseStatement());
             }
@@ -34,16 +89,54 @@ namespace {
             return result;
         }
 
+        void ParseProgram(const function<bool(ast::StatementPtr)>& on_statement) {
+            while (!lexer_.CurrentToken().Is<TokenType::Eof>()) {
+                if (!on_statement(ParseStatement())) {
+                    return;
+                }
+            }
+        }
+
     private:
+        // Увеличивает глубину разбора, восстанавливая прежнюю при выходе из области видимости
+        class DepthGuard {
+        public:
+            explicit DepthGuard(Parser& parser)
+                : parser_(parser)
+                , depth_(parser.depth_) {
+            }
+
+            DepthGuard(const DepthGuard&) = delete;
+            DepthGuard& operator=(const DepthGuard&) = delete;
+
+            ~DepthGuard() {
+                parser_.depth_ = depth_;
+            }
+
+            // Добавляет уровень вложенности
+            void Enter() {
+                if (++parser_.depth_ > MAX_NESTING_DEPTH) {
+                    throw ParseError("Program is nested too deeply: more than "s
+                        + std::to_string(MAX_NESTING_DEPTH) + " levels"s);
+                }
+            }
+
+        private:
+            Parser& parser_;
+            size_t depth_;
+        };
+
         // Suite -> NEWLINE INDENT (Statement)+ DEDENT
-        unique_ptr<ast::Statement> ParseSuite()  // NOLINT
+        ast::StatementPtr ParseSuite()  // NOLINT
         {
             lexer_.Expect<TokenType::Newline>();
             lexer_.ExpectNext<TokenType::Indent>();
 
             lexer_.NextToken();
 
-            auto result = make_unique<ast::Compound>();
+            DepthGuard guard(*this);
+            guard.Enter();
+            auto result = ast::MakeNode<ast::Compound>();
             while (!lexer_.CurrentToken().Is<TokenType::Dedent>()) {
                 result->AddStatement(ParseStatement());  // NOLINT
             }
@@ -76,7 +169,13 @@ namespace {
                 lexer_.ExpectNext<TokenType::Char>(':');
                 lexer_.NextToken();
 
-                m.body = std::make_unique<ast::MethodBody>(ParseSuite());  // NOLINT
+                auto body = ast::MakeNode<ast::MethodBody>(ParseSuite());  // NOLINT
+
+                ScopeResolver resolver(m);
+                body->Accept(resolver);
+                m.frame_size = resolver.GetFrameSize();
+                // Тело из арены класс не удаляет (см. ast::ClassDefinition)
+                m.body.reset(body.release());
 
                 result.push_back(std::move(m));
             }
@@ -84,23 +183,22 @@ namespace {
         }
 
         // ClassDefinition -> Id ['(' Id ')'] : new_line indent MethodList dedent
-        unique_ptr<ast::Statement> ParseClassDefinition()  // NOLINT
+        ast::StatementPtr ParseClassDefinition()  // NOLINT
         {
-            string class_name = lexer_.Expect<TokenType::Id>().value;
+            string class_name = lexer_.Expect<TokenType::Id>().value.GetName();
 
             lexer_.NextToken();
 
             const runtime::Class* base_class = nullptr;
             if (lexer_.CurrentToken() == '(') {
-                auto name = lexer_.ExpectNext<TokenType::Id>().value;
+                const string& name = lexer_.ExpectNext<TokenType::Id>().value.GetName();
                 lexer_.ExpectNext<TokenType::Char>(')');
                 lexer_.NextToken();
 
-                auto it = declared_classes_.find(name);
-                if (it == declared_classes_.end()) {
+                base_class = FindClass(name);
+                if (base_class == nullptr) {
                     throw ParseError("Base class "s + name + " not found for class "s + class_name);
                 }
-                base_class = static_cast<const runtime::Class*>(it->second.Get());  // NOLINT
             }
 
             lexer_.Expect<TokenType::Char>(':');
@@ -112,20 +210,19 @@ namespace {
             lexer_.Expect<TokenType::Dedent>();
             lexer_.NextToken();
 
-            auto [it, inserted] = declared_classes_.insert({
-                class_name,
-                runtime::ObjectHolder::Own(runtime::Class(class_name, std::move(methods), base_class)),
-                });
-
-            if (!inserted) {
+            if (FindClass(class_name) != nullptr) {
                 throw ParseError("Class "s + class_name + " already exists"s);
             }
+            auto it = declared_.classes.insert({
+                class_name,
+                runtime::ObjectHolder::Own(runtime::Class(class_name, std::move(methods), base_class)),
+                }).first;
 
-            return make_unique<ast::ClassDefinition>(it->second);
+            return ast::MakeNode<ast::ClassDefinition>(it->second);
         }
 
-        vector<string> ParseDottedIds() {
-            vector<string> result(1, lexer_.Expect<TokenType::Id>().value);
+        ast::NodeVector<runtime::Symbol> ParseDottedIds() {
+            ast::NodeVector<runtime::Symbol> result(1, lexer_.Expect<TokenType::Id>().value);
 
             while (lexer_.NextToken() == '.') {
                 result.push_back(lexer_.ExpectNext<TokenType::Id>().value);
@@ -136,71 +233,73 @@ namespace {
 
         //  AssgnOrCall -> DottedIds = Expr
         //               | DottedIds '(' ExprList ')'
-        unique_ptr<ast::Statement> ParseAssignmentOrCall() {
+        ast::StatementPtr ParseAssignmentOrCall() {
             lexer_.Expect<TokenType::Id>();
 
-            vector<string> id_list = ParseDottedIds();
-            string last_name = id_list.back();
+            ast::NodeVector<runtime::Symbol> id_list = ParseDottedIds();
+            runtime::Symbol last_name = id_list.back();
             id_list.pop_back();
 
             if (lexer_.CurrentToken() == '=') {
                 lexer_.NextToken();
 
                 if (id_list.empty()) {
-                    return make_unique<ast::Assignment>(std::move(last_name), ParseTest());
+                    return ast::MakeNode<ast::Assignment>(last_name, ParseTest());
                 }
-                return make_unique<ast::FieldAssignment>(ast::VariableValue{ std::move(id_list) },
-                    std::move(last_name), ParseTest());
+                return ast::MakeNode<ast::FieldAssignment>(ast::VariableValue{ std::move(id_list) },
+                    last_name, ParseTest());
             }
             lexer_.Expect<TokenType::Char>('(');
             lexer_.NextToken();
 
             if (id_list.empty()) {
-                throw ParseError("Mython doesn't support functions, only methods: "s + last_name);
+                throw ParseError("Mython doesn't support functions, only methods: "s + last_name.GetName());
             }
 
-            vector<unique_ptr<ast::Statement>> args;
+            ast::StatementList args;
             if (lexer_.CurrentToken() != ')') {
                 args = ParseTestList();
             }
             lexer_.Expect<TokenType::Char>(')');
             lexer_.NextToken();
 
-            return make_unique<ast::MethodCall>(make_unique<ast::VariableValue>(std::move(id_list)),
-                std::move(last_name), std::move(args));
+            return ast::MakeNode<ast::MethodCall>(ast::MakeNode<ast::VariableValue>(std::move(id_list)),
+                last_name, std::move(args));
         }
 
         // Expr -> Adder ['+'/'-' Adder]*
-        unique_ptr<ast::Statement> ParseExpression()  // NOLINT
+        // Операнды цепочки не добавляют уровней вложенности: цепочка любой длины вычисляется
+        // и обходится циклом (см. ast::BinaryOperation::GetLhsOperation)
+        ast::StatementPtr ParseExpression()  // NOLINT
         {
-            unique_ptr<ast::Statement> result = ParseAdder();
+            ast::StatementPtr result = ParseAdder();
             while (lexer_.CurrentToken() == '+' || lexer_.CurrentToken() == '-') {
                 char op = lexer_.CurrentToken().As<TokenType::Char>().value;
                 lexer_.NextToken();
 
                 if (op == '+') {
-                    result = make_unique<ast::Add>(std::move(result), ParseAdder());
+                    result = ast::MakeNode<ast::Add>(std::move(result), ParseAdder());
                 }
                 else {
-                    result = make_unique<ast::Sub>(std::move(result), ParseAdder());
+                    result = ast::MakeNode<ast::Sub>(std::move(result), ParseAdder());
                 }
             }
             return result;
         }
 
         // Adder -> Mult ['*'/'/' Mult]*
-        unique_ptr<ast::Statement> ParseAdder()  // NOLINT
+        ast::StatementPtr ParseAdder()  // NOLINT
         {
-            unique_ptr<ast::Statement> result = ParseMult();
+            ast::StatementPtr result = ParseMult();
             while (lexer_.CurrentToken() == '*' || lexer_.CurrentToken() == '/') {
                 char op = lexer_.CurrentToken().As<TokenType::Char>().value;
                 lexer_.NextToken();
 
                 if (op == '*') {
-                    result = make_unique<ast::Mult>(std::move(result), ParseMult());
+                    result = ast::MakeNode<ast::Mult>(std::move(result), ParseMult());
                 }
                 else {
-                    result = make_unique<ast::Div>(std::move(result), ParseMult());
+                    result = ast::MakeNode<ast::Div>(std::move(result), ParseMult());
                 }
             }
             return result;
@@ -215,9 +314,11 @@ namespace {
         //       | FALSE
         //       | DottedIds '(' ExprList ')'
         //       | DottedIds
-        unique_ptr<ast::Statement> ParseMult()  // NOLINT
+        ast::StatementPtr ParseMult()  // NOLINT
         {
+            DepthGuard guard(*this);
             if (lexer_.CurrentToken() == '(') {
+                guard.Enter();
                 lexer_.NextToken();
                 auto result = ParseTest();
                 lexer_.Expect<TokenType::Char>(')');
@@ -225,41 +326,44 @@ namespace {
                 return result;
             }
             if (lexer_.CurrentToken() == '-') {
+                guard.Enter();
                 lexer_.NextToken();
-                return make_unique<ast::Mult>(ParseMult(), make_unique<ast::NumericConst>(-1));
+                return ast::MakeNode<ast::Negate>(ParseMult());
             }
             if (const auto* num = lexer_.CurrentToken().TryAs<TokenType::Number>()) {
                 int result = num->value;
                 lexer_.NextToken();
-                return make_unique<ast::NumericConst>(result);
+                return ast::MakeNode<ast::NumericConst>(result);
             }
             if (const auto* str = lexer_.CurrentToken().TryAs<TokenType::String>()) {
                 string result = str->value;
                 lexer_.NextToken();
-                return make_unique<ast::StringConst>(std::move(result));
+                return ast::MakeNode<ast::StringConst>(std::move(result));
             }
             if (lexer_.CurrentToken().Is<TokenType::True>()) {
                 lexer_.NextToken();
-                return make_unique<ast::BoolConst>(runtime::Bool(true));
+                return ast::MakeNode<ast::BoolConst>(runtime::Bool(true));
             }
             if (lexer_.CurrentToken().Is<TokenType::False>()) {
                 lexer_.NextToken();
-                return make_unique<ast::BoolConst>(runtime::Bool(false));
+                return ast::MakeNode<ast::BoolConst>(runtime::Bool(false));
             }
             if (lexer_.CurrentToken().Is<TokenType::None>()) {
                 lexer_.NextToken();
-                return make_unique<ast::None>();
+                return ast::MakeNode<ast::None>();
             }
 
             return ParseDottedIdsInMultExpr();
         }
 
-        std::unique_ptr<ast::Statement> ParseDottedIdsInMultExpr() {
-            vector<string> names = ParseDottedIds();
+        ast::StatementPtr ParseDottedIdsInMultExpr() {
+            ast::NodeVector<runtime::Symbol> names = ParseDottedIds();
 
             if (lexer_.CurrentToken() == '(') {
                 // various calls
-                vector<unique_ptr<ast::Statement>> args;
+                DepthGuard guard(*this);
+                guard.Enter();
+                ast::StatementList args;
                 if (lexer_.NextToken() != ')') {
                     args = ParseTestList();
                 }
@@ -270,28 +374,27 @@ namespace {
                 names.pop_back();
 
                 if (!names.empty()) {
-                    return make_unique<ast::MethodCall>(
-                        make_unique<ast::VariableValue>(std::move(names)), std::move(method_name),
+                    return ast::MakeNode<ast::MethodCall>(
+                        ast::MakeNode<ast::VariableValue>(std::move(names)), method_name,
                         std::move(args));
                 }
-                if (auto it = declared_classes_.find(method_name); it != declared_classes_.end()) {
-                    return make_unique<ast::NewInstance>(
-                        static_cast<const runtime::Class&>(*it->second), std::move(args));  // NOLINT
+                if (const runtime::Class* cls = FindClass(method_name.GetName())) {
+                    return ast::MakeNode<ast::NewInstance>(*cls, std::move(args));
                 }
-                if (method_name == "str"sv) {
+                if (method_name.GetName() == "str"sv) {
                     if (args.size() != 1) {
                         throw ParseError("Function str takes exactly one argument"s);
                     }
-                    return make_unique<ast::Stringify>(std::move(args.front()));
+                    return ast::MakeNode<ast::Stringify>(std::move(args.front()));
                 }
-                throw ParseError("Unknown call to "s + method_name + "()"s);
+                throw ParseError("Unknown call to "s + method_name.GetName() + "()"s);
             }
-            return make_unique<ast::VariableValue>(std::move(names));
+            return ast::MakeNode<ast::VariableValue>(std::move(names));
         }
 
-        vector<unique_ptr<ast::Statement>> ParseTestList()  // NOLINT
+        ast::StatementList ParseTestList()  // NOLINT
         {
-            vector<unique_ptr<ast::Statement>> result;
+            ast::StatementList result;
             result.push_back(ParseTest());
 
             while (lexer_.CurrentToken() == ',') {
@@ -302,7 +405,7 @@ namespace {
         }
 
         // Condition -> if LogicalExpr: Suite [else: Suite]
-        unique_ptr<ast::Statement> ParseCondition()  // NOLINT
+        ast::StatementPtr ParseCondition()  // NOLINT
         {
             lexer_.Expect<TokenType::If>();
             lexer_.NextToken();
@@ -314,14 +417,14 @@ namespace {
 
             auto if_body = ParseSuite();
 
-            unique_ptr<ast::Statement> else_body;
+            ast::StatementPtr else_body;
             if (lexer_.CurrentToken().Is<TokenType::Else>()) {
                 lexer_.ExpectNext<TokenType::Char>(':');
                 lexer_.NextToken();
                 else_body = ParseSuite();
             }
 
-            return make_unique<ast::IfElse>(std::move(condition), std::move(if_body),
+            return ast::MakeNode<ast::IfElse>(std::move(condition), std::move(if_body),
                 std::move(else_body));
         }
 
@@ -329,37 +432,39 @@ namespace {
         // AndTest -> NotTest [AND NotTest]
         // NotTest -> [NOT] NotTest
         //          | Comparison
-        unique_ptr<ast::Statement> ParseTest()  // NOLINT
+        ast::StatementPtr ParseTest()  // NOLINT
         {
             auto result = ParseAndTest();
             while (lexer_.CurrentToken().Is<TokenType::Or>()) {
                 lexer_.NextToken();
-                result = make_unique<ast::Or>(std::move(result), ParseAndTest());
+                result = ast::MakeNode<ast::Or>(std::move(result), ParseAndTest());
             }
             return result;
         }
 
-        unique_ptr<ast::Statement> ParseAndTest()  // NOLINT
+        ast::StatementPtr ParseAndTest()  // NOLINT
         {
             auto result = ParseNotTest();
             while (lexer_.CurrentToken().Is<TokenType::And>()) {
                 lexer_.NextToken();
-                result = make_unique<ast::And>(std::move(result), ParseNotTest());
+                result = ast::MakeNode<ast::And>(std::move(result), ParseNotTest());
             }
             return result;
         }
 
-        unique_ptr<ast::Statement> ParseNotTest()  // NOLINT
+        ast::StatementPtr ParseNotTest()  // NOLINT
         {
             if (lexer_.CurrentToken().Is<TokenType::Not>()) {
+                DepthGuard guard(*this);
+                guard.Enter();
                 lexer_.NextToken();
-                return make_unique<ast::Not>(ParseNotTest());  // NOLINT
+                return ast::MakeNode<ast::Not>(ParseNotTest());  // NOLINT
             }
             return ParseComparison();
         }
 
         // Comparison -> Expr [COMP_OP Expr]
-        unique_ptr<ast::Statement> ParseComparison()  // NOLINT
+        ast::StatementPtr ParseComparison()  // NOLINT
         {
             auto result = ParseExpression();
 
@@ -367,32 +472,32 @@ namespace {
 
             if (tok == '<') {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::Less, std::move(result),
+                return ast::MakeNode<ast::Comparison>(runtime::Less, std::move(result),
                     ParseExpression());
             }
             if (tok == '>') {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::Greater, std::move(result),
+                return ast::MakeNode<ast::Comparison>(runtime::Greater, std::move(result),
                     ParseExpression());
             }
             if (tok.Is<TokenType::Eq>()) {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::Equal, std::move(result),
+                return ast::MakeNode<ast::Comparison>(runtime::Equal, std::move(result),
                     ParseExpression());
             }
             if (tok.Is<TokenType::NotEq>()) {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::NotEqual, std::move(result),
+                return ast::MakeNode<ast::Comparison>(runtime::NotEqual, std::move(result),
                     ParseExpression());
             }
             if (tok.Is<TokenType::LessOrEq>()) {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::LessOrEqual, std::move(result),
+                return ast::MakeNode<ast::Comparison>(runtime::LessOrEqual, std::move(result),
                     ParseExpression());
             }
             if (tok.Is<TokenType::GreaterOrEq>()) {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::GreaterOrEqual, std::move(result),
+                return ast::MakeNode<ast::Comparison>(runtime::GreaterOrEqual, std::move(result),
                     ParseExpression());
             }
             return result;
@@ -401,7 +506,7 @@ namespace {
         // Statement -> SimpleStatement Newline
         //           | class ClassDefinition
         //           | if Condition
-        unique_ptr<ast::Statement> ParseStatement()  // NOLINT
+        ast::StatementPtr ParseStatement()  // NOLINT
         {
             const auto& tok = lexer_.CurrentToken();
 
@@ -421,30 +526,55 @@ namespace {
         // StatementBody -> return Expression
         //               | print ExpressionList
         //               | AssignmentOrCall
-        unique_ptr<ast::Statement> ParseSimpleStatement() {
+        ast::StatementPtr ParseSimpleStatement() {
             const auto& tok = lexer_.CurrentToken();
 
             if (tok.Is<TokenType::Return>()) {
                 lexer_.NextToken();
-                return make_unique<ast::Return>(ParseTest());
+                return ast::MakeNode<ast::Return>(ParseTest());
             }
             if (tok.Is<TokenType::Print>()) {
                 lexer_.NextToken();
-                vector<unique_ptr<ast::Statement>> args;
+                ast::StatementList args;
                 if (!lexer_.CurrentToken().Is<TokenType::Newline>()) {
                     args = ParseTestList();
                 }
-                return make_unique<ast::Print>(std::move(args));
+                return ast::MakeNode<ast::Print>(std::move(args));
             }
             return ParseAssignmentOrCall();
         }
 
+        // Ищет класс среди объявленных и запоминает результат поиска
+        const runtime::Class* FindClass(const string& name) {
+            const runtime::Class* cls = nullptr;
+            if (auto it = declared_.classes.find(name); it != declared_.classes.end()) {
+                cls = static_cast<const runtime::Class*>(it->second.Get());  // NOLINT
+            }
+            else if (declared_.find_previous) {
+                cls = declared_.find_previous(name);
+            }
+            declared_.lookups.emplace_back(name, cls);
+            return cls;
+        }
+
         parse::Lexer& lexer_;
-        runtime::Closure declared_classes_;
+        DeclaredClasses& declared_;
+        size_t depth_ = 0;
     };
 
 }  // namespace
 
-unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer) {
-    return Parser{ lexer }.ParseProgram();
+ast::StatementPtr ParseProgram(parse::Lexer& lexer) {
+    DeclaredClasses declared;
+    return ParseProgram(lexer, declared);
+}
+
+ast::StatementPtr ParseProgram(parse::Lexer& lexer, DeclaredClasses& declared) {
+    return Parser{ lexer, declared }.ParseProgram();
+}
+
+void ParseProgram(parse::Lexer& lexer, DeclaredClasses& declared, ast::NodeArena& arena,
+    const function<bool(ast::StatementPtr)>& on_statement) {
+    ast::NodeArena::Scope scope(&arena);
+    Parser{ lexer, declared }.ParseProgram(on_statement);
 }
\ No newline at end of file
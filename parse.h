@@ -1,18 +1,57 @@
 #pragma once
 
+#include "runtime.h"
+
+#include <cstddef>
+#include <functional>
 #include <memory>
 #include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace parse {
     class Lexer;
 }
 
-namespace runtime {
-    class Executable;
+namespace ast {
+    class NodeArena;
+    class Statement;
+    struct NodeDeleter;
+    using StatementPtr = std::unique_ptr<Statement, NodeDeleter>;
 }
 
 struct ParseError : std::runtime_error {
     using std::runtime_error::runtime_error;
 };
 
-std::unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer);
\ No newline at end of file
+// Классы, объявленные в уже разобранной части программы. Позволяет разбирать программу по частям:
+// классы, объявленные в одной части, видны при разборе следующих
+struct DeclaredClasses {
+    runtime::Closure classes;
+    // Ищет класс, которого нет в classes. Если не задана, видны только классы из classes
+    std::function<const runtime::Class*(const std::string& name)> find_previous;
+    // Имена, которые разбор искал среди объявленных классов, и найденные классы (nullptr, если класса
+    // с таким именем не было). Результат разбора части не изменится, пока эти имена означают те же классы
+    std::vector<std::pair<std::string, const runtime::Class*>> lookups;
+};
+
+// Наибольшая глубина дерева разбора. Уровень добавляют вложенные скобки, унарные операции и блоки
+// инструкций. Более глубокая программа отвергается с ParseError, поэтому разбор, выполнение и удаление
+// дерева используют стек ограниченной глубины. Цепочка бинарных операций (1 + 2 + ... + n) уровней
+// не добавляет: её длина не ограничена, а вычисляется и обходится она циклом
+inline constexpr std::size_t MAX_NESTING_DEPTH = 1000;
+
+// Возвращает составную инструкцию программы. Она владеет ареной, в которой размещены узлы программы
+// (см. ast::Compound::SetArena), поэтому узлы и классы программы нельзя использовать после её удаления
+ast::StatementPtr ParseProgram(parse::Lexer& lexer);
+
+// Разбирает часть программы, перед которой объявлены классы declared. Классы, объявленные
+// в этой части, добавляются в declared.classes, а имена искавшихся классов - в declared.lookups
+ast::StatementPtr ParseProgram(parse::Lexer& lexer, DeclaredClasses& declared);
+
+// Разбирает программу, передавая каждую инструкцию верхнего уровня в on_statement, как только
+// она разобрана. Если on_statement возвращает false, разбор прекращается. Узлы размещаются
+// в арене arena, которая должна пережить их
+void ParseProgram(parse::Lexer& lexer, DeclaredClasses& declared, ast::NodeArena& arena,
+    const std::function<bool(ast::StatementPtr)>& on_statement);
\ No newline at end of file
@@ -1,5 +1,7 @@
+#include "incremental_parse.h"
 #include "lexer.h"
 #include "parse.h"
+#include "pipeline.h"
 #include "statement.h"
 #include "test_runner_p.h"
 
@@ -7,7 +9,7 @@ using namespace std;
 
 namespace parse {
 
-    unique_ptr<ast::Statement> ParseProgramFromString(const string& program) {
+    ast::StatementPtr ParseProgramFromString(const string& program) {
         istringstream is(program);
         parse::Lexer lexer(is);
         return ParseProgram(lexer);
@@ -244,6 +246,263 @@ print r, c, t1, t2
             "Rect(10x20) Circle(52) Triangle(3, 4, 5) Wrong triangle\n"s);
     }
 
+    void TestMethodVariablesAreResolvedToSlots() {
+        const string program = R"(
+class Calc:
+  def sum(a, b):
+    result = a + b
+    result = result + self.base
+    return result
+
+  def unknown():
+    return undefined_variable
+
+  def nested():
+    class Local:
+      def get():
+        return 1
+    local = Local()
+    return local.get()
+
+c = Calc()
+c.base = 100
+print c.sum(1, 2), c.nested()
+)"s;
+
+        runtime::DummyContext context;
+
+        runtime::Closure closure;
+        auto tree = ParseProgramFromString(program);
+        tree->Execute(closure, context);
+
+        ASSERT_EQUAL(context.output.str(), "103 1\n"s);
+
+        const auto* cls = closure.at("Calc"s).TryAs<runtime::Class>();
+        ASSERT(cls != nullptr);
+        // self, a, b, result
+        ASSERT_EQUAL(cls->GetMethod("sum"s)->frame_size, 4U);
+        ASSERT_EQUAL(cls->GetMethod("unknown"s)->frame_size, 2U);
+        // Класс, объявленный внутри метода, сохраняется по имени в Closure
+        ASSERT_EQUAL(cls->GetMethod("nested"s)->frame_size, 0U);
+
+        ASSERT_THROWS(closure.at("c"s).TryAs<runtime::ClassInstance>()->Call("unknown"s, {}, context),
+            std::runtime_error);
+    }
+
+    void TestNestingDepth() {
+        auto nested = [](size_t depth, const string& open, const string& close) {
+            string program = "print "s;
+            for (size_t i = 0; i < depth; ++i) {
+                program += open;
+            }
+            program += "1"s;
+            for (size_t i = 0; i < depth; ++i) {
+                program += close;
+            }
+            return program + "\n"s;
+        };
+        auto run = [](const string& program) {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            ParseProgramFromString(program)->Execute(closure, context);
+            return context.output.str();
+        };
+
+        ASSERT_EQUAL(run(nested(MAX_NESTING_DEPTH, "("s, ")"s)), "1\n"s);
+        ASSERT_EQUAL(run(nested(MAX_NESTING_DEPTH, "1 + "s, ""s)), to_string(MAX_NESTING_DEPTH + 1) + "\n"s);
+        ASSERT_EQUAL(run(nested(MAX_NESTING_DEPTH, "-"s, ""s)), "1\n"s);
+
+        // Глубина ограничена для скобок, унарных операций и аргументов вызовов
+        ASSERT_THROWS(ParseProgramFromString(nested(MAX_NESTING_DEPTH + 1, "("s, ")"s)), ParseError);
+        ASSERT_THROWS(ParseProgramFromString(nested(MAX_NESTING_DEPTH + 1, "not "s, ""s)), ParseError);
+        ASSERT_THROWS(ParseProgramFromString(nested(MAX_NESTING_DEPTH + 1, "str("s, ")"s)), ParseError);
+
+        string blocks;
+        for (size_t i = 0; i <= MAX_NESTING_DEPTH; ++i) {
+            blocks += string(i * 2, ' ') + "if True:\n"s;
+        }
+        blocks += string((MAX_NESTING_DEPTH + 1) * 2, ' ') + "print 1\n"s;
+        ASSERT_THROWS(ParseProgramFromString(blocks), ParseError);
+
+        // Длина цепочки бинарных операций не ограничена: её вычисление, обход и удаление не рекурсивны
+        const size_t terms = 20000;
+        ASSERT_EQUAL(run(nested(terms, "1 + "s, ""s)), to_string(terms + 1) + "\n"s);
+        ASSERT_EQUAL(run(nested(terms, "1 * 2 - "s, ""s)), to_string(3 - 2 * static_cast<int>(terms)) + "\n"s);
+        ASSERT_EQUAL(run(nested(terms, "False or "s, ""s)), "True\n"s);
+        ASSERT_EQUAL(run(nested(terms, "True and "s, ""s)), "True\n"s);
+        const string method = "class A:\n  def f(x):\n    return"s + nested(terms, " x +"s, ""s).substr(5)
+            + "a = A()\nprint a.f(2)\n"s;
+        ASSERT_EQUAL(run(method), to_string(2 * terms + 1) + "\n"s);
+    }
+
+    void TestProgramNodesLiveInArena() {
+        const size_t arenas = ast::NodeArena::GetArenaCount();
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        {
+            auto tree = ParseProgramFromString(R"(
+class Greeter:
+  def greet(name):
+    return 'Hello, ' + name
+
+g = Greeter()
+print g.greet('arena')
+)"s);
+            ASSERT_EQUAL(ast::NodeArena::GetArenaCount(), arenas + 1);
+            // Программой владеет арена, в которой размещены её инструкции
+            ast::NodeArena* arena = ast::GetTreeArena(*tree);
+            ASSERT(arena != nullptr);
+            for (const auto& statement : static_cast<ast::Compound&>(*tree).GetStatements()) {
+                ASSERT(statement->GetArena() == arena);
+                ASSERT(statement->IsInArena());
+            }
+            tree->Execute(closure, context);
+            ASSERT_EQUAL(context.output.str(), "Hello, arena\n"s);
+        }
+
+        // Арена освобождается вместе с программой. Класс и экземпляр, которые переживают программу,
+        // можно удалить, но не вызывать их методы
+        ASSERT_EQUAL(ast::NodeArena::GetArenaCount(), arenas);
+        closure.clear();
+
+        // Узлы, созданные вне разбора, размещаются в куче
+        auto node = make_unique<ast::Print>(make_unique<ast::NumericConst>(1));
+        ASSERT(node->GetArena() == nullptr);
+        ASSERT(!node->IsInArena());
+        ASSERT_EQUAL(ast::NodeArena::GetArenaCount(), arenas);
+    }
+
+    string RunProgram(ast::Statement& program) {
+        runtime::DummyContext context;
+        runtime::Closure closure;
+        program.Execute(closure, context);
+        return context.output.str();
+    }
+
+    // Применяет правку и проверяет, что обновлённое дерево выполняется так же, как дерево,
+    // полученное разбором всего текста
+    void CheckEdit(IncrementalParser& parser, const TextEdit& edit, size_t expected_reparsed) {
+        string source = parser.GetSource();
+        source.replace(edit.offset, edit.removed, edit.inserted);
+
+        parser.Apply(edit);
+        ASSERT_EQUAL(parser.GetSource(), source);
+        ASSERT_EQUAL(parser.GetReparsedCount(), expected_reparsed);
+        ASSERT_EQUAL(RunProgram(parser.GetProgram()), RunProgram(*ParseProgramFromString(source)));
+    }
+
+    void TestIncrementalParsing() {
+        IncrementalParser parser(R"(class Point:
+  def __init__(x):
+    self.x = x
+
+  def __str__():
+    return 'P' + str(self.x)
+
+p = Point(1)
+s = 'line one
+line two'
+a = 1
+b = 2 # "
+if p.x > 0:
+  print 'positive'
+else:
+  print 'negative'
+print p, s
+)"s);
+        ASSERT_EQUAL(parser.GetReparsedCount(), 7U);
+        ASSERT_EQUAL(RunProgram(parser.GetProgram()), "positive\nP1 line one\nline two\n"s);
+
+        // Правка внутри инструкции заново разбирает только её, остальные инструкции не меняются
+        vector<const ast::Statement*> before;
+        for (const auto& statement : parser.GetProgram().GetStatements()) {
+            before.push_back(statement.get());
+        }
+        CheckEdit(parser, { parser.GetSource().find("Point(1)"s) + 6, 1, "-5"s }, 1);
+        const auto& statements = parser.GetProgram().GetStatements();
+        ASSERT_EQUAL(statements.size(), before.size());
+        for (size_t i = 0; i < statements.size(); ++i) {
+            ASSERT_EQUAL(statements[i].get() == before[i], i != 1);
+        }
+
+        // Изменение класса заново разбирает инструкции, которые создают его экземпляры
+        CheckEdit(parser, { parser.GetSource().find("'P'"s) + 1, 1, "Q"s }, 2);
+
+        // Правка в начале строки затрагивает и предыдущую инструкцию
+        CheckEdit(parser, { parser.GetSource().find("if p.x"s), 0, "x = 7\nprint x\n"s }, 4);
+        CheckEdit(parser, { parser.GetSource().find("\nelse"s), 0, "\n  print 'still if'"s }, 1);
+
+        // Незакрытая строка поглощает следующие инструкции, пока не встретится закрывающая кавычка
+        CheckEdit(parser, { parser.GetSource().find("a = 1"s), 0, "w = \"start\n"s }, 2);
+        ASSERT_EQUAL(parser.GetProgram().GetStatements().size(), 8U);
+        CheckEdit(parser, { parser.GetSource().size(), 0, "print w\n"s }, 2);
+
+        // Удаление всего текста и вставка заново
+        const string source = parser.GetSource();
+        CheckEdit(parser, { 0, source.size(), ""s }, 0);
+        CheckEdit(parser, { 0, 0, source }, 9);
+
+        // Ошибочная правка не меняет ни текст, ни дерево
+        const size_t statement_count = parser.GetProgram().GetStatements().size();
+        ASSERT_THROWS(parser.Apply({ 0, 0, "class A(Unknown):\n  def f():\n    return 1\n"s }), ParseError);
+        ASSERT_THROWS(parser.Apply({ parser.GetSource().find("class Point"s), 0, "p = Point(2)\n"s }), ParseError);
+        ASSERT_THROWS(parser.Apply({ source.size() + 1, 0, "x"s }), std::out_of_range);
+        ASSERT_EQUAL(parser.GetSource(), source);
+        ASSERT_EQUAL(parser.GetProgram().GetStatements().size(), statement_count);
+        ASSERT_EQUAL(RunProgram(parser.GetProgram()), RunProgram(*ParseProgramFromString(source)));
+    }
+
+    string RunPipelinedProgram(const string& program, pipeline::Executor executor) {
+        runtime::DummyContext context;
+        parse::Lexer lexer{ string_view(program) };
+        pipeline::RunPipelined(lexer, context, executor);
+        return context.output.str();
+    }
+
+    void TestPipelinedExecution() {
+        string program = R"(class Counter:
+  def __init__():
+    self.value = 0
+
+  def add(n):
+    self.value = self.value + n
+    return self
+
+  def __str__():
+    return 'Counter(' + str(self.value) + ')'
+
+c = Counter()
+s = 'multi
+line'
+)"s;
+        // Токены программы не умещаются в одну часть, передаваемую разбору
+        for (size_t i = 0; i < pipeline::TOKEN_BATCH_SIZE; ++i) {
+            program += "c.add("s + to_string(i % 7) + ")\n"s;
+        }
+        program += "if c.value > 100:\n  print c, s\n  return None\nprint 'unreachable'\n"s;
+
+        const string expected = RunProgram(*ParseProgramFromString(program));
+        ASSERT_EQUAL(expected, "Counter(3067) multi\nline\n"s);
+        ASSERT_EQUAL(RunPipelinedProgram(program, pipeline::Executor::TreeWalker), expected);
+        ASSERT_EQUAL(RunPipelinedProgram(program, pipeline::Executor::VirtualMachine), expected);
+
+        // Инструкции, предшествующие ошибке разбора, уже выполнены
+        for (auto executor : { pipeline::Executor::TreeWalker, pipeline::Executor::VirtualMachine }) {
+            runtime::DummyContext context;
+            const string broken = "print 1\nx = Unknown()\nprint 2\n"s;
+            parse::Lexer lexer{ string_view(broken) };
+            ASSERT_THROWS(pipeline::RunPipelined(lexer, context, executor), ParseError);
+            ASSERT_EQUAL(context.output.str(), "1\n"s);
+        }
+
+        // Ошибка выполнения останавливает разбор остатка программы
+        runtime::DummyContext context;
+        const string failing = "print 1\nprint 1 / 0\n"s + string(100'000, '\n') + "print 2\n"s;
+        parse::Lexer lexer{ string_view(failing) };
+        ASSERT_THROWS(pipeline::RunPipelined(lexer, context), std::runtime_error);
+        ASSERT_EQUAL(context.output.str(), "1\n"s);
+    }
+
 }  // namespace parse
 
 void TestParseProgram(TestRunner& tr) {
@@ -255,4 +514,9 @@ void TestParseProgram(TestRunner& tr) {
     RUN_TEST(tr, parse::TestRecursion2);
     RUN_TEST(tr, parse::TestComplexLogicalExpression);
     RUN_TEST(tr, parse::TestClassicalPolymorphism);
+    RUN_TEST(tr, parse::TestMethodVariablesAreResolvedToSlots);
+    RUN_TEST(tr, parse::TestNestingDepth);
+    RUN_TEST(tr, parse::TestProgramNodesLiveInArena);
+    RUN_TEST(tr, parse::TestIncrementalParsing);
+    RUN_TEST(tr, parse::TestPipelinedExecution);
 }
\ No newline at end of file
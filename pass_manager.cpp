@@ -0,0 +1,264 @@
+#include "pass_manager.h"
+
+#include "optimizer.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+
+using namespace std;
+
+namespace optimizer {
+
+    namespace {
+
+        // Обходит дерево через RewriteChildren: в отличие от методов Get*, он передаёт указатели
+        // на дочерние узлы, поэтому отсутствующий узел обнаруживается, а не разыменовывается.
+        // Если check равен false, только считает узлы
+        class TreeVerifier {
+        public:
+            explicit TreeVerifier(bool check)
+                : check_(check) {
+            }
+
+            size_t Verify(ast::Statement& program) {
+                Check(program);
+                // Адреса узлов собираются при обходе и проверяются на повторы один раз в конце:
+                // сортировка обходится дешевле, чем вставка каждого узла в хеш-таблицу
+                sort(visited_.begin(), visited_.end());
+                if (adjacent_find(visited_.begin(), visited_.end()) != visited_.end()) {
+                    throw VerificationError("Node is reachable more than once"s);
+                }
+                return count_;
+            }
+
+        private:
+            void Check(ast::Statement& node) {
+                Register(node);
+                if (auto* variable = TryAs<ast::VariableValue>(node)) {
+                    if (variable->GetDottedIds().empty()) {
+                        throw VerificationError("Variable value without a name"s);
+                    }
+                    CheckSlot(variable->GetSlot(), variable->GetDottedIds().front());
+                }
+                else if (auto* assignment = TryAs<ast::Assignment>(node)) {
+                    CheckSlot(assignment->GetSlot(), assignment->GetVariable());
+                }
+                else if (auto* branch = TryAs<ast::CompareAndBranch>(node)) {
+                    // Сравнение не передаётся в RewriteChildren, передаются только его аргументы
+                    Register(branch->GetCondition());
+                }
+                else if (auto* definition = TryAs<ast::ClassDefinition>(node)) {
+                    CheckMethods(*definition);
+                }
+                else if (check_ && TryAs<ast::MethodBody>(node) != nullptr) {
+                    throw VerificationError("Method body outside of a method"s);
+                }
+                // Левые аргументы цепочки операций (см. ast::BinaryOperation) обходятся циклом
+                auto* operation = dynamic_cast<ast::BinaryOperation*>(&node);
+                for (; operation != nullptr && operation->GetLhsOperation() != nullptr;
+                     operation = operation->GetLhsOperation()) {
+                    operation->RewriteRhs(check_children_);
+                    Register(*operation->GetLhsOperation());
+                }
+                if (operation != nullptr) {
+                    operation->RewriteChildren(check_children_);
+                }
+                else {
+                    node.RewriteChildren(check_children_);
+                }
+            }
+
+            void Register(ast::Statement& node) {
+                ++count_;
+                if (check_) {
+                    visited_.push_back(&node);
+                }
+            }
+
+            void CheckMethods(ast::ClassDefinition& definition) {
+                auto* cls = definition.GetClass().TryAs<runtime::Class>();
+                if (cls == nullptr) {
+                    throw VerificationError("Class definition without a class"s);
+                }
+                const bool in_method = in_method_;
+                const size_t frame_size = frame_size_;
+                in_method_ = true;
+                for (runtime::Method& method : cls->GetOwnMethods()) {
+                    auto* body = dynamic_cast<ast::Statement*>(method.body.get());
+                    if (body == nullptr) {
+                        continue;
+                    }
+                    frame_size_ = method.frame_size;
+                    if (TryAs<ast::MethodBody>(*body) != nullptr) {
+                        Register(*body);
+                        body->RewriteChildren(check_children_);
+                    }
+                    else {
+                        Check(*body);
+                    }
+                }
+                in_method_ = in_method;
+                frame_size_ = frame_size;
+            }
+
+            // Переменные кода верхнего уровня хранятся в Closure, а переменные метода,
+            // выполняемого в кадре со слотами, - в слотах этого кадра
+            void CheckSlot(size_t slot, runtime::Symbol name) const {
+                if (!check_) {
+                    return;
+                }
+                if (!in_method_ && slot != runtime::Frame::NO_SLOT) {
+                    throw VerificationError("Top-level variable "s + name.GetName() + " is resolved to a slot"s);
+                }
+                if (in_method_ && frame_size_ > 0 && slot >= frame_size_) {
+                    throw VerificationError("Variable "s + name.GetName() + " is outside of the method frame"s);
+                }
+            }
+
+            const bool check_;
+            size_t count_ = 0;
+            vector<const ast::Statement*> visited_;
+            bool in_method_ = false;
+            size_t frame_size_ = 0;
+            const ast::ChildRewriter check_children_ = [this](ast::StatementPtr& child) {
+                if (!child) {
+                    throw VerificationError("Missing child node"s);
+                }
+                Check(*child);
+            };
+        };
+
+        size_t CountNodes(ast::Statement& program) {
+            return TreeVerifier(false).Verify(program);
+        }
+
+    }  // namespace
+
+    const vector<Pass>& GetStandardPasses() {
+        static const vector<Pass> passes = {
+            { "propagate-constants"s, PropagateConstants },
+            { "fold-constants"s, FoldConstants },
+            { "eliminate-dead-branches"s, EliminateDeadBranches },
+            { "fuse-conditions"s, FuseConditions },
+        };
+        return passes;
+    }
+
+    const Pass& FindPass(string_view name) {
+        for (const Pass& pass : GetStandardPasses()) {
+            if (pass.name == name) {
+                return pass;
+            }
+        }
+        throw invalid_argument("Unknown optimizer pass: "s + string(name));
+    }
+
+    vector<Pass> ParsePassList(string_view names) {
+        vector<Pass> passes;
+        for (;;) {
+            const size_t comma = names.find(',');
+            const string_view name = names.substr(0, comma);
+            if (name.empty()) {
+                throw invalid_argument("Empty optimizer pass name"s);
+            }
+            passes.push_back(FindPass(name));
+            if (comma == string_view::npos) {
+                return passes;
+            }
+            names.remove_prefix(comma + 1);
+        }
+    }
+
+    size_t VerifyTree(ast::Statement& program) {
+        return TreeVerifier(true).Verify(program);
+    }
+
+    PassManager::PassManager(OptimizationLevel level) {
+        switch (level) {
+        case OptimizationLevel::O0:
+            break;
+        case OptimizationLevel::O1:
+            AddPass(FindPass("fold-constants"sv));
+            AddPass(FindPass("eliminate-dead-branches"sv));
+            break;
+        case OptimizationLevel::O2:
+            for (const Pass& pass : GetStandardPasses()) {
+                AddPass(pass);
+            }
+            break;
+        }
+    }
+
+    void PassManager::AddPass(Pass pass) {
+        stats_.push_back({ pass.name });
+        passes_.push_back(std::move(pass));
+    }
+
+    size_t PassManager::Run(ast::StatementPtr& program) {
+        const bool count_nodes = verify_ || count_nodes_;
+        // Входное дерево тоже проверяется: иначе нарушение, допущенное разбором, приписывается первому проходу
+        size_t nodes = 0;
+        if (verify_) {
+            try {
+                nodes = VerifyTree(*program);
+            }
+            catch (const VerificationError& e) {
+                throw VerificationError("AST verification failed before optimization: "s + e.what());
+            }
+        }
+        else if (count_nodes) {
+            nodes = CountNodes(*program);
+        }
+
+        size_t rewritten = 0;
+        for (size_t i = 0; i < passes_.size(); ++i) {
+            PassStats& stats = stats_[i];
+            const auto start = chrono::steady_clock::now();
+            const size_t pass_rewritten = passes_[i].run(program);
+            stats.time += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+            ++stats.runs;
+            stats.rewritten += pass_rewritten;
+            rewritten += pass_rewritten;
+            if (!count_nodes) {
+                continue;
+            }
+
+            size_t nodes_after = 0;
+            if (verify_) {
+                try {
+                    nodes_after = VerifyTree(*program);
+                }
+                catch (const VerificationError& e) {
+                    throw VerificationError("AST verification failed after pass "s + passes_[i].name + ": "s + e.what());
+                }
+            }
+            else {
+                nodes_after = CountNodes(*program);
+            }
+            stats.nodes_before += nodes;
+            stats.nodes_after += nodes_after;
+            nodes = nodes_after;
+        }
+        return rewritten;
+    }
+
+    void PassManager::PrintStats(ostream& out) const {
+        out << "Optimizer passes:"sv << endl;
+        for (const PassStats& stats : stats_) {
+            const chrono::duration<double, milli> time = stats.time;
+            out << "  "sv << left << setw(24) << stats.name << right << fixed << setprecision(3) << time.count()
+                << " ms, "sv << stats.rewritten << " rewritten"sv;
+            if (verify_ || count_nodes_) {
+                if (stats.nodes_before >= stats.nodes_after) {
+                    out << ", "sv << stats.nodes_before - stats.nodes_after << " nodes removed"sv;
+                }
+                else {
+                    out << ", "sv << stats.nodes_after - stats.nodes_before << " nodes added"sv;
+                }
+            }
+            out << endl;
+        }
+    }
+
+}  // namespace optimizer
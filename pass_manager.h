@@ -0,0 +1,117 @@
+#pragma once
+
+#include "statement.h"
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace optimizer {
+
+    // Проход оптимизатора: изменяет дерево разбора program и возвращает количество заменённых узлов
+    struct Pass {
+        std::string name;
+        std::function<std::size_t(ast::StatementPtr& program)> run;
+    };
+
+    // Проходы, которые можно выбрать по имени:
+    //   propagate-constants      - PropagateConstants
+    //   fold-constants           - FoldConstants
+    //   eliminate-dead-branches  - EliminateDeadBranches
+    //   fuse-conditions          - FuseConditions
+    // Порядок совпадает с порядком проходов уровня -O2
+    const std::vector<Pass>& GetStandardPasses();
+
+    // Возвращает проход с именем name. Выбрасывает std::invalid_argument, если такого прохода нет
+    const Pass& FindPass(std::string_view name);
+
+    // Возвращает проходы, имена которых перечислены в names через запятую (например, "fold-constants,fuse-conditions").
+    // Выбрасывает std::invalid_argument, если имя пусто (в том числе после последней запятой) или прохода нет
+    std::vector<Pass> ParsePassList(std::string_view names);
+
+    // Уровень оптимизации - набор проходов, выполняемых перед выполнением программы.
+    // Чем выше уровень, тем дольше подготовка программы и тем быстрее, как правило, её выполнение
+    enum class OptimizationLevel {
+        O0,  // без оптимизации
+        O1,  // свёртка констант и удаление невыполнимых веток: проходы, обходящие дерево один раз
+        O2,  // все стандартные проходы
+    };
+
+    // Выбрасывается, если дерево разбора после прохода нарушает инварианты (см. VerifyTree)
+    class VerificationError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    /*
+    Проверяет инварианты дерева разбора program, включая тела методов объявленных в нём классов:
+      - у каждого узла есть все обязательные дочерние узлы (отсутствовать может только ветка else);
+      - каждый узел принадлежит дереву один раз;
+      - тело метода (ast::MethodBody) встречается только как тело метода класса;
+      - у обращения к переменной непустое имя;
+      - переменные кода верхнего уровня не разрешены в слоты кадра, а переменные тела метода,
+        выполняемого в кадре со слотами, разрешены в слоты этого кадра.
+    Выбрасывает VerificationError при нарушении. Возвращает количество узлов дерева
+    */
+    std::size_t VerifyTree(ast::Statement& program);
+
+    // Статистика прохода, накопленная за все вызовы PassManager::Run
+    struct PassStats {
+        std::string name;
+        // Количество выполнений прохода
+        std::size_t runs = 0;
+        std::chrono::nanoseconds time{ 0 };
+        // Количество узлов, заменённых проходом
+        std::size_t rewritten = 0;
+        // Количество узлов дерева до и после прохода. Считаются, только если включена
+        // проверка дерева (SetVerify) либо сбор статистики узлов (SetCountNodes)
+        std::size_t nodes_before = 0;
+        std::size_t nodes_after = 0;
+    };
+
+    // Выполняет над деревом разбора последовательность проходов, измеряя время каждого из них
+    class PassManager {
+    public:
+        PassManager() = default;
+        // Создаёт менеджер с проходами уровня level
+        explicit PassManager(OptimizationLevel level);
+
+        // Добавляет проход в конец последовательности
+        void AddPass(Pass pass);
+
+        // Если verify равен true, после каждого прохода дерево проверяется функцией VerifyTree,
+        // а её исключение дополняется именем прохода
+        void SetVerify(bool verify) {
+            verify_ = verify;
+        }
+
+        // Если count_nodes равен true, в статистике считаются узлы дерева до и после каждого прохода
+        void SetCountNodes(bool count_nodes) {
+            count_nodes_ = count_nodes;
+        }
+
+        // Выполняет проходы над program по порядку. Возвращает общее количество заменённых узлов
+        std::size_t Run(ast::StatementPtr& program);
+
+        // Возвращает статистику проходов в порядке их выполнения
+        [[nodiscard]] const std::vector<PassStats>& GetStats() const {
+            return stats_;
+        }
+
+        // Выводит статистику проходов таблицей: имя, время, заменённые и, если они считались, удалённые узлы
+        void PrintStats(std::ostream& out) const;
+
+    private:
+        std::vector<Pass> passes_;
+        std::vector<PassStats> stats_;
+        bool verify_ = false;
+        bool count_nodes_ = false;
+    };
+
+}  // namespace optimizer
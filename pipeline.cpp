@@ -0,0 +1,157 @@
+#include "pipeline.h"
+
+#include "bytecode.h"
+#include "flat_ast.h"
+#include "parse.h"
+#include "spsc_ring.h"
+#include "statement.h"
+#include "token_buffer.h"
+#include "vm.h"
+
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace pipeline {
+
+    namespace {
+
+        // Количество частей токенов и инструкций, которые поток может передать, не дожидаясь следующего
+        constexpr size_t TOKEN_RING_CAPACITY = 64;
+        constexpr size_t STATEMENT_RING_CAPACITY = 1024;
+
+        using TokenRing = SpscRing<parse::TokenBuffer>;
+        using StatementRing = SpscRing<ast::StatementPtr>;
+
+        // Выдаёт лексеру разбора части токенов, поступающие из очереди
+        class RingTokenSource : public parse::TokenSource {
+        public:
+            explicit RingTokenSource(TokenRing& ring)
+                : ring_(ring) {
+            }
+
+            const parse::TokenBuffer& NextBatch() override {
+                optional<parse::TokenBuffer> batch = ring_.Pop();
+                if (!batch) {
+                    throw parse::LexerError("Token stream ended without Eof"s);
+                }
+                batch_ = std::move(*batch);
+                return batch_;
+            }
+
+        private:
+            TokenRing& ring_;
+            parse::TokenBuffer batch_;
+        };
+
+        void LexTokens(parse::Lexer& lexer, TokenRing& tokens) {
+            try {
+                for (bool eof = false; !eof;) {
+                    parse::TokenBuffer batch;
+                    while (batch.size() < TOKEN_BATCH_SIZE && !eof) {
+                        batch.Append(lexer.CurrentToken(), lexer.CurrentSpan());
+                        eof = lexer.CurrentToken().Is<parse::token_type::Eof>();
+                        if (!eof) {
+                            lexer.NextToken();
+                        }
+                    }
+                    if (!tokens.Push(std::move(batch))) {
+                        return;
+                    }
+                }
+                tokens.Close();
+            }
+            catch (...) {
+                tokens.Close(current_exception());
+            }
+        }
+
+        void ParseStatements(TokenRing& tokens, DeclaredClasses& declared, ast::NodeArena& arena,
+            StatementRing& statements, optimizer::PassManager* passes) {
+            try {
+                RingTokenSource source(tokens);
+                parse::Lexer lexer(source);
+                ParseProgram(lexer, declared, arena, [&statements, passes](ast::StatementPtr statement) {
+                    if (passes != nullptr) {
+                        passes->Run(statement);
+                    }
+                    return statements.Push(std::move(statement));
+                });
+                statements.Close();
+            }
+            catch (...) {
+                statements.Close(current_exception());
+            }
+            // Оставшиеся токены не нужны
+            tokens.Cancel();
+        }
+
+        // Выполняет инструкции из очереди, пока она не закончится либо не будет выполнена
+        // инструкция return. Выполненные инструкции переносятся в executed: значения переменных
+        // и скомпилированные методы ссылаются на объекты, принадлежащие дереву разбора
+        void ExecuteStatements(StatementRing& statements, vector<ast::StatementPtr>& executed,
+            runtime::Context& context, Executor executor) {
+            runtime::Closure closure;
+            runtime::Frame frame(closure);
+            optional<bytecode::VirtualMachine> vm;
+            optional<flat::Evaluator> evaluator;
+            if (executor == Executor::VirtualMachine) {
+                vm.emplace(context);
+            }
+            else if (executor == Executor::FlatEvaluator) {
+                evaluator.emplace(context);
+            }
+            while (optional<ast::StatementPtr> statement = statements.Pop()) {
+                executed.push_back(std::move(*statement));
+                ast::Statement& current = *executed.back();
+                if (vm) {
+                    const bytecode::Chunk chunk = bytecode::Compile(current);
+                    vm->Run(chunk, frame);
+                }
+                else if (evaluator) {
+                    const flat::Program program = flat::Flatten(current);
+                    evaluator->Run(program, frame);
+                }
+                else {
+                    current.Execute(frame, context);
+                }
+                if (frame.IsReturning()) {
+                    return;
+                }
+            }
+        }
+
+    }  // namespace
+
+    void RunPipelined(parse::Lexer& lexer, runtime::Context& context, Executor executor,
+        optimizer::PassManager* passes) {
+        // Арена объявлена первой и удаляется последней: в ней размещены узлы всех инструкций
+        ast::NodeArena arena;
+        TokenRing tokens(TOKEN_RING_CAPACITY);
+        StatementRing statements(STATEMENT_RING_CAPACITY);
+        // Классы, объявленные при разборе, и выполненные инструкции живут, пока работают все потоки
+        DeclaredClasses declared;
+        vector<ast::StatementPtr> executed;
+
+        thread lexer_thread(LexTokens, ref(lexer), ref(tokens));
+        thread parser_thread(ParseStatements, ref(tokens), ref(declared), ref(arena), ref(statements), passes);
+        // Отказ от оставшихся инструкций останавливает разбор, а он - лексер
+        auto stop = [&] {
+            statements.Cancel();
+            parser_thread.join();
+            lexer_thread.join();
+        };
+        try {
+            ExecuteStatements(statements, executed, context, executor);
+        }
+        catch (...) {
+            stop();
+            throw;
+        }
+        stop();
+    }
+
+}  // namespace pipeline
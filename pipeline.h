@@ -0,0 +1,35 @@
+#pragma once
+
+#include "lexer.h"
+#include "pass_manager.h"
+#include "runtime.h"
+
+#include <cstddef>
+
+namespace pipeline {
+
+    // Количество токенов, которые поток лексера передаёт разбору за один раз
+    inline constexpr size_t TOKEN_BATCH_SIZE = 1024;
+
+    // Способ выполнения инструкций верхнего уровня
+    enum class Executor {
+        TreeWalker,      // обход дерева разбора инструкции
+        VirtualMachine,  // компиляция инструкции в байт-код и выполнение виртуальной машиной
+        FlatEvaluator,   // вычисление инструкции, записанной в плоский массив узлов (flat::Program)
+    };
+
+    // Выполняет программу, выделяя её токены, разбирая и выполняя инструкции одновременно.
+    // Лексер работает в отдельном потоке и передаёт токены частями по TOKEN_BATCH_SIZE
+    // через кольцевую очередь потоку разбора, а тот передаёт каждую разобранную инструкцию
+    // верхнего уровня через вторую очередь вызывающему потоку, который её выполняет. Поэтому
+    // первые инструкции выполняются, пока разбирается остаток программы. Если passes не равен nullptr,
+    // поток разбора выполняет проходы passes над каждой инструкцией до передачи её на выполнение;
+    // статистика проходов доступна после возврата из функции. Значения переменных
+    // (optimizer::PropagateConstants) не подставляются: для этого нужна программа целиком.
+    // Вывод программы совпадает с выводом последовательного выполнения, но ошибка разбора
+    // обнаруживается только после того, как выполнены все инструкции перед ней.
+    // Лексер должен стоять на первом токене программы и больше нигде не использоваться
+    void RunPipelined(parse::Lexer& lexer, runtime::Context& context, Executor executor = Executor::TreeWalker,
+        optimizer::PassManager* passes = nullptr);
+
+}  // namespace pipeline
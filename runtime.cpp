@@ -1,81 +1,158 @@
 ﻿#include "runtime.h"
 
+#include <algorithm>
 #include <cassert>
 #include <optional>
 #include <sstream>
+#include <utility>
 
 using namespace std;
 
 namespace runtime {
 
-    ObjectHolder::ObjectHolder(std::shared_ptr<Object> data)
+    ObjectHolder::ObjectHolder(Storage data)
         : data_(std::move(data)) {
     }
 
+    ObjectHolder::ObjectHolder(ObjectHolder&& other) noexcept
+        : data_(std::exchange(other.data_, std::monostate{})) {
+    }
+
+    ObjectHolder& ObjectHolder::operator=(ObjectHolder&& other) noexcept {
+        if (this != &other) {
+            data_ = std::exchange(other.data_, std::monostate{});
+        }
+        return *this;
+    }
+
     ObjectHolder ObjectHolder::Share(Object& object) {
-        // Возвращаем невладеющий shared_ptr (его deleter ничего не делает)
-        return ObjectHolder(std::shared_ptr<Object>(&object, [](auto* /*p*/) { /* do nothing */ }));
+        if (object.owned_) {
+            return ObjectHolder(Storage(std::in_place_type<Ref>, &object));
+        }
+        return ObjectHolder(Storage(std::in_place_type<Object*>, &object));
     }
 
     ObjectHolder ObjectHolder::None() {
         return ObjectHolder();
     }
 
+    ObjectHolder ObjectHolder::OwnObject(Object* object) {
+        object->owned_ = true;
+        return ObjectHolder(Storage(std::in_place_type<Ref>, object));
+    }
+
+    Object* ObjectHolder::Box() const {
+        Object* object = nullptr;
+        if (const int* value = std::get_if<NUMBER_INDEX>(&data_)) {
+            object = new Number(*value);
+        }
+        else {
+            object = new Bool(*std::get_if<BOOL_INDEX>(&data_));
+        }
+        data_ = std::move(OwnObject(object).data_);
+        return object;
+    }
+
+    void ObjectHolder::Print(std::ostream& os, Context& context) const {
+        if (const int* value = std::get_if<NUMBER_INDEX>(&data_)) {
+            os << *value;
+        }
+        else if (const bool* value = std::get_if<BOOL_INDEX>(&data_)) {
+            os << (*value ? "True"s : "False"s);
+        }
+        else {
+            Get()->Print(os, context);
+        }
+    }
+
     Object& ObjectHolder::operator*() const {
-        assert(data_ != nullptr);
+        assert(Get() != nullptr);
         return *Get();
     }
 
     Object* ObjectHolder::operator->() const {
-        assert(data_ != nullptr);
+        assert(Get() != nullptr);
         return Get();
     }
 
-    Object* ObjectHolder::Get() const {
-        return data_.get();
-    }
-
-    ObjectHolder::operator bool() const {
-        return Get() != nullptr;
+    ObjectHolder Executable::Execute(Frame& frame, Context& context) {
+        if (Closure* closure = frame.GetClosure()) {
+            return Execute(*closure, context);
+        }
+        throw std::logic_error("Executable doesn't support frames with slots"s);
     }
 
     bool IsTrue(const ObjectHolder& object) {
         if (!object) {
             return false;
         }
-        if (auto p = object.TryAs<runtime::Number>(); p && p->GetValue() != 0) {
-            return true;
-        }
-        if (auto p = object.TryAs<runtime::String>(); p && !p->GetValue().empty()) {
-            return true;
+        switch (object.GetKind()) {
+        case ObjectKind::Number:
+            return *object.TryGetNumber() != 0;
+        case ObjectKind::String:
+            return !static_cast<const String&>(*object).GetValue().empty();
+        case ObjectKind::Bool:
+            return *object.TryGetBool();
+        default:
+            return false;
         }
-        if (auto p = object.TryAs<runtime::Bool>(); p && p->GetValue()) {
-            return true;
+    }
+
+    const Shape& Shape::AddField(Symbol name) const {
+        auto& next = transitions_[name];
+        if (!next) {
+            next = std::make_unique<Shape>();
+            next->names_ = names_;
+            next->names_.push_back(name);
+            next->offsets_ = offsets_;
+            next->offsets_.emplace(name, names_.size());
+            next->root_ = root_;
+            root_->max_field_count_ = std::max(root_->max_field_count_, next->names_.size());
         }
-        return false;
+        return *next;
     }
 
-    Class::Class(std::string name, std::vector<Method> methods, const Class* parent)
-        : class_name_(std::move(name))
-        , parent_(parent) {
-        for (Method& method : methods) {
-            if (methods_.count(method.name) > 0) {
-                throw runtime_error( class_name_ + " has duplicate methods: " + method.name);
-            }
-            methods_[method.name] = std::move(method);
+    ObjectHolder& InstanceFields::at(Symbol name) {
+        return const_cast<ObjectHolder&>(std::as_const(*this).at(name));
+    }
+
+    const ObjectHolder& InstanceFields::at(Symbol name) const {
+        size_t offset = shape_->FindField(name);
+        if (offset == Shape::NO_FIELD) {
+            throw out_of_range(name.GetName() + " not found in fields"s);
         }
+        return values_[offset];
     }
 
-    const Method* Class::GetMethod(const std::string& name) const {
-        if (methods_.count(name) > 0) {
-            return &methods_.at(name);
+    ObjectHolder& InstanceFields::operator[](Symbol name) {
+        size_t offset = shape_->FindField(name);
+        if (offset == Shape::NO_FIELD) {
+            return Append(shape_->AddField(name), ObjectHolder::None());
         }
+        return values_[offset];
+    }
 
+    Class::Class(std::string name, std::vector<Method> methods, const Class* parent)
+        : Object(ObjectKind::Class)
+        , class_name_(std::move(name))
+        , parent_(parent)
+        , methods_(std::move(methods)) {
         if (parent_) {
-            return parent_->GetMethod(name);
+            dispatch_table_ = parent_->dispatch_table_;
+        }
+        // Методы хранятся в векторе, буфер которого не меняется и при перемещении класса,
+        // поэтому указатели на них в таблицах класса и наследников остаются действительными
+        for (const Method& method : methods_) {
+            const size_t index = method.name.GetId();
+            if (index >= dispatch_table_.size()) {
+                dispatch_table_.resize(index + 1, nullptr);
+            }
+            const Method*& entry = dispatch_table_[index];
+            if (entry != nullptr && (parent_ == nullptr || entry != parent_->GetMethod(method.name))) {
+                throw runtime_error( class_name_ + " has duplicate methods: " + method.name.GetName());
+            }
+            entry = &method;
         }
-
-        return nullptr;
     }
 
     [[nodiscard]] const std::string& Class::GetName() const {
@@ -83,51 +160,83 @@ namespace runtime {
     }
 
     void ClassInstance::Print(std::ostream& os, Context& context) {
-        if (HasMethod("__str__", 0)) {
-            Call("__str__", {}, context)->Print(os, context);
+        if (HasMethod(STR_METHOD_ID, 0)) {
+            Call(STR_METHOD_ID, {}, context).Print(os, context);
         }
         else {
             os << this;
         }
     }
 
-    bool ClassInstance::HasMethod(const std::string& method, size_t argument_count) const {
-        auto* m = class_.GetMethod(method);
-        if (!m) return false;
-        if (m->formal_params.size() != argument_count) return false;
-        return true;
+    bool ClassInstance::HasMethod(MethodId method, size_t argument_count) const {
+        return class_.GetMethod(method, argument_count) != nullptr;
     }
 
-    Closure& ClassInstance::Fields() {
+    thread_local MethodCacheStats MethodCache::total_stats_;
+
+    const Method* MethodCache::Miss(const Class& cls, MethodId method, size_t argument_count) {
+        ++stats_.misses;
+        ++total_stats_.misses;
+
+        const Method* found = cls.GetMethod(method, argument_count);
+        if (size_ < CAPACITY) {
+            entries_[size_++] = { &cls, found };
+        }
+        else {
+            entries_[next_victim_] = { &cls, found };
+            next_victim_ = static_cast<std::uint8_t>((next_victim_ + 1) % CAPACITY);
+        }
+        return found;
+    }
+
+    InstanceFields& ClassInstance::Fields() {
         return fields_;
     }
 
-    const Closure& ClassInstance::Fields() const {
+    const InstanceFields& ClassInstance::Fields() const {
         return fields_;
     }
 
+    const Class& ClassInstance::GetClass() const {
+        return class_;
+    }
+
     ClassInstance::ClassInstance(const Class& cls)
-        : class_(cls) {
+        : Object(ObjectKind::ClassInstance)
+        , class_(cls)
+        , fields_(cls.GetRootShape()) {
+    }
 
+    ObjectHolder ClassInstance::Call(MethodId method, const std::vector<ObjectHolder>& actual_args, Context& context) {
+        if (auto* m = class_.GetMethod(method, actual_args.size())) {
+            return Call(*m, actual_args, context);
+        }
+        throw std::runtime_error(class_.GetName() + " does not have method " + method.GetName() + " or method is incorrect");
     }
 
-    ObjectHolder ClassInstance::Call(const std::string& method, const std::vector<ObjectHolder>& actual_args, Context& context) {
-        if (HasMethod(method, actual_args.size())) {
-            auto* m = class_.GetMethod(method);
+    ObjectHolder ClassInstance::Call(MethodCache& cache, MethodId method, const std::vector<ObjectHolder>& actual_args,
+        Context& context) {
+        if (auto* m = cache.Lookup(class_, method, actual_args.size())) {
+            return Call(*m, actual_args, context);
+        }
+        throw std::runtime_error(class_.GetName() + " does not have method " + method.GetName() + " or method is incorrect");
+    }
 
-            try {
-                Closure closure = { {"self", ObjectHolder::Share(*this)} };
-                for (size_t i = 0; i < actual_args.size(); ++i) {
-                    closure[m->formal_params[i]] = actual_args[i];
-                }
-                return m->body->Execute(closure, context);
-            }
-            catch (ObjectHolder& value) {
-                return value;
+    ObjectHolder ClassInstance::Call(const Method& method, const std::vector<ObjectHolder>& actual_args, Context& context) {
+        if (method.frame_size > 0) {
+            Frame frame(method.frame_size);
+            frame.Bind(Frame::SELF_SLOT, ObjectHolder::Share(*this));
+            for (size_t i = 0; i < actual_args.size(); ++i) {
+                frame.Bind(Frame::SELF_SLOT + 1 + i, actual_args[i]);
             }
-            return ObjectHolder::None();
+            return method.body->Execute(frame, context);
+        }
+
+        Closure closure = { {SELF_SYMBOL, ObjectHolder::Share(*this)} };
+        for (size_t i = 0; i < actual_args.size(); ++i) {
+            closure[method.formal_params[i]] = actual_args[i];
         }
-        throw std::runtime_error(class_.GetName() + " does not have method " + method + "or method is incorrect");
+        return method.body->Execute(closure, context);
     }
 
     void Class::Print(ostream& os, Context&) {
@@ -138,62 +247,134 @@ namespace runtime {
         os << (GetValue() ? "True"s : "False"s);
     }
 
-    bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
-        if (!lhs && !rhs) {
-            return true;
+    namespace {
+        // Сравнивает операцией Compare значения lhs и rhs, если это числа, строки или значения Bool.
+        // Возвращает nullopt, если lhs и rhs не являются значениями одного из этих типов
+        template <template <typename> typename Compare>
+        optional<bool> CompareValues(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+            if (!lhs || !rhs || lhs.GetKind() != rhs.GetKind()) {
+                return nullopt;
+            }
+            switch (lhs.GetKind()) {
+            case ObjectKind::Number:
+                return Compare<int>()(*lhs.TryGetNumber(), *rhs.TryGetNumber());
+            case ObjectKind::String:
+                return Compare<string>()(static_cast<const String&>(*lhs).GetValue(),
+                    static_cast<const String&>(*rhs).GetValue());
+            case ObjectKind::Bool:
+                return Compare<bool>()(*lhs.TryGetBool(), *rhs.TryGetBool());
+            default:
+                return nullopt;
+            }
         }
 
-        if (lhs.TryAs<runtime::Number>() && rhs.TryAs<runtime::Number>()) {
-            return std::equal_to<int>()(lhs.TryAs<runtime::Number>()->GetValue(), rhs.TryAs<runtime::Number>()->GetValue());
-        }
-        if (lhs.TryAs<runtime::String>() && rhs.TryAs<runtime::String>()) {
-            return std::equal_to<string>()(lhs.TryAs<runtime::String>()->GetValue(), rhs.TryAs<runtime::String>()->GetValue());
+        // Возвращает метод method с одним параметром, если lhs - экземпляр класса с таким методом.
+        // Если cache не равен nullptr, метод ищется через него
+        const Method* FindOperatorMethod(const ClassInstance* lhs, MethodId method, MethodCache* cache) {
+            if (lhs == nullptr) {
+                return nullptr;
+            }
+            return cache != nullptr ? cache->Lookup(lhs->GetClass(), method, 1) : lhs->GetClass().GetMethod(method, 1);
         }
-        if (lhs.TryAs<runtime::Bool>() && rhs.TryAs<runtime::Bool>()) {
-            return std::equal_to<bool>()(lhs.TryAs<runtime::Bool>()->GetValue(), rhs.TryAs<runtime::Bool>()->GetValue());
+
+        bool EqualImpl(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context, MethodCache* cache) {
+            if (!lhs && !rhs) {
+                return true;
+            }
+
+            if (auto result = CompareValues<std::equal_to>(lhs, rhs)) {
+                return *result;
+            }
+
+            auto p = lhs.TryAs<runtime::ClassInstance>();
+            if (auto* method = FindOperatorMethod(p, EQ_METHOD_ID, cache)) {
+                return IsTrue(p->Call(*method, { rhs }, context));
+            }
+
+            throw std::runtime_error("Error in compare equal");
         }
 
-        auto p = lhs.TryAs<runtime::ClassInstance>();
-        if ( p != nullptr && p->HasMethod("__eq__", 1)) {
-            return IsTrue(p->Call("__eq__", { rhs }, context));
+        bool LessImpl(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context, MethodCache* cache) {
+            if (auto result = CompareValues<std::less>(lhs, rhs)) {
+                return *result;
+            }
+
+            auto p = lhs.TryAs<runtime::ClassInstance>();
+            if (auto* method = FindOperatorMethod(p, LT_METHOD_ID, cache)) {
+                return IsTrue(p->Call(*method, { rhs }, context));
+            }
+
+            throw std::runtime_error("Error in compare less");
         }
+    }  // namespace
 
-        throw std::runtime_error("Error in compare equal");
+    bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+        return EqualImpl(lhs, rhs, context, nullptr);
     }
 
     bool Less(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+        return LessImpl(lhs, rhs, context, nullptr);
+    }
 
-        if (lhs.TryAs<runtime::Number>() && rhs.TryAs<runtime::Number>()) {
-            return std::less<int>()(lhs.TryAs<runtime::Number>()->GetValue(), rhs.TryAs<runtime::Number>()->GetValue());
+    bool NotEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+        return !Equal(lhs, rhs, context);
+    }
+
+    bool Greater(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+        return !Less(lhs, rhs, context) && !Equal(lhs, rhs, context);
+    }
+
+    bool LessOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+        return !Greater(lhs, rhs, context);
+    }
+
+    bool GreaterOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+        return !Less(lhs, rhs, context);
+    }
+
+    CachedComparator::Method CachedComparator::Find(Comparator comparator) {
+        if (comparator == &runtime::Equal) {
+            return &CachedComparator::Equal;
         }
-        if (lhs.TryAs<runtime::String>() && rhs.TryAs<runtime::String>()) {
-            return std::less<string>()(lhs.TryAs<runtime::String>()->GetValue(), rhs.TryAs<runtime::String>()->GetValue());
+        if (comparator == &runtime::NotEqual) {
+            return &CachedComparator::NotEqual;
         }
-        if (lhs.TryAs<runtime::Bool>() && rhs.TryAs<runtime::Bool>()) {
-            return std::less<bool>()(lhs.TryAs<runtime::Bool>()->GetValue(), rhs.TryAs<runtime::Bool>()->GetValue());
+        if (comparator == &runtime::Less) {
+            return &CachedComparator::Less;
         }
-
-        auto p = lhs.TryAs<runtime::ClassInstance>();
-        if ( p != nullptr && p->HasMethod("__lt__", 1)) {
-            return IsTrue(p->Call("__lt__", { rhs }, context));
+        if (comparator == &runtime::Greater) {
+            return &CachedComparator::Greater;
+        }
+        if (comparator == &runtime::LessOrEqual) {
+            return &CachedComparator::LessOrEqual;
         }
+        if (comparator == &runtime::GreaterOrEqual) {
+            return &CachedComparator::GreaterOrEqual;
+        }
+        return nullptr;
+    }
 
-        throw std::runtime_error("Error in compare less");
+    bool CachedComparator::Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+        return EqualImpl(lhs, rhs, context, &eq_cache_);
     }
 
-    bool NotEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+    bool CachedComparator::NotEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
         return !Equal(lhs, rhs, context);
     }
 
-    bool Greater(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+    bool CachedComparator::Less(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+        return LessImpl(lhs, rhs, context, &lt_cache_);
+    }
+
+    bool CachedComparator::Greater(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
         return !Less(lhs, rhs, context) && !Equal(lhs, rhs, context);
     }
 
-    bool LessOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+    bool CachedComparator::LessOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
         return !Greater(lhs, rhs, context);
     }
 
-    bool GreaterOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+    bool CachedComparator::GreaterOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
         return !Less(lhs, rhs, context);
     }
 
@@ -1,9 +1,19 @@
 ﻿#pragma once
 
+#include "symbol.h"
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <new>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vector>
 
 namespace runtime {
@@ -18,12 +28,177 @@ namespace runtime {
         ~Context() = default;
     };
 
-    // Базовый класс для всех объектов языка Mython
+    // Вид объекта Mython. Позволяет проверить тип объекта сравнением целых чисел вместо dynamic_cast
+    enum class ObjectKind : std::uint8_t {
+        Other,          // объект, для проверки типа которого используется dynamic_cast
+        Number,
+        String,
+        Bool,
+        Class,
+        ClassInstance,
+        // Первый вид, доступный пользовательским наследникам Object. Такой наследник передаёт
+        // свой вид в конструктор Object и специализирует для себя ObjectKindOf
+        User = 64,
+    };
+
+    // Базовый класс для всех объектов языка Mython.
+    // Объект хранит счётчик ссылок ObjectHolder на него. Интерпретатор работает в одном потоке,
+    // поэтому по умолчанию счётчик изменяется без атомарных операций
     class Object {
     public:
         virtual ~Object() = default;
         // выводит в os своё представление в виде строки
         virtual void Print(std::ostream& os, Context& context) = 0;
+
+        // Возвращает вид объекта, заданный при его создании
+        [[nodiscard]] ObjectKind GetKind() const {
+            return kind_;
+        }
+
+        // Переводит счётчик ссылок объекта на атомарные операции, сохраняя уже имеющиеся ссылки.
+        // Должен вызываться до того, как объект или ссылки на него станут доступны другим потокам:
+        // сам перевод и обычный счётчик, который действует до него, не синхронизированы
+        void SetThreadShared() {
+            if (!thread_shared_) {
+                const std::uint32_t count = ref_count_;
+                new (&shared_ref_count_) std::atomic<std::uint32_t>(count);
+                thread_shared_ = true;
+            }
+        }
+
+        [[nodiscard]] bool IsThreadShared() const {
+            return thread_shared_;
+        }
+
+    protected:
+        Object() = default;
+        explicit Object(ObjectKind kind)
+            : kind_(kind) {
+        }
+
+        // Копия объекта - новый объект: счётчик ссылок и владение не копируются
+        Object(const Object& other)
+            : kind_(other.kind_) {
+        }
+
+        Object& operator=(const Object& /*other*/) {
+            return *this;
+        }
+
+    private:
+        friend class ObjectHolder;
+
+        void AddRef() const {
+            if (thread_shared_) {
+                shared_ref_count_.fetch_add(1, std::memory_order_relaxed);
+            }
+            else {
+                ++ref_count_;
+            }
+        }
+
+        // Уменьшает счётчик ссылок и удаляет объект, когда ссылок на него не остаётся.
+        // Счётчик ведётся только для объектов, созданных ObjectHolder::Own
+        void Release() const {
+            const std::uint32_t remaining = thread_shared_
+                ? shared_ref_count_.fetch_sub(1, std::memory_order_acq_rel) - 1
+                : --ref_count_;
+            if (remaining == 0) {
+                delete this;
+            }
+        }
+
+        // Счётчик ссылок: обычный, пока объект принадлежит одному потоку, и атомарный после
+        // SetThreadShared. Оба занимают одно место, действует тот, на который указывает thread_shared_
+        union {
+            mutable std::uint32_t ref_count_ = 0;
+            mutable std::atomic<std::uint32_t> shared_ref_count_;
+        };
+        ObjectKind kind_ = ObjectKind::Other;
+        // Объект создан в куче функцией ObjectHolder::Own и удаляется вместе с последней ссылкой
+        bool owned_ = false;
+        bool thread_shared_ = false;
+    };
+
+    template <typename T>
+    class ValueObject;
+    class Bool;
+    class Class;
+    class ClassInstance;
+
+    // Вид, которым обладают все объекты типа T и только они.
+    // Для типов, не имеющих собственного вида, value равно ObjectKind::Other
+    template <typename T>
+    struct ObjectKindOf {
+        static constexpr ObjectKind value = ObjectKind::Other;
+    };
+
+    template <>
+    struct ObjectKindOf<ValueObject<int>> {
+        static constexpr ObjectKind value = ObjectKind::Number;
+    };
+
+    template <>
+    struct ObjectKindOf<ValueObject<std::string>> {
+        static constexpr ObjectKind value = ObjectKind::String;
+    };
+
+    template <>
+    struct ObjectKindOf<Bool> {
+        static constexpr ObjectKind value = ObjectKind::Bool;
+    };
+
+    template <>
+    struct ObjectKindOf<Class> {
+        static constexpr ObjectKind value = ObjectKind::Class;
+    };
+
+    template <>
+    struct ObjectKindOf<ClassInstance> {
+        static constexpr ObjectKind value = ObjectKind::ClassInstance;
+    };
+
+    // Объект-значение, хранящий значение типа T
+    template <typename T>
+    class ValueObject : public Object { //думаю что реализован
+    public:
+        ValueObject(T v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+            : Object(ObjectKindOf<ValueObject>::value)
+            , value_(v) {
+        }
+
+        void Print(std::ostream& os, [[maybe_unused]] Context& context) override {
+            os << value_;
+        }
+
+        [[nodiscard]] const T& GetValue() const {
+            return value_;
+        }
+
+    protected:
+        ValueObject(T v, ObjectKind kind)
+            : Object(kind)
+            , value_(v) {
+        }
+
+    private:
+        T value_;
+    };
+
+    // Строковое значение
+    using String = ValueObject<std::string>;
+
+    // Числовое значение
+    using Number = ValueObject<int>;
+
+    // Логическое значение
+    class Bool : public ValueObject<bool> {
+    public:
+        Bool(bool v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+            : ValueObject<bool>(v, ObjectKind::Bool) {
+        }
+
+        void Print(std::ostream& os, Context& context) override;
     };
 
     // Специальный класс-обёртка, предназначенный для хранения объекта в Mython-программе
@@ -32,16 +207,37 @@ namespace runtime {
         // Создаёт пустое значение
         ObjectHolder() = default;
 
+        ObjectHolder(const ObjectHolder&) = default;
+        ObjectHolder& operator=(const ObjectHolder&) = default;
+        // Перемещение оставляет other пустым
+        ObjectHolder(ObjectHolder&& other) noexcept;
+        ObjectHolder& operator=(ObjectHolder&& other) noexcept;
+
         // Возвращает ObjectHolder, владеющий объектом типа T
         // Тип T - конкретный класс-наследник Object.
-        // object копируется или перемещается в кучу
+        // От чисел и логических значений ObjectHolder хранит только само значение и не обращается
+        // к куче, остальные объекты копируются или перемещаются в кучу
         template <typename T>
         [[nodiscard]] static ObjectHolder Own(T&& object) {
-            return ObjectHolder(std::make_shared<T>(std::forward<T>(object)));
+            using Type = std::decay_t<T>;
+            if constexpr (std::is_same_v<Type, Number>) {
+                return ObjectHolder(Storage(std::in_place_index<NUMBER_INDEX>, object.GetValue()));
+            }
+            else if constexpr (std::is_same_v<Type, Bool>) {
+                return ObjectHolder(Storage(std::in_place_index<BOOL_INDEX>, object.GetValue()));
+            }
+            else {
+                return OwnObject(new Type(std::forward<T>(object)));
+            }
         }
 
-        // Создаёт ObjectHolder, не владеющий объектом (аналог слабой ссылки)
+        // Создаёт ObjectHolder, ссылающийся на object, без обращения к куче.
+        // Объект, созданный функцией Own, продолжает жить, пока на него ссылается хотя бы один
+        // ObjectHolder. Любой другой объект ObjectHolder лишь заимствует (аналог слабой ссылки):
+        // за то, чтобы объект пережил все ссылки на него, отвечает его владелец
         [[nodiscard]] static ObjectHolder Share(Object& object);
+        // Временный объект будет разрушен раньше, чем заимствующий его ObjectHolder
+        static ObjectHolder Share(Object&& object) = delete;
         // Создаёт пустой ObjectHolder, соответствующий значению None
         [[nodiscard]] static ObjectHolder None();
 
@@ -51,47 +247,254 @@ namespace runtime {
 
         Object* operator->() const;
 
-        [[nodiscard]] Object* Get() const;
+        // Возвращает указатель на объект либо nullptr для пустого ObjectHolder.
+        // Число или логическое значение, которое хранится без объекта, при первом обращении
+        // переносится в созданный в куче объект, которым ObjectHolder затем владеет. Поэтому
+        // указатель остаётся действительным и после перемещения ObjectHolder, пока на объект
+        // есть ссылки. Чтобы получить само значение без обращения к куче, используются
+        // TryGetNumber и TryGetBool
+        [[nodiscard]] Object* Get() const {
+            switch (data_.index()) {
+            case NUMBER_INDEX:
+            case BOOL_INDEX:
+                return Box();
+            case OWNED_INDEX:
+                return std::get_if<OWNED_INDEX>(&data_)->Get();
+            case BORROWED_INDEX:
+                return *std::get_if<BORROWED_INDEX>(&data_);
+            default:
+                return nullptr;
+            }
+        }
+
+        // Возвращает вид хранимого объекта. Не переносит значения в кучу.
+        // ObjectHolder должен быть непустым
+        [[nodiscard]] ObjectKind GetKind() const {
+            switch (data_.index()) {
+            case NUMBER_INDEX:
+                return ObjectKind::Number;
+            case BOOL_INDEX:
+                return ObjectKind::Bool;
+            default:
+                return Get()->GetKind();
+            }
+        }
 
         // Возвращает указатель на объект типа T либо nullptr, если внутри ObjectHolder не хранится
         // объект данного типа
         template <typename T>
         [[nodiscard]] T* TryAs() const {
-            return dynamic_cast<T*>(this->Get());
+            constexpr ObjectKind kind = ObjectKindOf<std::remove_cv_t<T>>::value;
+            if constexpr (kind != ObjectKind::Other) {
+                return *this && GetKind() == kind ? static_cast<T*>(Get()) : nullptr;
+            }
+            else {
+                return dynamic_cast<T*>(this->Get());
+            }
+        }
+
+        // Возвращает число, если ObjectHolder хранит число, иначе nullopt. Не обращается к куче
+        [[nodiscard]] std::optional<int> TryGetNumber() const {
+            if (const int* value = std::get_if<NUMBER_INDEX>(&data_)) {
+                return *value;
+            }
+            if (data_.index() > BOOL_INDEX && GetKind() == ObjectKind::Number) {
+                return static_cast<const Number*>(Get())->GetValue();
+            }
+            return std::nullopt;
         }
 
+        // Возвращает логическое значение, если ObjectHolder хранит значение Bool, иначе nullopt.
+        // Не обращается к куче
+        [[nodiscard]] std::optional<bool> TryGetBool() const {
+            if (const bool* value = std::get_if<BOOL_INDEX>(&data_)) {
+                return *value;
+            }
+            if (data_.index() > BOOL_INDEX && GetKind() == ObjectKind::Bool) {
+                return static_cast<const Bool*>(Get())->GetValue();
+            }
+            return std::nullopt;
+        }
+
+        // Выводит в os представление хранимого объекта, как Object::Print. Числа и логические
+        // значения выводятся без переноса в кучу. ObjectHolder должен быть непустым
+        void Print(std::ostream& os, Context& context) const;
+
         // Возвращает true, если ObjectHolder не пуст
-        explicit operator bool() const;
+        explicit operator bool() const {
+            return data_.index() != NONE_INDEX;
+        }
 
-    private:
-        explicit ObjectHolder(std::shared_ptr<Object> data);
+        // Возвращает true, если ObjectHolder ссылается на объект, которым не владеет
+        [[nodiscard]] bool IsBorrowed() const {
+            return data_.index() == BORROWED_INDEX;
+        }
 
-        std::shared_ptr<Object> data_;
+    private:
+        // Ссылка на объект, созданный функцией Own, поддерживающая его счётчик ссылок
+        class Ref {
+        public:
+            explicit Ref(Object* object)
+                : object_(object) {
+                object_->AddRef();
+            }
+
+            Ref(const Ref& other)
+                : Ref(other.object_) {
+            }
+
+            Ref(Ref&& other) noexcept
+                : object_(std::exchange(other.object_, nullptr)) {
+            }
+
+            Ref& operator=(Ref other) noexcept {
+                std::swap(object_, other.object_);
+                return *this;
+            }
+
+            ~Ref() {
+                if (object_ != nullptr) {
+                    object_->Release();
+                }
+            }
+
+            [[nodiscard]] Object* Get() const {
+                return object_;
+            }
+
+        private:
+            Object* object_;
+        };
+
+        // None, значение числа или Bool без объекта, ссылка на объект, которым владеет ObjectHolder,
+        // либо заимствованный указатель на объект, которым владеет кто-то другой. Копирование
+        // заимствованного указателя не обращается к объекту
+        using Storage = std::variant<std::monostate, int, bool, Ref, Object*>;
+        static constexpr size_t NONE_INDEX = 0;
+        static constexpr size_t NUMBER_INDEX = 1;
+        static constexpr size_t BOOL_INDEX = 2;
+        static constexpr size_t OWNED_INDEX = 3;
+        static constexpr size_t BORROWED_INDEX = 4;
+
+        explicit ObjectHolder(Storage data);
+
+        // Возвращает ObjectHolder, владеющий созданным в куче объектом object
+        static ObjectHolder OwnObject(Object* object);
+
+        // Переносит хранимое без объекта число или логическое значение в созданный в куче объект
+        // и возвращает указатель на него
+        Object* Box() const;
+
+        // Get() const переносит в кучу число или логическое значение, хранящиеся без объекта
+        mutable Storage data_;
     };
 
-    // Объект-значение, хранящий значение типа T
-    template <typename T>
-    class ValueObject : public Object { //думаю что реализован
+
+    // Таблица символов, связывающая имя объекта с его значением. Имена хранятся символами:
+    // поиск переменной хеширует и сравнивает номер символа, а не строку
+    using Closure = std::unordered_map<Symbol, ObjectHolder>;
+
+    // Кадр, в котором выполняются инструкции Mython.
+    // Переменные метода, получившие при разборе номер слота, хранятся в плоском массиве слотов.
+    // Кадр верхнего уровня (и кадр метода, тело которого не прошло разрешение имён) хранит
+    // переменные в Closure и ищет их по символу имени
+    class Frame {
     public:
-        ValueObject(T v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
-            : value_(v) {
+        // Номер слота переменной, не получившей слот при разборе
+        static constexpr size_t NO_SLOT = std::numeric_limits<size_t>::max();
+        // Слот, в котором метод получает ссылку на self. Параметры метода занимают следующие слоты
+        static constexpr size_t SELF_SLOT = 0;
+
+        // Создаёт кадр, переменные которого хранятся в closure
+        explicit Frame(Closure& closure)
+            : closure_(&closure) {
         }
 
-        void Print(std::ostream& os, [[maybe_unused]] Context& context) override {
-            os << value_;
+        // Создаёт кадр из slot_count слотов, ни одному из которых ещё не присвоено значение
+        explicit Frame(size_t slot_count)
+            : slot_count_(slot_count) {
+            if (slot_count > INLINE_SLOTS) {
+                heap_slots_ = std::make_unique<Slot[]>(slot_count);
+                slots_ = heap_slots_.get();
+            }
         }
 
-        [[nodiscard]] const T& GetValue() const {
-            return value_;
+        Frame(const Frame&) = delete;
+        Frame& operator=(const Frame&) = delete;
+
+        // Возвращает указатель на значение переменной name, хранящейся в слоте slot,
+        // либо nullptr, если переменной не присвоено значение
+        [[nodiscard]] ObjectHolder* Find(Symbol name, size_t slot) {
+            if (closure_ != nullptr) {
+                auto it = closure_->find(name);
+                return it != closure_->end() ? &it->second : nullptr;
+            }
+            return FindSlot(slot);
         }
 
-    private:
-        T value_;
-    };
+        // Возвращает указатель на значение слота slot либо nullptr, если слоту не присвоено значение
+        [[nodiscard]] ObjectHolder* FindSlot(size_t slot) {
+            if (slot >= slot_count_ || !slots_[slot].bound) {
+                return nullptr;
+            }
+            return &slots_[slot].value;
+        }
+
+        // Присваивает значение value переменной name, хранящейся в слоте slot
+        ObjectHolder& Assign(Symbol name, size_t slot, ObjectHolder value) {
+            if (closure_ != nullptr) {
+                return (*closure_)[name] = std::move(value);
+            }
+            if (slot >= slot_count_) {
+                throw std::runtime_error("Variable " + name.GetName() + " has no slot");
+            }
+            return Bind(slot, std::move(value));
+        }
+
+        // Присваивает значение value слоту slot
+        ObjectHolder& Bind(size_t slot, ObjectHolder value) {
+            Slot& target = slots_[slot];
+            target.bound = true;
+            return target.value = std::move(value);
+        }
 
+        // Возвращает Closure кадра верхнего уровня либо nullptr для кадра из слотов
+        [[nodiscard]] Closure* GetClosure() const {
+            return closure_;
+        }
+
+        // Отмечает, что в кадре выполнена инструкция return. Составные инструкции, увидев отметку,
+        // прекращают выполнение и передают результат return вверх вместо исключения
+        void SetReturning() {
+            returning_ = true;
+        }
 
-    // Таблица символов, связывающая имя объекта с его значением
-    using Closure = std::unordered_map<std::string, ObjectHolder>;
+        [[nodiscard]] bool IsReturning() const {
+            return returning_;
+        }
+
+        // Снимает отметку о выполненном return и возвращает её прежнее значение
+        bool TakeReturning() {
+            return std::exchange(returning_, false);
+        }
+
+    private:
+        struct Slot {
+            ObjectHolder value;
+            bool bound = false;
+        };
+
+        // Большинство методов обходится несколькими переменными: их слоты размещаются
+        // прямо в кадре, без обращения к куче
+        static constexpr size_t INLINE_SLOTS = 8;
+
+        Closure* closure_ = nullptr;
+        size_t slot_count_ = 0;
+        Slot inline_slots_[INLINE_SLOTS];
+        std::unique_ptr<Slot[]> heap_slots_;
+        Slot* slots_ = inline_slots_;
+        bool returning_ = false;
+    };
 
     // Проверяет, содержится ли в object значение, приводимое к True
     // Для отличных от нуля чисел, True и непустых строк возвращается true. В остальных случаях - false.
@@ -104,30 +507,84 @@ namespace runtime {
         // Выполняет действие над объектами внутри closure, используя context
         // Возвращает результирующее значение либо None
         virtual ObjectHolder Execute(Closure& closure, Context& context) = 0;
+        // Выполняет действие над переменными кадра frame. Реализация по умолчанию поддерживает
+        // только кадры, хранящие переменные в Closure
+        virtual ObjectHolder Execute(Frame& frame, Context& context);
     };
 
-    // Строковое значение
-    using String = ValueObject<std::string>;
-
-    // Числовое значение
-    using Number = ValueObject<int>;
-
-    // Логическое значение
-    class Bool : public ValueObject<bool> {
-    public:
-        using ValueObject<bool>::ValueObject;
+    // Идентификатор имени метода
+    using MethodId = Symbol;
 
-        void Print(std::ostream& os, Context& context) override;
-    };
+    // Символы, имеющие особый смысл в Mython. Их имена регистрируются в таблице символов первыми
+    inline constexpr MethodId INIT_METHOD_ID = Symbol::FromId(0);  // __init__
+    inline constexpr MethodId STR_METHOD_ID = Symbol::FromId(1);   // __str__
+    inline constexpr MethodId EQ_METHOD_ID = Symbol::FromId(2);    // __eq__
+    inline constexpr MethodId LT_METHOD_ID = Symbol::FromId(3);    // __lt__
+    inline constexpr MethodId ADD_METHOD_ID = Symbol::FromId(4);   // __add__
+    inline constexpr Symbol SELF_SYMBOL = Symbol::FromId(5);       // self
 
     // Метод класса
     struct Method {
         // Имя метода
-        std::string name;
+        Symbol name;
         // Имена формальных параметров метода
-        std::vector<std::string> formal_params;
+        std::vector<Symbol> formal_params;
         // Тело метода
         std::unique_ptr<Executable> body;
+        // Количество слотов кадра, в котором выполняется тело: self, параметры и локальные переменные.
+        // 0 означает, что имена в теле не разрешены в слоты и метод выполняется над Closure
+        size_t frame_size = 0;
+    };
+
+    // Форма (скрытый класс) экземпляров: имена полей в порядке их добавления. Поле хранится
+    // в экземпляре по смещению, равному номеру его имени в форме. Формы образуют дерево переходов:
+    // добавление поля переводит экземпляр в дочернюю форму, общую для всех экземпляров класса,
+    // которые получили те же поля в том же порядке. Корень дерева - форма без полей - принадлежит
+    // классу, формы живут, пока существует класс
+    class Shape {
+    public:
+        // Смещение, возвращаемое FindField для отсутствующего поля
+        static constexpr size_t NO_FIELD = std::numeric_limits<size_t>::max();
+
+        Shape() = default;
+        Shape(const Shape&) = delete;
+        Shape& operator=(const Shape&) = delete;
+
+        // Возвращает смещение поля name либо NO_FIELD
+        [[nodiscard]] size_t FindField(Symbol name) const {
+            auto it = offsets_.find(name);
+            return it == offsets_.end() ? NO_FIELD : it->second;
+        }
+
+        // Возвращает форму, получаемую добавлением поля name, которого нет в этой форме.
+        // Форма создаётся при первом обращении и затем используется всеми экземплярами.
+        // Дерево форм достраивается без блокировки: классы и их экземпляры принадлежат
+        // интерпретатору, который выполняет программу в одном потоке
+        [[nodiscard]] const Shape& AddField(Symbol name) const;
+
+        [[nodiscard]] size_t GetFieldCount() const {
+            return names_.size();
+        }
+
+        [[nodiscard]] Symbol GetFieldName(size_t offset) const {
+            return names_[offset];
+        }
+
+        // Возвращает наибольшее количество полей среди форм дерева, которому принадлежит форма.
+        // Экземпляры заранее резервируют под поля столько места
+        [[nodiscard]] size_t GetExpectedFieldCount() const {
+            return root_->max_field_count_;
+        }
+
+    private:
+        // Корень дерева переходов
+        const Shape* root_ = this;
+        // Заполняется только в корне
+        mutable size_t max_field_count_ = 0;
+        std::vector<Symbol> names_;
+        std::unordered_map<Symbol, size_t> offsets_;
+        // Дочерние формы по имени добавляемого поля
+        mutable std::unordered_map<Symbol, std::unique_ptr<Shape>> transitions_;
     };
 
     // Класс
@@ -137,19 +594,276 @@ namespace runtime {
         // Если parent равен nullptr, то создаётся базовый класс
         explicit Class(std::string name, std::vector<Method> methods, const Class* parent);
 
-        // Возвращает указатель на метод name или nullptr, если метод с таким именем отсутствует
-        [[nodiscard]] const Method* GetMethod(const std::string& name) const;
+        // Возвращает указатель на метод id или nullptr, если метод с таким именем отсутствует
+        [[nodiscard]] const Method* GetMethod(MethodId id) const {
+            const size_t index = id.GetId();
+            return index < dispatch_table_.size() ? dispatch_table_[index] : nullptr;
+        }
+        // Возвращает указатель на метод id, принимающий argument_count параметров, или nullptr
+        [[nodiscard]] const Method* GetMethod(MethodId id, size_t argument_count) const {
+            const Method* method = GetMethod(id);
+            return method != nullptr && method->formal_params.size() == argument_count ? method : nullptr;
+        }
+
+        // Возвращает методы, объявленные в самом классе. Тела методов можно заменять
+        // равносильными (например, при оптимизации дерева разбора), не меняя их сигнатур
+        [[nodiscard]] std::vector<Method>& GetOwnMethods() {
+            return methods_;
+        }
 
         // Возвращает имя класса
         [[nodiscard]] const std::string& GetName() const;
 
+        // Возвращает форму экземпляров класса, не имеющих полей
+        [[nodiscard]] const Shape& GetRootShape() const {
+            return *root_shape_;
+        }
+
         // Выводит в os строку "Class <имя класса>", например "Class cat"
         void Print(std::ostream& os, Context& context) override;
 
     private:
         std::string class_name_;
         const Class* parent_;
-        std::unordered_map<std::string, Method> methods_;
+        std::vector<Method> methods_;
+        // Методы класса и всех его предков по номерам символов их имён либо nullptr. Таблица
+        // заканчивается на наибольшем номере имени метода. Поиск метода - индексирование массива
+        // при любой глубине наследования
+        std::vector<const Method*> dispatch_table_;
+        // Форма хранится отдельно, чтобы ссылки на неё не менялись при перемещении класса
+        std::unique_ptr<Shape> root_shape_ = std::make_unique<Shape>();
+    };
+
+    // Счётчики обращений к кэшам методов
+    struct MethodCacheStats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+    };
+
+    // Встроенный кэш места вызова метода. В месте вызова всегда вызывается один и тот же метод
+    // с одним и тем же количеством аргументов, поэтому результат поиска зависит только от класса
+    // получателя. Кэш помнит результаты для нескольких классов (полиморфный кэш) и при повторном
+    // вызове для знакомого класса обходится без поиска. Классы должны жить дольше кэша
+    class MethodCache {
+    public:
+        // Возвращает метод method класса cls, принимающий argument_count параметров, или nullptr
+        [[nodiscard]] const Method* Lookup(const Class& cls, MethodId method, size_t argument_count) {
+            for (size_t i = 0; i < size_; ++i) {
+                if (entries_[i].cls == &cls) {
+                    ++stats_.hits;
+                    ++total_stats_.hits;
+                    return entries_[i].method;
+                }
+            }
+            return Miss(cls, method, argument_count);
+        }
+
+        [[nodiscard]] const MethodCacheStats& GetStats() const {
+            return stats_;
+        }
+
+        // Возвращает суммарные счётчики всех кэшей, к которым обращался текущий поток
+        [[nodiscard]] static const MethodCacheStats& GetTotalStats() {
+            return total_stats_;
+        }
+
+    private:
+        const Method* Miss(const Class& cls, MethodId method, size_t argument_count);
+
+        struct Entry {
+            const Class* cls = nullptr;
+            const Method* method = nullptr;
+        };
+
+        static constexpr size_t CAPACITY = 4;
+
+        Entry entries_[CAPACITY];
+        std::uint8_t size_ = 0;
+        // Запись, которая будет вытеснена следующей, когда кэш заполнен
+        std::uint8_t next_victim_ = 0;
+        MethodCacheStats stats_;
+
+        static thread_local MethodCacheStats total_stats_;
+    };
+
+    // Поля экземпляра класса. Значения полей лежат в одном непрерывном массиве в порядке,
+    // заданном формой экземпляра, имена полей хранятся в форме и не дублируются в экземплярах.
+    // Интерфейс повторяет ассоциативный контейнер Closure, при обходе поля представлены строками имён
+    class InstanceFields {
+        template <bool IsConst>
+        class BasicIterator {
+            using Fields = std::conditional_t<IsConst, const InstanceFields, InstanceFields>;
+            using Value = std::conditional_t<IsConst, const ObjectHolder, ObjectHolder>;
+
+        public:
+            using reference = std::pair<const std::string&, Value&>;
+
+            // Пара имени и значения поля, к членам которой обращаются через оператор ->
+            struct pointer {
+                reference pair;
+
+                const reference* operator->() const {
+                    return &pair;
+                }
+            };
+
+            BasicIterator(Fields& fields, size_t offset)
+                : fields_(&fields)
+                , offset_(offset) {
+            }
+
+            reference operator*() const {
+                return { fields_->shape_->GetFieldName(offset_).GetName(), fields_->values_[offset_] };
+            }
+
+            pointer operator->() const {
+                return { **this };
+            }
+
+            BasicIterator& operator++() {
+                ++offset_;
+                return *this;
+            }
+
+            bool operator==(const BasicIterator& other) const {
+                return fields_ == other.fields_ && offset_ == other.offset_;
+            }
+
+            bool operator!=(const BasicIterator& other) const {
+                return !(*this == other);
+            }
+
+        private:
+            Fields* fields_;
+            size_t offset_;
+        };
+
+    public:
+        using iterator = BasicIterator<false>;
+        using const_iterator = BasicIterator<true>;
+
+        explicit InstanceFields(const Shape& shape)
+            : shape_(&shape) {
+            values_.reserve(shape.GetExpectedFieldCount());
+        }
+
+        [[nodiscard]] const Shape& GetShape() const {
+            return *shape_;
+        }
+
+        [[nodiscard]] size_t size() const {
+            return values_.size();
+        }
+
+        [[nodiscard]] bool empty() const {
+            return values_.empty();
+        }
+
+        [[nodiscard]] iterator begin() {
+            return { *this, 0 };
+        }
+
+        [[nodiscard]] iterator end() {
+            return { *this, values_.size() };
+        }
+
+        [[nodiscard]] const_iterator begin() const {
+            return { *this, 0 };
+        }
+
+        [[nodiscard]] const_iterator end() const {
+            return { *this, values_.size() };
+        }
+
+        [[nodiscard]] iterator find(Symbol name) {
+            return { *this, FindOffset(name) };
+        }
+
+        [[nodiscard]] const_iterator find(Symbol name) const {
+            return { *this, FindOffset(name) };
+        }
+
+        [[nodiscard]] size_t count(Symbol name) const {
+            return shape_->FindField(name) == Shape::NO_FIELD ? 0 : 1;
+        }
+
+        // Возвращает значение поля name. Если поля нет, выбрасывает исключение std::out_of_range
+        [[nodiscard]] ObjectHolder& at(Symbol name);
+        [[nodiscard]] const ObjectHolder& at(Symbol name) const;
+
+        // Возвращает значение поля name, добавляя поле со значением None, если его нет
+        ObjectHolder& operator[](Symbol name);
+
+        // Возвращает значение поля по его смещению в форме экземпляра
+        [[nodiscard]] ObjectHolder& GetAt(size_t offset) {
+            return values_[offset];
+        }
+
+        [[nodiscard]] const ObjectHolder& GetAt(size_t offset) const {
+            return values_[offset];
+        }
+
+        // Добавляет последнее поле формы next_shape, переводя экземпляр в эту форму.
+        // next_shape должна быть получена из текущей формы вызовом AddField
+        ObjectHolder& Append(const Shape& next_shape, ObjectHolder value) {
+            shape_ = &next_shape;
+            return values_.emplace_back(std::move(value));
+        }
+
+    private:
+        size_t FindOffset(Symbol name) const {
+            size_t offset = shape_->FindField(name);
+            return offset == Shape::NO_FIELD ? values_.size() : offset;
+        }
+
+        const Shape* shape_;
+        std::vector<ObjectHolder> values_;
+    };
+
+    // Встроенный кэш смещения поля в месте обращения к нему (self.x, self.x = ...).
+    // Помнит форму последнего экземпляра и смещение поля в ней, поэтому для экземпляров той же
+    // формы поле находится без поиска по имени. Присваивание новому полю запоминает переход
+    // к дочерней форме, и следующие экземпляры получают поле без обращения к дереву форм.
+    // Классы экземпляров должны жить дольше кэша
+    class FieldCache {
+    public:
+        // Возвращает поле name или nullptr, если его нет
+        [[nodiscard]] ObjectHolder* Find(InstanceFields& fields, Symbol name) {
+            if (&fields.GetShape() != shape_ || next_shape_ != nullptr) {
+                size_t offset = fields.GetShape().FindField(name);
+                if (offset == Shape::NO_FIELD) {
+                    return nullptr;
+                }
+                shape_ = &fields.GetShape();
+                offset_ = offset;
+                next_shape_ = nullptr;
+            }
+            return &fields.GetAt(offset_);
+        }
+
+        // Присваивает полю name значение value, добавляя поле, если его нет
+        ObjectHolder& Assign(InstanceFields& fields, Symbol name, ObjectHolder value) {
+            if (&fields.GetShape() != shape_) {
+                shape_ = &fields.GetShape();
+                offset_ = shape_->FindField(name);
+                next_shape_ = offset_ == Shape::NO_FIELD ? &shape_->AddField(name) : nullptr;
+            }
+            if (next_shape_ != nullptr) {
+                return fields.Append(*next_shape_, std::move(value));
+            }
+            return fields.GetAt(offset_) = std::move(value);
+        }
+
+        // Возвращает форму, для которой кэш хранит смещение, либо nullptr
+        [[nodiscard]] const Shape* GetShape() const {
+            return shape_;
+        }
+
+    private:
+        const Shape* shape_ = nullptr;
+        size_t offset_ = 0;
+        // Форма после добавления поля, если в форме shape_ поля нет
+        const Shape* next_shape_ = nullptr;
     };
 
     // Экземпляр класса
@@ -169,20 +883,28 @@ namespace runtime {
          * Если ни сам класс, ни его родители не содержат метод method, метод выбрасывает исключение
          * runtime_error
          */
-        ObjectHolder Call(const std::string& method, const std::vector<ObjectHolder>& actual_args,
+        ObjectHolder Call(MethodId method, const std::vector<ObjectHolder>& actual_args, Context& context);
+        // Находит метод method через кэш места вызова cache
+        ObjectHolder Call(MethodCache& cache, MethodId method, const std::vector<ObjectHolder>& actual_args,
             Context& context);
+        // Вызывает уже найденный метод method класса объекта.
+        // Количество аргументов должно совпадать с количеством параметров метода
+        ObjectHolder Call(const Method& method, const std::vector<ObjectHolder>& actual_args, Context& context);
 
         // Возвращает true, если объект имеет метод method, принимающий argument_count параметров
-        [[nodiscard]] bool HasMethod(const std::string& method, size_t argument_count) const;
+        [[nodiscard]] bool HasMethod(MethodId method, size_t argument_count) const;
 
-        // Возвращает ссылку на Closure, содержащий поля объекта
-        [[nodiscard]] Closure& Fields();
-        // Возвращает константную ссылку на Closure, содержащую поля объекта
-        [[nodiscard]] const Closure& Fields() const;
+        // Возвращает ссылку на поля объекта
+        [[nodiscard]] InstanceFields& Fields();
+        // Возвращает константную ссылку на поля объекта
+        [[nodiscard]] const InstanceFields& Fields() const;
+
+        // Возвращает класс, экземпляром которого является объект
+        [[nodiscard]] const Class& GetClass() const;
 
     private:
         const Class& class_;
-        Closure fields_;
+        InstanceFields fields_;
     };
 
     /*
@@ -213,6 +935,38 @@ namespace runtime {
     // Возвращает значение, противоположное Less(lhs, rhs, context)
     bool GreaterOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
 
+    // Сравнения, выполняемые в одном месте программы. Дают те же результаты, что и одноимённые
+    // функции, но находят методы __eq__ и __lt__ через встроенные кэши этого места
+    class CachedComparator {
+    public:
+        using Comparator = bool (*)(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
+        using Method = bool (CachedComparator::*)(const ObjectHolder& lhs, const ObjectHolder& rhs,
+            Context& context);
+
+        // Возвращает метод, выполняющий то же сравнение, что и comparator (одна из функций Equal,
+        // NotEqual, Less, Greater, LessOrEqual, GreaterOrEqual), либо nullptr для других функций
+        [[nodiscard]] static Method Find(Comparator comparator);
+
+        bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
+        bool NotEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
+        bool Less(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
+        bool Greater(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
+        bool LessOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
+        bool GreaterOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
+
+        [[nodiscard]] const MethodCache& GetEqualCache() const {
+            return eq_cache_;
+        }
+
+        [[nodiscard]] const MethodCache& GetLessCache() const {
+            return lt_cache_;
+        }
+
+    private:
+        MethodCache eq_cache_;
+        MethodCache lt_cache_;
+    };
+
     // Контекст-заглушка, применяется в тестах.
     // В этом контексте весь вывод перенаправляется в строковый поток вывода output
     struct DummyContext : Context {
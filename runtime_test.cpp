@@ -2,6 +2,7 @@
 #include "test_runner_p.h"
 
 #include <functional>
+#include <thread>
 
 using namespace std;
 
@@ -19,7 +20,8 @@ namespace runtime {
             }
 
             Logger(const Logger& rhs)
-                : id_(rhs.id_)  //
+                : Object(rhs)
+                , id_(rhs.id_)  //
             {
                 ++instance_count;
             }
@@ -90,6 +92,41 @@ namespace runtime {
             ASSERT(context.output.str().empty());
         }
 
+        void TestObjectKinds() {
+            Class cls("Cls"s, {}, nullptr);
+            auto number = ObjectHolder::Own(Number{ 1 });
+            auto str = ObjectHolder::Own(String{ "s"s });
+            auto boolean = ObjectHolder::Own(Bool{ true });
+            auto instance = ObjectHolder::Own(ClassInstance{ cls });
+
+            ASSERT(number->GetKind() == ObjectKind::Number);
+            ASSERT(str->GetKind() == ObjectKind::String);
+            ASSERT(boolean->GetKind() == ObjectKind::Bool);
+            ASSERT(cls.GetKind() == ObjectKind::Class);
+            ASSERT(instance->GetKind() == ObjectKind::ClassInstance);
+
+            ASSERT(number.TryAs<Number>() == number.Get());
+            ASSERT(number.TryAs<const Number>() == number.Get());
+            ASSERT(number.TryAs<String>() == nullptr);
+            ASSERT(str.TryAs<Number>() == nullptr);
+            ASSERT(ObjectHolder::None().TryAs<Number>() == nullptr);
+
+            // Bool - наследник ValueObject<bool>, но не всякий ValueObject<bool> является Bool
+            ASSERT(boolean.TryAs<ValueObject<bool>>() == boolean.Get());
+            auto plain_bool = ObjectHolder::Own(ValueObject<bool>{ true });
+            ASSERT(plain_bool->GetKind() == ObjectKind::Other);
+            ASSERT(plain_bool.TryAs<Bool>() == nullptr);
+
+            // Типы без собственного вида проверяются через dynamic_cast
+            struct Derived : ClassInstance {
+                using ClassInstance::ClassInstance;
+            };
+            auto derived = ObjectHolder::Own(Derived{ cls });
+            ASSERT(derived.TryAs<ClassInstance>() == derived.Get());
+            ASSERT(derived.TryAs<Derived>() == derived.Get());
+            ASSERT(instance.TryAs<Derived>() == nullptr);
+        }
+
         struct TestMethodBody : Executable {
             using Fn = std::function<ObjectHolder(Closure& closure, Context& context)>;
             Fn body;
@@ -242,6 +279,136 @@ namespace runtime {
             }
         }
 
+        void TestInlineValues() {
+            // От чисел и логических значений хранится только значение, без объекта
+            ASSERT(sizeof(ObjectHolder) <= 2 * sizeof(void*));
+            auto number = ObjectHolder::Own(Number{ 42 });
+            auto boolean = ObjectHolder::Own(Bool{ true });
+            ASSERT(number.GetKind() == ObjectKind::Number);
+            ASSERT(boolean.GetKind() == ObjectKind::Bool);
+            ASSERT_EQUAL(*number.TryGetNumber(), 42);
+            ASSERT(!number.TryGetBool());
+            ASSERT_EQUAL(*boolean.TryGetBool(), true);
+            ASSERT(!boolean.TryGetNumber());
+            ASSERT_EQUAL(number.TryAs<Number>()->GetValue(), 42);
+            ASSERT_EQUAL(boolean.TryAs<Bool>()->GetValue(), true);
+
+            ObjectHolder copy = number;
+            ASSERT_EQUAL(copy.TryAs<Number>()->GetValue(), 42);
+
+            ObjectHolder moved = std::move(number);
+            ASSERT(!number);  // NOLINT
+            ASSERT_EQUAL(moved.TryAs<Number>()->GetValue(), 42);
+
+            moved = boolean;
+            ASSERT(moved.TryAs<Number>() == nullptr);
+            ASSERT(IsTrue(moved));
+
+            // Объект числа не хранится внутри ObjectHolder: ссылки на него остаются действительными,
+            // когда ObjectHolder перемещается, например при перераспределении слотов или полей
+            vector<ObjectHolder> values;
+            values.push_back(ObjectHolder::Own(Number{ 5 }));
+            Object* object = values.front().Get();
+            ObjectHolder shared_value = ObjectHolder::Share(*values.front());
+            for (int i = 0; i < 100; ++i) {
+                values.push_back(ObjectHolder::Own(Number{ i }));
+            }
+            ASSERT(values.front().Get() == object);
+            values.clear();
+            ASSERT(shared_value.Get() == object);
+            ASSERT_EQUAL(*shared_value.TryGetNumber(), 5);
+
+            Number shared{ 7 };
+            auto share = ObjectHolder::Share(shared);
+            ASSERT(share.Get() == &shared);
+            ASSERT_EQUAL(*share.TryGetNumber(), 7);
+        }
+
+        void TestReferenceCounting() {
+            {
+                auto owner = ObjectHolder::Own(Logger());
+                ASSERT_EQUAL(Logger::instance_count, 1);
+                auto shared = ObjectHolder::Share(*owner);
+                owner = ObjectHolder::None();
+                ASSERT_EQUAL(Logger::instance_count, 1);
+                ASSERT_EQUAL(shared.TryAs<Logger>()->GetId(), 0);
+            }
+            ASSERT_EQUAL(Logger::instance_count, 0);
+
+            {
+                auto owner = ObjectHolder::Own(Logger(5));
+                ASSERT(!owner->IsThreadShared());
+                // Ссылки, полученные до перевода счётчика на атомарные операции, сохраняются
+                ObjectHolder before = owner;
+                owner->SetThreadShared();
+                ASSERT(owner->IsThreadShared());
+
+                vector<thread> threads;
+                for (int i = 0; i < 4; ++i) {
+                    threads.emplace_back([owner] {
+                        for (int j = 0; j < 10000; ++j) {
+                            ObjectHolder copy = owner;
+                            ASSERT_EQUAL(copy.TryAs<Logger>()->GetId(), 5);
+                        }
+                    });
+                }
+                for (auto& thread : threads) {
+                    thread.join();
+                }
+                owner = ObjectHolder::None();
+                ASSERT_EQUAL(Logger::instance_count, 1);
+                ASSERT_EQUAL(before.TryAs<Logger>()->GetId(), 5);
+            }
+            ASSERT_EQUAL(Logger::instance_count, 0);
+        }
+
+        void TestBorrowing() {
+            Number number{ 1 };
+            auto borrowed = ObjectHolder::Share(number);
+            ASSERT(borrowed.IsBorrowed());
+            ObjectHolder copy = borrowed;
+            ASSERT(copy.IsBorrowed());
+            ASSERT(copy.Get() == &number);
+
+            auto owned = ObjectHolder::Own(Logger());
+            ASSERT(!owned.IsBorrowed());
+            ASSERT(!ObjectHolder::Share(*owned).IsBorrowed());
+            ASSERT(!ObjectHolder::Own(Number{ 1 }).IsBorrowed());
+            ASSERT(!ObjectHolder::None().IsBorrowed());
+
+            // Заимствующий ObjectHolder может пережить объект, если больше к нему не обращается
+            auto logger = make_unique<Logger>();
+            {
+                auto dangling = ObjectHolder::Share(*logger);
+                ASSERT(dangling.IsBorrowed());
+                logger.reset();
+            }
+            ASSERT_EQUAL(Logger::instance_count, 1);
+        }
+
+        void TestFrame() {
+            Frame frame(10);
+            ASSERT(frame.FindSlot(Frame::SELF_SLOT) == nullptr);
+            ASSERT(frame.Find("x"s, 9) == nullptr);
+            ASSERT(frame.FindSlot(10) == nullptr);
+
+            frame.Bind(9, ObjectHolder::Own(Number{ 5 }));
+            ASSERT(frame.Find("x"s, 9) != nullptr);
+            ASSERT_EQUAL(frame.Find("x"s, 9)->TryAs<Number>()->GetValue(), 5);
+
+            frame.Assign("y"s, 1, ObjectHolder::None());
+            ASSERT(frame.FindSlot(1) != nullptr);
+            ASSERT(!*frame.FindSlot(1));
+            ASSERT_THROWS(frame.Assign("z"s, Frame::NO_SLOT, ObjectHolder::None()), runtime_error);
+
+            Closure closure;
+            Frame top_level(closure);
+            top_level.Assign("x"s, Frame::NO_SLOT, ObjectHolder::Own(Number{ 7 }));
+            ASSERT_EQUAL(closure.count("x"s), 1U);
+            ASSERT(top_level.Find("x"s, Frame::NO_SLOT) == &closure.at("x"s));
+            ASSERT(top_level.Find("y"s, Frame::NO_SLOT) == nullptr);
+        }
+
         void TestNullptr() {
             ObjectHolder oh;
             ASSERT(!oh);
@@ -504,6 +671,195 @@ namespace runtime {
             ASSERT_EQUAL(out.str(), "Class Test"s);
         }
 
+        void TestSymbols() {
+            const Symbol x("symbol_test_x"s);
+            ASSERT(x);
+            ASSERT(!Symbol());
+            ASSERT_EQUAL(Symbol("symbol_test_x"sv), x);
+            ASSERT_EQUAL(x.GetName(), "symbol_test_x"s);
+            ASSERT_EQUAL(x.GetHash(), std::hash<string_view>{}("symbol_test_x"sv));
+            ASSERT_EQUAL(std::hash<Symbol>{}(x), std::hash<uint32_t>{}(x.GetId()));
+            ASSERT_EQUAL(Symbol("self"s), SELF_SYMBOL);
+
+            // Find не регистрирует имя
+            ASSERT(!Symbol::Find("symbol_test_unknown"sv));
+            ASSERT_EQUAL(Symbol::Find("symbol_test_x"sv), x);
+
+            // Имена остаются на месте, пока таблица растёт
+            const string* x_name = &x.GetName();
+            vector<Symbol> symbols;
+            for (int i = 0; i < 5000; ++i) {
+                symbols.emplace_back("symbol_test_"s + to_string(i));
+            }
+            ASSERT_EQUAL(&x.GetName(), x_name);
+            for (int i = 0; i < 5000; ++i) {
+                ASSERT_EQUAL(symbols[i], Symbol("symbol_test_"s + to_string(i)));
+                ASSERT_EQUAL(symbols[i].GetName(), "symbol_test_"s + to_string(i));
+            }
+
+            // Потоки, одновременно регистрирующие одни и те же имена, получают одинаковые символы
+            vector<vector<Symbol>> interned(4);
+            vector<thread> threads;
+            for (auto& result : interned) {
+                threads.emplace_back([&result] {
+                    for (int i = 0; i < 2000; ++i) {
+                        result.emplace_back("symbol_thread_test_"s + to_string(i));
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            for (const auto& result : interned) {
+                ASSERT(result == interned.front());
+            }
+
+            // Зарегистрированные имена находятся без блокировки и во время роста индекса другим потоком
+            thread writer([] {
+                for (int i = 0; i < 5000; ++i) {
+                    Symbol("symbol_growth_test_"s + to_string(i));
+                }
+            });
+            vector<thread> readers;
+            // vector<char>, а не vector<bool>: потоки пишут в соседние элементы
+            vector<char> found(4, 1);
+            for (size_t r = 0; r < found.size(); ++r) {
+                readers.emplace_back([&symbols, &found, r] {
+                    for (int i = 0; i < 5000; ++i) {
+                        const string name = "symbol_test_"s + to_string(i);
+                        if (Symbol(name) != symbols[i] || Symbol::Find(name) != symbols[i]) {
+                            found[r] = 0;
+                        }
+                    }
+                });
+            }
+            writer.join();
+            for (auto& reader : readers) {
+                reader.join();
+            }
+            ASSERT(found == vector<char>(4, 1));
+            ASSERT_EQUAL(Symbol::Find("symbol_growth_test_4999"sv).GetName(), "symbol_growth_test_4999"s);
+        }
+
+        void TestMethodDispatch() {
+            ASSERT_EQUAL(Symbol("__init__"s), INIT_METHOD_ID);
+            ASSERT_EQUAL(Symbol("__str__"s), STR_METHOD_ID);
+            ASSERT_EQUAL(Symbol("__eq__"s), EQ_METHOD_ID);
+            ASSERT_EQUAL(Symbol("__lt__"s), LT_METHOD_ID);
+            ASSERT_EQUAL(Symbol("__add__"s), ADD_METHOD_ID);
+            const MethodId id = Symbol("dispatch_test_method"s);
+            ASSERT_EQUAL(Symbol("dispatch_test_method"s), id);
+            ASSERT_EQUAL(id.GetName(), "dispatch_test_method"s);
+
+            auto make_method = [](const string& name, int result) {
+                return Method{ name, {}, make_unique<TestMethodBody>([result](Closure&, Context&) {
+                    return ObjectHolder::Own(Number{ result });
+                }) };
+            };
+
+            // Иерархия из восьми классов: каждый добавляет свой метод и переопределяет get
+            vector<unique_ptr<Class>> hierarchy;
+            for (int level = 0; level < 8; ++level) {
+                vector<Method> methods;
+                methods.push_back(make_method("get"s, level));
+                methods.push_back(make_method("level"s + to_string(level), level));
+                hierarchy.push_back(make_unique<Class>("C"s + to_string(level), std::move(methods),
+                    hierarchy.empty() ? nullptr : hierarchy.back().get()));
+            }
+
+            DummyContext context;
+            ClassInstance instance(*hierarchy.back());
+            ASSERT_EQUAL(instance.Call("get"s, {}, context).TryAs<Number>()->GetValue(), 7);
+            for (int level = 0; level < 8; ++level) {
+                const string name = "level"s + to_string(level);
+                ASSERT(hierarchy.back()->GetMethod(name) == hierarchy[level]->GetMethod(name));
+                ASSERT_EQUAL(instance.Call(Symbol(name), {}, context).TryAs<Number>()->GetValue(), level);
+            }
+            ASSERT(hierarchy.front()->GetMethod("level7"s) == nullptr);
+            ASSERT(!instance.HasMethod("get"s, 1));
+            ASSERT_THROWS(instance.Call("level0"s, { ObjectHolder::None() }, context), runtime_error);
+
+            vector<Method> duplicates;
+            duplicates.push_back(make_method("get"s, 1));
+            duplicates.push_back(make_method("get"s, 2));
+            ASSERT_THROWS(Class("Duplicates"s, std::move(duplicates), hierarchy.back().get()), runtime_error);
+        }
+
+        void TestMethodCache() {
+            const MethodId id = Symbol("cached"s);
+            vector<unique_ptr<Class>> classes;
+            for (int i = 0; i < 5; ++i) {
+                vector<Method> methods;
+                methods.push_back({ "cached"s, {"x"s}, make_unique<TestMethodBody>(nullptr) });
+                classes.push_back(make_unique<Class>("C"s + to_string(i), std::move(methods), nullptr));
+            }
+
+            MethodCache cache;
+            // Четыре класса помещаются в кэш одновременно
+            for (int round = 0; round < 2; ++round) {
+                for (int i = 0; i < 4; ++i) {
+                    ASSERT(cache.Lookup(*classes[i], id, 1) == classes[i]->GetMethod(id));
+                }
+            }
+            ASSERT_EQUAL(cache.GetStats().misses, 4U);
+            ASSERT_EQUAL(cache.GetStats().hits, 4U);
+
+            // Пятый класс вытесняет самую старую запись
+            ASSERT(cache.Lookup(*classes[4], id, 1) == classes[4]->GetMethod(id));
+            ASSERT(cache.Lookup(*classes[0], id, 1) == classes[0]->GetMethod(id));
+            ASSERT_EQUAL(cache.GetStats().misses, 6U);
+            ASSERT(cache.Lookup(*classes[4], id, 1) == classes[4]->GetMethod(id));
+            ASSERT_EQUAL(cache.GetStats().hits, 5U);
+
+            MethodCache arity_cache;
+            ASSERT(arity_cache.Lookup(*classes[0], id, 2) == nullptr);
+            ASSERT(arity_cache.Lookup(*classes[0], id, 2) == nullptr);
+            ASSERT_EQUAL(arity_cache.GetStats().hits, 1U);
+        }
+
+        void TestInstanceShapes() {
+            Class cls{ "Point"s, {}, nullptr };
+            ClassInstance a{ cls };
+            ClassInstance b{ cls };
+            ClassInstance c{ cls };
+            ASSERT_EQUAL(&a.Fields().GetShape(), &cls.GetRootShape());
+
+            a.Fields()["x"s] = ObjectHolder::Own(Number{ 1 });
+            a.Fields()["y"s] = ObjectHolder::Own(Number{ 2 });
+            b.Fields()["x"s] = ObjectHolder::Own(Number{ 3 });
+            b.Fields()["y"s] = ObjectHolder::Own(Number{ 4 });
+            c.Fields()["y"s] = ObjectHolder::Own(Number{ 5 });
+            c.Fields()["x"s] = ObjectHolder::Own(Number{ 6 });
+
+            // Экземпляры, получившие поля в одном порядке, имеют общую форму
+            ASSERT_EQUAL(&a.Fields().GetShape(), &b.Fields().GetShape());
+            ASSERT(&a.Fields().GetShape() != &c.Fields().GetShape());
+            ASSERT_EQUAL(a.Fields().GetShape().GetFieldCount(), 2U);
+            ASSERT_EQUAL(a.Fields().GetShape().FindField("y"s), 1U);
+            ASSERT_EQUAL(c.Fields().GetShape().FindField("y"s), 0U);
+            ASSERT_EQUAL(a.Fields().GetShape().FindField("z"s), Shape::NO_FIELD);
+
+            // Повторное присваивание не меняет форму
+            const Shape* shape = &b.Fields().GetShape();
+            b.Fields()["x"s] = ObjectHolder::Own(Number{ 7 });
+            ASSERT_EQUAL(&b.Fields().GetShape(), shape);
+
+            // Значения полей лежат подряд в порядке смещений
+            ASSERT_EQUAL(&a.Fields().at("y"s), &a.Fields().at("x"s) + 1);
+            ASSERT_EQUAL(b.Fields().at("x"s).TryAs<Number>()->GetValue(), 7);
+            ASSERT_EQUAL(c.Fields().count("x"s), 1U);
+            ASSERT_EQUAL(c.Fields().count("z"s), 0U);
+            ASSERT(c.Fields().find("z"s) == c.Fields().end());
+            ASSERT_THROWS((void)c.Fields().at("z"s), out_of_range);
+
+            vector<string> names;
+            for (const auto& [name, value] : c.Fields()) {
+                names.push_back(name);
+                ASSERT(value.TryAs<Number>() != nullptr);
+            }
+            ASSERT_EQUAL(names, (vector<string>{ "y"s, "x"s }));
+        }
+
         void TestClassInstance() {
             vector<Method> methods;
 
@@ -535,10 +891,15 @@ namespace runtime {
         RUN_TEST(tr, runtime::TestNumber);
         RUN_TEST(tr, runtime::TestString);
         RUN_TEST(tr, runtime::TestBool);
+        RUN_TEST(tr, runtime::TestObjectKinds);
         RUN_TEST(tr, runtime::TestMethodInvocation);
         RUN_TEST(tr, runtime::TestIsTrue);
         RUN_TEST(tr, runtime::TestComparison);
         RUN_TEST(tr, runtime::TestClass);
+        RUN_TEST(tr, runtime::TestSymbols);
+        RUN_TEST(tr, runtime::TestMethodDispatch);
+        RUN_TEST(tr, runtime::TestMethodCache);
+        RUN_TEST(tr, runtime::TestInstanceShapes);
         RUN_TEST(tr, runtime::TestClassInstance);
     }
 
@@ -547,6 +908,10 @@ namespace runtime {
         RUN_TEST(tr, runtime::TestOwning);
         RUN_TEST(tr, runtime::TestMove);
         RUN_TEST(tr, runtime::TestNullptr);
+        RUN_TEST(tr, runtime::TestInlineValues);
+        RUN_TEST(tr, runtime::TestReferenceCounting);
+        RUN_TEST(tr, runtime::TestBorrowing);
+        RUN_TEST(tr, runtime::TestFrame);
     }
 
 }  // namespace runtime
\ No newline at end of file
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace pipeline {
+
+    // Кольцевая очередь без блокировок для одного производителя и одного потребителя.
+    // Производитель кладёт значения методом Push и по окончании вызывает Close, потребитель
+    // забирает их методом Pop. Потребитель, которому значения больше не нужны, вызывает Cancel,
+    // и производитель перестаёт ждать свободного места.
+    // Передача значений не использует блокировок. Поток, которому приходится ждать (очередь
+    // пуста либо заполнена), недолго проверяет её в цикле, а затем засыпает на условной
+    // переменной, чтобы не отнимать процессор у других стадий конвейера
+    template <typename T>
+    class SpscRing {
+    public:
+        // Создаёт очередь, вмещающую не меньше capacity значений
+        explicit SpscRing(size_t capacity)
+            : mask_(RoundUpToPowerOfTwo(capacity) - 1)
+            , slots_(std::make_unique<T[]>(mask_ + 1)) {
+        }
+
+        SpscRing(const SpscRing&) = delete;
+        SpscRing& operator=(const SpscRing&) = delete;
+
+        // Кладёт value в очередь, дожидаясь свободного места. Возвращает false, не положив
+        // значение, если потребитель отказался от значений
+        bool Push(T value) {
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            WaitUntil([&] {
+                return tail - head_.load(std::memory_order_acquire) <= mask_
+                    || cancelled_.load(std::memory_order_acquire);
+            });
+            if (tail - head_.load(std::memory_order_acquire) > mask_) {
+                return false;
+            }
+            slots_[tail & mask_] = std::move(value);
+            tail_.store(tail + 1, std::memory_order_release);
+            WakeWaiting();
+            return true;
+        }
+
+        // Сообщает, что значений больше не будет. Если задана error, Pop, забрав все значения,
+        // выбросит это исключение
+        void Close(std::exception_ptr error = nullptr) {
+            error_ = std::move(error);
+            closed_.store(true, std::memory_order_release);
+            WakeWaiting();
+        }
+
+        // Забирает очередное значение, дожидаясь его появления. Возвращает std::nullopt,
+        // если очередь закрыта и все значения забраны
+        std::optional<T> Pop() {
+            const size_t head = head_.load(std::memory_order_relaxed);
+            WaitUntil([&] {
+                return tail_.load(std::memory_order_acquire) != head || closed_.load(std::memory_order_acquire);
+            });
+            // Значения, положенные до Close, видны после того, как замечено закрытие
+            if (tail_.load(std::memory_order_acquire) == head) {
+                if (error_) {
+                    std::rethrow_exception(error_);
+                }
+                return std::nullopt;
+            }
+            std::optional<T> value(std::move(slots_[head & mask_]));
+            slots_[head & mask_] = T{};
+            head_.store(head + 1, std::memory_order_release);
+            WakeWaiting();
+            return value;
+        }
+
+        // Отказывается от значений: Push больше не ждёт и возвращает false
+        void Cancel() {
+            cancelled_.store(true, std::memory_order_release);
+            WakeWaiting();
+        }
+
+    private:
+        static size_t RoundUpToPowerOfTwo(size_t value) {
+            size_t result = 1;
+            while (result < value) {
+                result *= 2;
+            }
+            return result;
+        }
+
+        // Ждёт, пока ready не вернёт true. ready проверяет состояние очереди, которое меняет другой поток
+        template <typename Ready>
+        void WaitUntil(Ready ready) {
+            for (unsigned attempt = 0; attempt < SPIN_ATTEMPTS; ++attempt) {
+                if (ready()) {
+                    return;
+                }
+            }
+            std::unique_lock lock(mutex_);
+            sleeping_.fetch_add(1, std::memory_order_relaxed);
+            // Либо ready увидит изменение, либо WakeWaiting увидит спящий поток (парные барьеры)
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            wake_.wait(lock, ready);
+            sleeping_.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        // Будит поток, заснувший в WaitUntil, после изменения состояния очереди
+        void WakeWaiting() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (sleeping_.load(std::memory_order_relaxed) > 0) {
+                // Поток, увеличивший sleeping_, держит мьютекс, пока не начнёт ждать
+                { std::lock_guard lock(mutex_); }
+                wake_.notify_all();
+            }
+        }
+
+        // Количество проверок очереди, после которых ожидающий поток засыпает
+        static constexpr unsigned SPIN_ATTEMPTS = 64;
+        static constexpr size_t CACHE_LINE_SIZE = 64;
+
+        const size_t mask_;
+        const std::unique_ptr<T[]> slots_;
+        // Индексы растут неограниченно, ячейка определяется младшими битами.
+        // Индекс потребителя и индекс производителя лежат в разных строках кэша
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> head_{ 0 };
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail_{ 0 };
+        alignas(CACHE_LINE_SIZE) std::atomic<bool> closed_{ false };
+        std::atomic<bool> cancelled_{ false };
+        std::exception_ptr error_;
+        std::atomic<int> sleeping_{ 0 };
+        std::mutex mutex_;
+        std::condition_variable wake_;
+    };
+
+}  // namespace pipeline
@@ -1,6 +1,8 @@
 #include "statement.h"
 
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <sstream>
 
 using namespace std;
@@ -9,110 +11,169 @@ namespace ast {
 
     using runtime::Closure;
     using runtime::Context;
+    using runtime::Frame;
     using runtime::ObjectHolder;
 
-    namespace {
-        const string ADD_METHOD = "__add__"s;
-        const string INIT_METHOD = "__init__"s;
-
-    }  // namespace
-
+    void NodeDeleter::operator()(Statement* node) const noexcept {
+        if (!node->IsInArena()) {
+            delete node;
+        }
+    }
 
-    Assignment::Assignment(std::string var, std::unique_ptr<Statement> rv)
-        : var_(std::move(var))
+#define ACCEPT_VISITOR(type)                              \
+    void type::Accept(StatementVisitor& visitor) {        \
+        visitor.Visit(*this);                             \
+    }
+
+    ACCEPT_VISITOR(VariableValue)
+    ACCEPT_VISITOR(Assignment)
+    ACCEPT_VISITOR(FieldAssignment)
+    ACCEPT_VISITOR(Print)
+    ACCEPT_VISITOR(MethodCall)
+    ACCEPT_VISITOR(NewInstance)
+    ACCEPT_VISITOR(Stringify)
+    ACCEPT_VISITOR(Add)
+    ACCEPT_VISITOR(Sub)
+    ACCEPT_VISITOR(Mult)
+    ACCEPT_VISITOR(Div)
+    ACCEPT_VISITOR(Or)
+    ACCEPT_VISITOR(And)
+    ACCEPT_VISITOR(Not)
+    ACCEPT_VISITOR(Negate)
+    ACCEPT_VISITOR(Compound)
+    ACCEPT_VISITOR(MethodBody)
+    ACCEPT_VISITOR(Return)
+    ACCEPT_VISITOR(ClassDefinition)
+    ACCEPT_VISITOR(IfElse)
+    ACCEPT_VISITOR(Comparison)
+    ACCEPT_VISITOR(CompareAndBranch)
+
+#undef ACCEPT_VISITOR
+
+#define EVALUATE_OPERATION(type)                                     \
+    ObjectHolder type::Evaluate(Frame& frame, Context& context) {    \
+        return Apply(EvaluateLhs(frame, context), frame, context);   \
+    }
+
+    EVALUATE_OPERATION(Add)
+    EVALUATE_OPERATION(Sub)
+    EVALUATE_OPERATION(Mult)
+    EVALUATE_OPERATION(Div)
+    EVALUATE_OPERATION(Or)
+    EVALUATE_OPERATION(And)
+    EVALUATE_OPERATION(Comparison)
+
+#undef EVALUATE_OPERATION
+
+    Assignment::Assignment(runtime::Symbol var, StatementPtr rv)
+        : var_(var)
         , rv_(std::move(rv)) {
     }
 
-    ObjectHolder Assignment::Execute(Closure& closure, Context& context) {
-        return closure[var_] = rv_->Execute(closure, context);
+    ObjectHolder Assignment::Evaluate(Frame& frame, Context& context) {
+        return frame.Assign(var_, slot_, rv_->Execute(frame, context));
     }
 
-    VariableValue::VariableValue(const std::string& var_name)
+    VariableValue::VariableValue(runtime::Symbol var_name)
         : dotted_ids_{ var_name } {
     }
 
-    VariableValue::VariableValue(std::vector<std::string> dotted_ids)
-        : dotted_ids_(std::move(dotted_ids)) {
+    VariableValue::VariableValue(NodeVector<runtime::Symbol> dotted_ids)
+        : dotted_ids_(std::move(dotted_ids))
+        , field_caches_(dotted_ids_.empty() ? 0 : dotted_ids_.size() - 1) {
     }
 
-    ObjectHolder VariableValue::Execute(Closure& closure, Context&) {
-        auto* current_closure = &closure;
+    VariableValue::VariableValue(const std::vector<runtime::Symbol>& dotted_ids)
+        : VariableValue(NodeVector<runtime::Symbol>(dotted_ids.begin(), dotted_ids.end())) {
+    }
 
-        for (size_t i = 0; i + 1 < dotted_ids_.size(); ++i) {
-            if (current_closure->count(dotted_ids_[i]) > 0) {
-                auto p = current_closure->at(dotted_ids_[i]).TryAs<runtime::ClassInstance>();
-                if (p != nullptr) {
-                    current_closure = &p->Fields();
-                    continue;
-                }
-                throw std::runtime_error(dotted_ids_[i] + "can't access fields");
-            }
-            throw std::runtime_error(dotted_ids_[i] + " not found");
+    VariableValue::VariableValue(const std::vector<std::string>& dotted_ids)
+        : VariableValue(NodeVector<runtime::Symbol>(dotted_ids.begin(), dotted_ids.end())) {
+    }
+
+    ObjectHolder VariableValue::Evaluate(Frame& frame, Context&) {
+        const ObjectHolder* value = frame.Find(dotted_ids_.front(), slot_);
+        if (value == nullptr) {
+            throw std::runtime_error(dotted_ids_.front().GetName()
+                + (dotted_ids_.size() == 1 ? " not found in closure"s : " not found"s));
         }
 
-        if (current_closure->count(dotted_ids_.back()) > 0) {
-            return current_closure->at(dotted_ids_.back());
+        for (size_t i = 1; i < dotted_ids_.size(); ++i) {
+            auto p = value->TryAs<runtime::ClassInstance>();
+            if (p == nullptr) {
+                throw std::runtime_error(dotted_ids_[i - 1].GetName() + " can't access fields");
+            }
+            value = field_caches_[i - 1].Find(p->Fields(), dotted_ids_[i]);
+            if (value == nullptr) {
+                throw std::runtime_error(dotted_ids_[i].GetName()
+                    + (i + 1 == dotted_ids_.size() ? " not found in closure"s : " not found"s));
+            }
         }
 
-        throw std::runtime_error(dotted_ids_.back() + " not found in closure");
+        return *value;
     }
 
-    FieldAssignment::FieldAssignment(VariableValue object, std::string field_name, std::unique_ptr<Statement> rv)
+    FieldAssignment::FieldAssignment(VariableValue object, runtime::Symbol field_name, StatementPtr rv)
         : object_(std::move(object))
-        , field_name_(std::move(field_name))
+        , field_name_(field_name)
         , rv_(std::move(rv)) {
     }
 
-    ObjectHolder FieldAssignment::Execute(Closure& closure, Context& context) {
-        ObjectHolder holder = object_.Execute(closure, context);
+    ObjectHolder FieldAssignment::Evaluate(Frame& frame, Context& context) {
+        ObjectHolder holder = object_.Execute(frame, context);
         auto* p = holder.TryAs<runtime::ClassInstance>();
         if (p != nullptr) {
-            return p->Fields()[field_name_] = rv_->Execute(closure, context);
+            return field_cache_.Assign(p->Fields(), field_name_, rv_->Execute(frame, context));
         }
         return ObjectHolder::None();
     }
 
     NewInstance::NewInstance(const runtime::Class& class_type)
-        : class_(class_type) {
+        : class_(GetArena(), class_type) {
     }
 
-    NewInstance::NewInstance(const runtime::Class& class_type, std::vector<std::unique_ptr<Statement>> args)
-        : class_(class_type)
+    NewInstance::NewInstance(const runtime::Class& class_type, StatementList args)
+        : class_(GetArena(), class_type)
         , args_(std::move(args)) {
     }
 
-    ObjectHolder NewInstance::Execute(Closure& closure, Context& context) {
-        if (class_.HasMethod(INIT_METHOD, args_.size())) {
+    NewInstance::~NewInstance() {
+        class_.Destroy(GetArena());
+    }
+
+    ObjectHolder NewInstance::Evaluate(Frame& frame, Context& context) {
+        runtime::ClassInstance& instance = class_.Get();
+        if (auto* init = instance.GetClass().GetMethod(runtime::INIT_METHOD_ID, args_.size())) {
             std::vector<ObjectHolder> current_args;
             for (const auto& arg : args_) {
-                current_args.push_back(arg->Execute(closure, context));
+                current_args.push_back(arg->Execute(frame, context));
             }
-            class_.Call(INIT_METHOD, current_args, context);
+            instance.Call(*init, current_args, context);
         }
-        return ObjectHolder::Share(class_);
+        return ObjectHolder::Share(instance);
     }
 
-    Print::Print(unique_ptr<Statement> argument) {
+    Print::Print(StatementPtr argument) {
         args_.push_back(std::move(argument));
     }
 
-    Print::Print(vector<unique_ptr<Statement>> args)
+    Print::Print(StatementList args)
         : args_(std::move(args)) {
     }
 
-    unique_ptr<Print> Print::Variable(const std::string& name) {
-        return std::make_unique<Print>(std::make_unique<VariableValue>(name));
+    NodePtr<Print> Print::Variable(runtime::Symbol name) {
+        return MakeNode<Print>(MakeNode<VariableValue>(name));
     }
 
-    ObjectHolder Print::Execute(Closure& closure, Context& context) {
+    ObjectHolder Print::Evaluate(Frame& frame, Context& context) {
         bool first = true;
         ostream& out = context.GetOutputStream();
         for (const auto& arg : args_) {
             if (!first) out << ' ';
             first = false;
 
-            if (ObjectHolder holder = arg->Execute(closure, context)) {
-                holder->Print(out, context);
+            if (ObjectHolder holder = arg->Execute(frame, context)) {
+                holder.Print(out, context);
             }
             else {
                 out << "None";
@@ -122,35 +183,34 @@ namespace ast {
         return ObjectHolder::None();
     }
 
-    MethodCall::MethodCall(std::unique_ptr<Statement> object, std::string method,
-        std::vector<std::unique_ptr<Statement>> args)
+    MethodCall::MethodCall(StatementPtr object, runtime::MethodId method, StatementList args)
         : object_(std::move(object))
-        , method_(std::move(method))
+        , method_(method)
         , args_(std::move(args)) {
     }
 
-    ObjectHolder MethodCall::Execute(Closure& closure, Context& context) {
+    ObjectHolder MethodCall::Evaluate(Frame& frame, Context& context) {
         std::vector<ObjectHolder> current_args;
         for (auto& arg : args_) {
-            current_args.push_back(arg->Execute(closure, context));
+            current_args.push_back(arg->Execute(frame, context));
         }
 
-        ObjectHolder holder = object_->Execute(closure, context);
+        ObjectHolder holder = object_->Execute(frame, context);
         auto instance = holder.TryAs<runtime::ClassInstance>();
         if (instance != nullptr) {
-            return instance->Call(method_, current_args, context);
+            return instance->Call(method_cache_, method_, current_args, context);
         }
         return ObjectHolder::None();
     }
 
 
-    ObjectHolder Stringify::Execute(Closure& closure, Context& context) {
-        ObjectHolder holder = argument_->Execute(closure, context);
+    ObjectHolder Stringify::Evaluate(Frame& frame, Context& context) {
+        ObjectHolder holder = argument_->Execute(frame, context);
 
         std::string result = "None";
         if (holder) {
             std::ostringstream out;
-            holder->Print(out, context);
+            holder.Print(out, context);
             result = out.str();
         }
 
@@ -159,34 +219,63 @@ namespace ast {
 
 
 
-    ObjectHolder Add::Execute(Closure& closure, Context& context) {
-        ObjectHolder lhs = lhs_->Execute(closure, context);
-        ObjectHolder rhs = rhs_->Execute(closure, context);
+    BinaryOperation::~BinaryOperation() {
+        // Левые аргументы цепочки удаляются по одному: иначе деструкторы вызывали бы друг друга
+        // на всю длину цепочки
+        StatementPtr lhs = std::move(lhs_);
+        for (BinaryOperation* operation = lhs_operation_; operation != nullptr;) {
+            BinaryOperation* next = operation->lhs_operation_;
+            operation->lhs_operation_ = nullptr;
+            // Удаляет operation, уже лишённую левого аргумента
+            lhs = std::move(operation->lhs_);
+            operation = next;
+        }
+    }
+
+    ObjectHolder BinaryOperation::EvaluateChain(Frame& frame, Context& context) {
+        vector<BinaryOperation*> chain;
+        for (BinaryOperation* operation = this; operation != nullptr; operation = operation->lhs_operation_) {
+            chain.push_back(operation);
+        }
+        ObjectHolder value = chain.back()->lhs_->Execute(frame, context);
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            value = (*it)->Apply(value, frame, context);
+        }
+        return value;
+    }
+
+    ObjectHolder Add::Apply(const ObjectHolder& lhs, Frame& frame, Context& context) {
+        ObjectHolder rhs = rhs_->Execute(frame, context);
 
-        if (lhs.TryAs<runtime::Number>() != nullptr && rhs.TryAs<runtime::Number>() != nullptr) {
-            auto result = lhs.TryAs<runtime::Number>()->GetValue() + rhs.TryAs<runtime::Number>()->GetValue();
+        auto lhs_number = lhs.TryGetNumber();
+        auto rhs_number = rhs.TryGetNumber();
+        if (lhs_number && rhs_number) {
+            auto result = *lhs_number + *rhs_number;
             return ObjectHolder::Own(runtime::Number(result));
         }
 
-        if (lhs.TryAs<runtime::String>() != nullptr && rhs.TryAs<runtime::String>() != nullptr) {
-            auto result = lhs.TryAs<runtime::String>()->GetValue() + rhs.TryAs<runtime::String>()->GetValue();
+        auto lhs_string = lhs.TryAs<runtime::String>();
+        auto rhs_string = rhs.TryAs<runtime::String>();
+        if (lhs_string != nullptr && rhs_string != nullptr) {
+            auto result = lhs_string->GetValue() + rhs_string->GetValue();
             return ObjectHolder::Own(runtime::String(result));
         }
 
         if (auto pointer = lhs.TryAs<runtime::ClassInstance>()) {
-            return pointer->Call(ADD_METHOD, { rhs }, context);
+            return pointer->Call(method_cache_, runtime::ADD_METHOD_ID, { rhs }, context);
         }
 
         throw std::runtime_error("Error in add"s);
     }
 
 
-    ObjectHolder Sub::Execute(Closure& closure, Context& context) {
-        auto lhs = lhs_->Execute(closure, context);
-        auto rhs = rhs_->Execute(closure, context);
+    ObjectHolder Sub::Apply(const ObjectHolder& lhs, Frame& frame, Context& context) {
+        auto rhs = rhs_->Execute(frame, context);
 
-        if (lhs.TryAs<runtime::Number>() != nullptr && rhs.TryAs<runtime::Number>() != nullptr) {
-            auto result = lhs.TryAs<runtime::Number>()->GetValue() - rhs.TryAs<runtime::Number>()->GetValue();
+        auto lhs_number = lhs.TryGetNumber();
+        auto rhs_number = rhs.TryGetNumber();
+        if (lhs_number && rhs_number) {
+            auto result = *lhs_number - *rhs_number;
             return ObjectHolder::Own(runtime::Number( result ));
         }
         throw std::runtime_error("Error in sub"s);
@@ -194,12 +283,13 @@ namespace ast {
     }
 
 
-    ObjectHolder Mult::Execute(Closure& closure, Context& context) {
-        auto lhs = lhs_->Execute(closure, context);
-        auto rhs = rhs_->Execute(closure, context);
+    ObjectHolder Mult::Apply(const ObjectHolder& lhs, Frame& frame, Context& context) {
+        auto rhs = rhs_->Execute(frame, context);
 
-        if (lhs.TryAs<runtime::Number>() != nullptr && rhs.TryAs<runtime::Number>() != nullptr) {
-            auto result = lhs.TryAs<runtime::Number>()->GetValue() * rhs.TryAs<runtime::Number>()->GetValue();
+        auto lhs_number = lhs.TryGetNumber();
+        auto rhs_number = rhs.TryGetNumber();
+        if (lhs_number && rhs_number) {
+            auto result = *lhs_number * *rhs_number;
             return ObjectHolder::Own(runtime::Number( result ));  
         }
         
@@ -209,35 +299,58 @@ namespace ast {
 
 
 
-    ObjectHolder Div::Execute(Closure& closure, Context& context) {
-        auto lhs = lhs_->Execute(closure, context);
-        auto rhs = rhs_->Execute(closure, context);
+    ObjectHolder Div::Apply(const ObjectHolder& lhs, Frame& frame, Context& context) {
+        auto rhs = rhs_->Execute(frame, context);
 
-        if (lhs.TryAs<runtime::Number>() != nullptr && rhs.TryAs<runtime::Number>() != nullptr) {
-            auto result = lhs.TryAs<runtime::Number>()->GetValue() / rhs.TryAs<runtime::Number>()->GetValue();
+        auto lhs_number = lhs.TryGetNumber();
+        auto rhs_number = rhs.TryGetNumber();
+        if (lhs_number && rhs_number) {
+            if (*rhs_number == 0) {
+                throw std::runtime_error("Division by zero");
+            }
+            auto result = *lhs_number / *rhs_number;
             return ObjectHolder::Own(runtime::Number( result ));
         }
-        else if (lhs.TryAs<runtime::Number>() != nullptr && rhs.TryAs<runtime::Number>() != nullptr && rhs.TryAs<runtime::Number>()->GetValue() == 0) {
-            throw std::runtime_error("Division by zero");
-        }
 
         throw std::runtime_error("Error in division"s); 
     }
 
 
 
-    ObjectHolder Compound::Execute(Closure& closure, Context& context) {
+    void Compound::ReplaceStatements(size_t first, size_t count, StatementList statements) {
+        const auto position = statements_.begin() + static_cast<ptrdiff_t>(first);
+        if (statements.size() == count) {
+            std::move(statements.begin(), statements.end(), position);
+            return;
+        }
+        statements_.erase(position, position + static_cast<ptrdiff_t>(count));
+        statements_.insert(statements_.begin() + static_cast<ptrdiff_t>(first),
+            make_move_iterator(statements.begin()), make_move_iterator(statements.end()));
+    }
+
+    NodeArena* GetTreeArena(Statement& program) {
+        auto* compound = dynamic_cast<Compound*>(&program);
+        if (compound != nullptr && compound->GetOwnedArena() != nullptr) {
+            return compound->GetOwnedArena();
+        }
+        return program.GetArena();
+    }
+
+    ObjectHolder Compound::Evaluate(Frame& frame, Context& context) {
         for (auto& state : statements_) {
-            state->Execute(closure, context);
+            ObjectHolder result = state->Execute(frame, context);
+            if (frame.IsReturning()) {
+                return result;
+            }
         }
         return ObjectHolder::None();
     }
 
-    ObjectHolder Or::Execute(Closure& closure, Context& context) {
+    ObjectHolder Or::Apply(const ObjectHolder& lhs, Frame& frame, Context& context) {
 
         if (
-            runtime::IsTrue(lhs_->Execute(closure, context))
-            || runtime::IsTrue(rhs_->Execute(closure, context))
+            runtime::IsTrue(lhs)
+            || runtime::IsTrue(rhs_->Execute(frame, context))
             )
         {
             return ObjectHolder::Own(runtime::Bool(true));
@@ -246,10 +359,10 @@ namespace ast {
     }
 
 
-    ObjectHolder And::Execute(Closure& closure, Context& context) {
+    ObjectHolder And::Apply(const ObjectHolder& lhs, Frame& frame, Context& context) {
         if (
-            runtime::IsTrue(lhs_->Execute(closure, context))
-            && runtime::IsTrue(rhs_->Execute(closure, context))
+            runtime::IsTrue(lhs)
+            && runtime::IsTrue(rhs_->Execute(frame, context))
             )
         {
             return ObjectHolder::Own(runtime::Bool(true));
@@ -257,41 +370,79 @@ namespace ast {
         return ObjectHolder::Own(runtime::Bool(false));
     }
 
-    ObjectHolder Not::Execute(Closure& closure, Context& context) {
-        auto result = IsTrue(argument_->Execute(closure, context));
+    ObjectHolder Not::Evaluate(Frame& frame, Context& context) {
+        auto result = IsTrue(argument_->Execute(frame, context));
         return ObjectHolder::Own(runtime::Bool(!result));
     }
 
+    ObjectHolder Negate::Evaluate(Frame& frame, Context& context) {
+        ObjectHolder argument = argument_->Execute(frame, context);
+        if (auto number = argument.TryGetNumber()) {
+            return ObjectHolder::Own(runtime::Number(-*number));
+        }
+        throw std::runtime_error("Error in negation"s);
+    }
 
 
-    Comparison::Comparison(Comparator cmp, unique_ptr<Statement> lhs, unique_ptr<Statement> rhs)
+
+    Comparison::Comparison(Comparator cmp, StatementPtr lhs, StatementPtr rhs)
         : BinaryOperation(std::move(lhs), std::move(rhs))
         , comparator_(std::move(cmp)) {
+        if (const auto* fn = comparator_.target<runtime::CachedComparator::Comparator>()) {
+            cached_method_ = runtime::CachedComparator::Find(*fn);
+        }
+    }
+
+    ObjectHolder Comparison::Apply(const ObjectHolder& lhs, Frame& frame, Context& context) {
+        return ObjectHolder::Own(runtime::Bool(CompareWith(lhs, frame, context)));
+    }
+
+    bool Comparison::Compare(Frame& frame, Context& context) {
+        return CompareWith(EvaluateLhs(frame, context), frame, context);
+    }
+
+    bool Comparison::CompareWith(const ObjectHolder& lhs, Frame& frame, Context& context) {
+        ObjectHolder rhs = rhs_->Execute(frame, context);
+        if (cached_method_ != nullptr) {
+            return (cached_comparator_.*cached_method_)(lhs, rhs, context);
+        }
+        return comparator_(lhs, rhs, context);
+    }
+
+    CompareAndBranch::CompareAndBranch(NodePtr<Comparison> condition, StatementPtr if_body,
+        StatementPtr else_body)
+        : condition_(std::move(condition))
+        , if_body_(std::move(if_body))
+        , else_body_(std::move(else_body)) {
     }
 
-    ObjectHolder Comparison::Execute(Closure& closure, Context& context) {
-         return ObjectHolder::Own(runtime::Bool(
-             comparator_(lhs_->Execute(closure, context), rhs_->Execute(closure, context), context)
-         ));  
+    ObjectHolder CompareAndBranch::Evaluate(Frame& frame, Context& context) {
+        if (condition_->Compare(frame, context)) {
+            return if_body_->Execute(frame, context);
+        }
+        if (else_body_) {
+            return else_body_->Execute(frame, context);
+        }
+        return ObjectHolder::None();
     }
 
 
 
-    ObjectHolder Return::Execute(Closure& closure, Context& context) {
-        throw ReturnException(statement_->Execute(closure, context));
+    ObjectHolder Return::Evaluate(Frame& frame, Context& context) {
+        ObjectHolder result = statement_->Execute(frame, context);
+        frame.SetReturning();
+        return result;
     }
 
 
-    MethodBody::MethodBody(std::unique_ptr<Statement>&& body)
+    MethodBody::MethodBody(StatementPtr&& body)
         : body_(std::move(body)) {
     }
 
-    ObjectHolder MethodBody::Execute(Closure& closure, Context& context) {
-        try {
-            body_->Execute(closure, context);
-        }
-        catch (ReturnException& ret) {
-            return ret.GetResult();
+    ObjectHolder MethodBody::Evaluate(Frame& frame, Context& context) {
+        ObjectHolder result = body_->Execute(frame, context);
+        if (frame.TakeReturning()) {
+            return result;
         }
         return ObjectHolder::None();
     }
@@ -299,33 +450,264 @@ namespace ast {
  
 
     ClassDefinition::ClassDefinition(ObjectHolder cls)
-        : cls_(std::move(cls))
-        , class_name_(cls_.TryAs<runtime::Class>()->GetName())
+        : cls_(GetArena(), std::move(cls))
+        , class_name_(GetClass().TryAs<runtime::Class>()->GetName())
     {
     }
 
-    ObjectHolder ClassDefinition::Execute(Closure& closure, Context&) {
-        closure[class_name_] = cls_;
+    ClassDefinition::~ClassDefinition() {
+        cls_.Destroy(GetArena());
+    }
+
+    ClassDefinition::DeclaredClass::~DeclaredClass() {
+        if (auto* declared = cls.TryAs<runtime::Class>()) {
+            for (runtime::Method& method : declared->GetOwnMethods()) {
+                auto* body = dynamic_cast<Statement*>(method.body.get());
+                if (body != nullptr && body->IsInArena()) {
+                    (void)method.body.release();
+                }
+            }
+        }
+    }
+
+    ObjectHolder ClassDefinition::Evaluate(Frame& frame, Context&) {
+        frame.Assign(class_name_, Frame::NO_SLOT, GetClass());
         return ObjectHolder::None();
     }
 
 
 
-    IfElse::IfElse(std::unique_ptr<Statement> condition, std::unique_ptr<Statement> if_body,
-        std::unique_ptr<Statement> else_body)
+    IfElse::IfElse(StatementPtr condition, StatementPtr if_body,
+        StatementPtr else_body)
         : condition_(std::move(condition))
         , if_body_(std::move(if_body))
         , else_body_(std::move(else_body)) {
     }
 
-    ObjectHolder IfElse::Execute(Closure& closure, Context& context) {
-        if (runtime::IsTrue(condition_->Execute(closure, context))) {
-            return if_body_->Execute(closure, context);
+    ObjectHolder IfElse::Evaluate(Frame& frame, Context& context) {
+        if (runtime::IsTrue(condition_->Execute(frame, context))) {
+            return if_body_->Execute(frame, context);
         }
         else if (else_body_) {
-            return else_body_->Execute(closure, context);
+            return else_body_->Execute(frame, context);
         }
         return ObjectHolder::None();
     }
 
+    namespace {
+        void RewriteAll(StatementList& statements, const ChildRewriter& rewrite) {
+            for (auto& statement : statements) {
+                rewrite(statement);
+            }
+        }
+    }  // namespace
+
+    void Assignment::RewriteChildren(const ChildRewriter& rewrite) {
+        rewrite(rv_);
+    }
+
+    void FieldAssignment::RewriteChildren(const ChildRewriter& rewrite) {
+        rewrite(rv_);
+    }
+
+    void Print::RewriteChildren(const ChildRewriter& rewrite) {
+        RewriteAll(args_, rewrite);
+    }
+
+    void MethodCall::RewriteChildren(const ChildRewriter& rewrite) {
+        rewrite(object_);
+        RewriteAll(args_, rewrite);
+    }
+
+    void NewInstance::RewriteChildren(const ChildRewriter& rewrite) {
+        RewriteAll(args_, rewrite);
+    }
+
+    void UnaryOperation::RewriteChildren(const ChildRewriter& rewrite) {
+        rewrite(argument_);
+    }
+
+    void BinaryOperation::RewriteChildren(const ChildRewriter& rewrite) {
+        RewriteLhs(rewrite);
+        RewriteRhs(rewrite);
+    }
+
+    void BinaryOperation::RewriteLhs(const ChildRewriter& rewrite) {
+        rewrite(lhs_);
+        lhs_operation_ = dynamic_cast<BinaryOperation*>(lhs_.get());
+    }
+
+    void BinaryOperation::RewriteRhs(const ChildRewriter& rewrite) {
+        rewrite(rhs_);
+    }
+
+    void Compound::RewriteChildren(const ChildRewriter& rewrite) {
+        RewriteAll(statements_, rewrite);
+    }
+
+    void MethodBody::RewriteChildren(const ChildRewriter& rewrite) {
+        rewrite(body_);
+    }
+
+    void Return::RewriteChildren(const ChildRewriter& rewrite) {
+        rewrite(statement_);
+    }
+
+    void IfElse::RewriteChildren(const ChildRewriter& rewrite) {
+        rewrite(condition_);
+        rewrite(if_body_);
+        if (else_body_) {
+            rewrite(else_body_);
+        }
+    }
+
+    void CompareAndBranch::RewriteChildren(const ChildRewriter& rewrite) {
+        condition_->RewriteChildren(rewrite);
+        rewrite(if_body_);
+        if (else_body_) {
+            rewrite(else_body_);
+        }
+    }
+
+    bool ChainTraversal::VisitLhs(BinaryOperation& node, StatementVisitor& visitor) {
+        if (lhs_visited_) {
+            lhs_visited_ = false;
+            return true;
+        }
+        if (node.GetLhsOperation() == nullptr) {
+            node.GetLhs().Accept(visitor);
+            return true;
+        }
+        vector<BinaryOperation*> chain;
+        for (BinaryOperation* operation = &node; operation != nullptr; operation = operation->GetLhsOperation()) {
+            chain.push_back(operation);
+        }
+        chain.back()->GetLhs().Accept(visitor);
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            lhs_visited_ = true;
+            (*it)->Accept(visitor);
+        }
+        return false;
+    }
+
+    void RecursiveStatementVisitor::VisitAll(const StatementList& statements) {
+        for (const auto& statement : statements) {
+            statement->Accept(*this);
+        }
+    }
+
+    void RecursiveStatementVisitor::Visit(NumericConst&) {
+    }
+
+    void RecursiveStatementVisitor::Visit(StringConst&) {
+    }
+
+    void RecursiveStatementVisitor::Visit(BoolConst&) {
+    }
+
+    void RecursiveStatementVisitor::Visit(VariableValue&) {
+    }
+
+    void RecursiveStatementVisitor::Visit(Assignment& node) {
+        node.GetRightValue().Accept(*this);
+    }
+
+    void RecursiveStatementVisitor::Visit(FieldAssignment& node) {
+        node.GetObject().Accept(*this);
+        node.GetRightValue().Accept(*this);
+    }
+
+    void RecursiveStatementVisitor::Visit(None&) {
+    }
+
+    void RecursiveStatementVisitor::Visit(Print& node) {
+        VisitAll(node.GetArguments());
+    }
+
+    void RecursiveStatementVisitor::Visit(MethodCall& node) {
+        VisitAll(node.GetArguments());
+        node.GetObject().Accept(*this);
+    }
+
+    void RecursiveStatementVisitor::Visit(NewInstance& node) {
+        VisitAll(node.GetArguments());
+    }
+
+    void RecursiveStatementVisitor::Visit(Stringify& node) {
+        node.GetArgument().Accept(*this);
+    }
+
+    void RecursiveStatementVisitor::Visit(Add& node) {
+        VisitOperation(node);
+    }
+
+    void RecursiveStatementVisitor::Visit(Sub& node) {
+        VisitOperation(node);
+    }
+
+    void RecursiveStatementVisitor::Visit(Mult& node) {
+        VisitOperation(node);
+    }
+
+    void RecursiveStatementVisitor::Visit(Div& node) {
+        VisitOperation(node);
+    }
+
+    void RecursiveStatementVisitor::Visit(Or& node) {
+        VisitOperation(node);
+    }
+
+    void RecursiveStatementVisitor::Visit(And& node) {
+        VisitOperation(node);
+    }
+
+    void RecursiveStatementVisitor::VisitOperation(BinaryOperation& node) {
+        if (chain_.VisitLhs(node, *this)) {
+            node.GetRhs().Accept(*this);
+        }
+    }
+
+    void RecursiveStatementVisitor::Visit(Not& node) {
+        node.GetArgument().Accept(*this);
+    }
+
+    void RecursiveStatementVisitor::Visit(Negate& node) {
+        node.GetArgument().Accept(*this);
+    }
+
+    void RecursiveStatementVisitor::Visit(Compound& node) {
+        VisitAll(node.GetStatements());
+    }
+
+    void RecursiveStatementVisitor::Visit(MethodBody& node) {
+        node.GetBody().Accept(*this);
+    }
+
+    void RecursiveStatementVisitor::Visit(Return& node) {
+        node.GetStatement().Accept(*this);
+    }
+
+    void RecursiveStatementVisitor::Visit(ClassDefinition&) {
+    }
+
+    void RecursiveStatementVisitor::Visit(IfElse& node) {
+        node.GetCondition().Accept(*this);
+        node.GetIfBody().Accept(*this);
+        if (auto* else_body = node.GetElseBody()) {
+            else_body->Accept(*this);
+        }
+    }
+
+    void RecursiveStatementVisitor::Visit(Comparison& node) {
+        VisitOperation(node);
+    }
+
+    void RecursiveStatementVisitor::Visit(CompareAndBranch& node) {
+        node.GetCondition().Accept(*this);
+        node.GetIfBody().Accept(*this);
+        if (auto* else_body = node.GetElseBody()) {
+            else_body->Accept(*this);
+        }
+    }
+
 }  // namespace ast
\ No newline at end of file
@@ -1,12 +1,136 @@
 #pragma once
 
+#include "node_arena.h"
 #include "runtime.h"
 
 #include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace ast {
 
-    using Statement = runtime::Executable;
+    class StatementVisitor;
+    class Statement;
+
+    // Удаляет узел дерева разбора, которым владеет указатель NodePtr. Узел из кучи удаляется
+    // оператором delete. Узел арены (см. MakeNode) не удаляется по одному: его значения удаляет
+    // арена (см. NodeValue), а память освобождается вместе с ней
+    struct NodeDeleter {
+        NodeDeleter() noexcept = default;
+
+        // Узел, созданный std::make_unique, размещён в куче
+        template <typename T>
+        NodeDeleter(const std::default_delete<T>& /*deleter*/) noexcept {  // NOLINT(google-explicit-constructor)
+        }
+
+        void operator()(Statement* node) const noexcept;
+    };
+
+    // Указатель, владеющий узлом дерева разбора
+    template <typename T>
+    using NodePtr = std::unique_ptr<T, NodeDeleter>;
+    using StatementPtr = NodePtr<Statement>;
+
+    // Создаёт узел типа T в текущей арене потока (см. NodeArena::Scope) либо в куче
+    template <typename T, typename... Args>
+    [[nodiscard]] NodePtr<T> MakeNode(Args&&... args);
+
+    // Функция, получающая ссылку на дочернюю инструкцию узла и, возможно, заменяющая её
+    using ChildRewriter = std::function<void(StatementPtr&)>;
+
+    // Инструкция Mython. В отличие от произвольного runtime::Executable, узлы дерева разбора
+    // позволяют обойти себя посетителем StatementVisitor (используется компилятором байт-кода)
+    // и выполняются в кадре runtime::Frame, где переменные методов хранятся в слотах.
+    // Узлы, созданные MakeNode, пока для потока текущая арена программы (см. NodeArena::Scope),
+    // размещаются в ней. Узел арены, удалённый по одному (например, заменённый оптимизатором),
+    // не освобождает свою память: она освобождается вместе с ареной
+    class Statement : public runtime::Executable {
+    public:
+        Statement() noexcept
+            : arena_(NodeArena::GetCurrent()) {
+        }
+
+        // Копия узла размещается там же, где создаётся
+        Statement(const Statement& /*other*/) noexcept
+            : Statement() {
+        }
+
+        Statement& operator=(const Statement& /*other*/) noexcept {
+            return *this;
+        }
+
+        // Возвращает арену, текущую при создании узла (nullptr - куча). В ней размещены списки
+        // и значения узла, а также сам узел, если он создан MakeNode
+        [[nodiscard]] NodeArena* GetArena() const {
+            return arena_;
+        }
+
+        // Возвращает true, если память узла выделена в арене
+        [[nodiscard]] bool IsInArena() const {
+            return in_arena_;
+        }
+
+        // Выполняет инструкцию в кадре верхнего уровня, хранящем переменные в closure
+        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) final {
+            runtime::Frame frame(closure);
+            return Evaluate(frame, context);
+        }
+
+        runtime::ObjectHolder Execute(runtime::Frame& frame, runtime::Context& context) final {
+            return Evaluate(frame, context);
+        }
+
+        // Вычисляет инструкцию в кадре frame
+        virtual runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) = 0;
+
+        // Вызывает у visitor метод Visit, соответствующий конкретному типу инструкции
+        virtual void Accept(StatementVisitor& visitor) = 0;
+
+        // Передаёт rewrite ссылку на каждую дочернюю инструкцию узла, позволяя заменить её.
+        // Используется проходами оптимизации дерева разбора
+        virtual void RewriteChildren(const ChildRewriter& rewrite) {
+            (void)rewrite;
+        }
+
+    private:
+        template <typename T, typename... Args>
+        friend NodePtr<T> MakeNode(Args&&... args);
+
+        NodeArena* arena_;
+        bool in_arena_ = false;
+    };
+
+    template <typename T, typename... Args>
+    NodePtr<T> MakeNode(Args&&... args) {
+        static_assert(std::is_base_of_v<Statement, T>);
+        NodeArena* arena = NodeArena::GetCurrent();
+        if (arena == nullptr) {
+            return NodePtr<T>(new T(std::forward<Args>(args)...));
+        }
+        // Если конструктор выбросит исключение, память останется в арене до её удаления
+        T* node = new (arena->Allocate(sizeof(T))) T(std::forward<Args>(args)...);
+        node->in_arena_ = true;
+        return NodePtr<T>(node);
+    }
+
+    // Список дочерних инструкций узла
+    class StatementList : public NodeVector<StatementPtr> {
+        using Base = NodeVector<StatementPtr>;
+
+    public:
+        using Base::Base;
+
+        StatementList() = default;
+
+        // Переносит инструкции из statements. Pointer - StatementPtr либо std::unique_ptr на узел из кучи
+        template <typename Pointer>
+        StatementList(std::vector<Pointer> statements)  // NOLINT(google-explicit-constructor)
+            : Base(std::make_move_iterator(statements.begin()), std::make_move_iterator(statements.end())) {
+        }
+    };
 
     // Выражение, возвращающее значение типа T,
     // используется как основа для создания констант
@@ -14,16 +138,33 @@ namespace ast {
     class ValueStatement : public Statement {
     public:
         explicit ValueStatement(T v)
-            : value_(std::move(v)) {
+            : value_(GetArena(), std::move(v)) {
         }
 
-        runtime::ObjectHolder Execute(runtime::Closure& /*closure*/,
+        ValueStatement(const ValueStatement&) = delete;
+        ValueStatement& operator=(const ValueStatement&) = delete;
+
+        ~ValueStatement() override {
+            value_.Destroy(GetArena());
+        }
+
+        runtime::ObjectHolder Evaluate(runtime::Frame& /*frame*/,
             runtime::Context& /*context*/) override {
-            return runtime::ObjectHolder::Share(value_);
+            return runtime::ObjectHolder::Share(value_.Get());
+        }
+
+        void Accept(StatementVisitor& visitor) override;
+
+        [[nodiscard]] T& GetValue() {
+            return value_.Get();
         }
 
     private:
-        T value_;
+        // Значение владеет памятью вне арены (строка) и удаляется вместе с ней
+        static constexpr bool OWNS_MEMORY =
+            !std::is_trivially_destructible_v<std::decay_t<decltype(std::declval<const T&>().GetValue())>>;
+
+        NodeValue<T, OWNS_MEMORY> value_;
     };
 
     using NumericConst = ValueStatement<runtime::Number>;
@@ -37,79 +178,163 @@ namespace ast {
     */
     class VariableValue : public Statement {
     public:
-        explicit VariableValue(const std::string& var_name);
-        explicit VariableValue(std::vector<std::string> dotted_ids);
+        explicit VariableValue(runtime::Symbol var_name);
+        explicit VariableValue(NodeVector<runtime::Symbol> dotted_ids);
+        explicit VariableValue(const std::vector<runtime::Symbol>& dotted_ids);
+        explicit VariableValue(const std::vector<std::string>& dotted_ids);
 
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+
+        [[nodiscard]] const NodeVector<runtime::Symbol>& GetDottedIds() const {
+            return dotted_ids_;
+        }
+
+        // Слот кадра, в котором хранится переменная dotted_ids_[0], либо runtime::Frame::NO_SLOT
+        [[nodiscard]] size_t GetSlot() const {
+            return slot_;
+        }
+
+        void SetSlot(size_t slot) {
+            slot_ = slot;
+        }
 
     private:
-        std::vector<std::string> dotted_ids_;
+        NodeVector<runtime::Symbol> dotted_ids_;
+        size_t slot_ = runtime::Frame::NO_SLOT;
+        // Кэши смещений полей dotted_ids_[1], dotted_ids_[2], ...
+        NodeVector<runtime::FieldCache> field_caches_;
     };
 
     // Присваивает переменной, имя которой задано в параметре var, значение выражения rv
     class Assignment : public Statement {
     public:
-        Assignment(std::string var, std::unique_ptr<Statement> rv);
+        Assignment(runtime::Symbol var, StatementPtr rv);
 
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+        void RewriteChildren(const ChildRewriter& rewrite) override;
+
+        [[nodiscard]] runtime::Symbol GetVariable() const {
+            return var_;
+        }
+
+        [[nodiscard]] Statement& GetRightValue() const {
+            return *rv_;
+        }
+
+        // Слот кадра, в котором хранится переменная var, либо runtime::Frame::NO_SLOT
+        [[nodiscard]] size_t GetSlot() const {
+            return slot_;
+        }
+
+        void SetSlot(size_t slot) {
+            slot_ = slot;
+        }
 
     private:
-        std::string var_;
-        std::unique_ptr<Statement> rv_;
+        runtime::Symbol var_;
+        StatementPtr rv_;
+        size_t slot_ = runtime::Frame::NO_SLOT;
     };
 
     // Присваивает полю object.field_name значение выражения rv
     class FieldAssignment : public Statement {
     public:
-        FieldAssignment(VariableValue object, std::string field_name, std::unique_ptr<Statement> rv);
+        FieldAssignment(VariableValue object, runtime::Symbol field_name, StatementPtr rv);
+
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+        void RewriteChildren(const ChildRewriter& rewrite) override;
+
+        [[nodiscard]] VariableValue& GetObject() {
+            return object_;
+        }
 
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        [[nodiscard]] runtime::Symbol GetFieldName() const {
+            return field_name_;
+        }
+
+        [[nodiscard]] Statement& GetRightValue() const {
+            return *rv_;
+        }
+
+        [[nodiscard]] const runtime::FieldCache& GetFieldCache() const {
+            return field_cache_;
+        }
 
     private:
         VariableValue object_;
-        std::string field_name_;
-        std::unique_ptr<Statement> rv_;
+        runtime::Symbol field_name_;
+        StatementPtr rv_;
+        runtime::FieldCache field_cache_;
     };
 
     // Значение None
     class None : public Statement {
     public:
-        runtime::ObjectHolder Execute([[maybe_unused]] runtime::Closure& closure,
+        runtime::ObjectHolder Evaluate([[maybe_unused]] runtime::Frame& frame,
             [[maybe_unused]] runtime::Context& context) override {
             return {};
         }
+
+        void Accept(StatementVisitor& visitor) override;
     };
 
     // Команда print
     class Print : public Statement {
     public:
         // Инициализирует команду print для вывода значения выражения argument
-        explicit Print(std::unique_ptr<Statement> argument);
+        explicit Print(StatementPtr argument);
         // Инициализирует команду print для вывода списка значений args
-        explicit Print(std::vector<std::unique_ptr<Statement>> args);
+        explicit Print(StatementList args);
 
         // Инициализирует команду print для вывода значения переменной name
-        static std::unique_ptr<Print> Variable(const std::string& name);
+        static NodePtr<Print> Variable(runtime::Symbol name);
 
         // Во время выполнения команды print вывод должен осуществляться в поток, возвращаемый из
         // context.GetOutputStream()
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+        void RewriteChildren(const ChildRewriter& rewrite) override;
+
+        [[nodiscard]] const StatementList& GetArguments() const {
+            return args_;
+        }
     private:
-        std::vector<std::unique_ptr<Statement>> args_;
+        StatementList args_;
     };
 
     // Вызывает метод object.method со списком параметров args
     class MethodCall : public Statement {
     public:
-        MethodCall(std::unique_ptr<Statement> object, std::string method,
-            std::vector<std::unique_ptr<Statement>> args);
+        MethodCall(StatementPtr object, runtime::MethodId method, StatementList args);
+
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+        void RewriteChildren(const ChildRewriter& rewrite) override;
+
+        [[nodiscard]] Statement& GetObject() const {
+            return *object_;
+        }
+
+        [[nodiscard]] runtime::MethodId GetMethod() const {
+            return method_;
+        }
+
+        [[nodiscard]] const StatementList& GetArguments() const {
+            return args_;
+        }
 
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        [[nodiscard]] const runtime::MethodCache& GetMethodCache() const {
+            return method_cache_;
+        }
 
     private:
-        std::unique_ptr<Statement> object_;
-        std::string method_;
-        std::vector<std::unique_ptr<Statement>> args_;
+        StatementPtr object_;
+        runtime::MethodId method_;
+        StatementList args_;
+        runtime::MethodCache method_cache_;
     };
 
     /*
@@ -128,48 +353,171 @@ namespace ast {
     class NewInstance : public Statement {
     public:
         explicit NewInstance(const runtime::Class& class_);
-        NewInstance(const runtime::Class& class_, std::vector<std::unique_ptr<Statement>> args);
+        NewInstance(const runtime::Class& class_, StatementList args);
+        ~NewInstance() override;
+
+        NewInstance(const NewInstance&) = delete;
+        NewInstance& operator=(const NewInstance&) = delete;
+
         // Возвращает объект, содержащий значение типа ClassInstance
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+        void RewriteChildren(const ChildRewriter& rewrite) override;
+
+        // Возвращает экземпляр, который создаётся (и возвращается) этой инструкцией
+        [[nodiscard]] runtime::ClassInstance& GetInstance() {
+            return class_.Get();
+        }
+
+        [[nodiscard]] const StatementList& GetArguments() const {
+            return args_;
+        }
 
     private:
-        runtime::ClassInstance class_;
-        std::vector<std::unique_ptr<Statement>> args_;
+        NodeValue<runtime::ClassInstance> class_;
+        StatementList args_;
 
     };
 
     // Базовый класс для унарных операций
     class UnaryOperation : public Statement {
     public:
-        explicit UnaryOperation(std::unique_ptr<Statement> argument)
+        explicit UnaryOperation(StatementPtr argument)
             : argument_(std::move(argument))
         {
             // Реализуйте метод самостоятельно
         }
+
+        [[nodiscard]] Statement& GetArgument() const {
+            return *argument_;
+        }
+
+        // Забирает аргумент, оставляя операцию без него. Используется, когда операция заменяется
+        // своим аргументом
+        [[nodiscard]] StatementPtr TakeArgument() {
+            return std::move(argument_);
+        }
+
+        void RewriteChildren(const ChildRewriter& rewrite) override;
+
     protected:
-        std::unique_ptr<Statement> argument_;
+        StatementPtr argument_;
     };
 
     // Операция str, возвращающая строковое значение своего аргумента
     class Stringify : public UnaryOperation {
     public:
         using UnaryOperation::UnaryOperation;
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
     };
 
-    // Родительский класс Бинарная операция с аргументами lhs и rhs
+    // Родительский класс Бинарная операция с аргументами lhs и rhs.
+    // Разбор строит из выражения 1 + 2 + ... + n цепочку операций, каждая из которых - левый аргумент
+    // следующей. Длина цепочки не ограничена (см. MAX_NESTING_DEPTH), поэтому вычисление, обход
+    // и удаление цепочки спускаются по левым аргументам циклом, а не рекурсией
     class BinaryOperation : public Statement {
     public:
-        BinaryOperation(std::unique_ptr<Statement> lhs, std::unique_ptr<Statement> rhs)
+        BinaryOperation(StatementPtr lhs, StatementPtr rhs)
             : lhs_(std::move(lhs))
             , rhs_(std::move(rhs))
+            , lhs_operation_(dynamic_cast<BinaryOperation*>(lhs_.get()))
         {
-            // Реализуйте метод самостоятельно
         }
 
+        ~BinaryOperation() override;
+
+        [[nodiscard]] Statement& GetLhs() const {
+            return *lhs_;
+        }
+
+        [[nodiscard]] Statement& GetRhs() const {
+            return *rhs_;
+        }
+
+        // Возвращает левый аргумент, если он тоже бинарная операция, иначе nullptr
+        [[nodiscard]] BinaryOperation* GetLhsOperation() const {
+            return lhs_operation_;
+        }
+
+        // Забирают аргумент, оставляя операцию без него. Используются, когда операция заменяется
+        // одним из своих аргументов
+        [[nodiscard]] StatementPtr TakeLhs() {
+            lhs_operation_ = nullptr;
+            return std::move(lhs_);
+        }
+
+        [[nodiscard]] StatementPtr TakeRhs() {
+            return std::move(rhs_);
+        }
+
+        void RewriteChildren(const ChildRewriter& rewrite) override;
+
+        // Передают rewrite только левый либо только правый аргумент
+        void RewriteLhs(const ChildRewriter& rewrite);
+        void RewriteRhs(const ChildRewriter& rewrite);
+
     protected:
-        std::unique_ptr<Statement> lhs_;
-        std::unique_ptr<Statement> rhs_;
+        // Вычисляет левый аргумент. Наследники вычисляют операцию как Apply(EvaluateLhs(...), ...).
+        // Встраивается в Evaluate наследников, поэтому у каждого вида операции своё место вызова
+        // Execute аргумента, и процессор предсказывает их по отдельности
+        runtime::ObjectHolder EvaluateLhs(runtime::Frame& frame, runtime::Context& context) {
+            if (lhs_operation_ == nullptr) {
+                return lhs_->Execute(frame, context);
+            }
+            // Цепочка обычной длины вычисляется рекурсией: это быстрее, чем спуск по ней с запоминанием
+            // операций. Операции глубже MAX_CHAIN_RECURSION вычисляются циклом
+            if (chain_recursion_depth_ >= MAX_CHAIN_RECURSION) {
+                return lhs_operation_->EvaluateChain(frame, context);
+            }
+            ChainRecursion recursion;
+            return lhs_->Execute(frame, context);
+        }
+
+        // Вычисляет операцию по уже вычисленному значению левого аргумента lhs
+        virtual runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, runtime::Frame& frame,
+            runtime::Context& context) = 0;
+
+        StatementPtr lhs_;
+        StatementPtr rhs_;
+
+    private:
+        static constexpr std::size_t MAX_CHAIN_RECURSION = 64;
+
+        // Количество левых аргументов-операций, которые вычисляются рекурсивно в этом потоке
+        inline static thread_local std::size_t chain_recursion_depth_ = 0;
+
+        struct ChainRecursion {
+            ChainRecursion() {
+                ++chain_recursion_depth_;
+            }
+
+            ChainRecursion(const ChainRecursion&) = delete;
+            ChainRecursion& operator=(const ChainRecursion&) = delete;
+
+            ~ChainRecursion() {
+                --chain_recursion_depth_;
+            }
+        };
+
+        // Вычисляет цепочку, вершина которой - эта операция, циклом
+        runtime::ObjectHolder EvaluateChain(runtime::Frame& frame, runtime::Context& context);
+
+        BinaryOperation* lhs_operation_;
+    };
+
+    // Помогает посетителю обходить цепочку бинарных операций циклом. Посетитель начинает Visit
+    // бинарной операции с вызова VisitLhs и продолжает обработку операции, только если тот вернул true
+    class ChainTraversal {
+    public:
+        // Если левый аргумент node - не бинарная операция, передаёт его visitor и возвращает true.
+        // Иначе передаёт visitor самый левый аргумент цепочки, затем каждую операцию цепочки от самой
+        // внутренней до node и возвращает false: node уже обработана. Для операций цепочки VisitLhs
+        // ничего не посещает и возвращает true, так как их левые аргументы уже посещены
+        bool VisitLhs(BinaryOperation& node, StatementVisitor& visitor);
+
+    private:
+        bool lhs_visited_ = false;
     };
 
     // Возвращает результат операции + над аргументами lhs и rhs
@@ -177,12 +525,24 @@ namespace ast {
     public:
         using BinaryOperation::BinaryOperation;
 
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+
+        [[nodiscard]] const runtime::MethodCache& GetMethodCache() const {
+            return method_cache_;
+        }
+
+    protected:
         // Поддерживается сложение:
         //  число + число
         //  строка + строка
         //  объект1 + объект2, если у объект1 - пользовательский класс с методом _add__(rhs)
         // В противном случае при вычислении выбрасывается runtime_error
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, runtime::Frame& frame,
+            runtime::Context& context) final;
+
+    private:
+        runtime::MethodCache method_cache_;
     };
 
     // Возвращает результат вычитания аргументов lhs и rhs
@@ -190,10 +550,15 @@ namespace ast {
     public:
         using BinaryOperation::BinaryOperation;
 
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+
+    protected:
         // Поддерживается вычитание:
         //  число - число
         // Если lhs и rhs - не числа, выбрасывается исключение runtime_error
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, runtime::Frame& frame,
+            runtime::Context& context) final;
     };
 
     // Возвращает результат умножения аргументов lhs и rhs
@@ -201,10 +566,15 @@ namespace ast {
     public:
         using BinaryOperation::BinaryOperation;
 
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+
+    protected:
         // Поддерживается умножение:
         //  число * число
         // Если lhs и rhs - не числа, выбрасывается исключение runtime_error
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, runtime::Frame& frame,
+            runtime::Context& context) final;
     };
 
     // Возвращает результат деления lhs и rhs
@@ -212,36 +582,62 @@ namespace ast {
     public:
         using BinaryOperation::BinaryOperation;
 
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+
+    protected:
         // Поддерживается деление:
         //  число / число
         // Если lhs и rhs - не числа, выбрасывается исключение runtime_error
         // Если rhs равен 0, выбрасывается исключение runtime_error
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, runtime::Frame& frame,
+            runtime::Context& context) final;
     };
 
     // Возвращает результат вычисления логической операции or над lhs и rhs
     class Or : public BinaryOperation {
     public:
         using BinaryOperation::BinaryOperation;
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+
+    protected:
         // Значение аргумента rhs вычисляется, только если значение lhs
         // после приведения к Bool равно False
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, runtime::Frame& frame,
+            runtime::Context& context) final;
     };
 
     // Возвращает результат вычисления логической операции and над lhs и rhs
     class And : public BinaryOperation {
     public:
         using BinaryOperation::BinaryOperation;
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+
+    protected:
         // Значение аргумента rhs вычисляется, только если значение lhs
         // после приведения к Bool равно True
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, runtime::Frame& frame,
+            runtime::Context& context) final;
     };
 
     // Возвращает результат вычисления логической операции not над единственным аргументом операции
     class Not : public UnaryOperation {
     public:
         using UnaryOperation::UnaryOperation;
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+    };
+
+    // Возвращает число, противоположное значению аргумента (унарный минус)
+    class Negate : public UnaryOperation {
+    public:
+        using UnaryOperation::UnaryOperation;
+
+        // Поддерживается только число. Для других значений выбрасывается исключение runtime_error
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
     };
 
     // Составная инструкция (например: тело метода, содержимое ветки if, либо else)
@@ -255,36 +651,76 @@ namespace ast {
         }
 
         // Добавляет очередную инструкцию в конец составной инструкции
-        void AddStatement(std::unique_ptr<Statement> stmt) {
+        void AddStatement(StatementPtr stmt) {
             // Реализуйте метод самостоятельно
             statements_.push_back(std::move(stmt));
         }
 
-        // Последовательно выполняет добавленные инструкции. Возвращает None
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        // Последовательно выполняет добавленные инструкции. Возвращает None.
+        // Если одна из инструкций выполнила return, остальные не выполняются, а Compound
+        // возвращает результат return, оставляя отметку о нём в кадре
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+        void RewriteChildren(const ChildRewriter& rewrite) override;
+
+        [[nodiscard]] const StatementList& GetStatements() const {
+            return statements_;
+        }
+
+        // Забирает добавленные инструкции, оставляя составную инструкцию пустой
+        [[nodiscard]] StatementList TakeStatements() {
+            return std::exchange(statements_, {});
+        }
+
+        // Заменяет count инструкций, начиная с first, инструкциями statements
+        void ReplaceStatements(size_t first, size_t count, StatementList statements);
+
+        // Передаёт составной инструкции владение ареной, в которой размещены её инструкции
+        // (так разбор возвращает программу). Инструкции арены не удаляются по одному (см. NodeDeleter):
+        // их память и память их потомков освобождается вместе с ареной
+        void SetArena(std::unique_ptr<NodeArena> arena) {
+            owned_arena_ = std::move(arena);
+        }
+
+        // Возвращает арену, которой владеет составная инструкция, либо nullptr
+        [[nodiscard]] NodeArena* GetOwnedArena() const {
+            return owned_arena_.get();
+        }
 
     private:
-        std::vector<std::unique_ptr<Statement>> statements_;
+        // Объявлена раньше списка инструкций, поэтому удаляется после него
+        std::unique_ptr<NodeArena> owned_arena_;
+        StatementList statements_;
     };
 
+    // Возвращает арену, в которой следует размещать новые узлы дерева program: арену программы,
+    // если program ею владеет (см. Compound::SetArena), иначе арену самого узла program
+    [[nodiscard]] NodeArena* GetTreeArena(Statement& program);
+
     // Тело метода. Как правило, содержит составную инструкцию
     class MethodBody : public Statement {
     public:
-        explicit MethodBody(std::unique_ptr<Statement>&& body);
+        explicit MethodBody(StatementPtr&& body);
 
         // Вычисляет инструкцию, переданную в качестве body.
         // Если внутри body была выполнена инструкция return, возвращает результат return
         // В противном случае возвращает None
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+        void RewriteChildren(const ChildRewriter& rewrite) override;
+
+        [[nodiscard]] Statement& GetBody() const {
+            return *body_;
+        }
 
     private:
-        std::unique_ptr<Statement> body_;
+        StatementPtr body_;
     };
 
     // Выполняет инструкцию return с выражением statement
     class Return : public Statement {
     public:
-        explicit Return(std::unique_ptr<Statement> statement)
+        explicit Return(StatementPtr statement)
             : statement_(std::move(statement))
         {
             // Реализуйте метод самостоятельно
@@ -292,10 +728,17 @@ namespace ast {
 
         // Останавливает выполнение текущего метода. После выполнения инструкции return метод,
         // внутри которого она была исполнена, должен вернуть результат вычисления выражения statement.
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        // Возвращает этот результат и отмечает в кадре, что выполнен return (см. Frame::SetReturning)
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+        void RewriteChildren(const ChildRewriter& rewrite) override;
+
+        [[nodiscard]] Statement& GetStatement() const {
+            return *statement_;
+        }
 
     private:
-        std::unique_ptr<Statement> statement_;
+        StatementPtr statement_;
     };
 
     // Объявляет класс
@@ -303,29 +746,81 @@ namespace ast {
     public:
         // Гарантируется, что ObjectHolder содержит объект типа runtime::Class
         explicit ClassDefinition(runtime::ObjectHolder cls);
+        ~ClassDefinition() override;
+
+        ClassDefinition(const ClassDefinition&) = delete;
+        ClassDefinition& operator=(const ClassDefinition&) = delete;
 
         // Создаёт внутри closure новый объект, совпадающий с именем класса и значением, переданным в
         // конструктор
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+
+        [[nodiscard]] const runtime::ObjectHolder& GetClass() const {
+            return cls_.Get().cls;
+        }
 
     private:
-        runtime::ObjectHolder cls_;
-        const std::string class_name_;
+        // Объявленный класс. Удаляясь, отказывается от тел методов, размещённых в арене:
+        // их память освобождается вместе с ней, даже если класс её переживёт
+        struct DeclaredClass {
+            explicit DeclaredClass(runtime::ObjectHolder declared)
+                : cls(std::move(declared)) {
+            }
+
+            DeclaredClass(const DeclaredClass&) = delete;
+            DeclaredClass& operator=(const DeclaredClass&) = delete;
+            ~DeclaredClass();
+
+            runtime::ObjectHolder cls;
+        };
+
+        NodeValue<DeclaredClass> cls_;
+        const runtime::Symbol class_name_;
     };
 
     // Инструкция if <condition> <if_body> else <else_body>
     class IfElse : public Statement {
     public:
         // Параметр else_body может быть равен nullptr
-        IfElse(std::unique_ptr<Statement> condition, std::unique_ptr<Statement> if_body,
-            std::unique_ptr<Statement> else_body);
+        IfElse(StatementPtr condition, StatementPtr if_body,
+            StatementPtr else_body);
 
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+        void RewriteChildren(const ChildRewriter& rewrite) override;
+
+        [[nodiscard]] Statement& GetCondition() const {
+            return *condition_;
+        }
+
+        [[nodiscard]] Statement& GetIfBody() const {
+            return *if_body_;
+        }
+
+        // Возвращает nullptr, если ветка else отсутствует
+        [[nodiscard]] Statement* GetElseBody() const {
+            return else_body_.get();
+        }
+
+        // Забирают условие и ветки, оставляя инструкцию без них. Используются, когда инструкция
+        // заменяется одной из веток или равносильной инструкцией
+        [[nodiscard]] StatementPtr TakeCondition() {
+            return std::move(condition_);
+        }
+
+        [[nodiscard]] StatementPtr TakeIfBody() {
+            return std::move(if_body_);
+        }
+
+        [[nodiscard]] StatementPtr TakeElseBody() {
+            return std::move(else_body_);
+        }
 
     private:
-        std::unique_ptr<Statement> condition_;
-        std::unique_ptr<Statement> if_body_;
-        std::unique_ptr<Statement> else_body_;
+        StatementPtr condition_;
+        StatementPtr if_body_;
+        StatementPtr else_body_;
     };
 
     // Операция сравнения
@@ -335,31 +830,157 @@ namespace ast {
         using Comparator = std::function<bool(const runtime::ObjectHolder&,
             const runtime::ObjectHolder&, runtime::Context&)>;
 
-        Comparison(Comparator cmp, std::unique_ptr<Statement> lhs, std::unique_ptr<Statement> rhs);
+        Comparison(Comparator cmp, StatementPtr lhs, StatementPtr rhs);
 
         // Вычисляет значение выражений lhs и rhs и возвращает результат работы comparator,
         // приведённый к типу runtime::Bool
-        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+
+        // Вычисляет значение выражений lhs и rhs и возвращает результат работы comparator
+        bool Compare(runtime::Frame& frame, runtime::Context& context);
+        void Accept(StatementVisitor& visitor) override;
+
+        [[nodiscard]] const Comparator& GetComparator() const {
+            return comparator_;
+        }
+
+        [[nodiscard]] const runtime::CachedComparator& GetCachedComparator() const {
+            return cached_comparator_;
+        }
+
+    protected:
+        runtime::ObjectHolder Apply(const runtime::ObjectHolder& lhs, runtime::Frame& frame,
+            runtime::Context& context) final;
 
     private:
+        bool CompareWith(const runtime::ObjectHolder& lhs, runtime::Frame& frame, runtime::Context& context);
+
         Comparator comparator_;
-        std::unique_ptr<Statement> left_;
-        std::unique_ptr<Statement> right_;
+        // Если comparator_ - одна из функций сравнения runtime, сравнение выполняется
+        // соответствующим методом cached_comparator_
+        runtime::CachedComparator::Method cached_method_ = nullptr;
+        runtime::CachedComparator cached_comparator_;
+        StatementPtr left_;
+        StatementPtr right_;
     };
 
-
-    class ReturnException : std::runtime_error {
+    // Инструкция if <lhs> <сравнение> <rhs>: <if_body> else: <else_body>, условие которой - сравнение.
+    // В отличие от IfElse, ветка выбирается по результату сравнения без создания значения Bool
+    // и его приведения к логическому значению. Создаётся оптимизатором из IfElse
+    class CompareAndBranch : public Statement {
     public:
-        explicit ReturnException(runtime::ObjectHolder&& result)
-            : std::runtime_error("result")
-            , result_(std::move(result)) {
+        // Параметр else_body может быть равен nullptr
+        CompareAndBranch(NodePtr<Comparison> condition, StatementPtr if_body,
+            StatementPtr else_body);
+
+        runtime::ObjectHolder Evaluate(runtime::Frame& frame, runtime::Context& context) override;
+        void Accept(StatementVisitor& visitor) override;
+        // Передаёт rewrite аргументы сравнения и ветки. Само сравнение не заменяется
+        void RewriteChildren(const ChildRewriter& rewrite) override;
+
+        [[nodiscard]] Comparison& GetCondition() const {
+            return *condition_;
         }
 
-        runtime::ObjectHolder GetResult() const {
-            return result_;
+        [[nodiscard]] Statement& GetIfBody() const {
+            return *if_body_;
+        }
+
+        // Возвращает nullptr, если ветка else отсутствует
+        [[nodiscard]] Statement* GetElseBody() const {
+            return else_body_.get();
         }
 
     private:
-        runtime::ObjectHolder result_{};
+        NodePtr<Comparison> condition_;
+        StatementPtr if_body_;
+        StatementPtr else_body_;
+    };
+
+    // Посетитель узлов дерева разбора
+    class StatementVisitor {
+    public:
+        virtual void Visit(NumericConst& node) = 0;
+        virtual void Visit(StringConst& node) = 0;
+        virtual void Visit(BoolConst& node) = 0;
+        virtual void Visit(VariableValue& node) = 0;
+        virtual void Visit(Assignment& node) = 0;
+        virtual void Visit(FieldAssignment& node) = 0;
+        virtual void Visit(None& node) = 0;
+        virtual void Visit(Print& node) = 0;
+        virtual void Visit(MethodCall& node) = 0;
+        virtual void Visit(NewInstance& node) = 0;
+        virtual void Visit(Stringify& node) = 0;
+        virtual void Visit(Add& node) = 0;
+        virtual void Visit(Sub& node) = 0;
+        virtual void Visit(Mult& node) = 0;
+        virtual void Visit(Div& node) = 0;
+        virtual void Visit(Or& node) = 0;
+        virtual void Visit(And& node) = 0;
+        virtual void Visit(Not& node) = 0;
+        virtual void Visit(Negate& node) = 0;
+        virtual void Visit(Compound& node) = 0;
+        virtual void Visit(MethodBody& node) = 0;
+        virtual void Visit(Return& node) = 0;
+        virtual void Visit(ClassDefinition& node) = 0;
+        virtual void Visit(IfElse& node) = 0;
+        virtual void Visit(Comparison& node) = 0;
+        virtual void Visit(CompareAndBranch& node) = 0;
+
+    protected:
+        ~StatementVisitor() = default;
     };
+
+    // Посетитель, по умолчанию обходящий все дочерние инструкции узла.
+    // Наследники переопределяют Visit только для интересующих их узлов. Цепочки бинарных операций
+    // обходятся циклом (см. ChainTraversal), поэтому наследник, переопределяющий Visit бинарной
+    // операции, вызывает из него реализацию этого класса
+    class RecursiveStatementVisitor : public StatementVisitor {
+    public:
+        void Visit(NumericConst& node) override;
+        void Visit(StringConst& node) override;
+        void Visit(BoolConst& node) override;
+        void Visit(VariableValue& node) override;
+        void Visit(Assignment& node) override;
+        void Visit(FieldAssignment& node) override;
+        void Visit(None& node) override;
+        void Visit(Print& node) override;
+        void Visit(MethodCall& node) override;
+        void Visit(NewInstance& node) override;
+        void Visit(Stringify& node) override;
+        void Visit(Add& node) override;
+        void Visit(Sub& node) override;
+        void Visit(Mult& node) override;
+        void Visit(Div& node) override;
+        void Visit(Or& node) override;
+        void Visit(And& node) override;
+        void Visit(Not& node) override;
+        void Visit(Negate& node) override;
+        void Visit(Compound& node) override;
+        void Visit(MethodBody& node) override;
+        void Visit(Return& node) override;
+        void Visit(ClassDefinition& node) override;
+        void Visit(IfElse& node) override;
+        void Visit(Comparison& node) override;
+        void Visit(CompareAndBranch& node) override;
+
+    protected:
+        ~RecursiveStatementVisitor() = default;
+
+        void VisitAll(const StatementList& statements);
+
+    private:
+        void VisitOperation(BinaryOperation& node);
+
+        ChainTraversal chain_;
+    };
+
+    template <typename T>
+    void ValueStatement<T>::Accept(StatementVisitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    inline void None::Accept(StatementVisitor& visitor) {
+        visitor.Visit(*this);
+    }
 }  // namespace ast
\ No newline at end of file
@@ -287,6 +287,85 @@ namespace ast {
             ASSERT(context.output.str().empty());
         }
 
+        void TestCallSiteCaches() {
+            runtime::DummyContext context;
+
+            auto make_class = [](const string& name, int value) {
+                vector<runtime::Method> methods;
+                methods.push_back({ "get"s, {}, make_unique<NumericConst>(value) });
+                methods.push_back({ "__eq__"s, {"other"s}, make_unique<BoolConst>(runtime::Bool{ true }) });
+                methods.push_back({ "__add__"s, {"other"s}, make_unique<NumericConst>(value) });
+                return runtime::Class(name, std::move(methods), nullptr);
+            };
+            runtime::Class first = make_class("First"s, 1);
+            runtime::Class second = make_class("Second"s, 2);
+            runtime::ClassInstance first_instance(first);
+            runtime::ClassInstance second_instance(second);
+
+            MethodCall call(make_unique<VariableValue>("obj"s), "get"s, {});
+            Add add(make_unique<VariableValue>("obj"s), make_unique<NumericConst>(0));
+            Comparison equal(runtime::Equal, make_unique<VariableValue>("obj"s), make_unique<NumericConst>(0));
+
+            Closure closure = { {"obj"s, ObjectHolder::Share(first_instance)} };
+            for (int i = 0; i < 3; ++i) {
+                ASSERT_OBJECT_VALUE_EQUAL(call.Execute(closure, context), 1);
+                ASSERT_OBJECT_VALUE_EQUAL(add.Execute(closure, context), 1);
+                ASSERT_OBJECT_VALUE_EQUAL(equal.Execute(closure, context), "True"s);
+            }
+            closure["obj"s] = ObjectHolder::Share(second_instance);
+            ASSERT_OBJECT_VALUE_EQUAL(call.Execute(closure, context), 2);
+            ASSERT_OBJECT_VALUE_EQUAL(add.Execute(closure, context), 2);
+            ASSERT_OBJECT_VALUE_EQUAL(equal.Execute(closure, context), "True"s);
+
+            for (const runtime::MethodCache* cache :
+                 { &call.GetMethodCache(), &add.GetMethodCache(), &equal.GetCachedComparator().GetEqualCache() }) {
+                ASSERT_EQUAL(cache->GetStats().hits, 2U);
+                ASSERT_EQUAL(cache->GetStats().misses, 2U);
+            }
+            ASSERT_EQUAL(equal.GetCachedComparator().GetLessCache().GetStats().misses, 0U);
+
+            // Кэш помнит и отсутствие метода
+            runtime::Class empty("Empty"s, {}, nullptr);
+            runtime::ClassInstance empty_instance(empty);
+            closure["obj"s] = ObjectHolder::Share(empty_instance);
+            ASSERT_THROWS(call.Execute(closure, context), runtime_error);
+            ASSERT_THROWS(call.Execute(closure, context), runtime_error);
+            ASSERT_EQUAL(call.GetMethodCache().GetStats().hits, 3U);
+            ASSERT_EQUAL(call.GetMethodCache().GetStats().misses, 3U);
+        }
+
+        void TestFieldCaches() {
+            runtime::DummyContext context;
+
+            runtime::Class cls("Point"s, {}, nullptr);
+            runtime::ClassInstance first(cls);
+            runtime::ClassInstance second(cls);
+            runtime::ClassInstance other_order(cls);
+            other_order.Fields()["y"s] = ObjectHolder::Own(runtime::Number(0));
+
+            FieldAssignment assign_x(VariableValue{ "obj"s }, "x"s, make_unique<NumericConst>(1));
+            FieldAssignment assign_y(VariableValue{ "obj"s }, "y"s, make_unique<NumericConst>(2));
+            VariableValue get_y(vector<string>{ "obj"s, "y"s });
+
+            // Смещения полей, запомненные на первом экземпляре, подходят второму той же формы,
+            // а для экземпляра другой формы кэши обновляются
+            for (runtime::ClassInstance* instance : { &first, &second, &other_order }) {
+                Closure closure = { {"obj"s, ObjectHolder::Share(*instance)} };
+                assign_x.Execute(closure, context);
+                assign_y.Execute(closure, context);
+                ASSERT_OBJECT_VALUE_EQUAL(get_y.Execute(closure, context), 2);
+                ASSERT_OBJECT_VALUE_EQUAL(instance->Fields().at("x"s), 1);
+                ASSERT_EQUAL(instance->Fields().size(), 2U);
+            }
+            ASSERT_EQUAL(&first.Fields().GetShape(), &second.Fields().GetShape());
+            ASSERT(&first.Fields().GetShape() != &other_order.Fields().GetShape());
+            // Поле y у последнего экземпляра уже было, поэтому кэш помнит его итоговую форму
+            ASSERT_EQUAL(assign_y.GetFieldCache().GetShape(), &other_order.Fields().GetShape());
+
+            Closure closure = { {"obj"s, ObjectHolder::Share(first)} };
+            ASSERT_THROWS(VariableValue(vector<string>{ "obj"s, "z"s }).Execute(closure, context), runtime_error);
+        }
+
         void TestCompound() {
             runtime::DummyContext context;
 
@@ -308,6 +387,36 @@ namespace ast {
             ASSERT(context.output.str().empty());
         }
 
+        void TestReturn() {
+            runtime::DummyContext context;
+
+            // if x: return 'if' / print 'after if' / return 'end' / print 'unreachable'
+            auto make_body = [] {
+                auto if_body = make_unique<Compound>(make_unique<Return>(make_unique<StringConst>("if"s)));
+                return MethodBody(make_unique<Compound>(
+                    make_unique<IfElse>(make_unique<VariableValue>("x"s), std::move(if_body), nullptr),
+                    make_unique<Print>(make_unique<StringConst>("after if"s)),
+                    make_unique<Return>(make_unique<StringConst>("end"s)),
+                    make_unique<Print>(make_unique<StringConst>("unreachable"s))));
+            };
+            MethodBody body = make_body();
+
+            Closure closure = { {"x"s, ObjectHolder::Own(runtime::Bool(true))} };
+            runtime::Frame frame(closure);
+            ASSERT_OBJECT_VALUE_EQUAL(body.Execute(frame, context), "if"s);
+            // Тело метода снимает отметку о return, и кадр можно использовать дальше
+            ASSERT(!frame.IsReturning());
+            ASSERT(context.output.str().empty());
+
+            closure["x"s] = ObjectHolder::Own(runtime::Bool(false));
+            ASSERT_OBJECT_VALUE_EQUAL(body.Execute(frame, context), "end"s);
+            ASSERT_EQUAL(context.output.str(), "after if\n"s);
+
+            // Без return тело метода возвращает None, даже если последняя инструкция имеет значение
+            MethodBody no_return(make_unique<Compound>(make_unique<StringConst>("value"s)));
+            ASSERT(!no_return.Execute(closure, context));
+        }
+
         void TestFields() {
             runtime::DummyContext context;
 
@@ -469,7 +578,10 @@ namespace ast {
         RUN_TEST(tr, ast::TestBadAddition);
         RUN_TEST(tr, ast::TestSuccessfulClassInstanceAdd);
         RUN_TEST(tr, ast::TestClassInstanceAddWithoutMethod);
+        RUN_TEST(tr, ast::TestCallSiteCaches);
+        RUN_TEST(tr, ast::TestFieldCaches);
         RUN_TEST(tr, ast::TestCompound);
+        RUN_TEST(tr, ast::TestReturn);
         RUN_TEST(tr, ast::TestFields);
         RUN_TEST(tr, ast::TestBaseClass);
         RUN_TEST(tr, ast::TestInheritance);
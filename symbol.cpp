@@ -0,0 +1,192 @@
+#include "symbol.h"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+using namespace std;
+
+namespace runtime {
+
+    namespace {
+
+        // Таблица символов. Регистрация имён защищена мьютексом, а имена и хеши зарегистрированных
+        // символов читаются без блокировки: записи хранятся в блоках, которые не перемещаются.
+        // Уже зарегистрированное имя тоже находится без блокировки (см. Probe), поэтому потоки,
+        // одновременно выделяющие токены, не ждут друг друга на повторяющихся идентификаторах
+        class SymbolTable {
+        public:
+            SymbolTable() {
+                indices_.push_back(make_unique<Index>(64));
+                index_.store(indices_.back().get(), memory_order_release);
+                // Порядок совпадает с номерами символов INIT_METHOD_ID, STR_METHOD_ID, EQ_METHOD_ID,
+                // LT_METHOD_ID, ADD_METHOD_ID и SELF_SYMBOL из runtime.h
+                for (const char* name : { "__init__", "__str__", "__eq__", "__lt__", "__add__", "self" }) {
+                    Intern(name);
+                }
+            }
+
+            SymbolTable(const SymbolTable&) = delete;
+            SymbolTable& operator=(const SymbolTable&) = delete;
+
+            uint32_t Intern(string_view name) {
+                const size_t hash = std::hash<string_view>{}(name);
+                if (const uint32_t slot = Probe(*index_.load(memory_order_acquire), name, hash).first; slot != 0) {
+                    return slot - 1;
+                }
+                lock_guard guard(mutex_);
+
+                // Пока мьютекс не был захвачен, имя могло зарегистрировать другой поток
+                Index& index = *indices_.back();
+                const auto [slot, position] = Probe(index, name, hash);
+                if (slot != 0) {
+                    return slot - 1;
+                }
+
+                const uint32_t id = size_;
+                if (id == Symbol::NO_ID) {
+                    throw length_error("Too many symbols"s);
+                }
+                Entry& entry = AllocateEntry(id);
+                entry.name = string(name);
+                entry.hash = hash;
+                ++size_;
+
+                // Запись заполнена до публикации ячейки, поэтому нашедший ячейку поток видит имя и хеш
+                index.slots[position].store(id + 1, memory_order_release);
+                // Таблица индекса заполняется не более чем наполовину
+                if (2 * static_cast<size_t>(size_) > index.mask + 1) {
+                    Rehash();
+                }
+                return id;
+            }
+
+            uint32_t Find(string_view name) const {
+                const size_t hash = std::hash<string_view>{}(name);
+                return Probe(*index_.load(memory_order_acquire), name, hash).first - 1;
+            }
+
+            struct Entry {
+                string name;
+                size_t hash = 0;
+            };
+
+            const Entry& GetEntry(uint32_t id) const {
+                const auto [block, offset] = Locate(id);
+                return blocks_[block].load(memory_order_acquire)[offset];
+            }
+
+        private:
+            // Блок b содержит FIRST_BLOCK_SIZE * 2^b записей, поэтому MAX_BLOCKS блоков вмещают все номера
+            static constexpr size_t FIRST_BLOCK_SIZE = 256;
+            static constexpr size_t MAX_BLOCKS = 24;
+
+            static pair<size_t, size_t> Locate(uint32_t id) {
+                const size_t n = id / FIRST_BLOCK_SIZE + 1;
+                size_t block = 0;
+                while ((n >> (block + 1)) != 0) {
+                    ++block;
+                }
+                return { block, id - FIRST_BLOCK_SIZE * ((size_t{ 1 } << block) - 1) };
+            }
+
+            Entry& AllocateEntry(uint32_t id) {
+                const auto [block, offset] = Locate(id);
+                Entry* entries = blocks_[block].load(memory_order_relaxed);
+                if (entries == nullptr) {
+                    storage_.push_back(make_unique<Entry[]>(FIRST_BLOCK_SIZE << block));
+                    entries = storage_.back().get();
+                    blocks_[block].store(entries, memory_order_release);
+                }
+                return entries[offset];
+            }
+
+            // Индекс с открытой адресацией: номер символа, увеличенный на 1, либо 0 в свободной ячейке.
+            // Ячейки заполняются под мьютексом и читаются без блокировки
+            struct Index {
+                explicit Index(size_t size)
+                    : slots(make_unique<atomic<uint32_t>[]>(size))
+                    , mask(size - 1) {
+                }
+
+                unique_ptr<atomic<uint32_t>[]> slots;
+                size_t mask;
+            };
+
+            // Возвращает номер символа name, увеличенный на 1, и ячейку индекса, в которой он находится,
+            // либо 0 и пустую ячейку, в которую его нужно добавить
+            pair<uint32_t, size_t> Probe(const Index& index, string_view name, size_t hash) const {
+                for (size_t i = hash & index.mask;; i = (i + 1) & index.mask) {
+                    const uint32_t slot = index.slots[i].load(memory_order_acquire);
+                    if (slot == 0) {
+                        return { 0, i };
+                    }
+                    const Entry& entry = GetEntry(slot - 1);
+                    if (entry.hash == hash && entry.name == name) {
+                        return { slot, i };
+                    }
+                }
+            }
+
+            // Увеличивает индекс вдвое, используя сохранённые хеши имён. Прежний индекс не удаляется:
+            // его ещё могут читать другие потоки. Все индексы вместе занимают меньше удвоенного последнего
+            void Rehash() {
+                const Index& old_index = *indices_.back();
+                auto index = make_unique<Index>((old_index.mask + 1) * 2);
+                for (size_t i = 0; i <= old_index.mask; ++i) {
+                    const uint32_t slot = old_index.slots[i].load(memory_order_relaxed);
+                    if (slot == 0) {
+                        continue;
+                    }
+                    size_t j = GetEntry(slot - 1).hash & index->mask;
+                    while (index->slots[j].load(memory_order_relaxed) != 0) {
+                        j = (j + 1) & index->mask;
+                    }
+                    index->slots[j].store(slot, memory_order_relaxed);
+                }
+                index_.store(index.get(), memory_order_release);
+                indices_.push_back(std::move(index));
+            }
+
+            mutex mutex_;
+            array<atomic<Entry*>, MAX_BLOCKS> blocks_{};
+            vector<unique_ptr<Entry[]>> storage_;
+            // Все созданные индексы, текущий - последний. Он же опубликован в index_ для чтения без блокировки
+            vector<unique_ptr<Index>> indices_;
+            atomic<const Index*> index_{ nullptr };
+            uint32_t size_ = 0;
+        };
+
+        SymbolTable& GetSymbolTable() {
+            // Таблица не разрушается, так как символы могут использоваться при разрушении других
+            // статических объектов
+            static SymbolTable* table = new SymbolTable;
+            return *table;
+        }
+
+    }  // namespace
+
+    Symbol::Symbol(std::string_view name)
+        : id_(GetSymbolTable().Intern(name)) {
+    }
+
+    Symbol Symbol::Find(std::string_view name) {
+        return FromId(GetSymbolTable().Find(name));
+    }
+
+    const std::string& Symbol::GetName() const {
+        return GetSymbolTable().GetEntry(id_).name;
+    }
+
+    std::size_t Symbol::GetHash() const {
+        return GetSymbolTable().GetEntry(id_).hash;
+    }
+
+    std::ostream& operator<<(std::ostream& os, Symbol symbol) {
+        return os << symbol.GetName();
+    }
+
+}  // namespace runtime
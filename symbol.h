@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <limits>
+#include <string>
+#include <string_view>
+
+namespace runtime {
+
+    // Идентификатор (имя переменной, поля, метода или параметра), зарегистрированный в общей для
+    // всего процесса таблице символов. Одинаковые имена получают одинаковые символы, поэтому
+    // имена сравниваются как 32-битные числа. Хеш имени вычисляется один раз при регистрации.
+    // Таблица символов только растёт: имя символа остаётся доступным до конца работы программы
+    class Symbol {
+    public:
+        static constexpr std::uint32_t NO_ID = std::numeric_limits<std::uint32_t>::max();
+
+        // Создаёт пустой символ, не соответствующий никакому имени
+        constexpr Symbol() = default;
+
+        // Возвращает символ имени name, регистрируя имя при первом обращении
+        Symbol(std::string_view name);  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        Symbol(const std::string& name)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+            : Symbol(std::string_view(name)) {
+        }
+        Symbol(const char* name)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+            : Symbol(std::string_view(name)) {
+        }
+
+        // Возвращает символ уже зарегистрированного имени name либо пустой символ, не регистрируя имя
+        [[nodiscard]] static Symbol Find(std::string_view name);
+
+        // Возвращает символ с номером id. Символ должен быть зарегистрирован
+        [[nodiscard]] static constexpr Symbol FromId(std::uint32_t id) {
+            Symbol symbol;
+            symbol.id_ = id;
+            return symbol;
+        }
+
+        // Возвращает номер символа в таблице. Символы нумеруются подряд в порядке регистрации
+        [[nodiscard]] constexpr std::uint32_t GetId() const {
+            return id_;
+        }
+
+        // Возвращает имя символа. Символ не должен быть пустым
+        [[nodiscard]] const std::string& GetName() const;
+
+        // Возвращает хеш имени, вычисленный при регистрации символа
+        [[nodiscard]] std::size_t GetHash() const;
+
+        // Возвращает true, если символ не пуст
+        constexpr explicit operator bool() const {
+            return id_ != NO_ID;
+        }
+
+        friend constexpr bool operator==(Symbol lhs, Symbol rhs) {
+            return lhs.id_ == rhs.id_;
+        }
+
+        friend constexpr bool operator!=(Symbol lhs, Symbol rhs) {
+            return lhs.id_ != rhs.id_;
+        }
+
+    private:
+        std::uint32_t id_ = NO_ID;
+    };
+
+    // Выводит имя символа
+    std::ostream& operator<<(std::ostream& os, Symbol symbol);
+
+}  // namespace runtime
+
+namespace std {
+
+    // Символы хешируются по номеру: одинаковые имена имеют одинаковые номера, а обращаться
+    // к таблице символов за хешем имени не нужно
+    template <>
+    struct hash<runtime::Symbol> {
+        size_t operator()(runtime::Symbol symbol) const {
+            return hash<uint32_t>{}(symbol.GetId());
+        }
+    };
+
+}  // namespace std
@@ -0,0 +1,94 @@
+#include "token_buffer.h"
+
+#include <utility>
+
+using namespace std;
+
+namespace parse {
+
+    namespace {
+
+        template <size_t... Indices>
+        std::array<Token, sizeof...(Indices)> MakeEmptyTokens(std::index_sequence<Indices...>) {
+            return { Token(std::in_place_index<Indices>)... };
+        }
+
+        // Токены каждого вида со значением по умолчанию
+        const std::array<Token, std::variant_size_v<TokenBase>> EMPTY_TOKENS
+            = MakeEmptyTokens(std::make_index_sequence<std::variant_size_v<TokenBase>>{});
+
+    }  // namespace
+
+    TokenBuffer TokenBuffer::Read(Lexer& lexer) {
+        TokenBuffer tokens;
+        while (true) {
+            const Token& token = lexer.CurrentToken();
+            tokens.Append(token, lexer.CurrentSpan());
+            if (token.Is<token_type::Eof>()) {
+                return tokens;
+            }
+            lexer.NextToken();
+        }
+    }
+
+    void TokenBuffer::Append(const Token& token, const SourceSpan& span) {
+        std::uint32_t value = 0;
+        switch (token.GetKind()) {
+        case TokenKind::Number:
+            value = static_cast<std::uint32_t>(token.As<token_type::Number>().value);
+            break;
+        case TokenKind::Id:
+            value = token.As<token_type::Id>().value.GetId();
+            break;
+        case TokenKind::Char:
+            value = static_cast<unsigned char>(token.As<token_type::Char>().value);
+            break;
+        case TokenKind::String:
+            value = static_cast<std::uint32_t>(strings_.size());
+            strings_.push_back(token.As<token_type::String>().value);
+            break;
+        default:
+            break;
+        }
+        kinds_.push_back(token.GetKind());
+        values_.push_back(value);
+        spans_.push_back(span);
+    }
+
+    void TokenBuffer::Append(const TokenBuffer& tokens, size_t count, std::uint32_t offset, std::uint32_t line) {
+        kinds_.reserve(kinds_.size() + count);
+        values_.reserve(values_.size() + count);
+        spans_.reserve(spans_.size() + count);
+        for (size_t i = 0; i < count; ++i) {
+            std::uint32_t value = tokens.values_[i];
+            if (tokens.kinds_[i] == TokenKind::String) {
+                value = static_cast<std::uint32_t>(strings_.size());
+                strings_.push_back(tokens.strings_[tokens.values_[i]]);
+            }
+            SourceSpan span = tokens.spans_[i];
+            span.offset += offset;
+            span.line += line - 1;
+
+            kinds_.push_back(tokens.kinds_[i]);
+            values_.push_back(value);
+            spans_.push_back(span);
+        }
+    }
+
+    Token TokenBuffer::Get(size_t index) const {
+        const std::uint32_t value = values_[index];
+        switch (kinds_[index]) {
+        case TokenKind::Number:
+            return token_type::Number{ static_cast<int>(value) };
+        case TokenKind::Id:
+            return token_type::Id{ runtime::Symbol::FromId(value) };
+        case TokenKind::Char:
+            return token_type::Char{ static_cast<char>(value) };
+        case TokenKind::String:
+            return token_type::String{ strings_[value] };
+        default:
+            return EMPTY_TOKENS[static_cast<size_t>(kinds_[index])];
+        }
+    }
+
+}  // namespace parse
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "lexer.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace parse {
+
+    // Последовательность токенов, сохранённая в виде структуры массивов: вид токена занимает
+    // один байт, значение - четыре (число, идентификатор символа, код символа либо индекс
+    // текста строки), положение в исходном тексте хранится в отдельном массиве.
+    // Строки, выделенные из программы в памяти, ссылаются на её текст, как и токены лексера.
+    // Токены буфера выдаёт Lexer(const TokenBuffer&), поэтому разбор буфера не отличается
+    // от разбора текста
+    class TokenBuffer {
+    public:
+        // Читает из lexer все токены, начиная с текущего, до Eof включительно
+        [[nodiscard]] static TokenBuffer Read(Lexer& lexer);
+
+        void Append(const Token& token, const SourceSpan& span);
+
+        // Дописывает первые count токенов из tokens, выделенных из фрагмента программы, который
+        // начинается со смещения offset в начале строки line. Положения токенов пересчитываются
+        // от начала программы
+        void Append(const TokenBuffer& tokens, size_t count, std::uint32_t offset, std::uint32_t line);
+
+        [[nodiscard]] size_t size() const {
+            return kinds_.size();
+        }
+
+        [[nodiscard]] bool empty() const {
+            return kinds_.empty();
+        }
+
+        [[nodiscard]] TokenKind GetKind(size_t index) const {
+            return kinds_[index];
+        }
+
+        template <typename T>
+        [[nodiscard]] bool Is(size_t index) const {
+            return kinds_[index] == TOKEN_KIND<T>;
+        }
+
+        // Восстанавливает токен с индексом index
+        [[nodiscard]] Token Get(size_t index) const;
+
+        [[nodiscard]] const SourceSpan& GetSpan(size_t index) const {
+            return spans_[index];
+        }
+
+    private:
+        std::vector<TokenKind> kinds_;
+        std::vector<std::uint32_t> values_;
+        std::vector<SourceSpan> spans_;
+        std::vector<TokenText> strings_;
+    };
+
+}  // namespace parse
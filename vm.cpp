@@ -0,0 +1,290 @@
+#include "vm.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace bytecode {
+
+    using runtime::Closure;
+    using runtime::ObjectHolder;
+
+    VirtualMachine::VirtualMachine(runtime::Context& context)
+        : Dispatcher(context) {
+    }
+
+    ObjectHolder VirtualMachine::Run(const Chunk& chunk, Closure& closure) {
+        runtime::Frame frame(closure);
+        return Execute(chunk, frame);
+    }
+
+    ObjectHolder VirtualMachine::Run(const Chunk& chunk, runtime::Frame& frame) {
+        return Execute(chunk, frame);
+    }
+
+    ObjectHolder VirtualMachine::Pop() {
+        ObjectHolder value = std::move(stack_.back());
+        stack_.pop_back();
+        return value;
+    }
+
+    ObjectHolder VirtualMachine::Execute(const Chunk& chunk, runtime::Frame& frame) {
+        const size_t base = stack_.size();
+        const Instruction* code = chunk.code.data();
+        size_t ip = 0;
+
+        try {
+            for (;;) {
+                const Instruction& instruction = code[ip++];
+                switch (instruction.code) {
+                case OpCode::LoadConst:
+                    stack_.push_back(chunk.constants[instruction.operand]);
+                    break;
+
+                case OpCode::LoadNone:
+                    stack_.emplace_back();
+                    break;
+
+                case OpCode::LoadName: {
+                    const runtime::Symbol name = chunk.names[instruction.operand];
+                    const ObjectHolder* value = frame.Find(name, runtime::Frame::NO_SLOT);
+                    if (value == nullptr) {
+                        throw runtime_error(name.GetName() + " not found in closure"s);
+                    }
+                    stack_.push_back(*value);
+                    break;
+                }
+
+                case OpCode::LoadLocal: {
+                    const ObjectHolder* value = frame.FindSlot(instruction.operand);
+                    if (value == nullptr) {
+                        throw runtime_error(chunk.local_names[instruction.operand].GetName() + " not found in closure"s);
+                    }
+                    stack_.push_back(*value);
+                    break;
+                }
+
+                case OpCode::LoadField: {
+                    const FieldSite& site = chunk.field_sites[instruction.operand];
+                    auto* instance = stack_.back().TryAs<runtime::ClassInstance>();
+                    if (instance == nullptr) {
+                        throw runtime_error("can't access field "s + site.name.GetName());
+                    }
+                    const ObjectHolder* field = site.cache.Find(instance->Fields(), site.name);
+                    if (field == nullptr) {
+                        throw runtime_error(site.name.GetName() + " not found in closure");
+                    }
+                    stack_.back() = ObjectHolder(*field);
+                    break;
+                }
+
+                case OpCode::StoreName:
+                    frame.Assign(chunk.names[instruction.operand], runtime::Frame::NO_SLOT, stack_.back());
+                    break;
+
+                case OpCode::StoreLocal:
+                    frame.Bind(instruction.operand, stack_.back());
+                    break;
+
+                case OpCode::StoreField: {
+                    const FieldSite& site = chunk.field_sites[instruction.operand];
+                    ObjectHolder value = Pop();
+                    site.cache.Assign(stack_.back().TryAs<runtime::ClassInstance>()->Fields(), site.name, value);
+                    stack_.back() = std::move(value);
+                    break;
+                }
+
+                case OpCode::Pop:
+                    stack_.pop_back();
+                    break;
+
+                case OpCode::Add: {
+                    ObjectHolder rhs = Pop();
+                    ObjectHolder lhs = Pop();
+                    auto lhs_number = lhs.TryGetNumber();
+                    auto rhs_number = rhs.TryGetNumber();
+                    if (lhs_number && rhs_number) {
+                        stack_.push_back(ObjectHolder::Own(runtime::Number(*lhs_number + *rhs_number)));
+                        break;
+                    }
+                    auto* lhs_string = lhs.TryAs<runtime::String>();
+                    auto* rhs_string = rhs.TryAs<runtime::String>();
+                    if (lhs_string != nullptr && rhs_string != nullptr) {
+                        stack_.push_back(ObjectHolder::Own(runtime::String(lhs_string->GetValue() + rhs_string->GetValue())));
+                        break;
+                    }
+                    if (lhs.TryAs<runtime::ClassInstance>() != nullptr) {
+                        stack_.push_back(std::move(rhs));
+                        stack_.push_back(CallMethod(lhs, runtime::ADD_METHOD_ID, 1,
+                            chunk.call_sites[instruction.operand].cache));
+                        break;
+                    }
+                    throw runtime_error("Error in add"s);
+                }
+
+                case OpCode::Sub:
+                case OpCode::Mult:
+                case OpCode::Div: {
+                    ObjectHolder rhs = Pop();
+                    ObjectHolder lhs = Pop();
+                    auto lhs_number = lhs.TryGetNumber();
+                    auto rhs_number = rhs.TryGetNumber();
+                    if (!lhs_number || !rhs_number) {
+                        throw runtime_error(instruction.code == OpCode::Sub ? "Error in sub"s
+                            : instruction.code == OpCode::Mult ? "Error in mult"s : "Error in division"s);
+                    }
+                    int result = 0;
+                    if (instruction.code == OpCode::Sub) {
+                        result = *lhs_number - *rhs_number;
+                    }
+                    else if (instruction.code == OpCode::Mult) {
+                        result = *lhs_number * *rhs_number;
+                    }
+                    else {
+                        if (*rhs_number == 0) {
+                            throw runtime_error("Division by zero"s);
+                        }
+                        result = *lhs_number / *rhs_number;
+                    }
+                    stack_.push_back(ObjectHolder::Own(runtime::Number(result)));
+                    break;
+                }
+
+                case OpCode::Not:
+                    stack_.back() = ObjectHolder::Own(runtime::Bool(!runtime::IsTrue(stack_.back())));
+                    break;
+
+                case OpCode::Negate: {
+                    auto number = stack_.back().TryGetNumber();
+                    if (!number) {
+                        throw runtime_error("Error in negation"s);
+                    }
+                    stack_.back() = ObjectHolder::Own(runtime::Number(-*number));
+                    break;
+                }
+
+                case OpCode::Compare: {
+                    ObjectHolder rhs = Pop();
+                    ObjectHolder lhs = Pop();
+                    bool result = Compare(chunk.compare_sites[instruction.operand], lhs, rhs);
+                    stack_.push_back(ObjectHolder::Own(runtime::Bool(result)));
+                    break;
+                }
+
+                case OpCode::Stringify: {
+                    ObjectHolder value = Pop();
+                    string result = "None"s;
+                    if (value) {
+                        ostringstream out;
+                        PrintValue(value, out, chunk.call_sites[instruction.operand].cache);
+                        result = out.str();
+                    }
+                    stack_.push_back(ObjectHolder::Own(runtime::String(std::move(result))));
+                    break;
+                }
+
+                case OpCode::PrintSpace:
+                    context_.GetOutputStream() << ' ';
+                    break;
+
+                case OpCode::PrintValue: {
+                    ObjectHolder value = Pop();
+                    ostream& out = context_.GetOutputStream();
+                    if (value) {
+                        PrintValue(value, out, chunk.call_sites[instruction.operand].cache);
+                    }
+                    else {
+                        out << "None"sv;
+                    }
+                    break;
+                }
+
+                case OpCode::PrintNewline:
+                    context_.GetOutputStream() << '\n';
+                    stack_.emplace_back();
+                    break;
+
+                case OpCode::CallMethod: {
+                    ObjectHolder object = Pop();
+                    if (object.TryAs<runtime::ClassInstance>() == nullptr) {
+                        stack_.resize(stack_.size() - instruction.arg);
+                        stack_.emplace_back();
+                        break;
+                    }
+                    const CallSite& site = chunk.call_sites[instruction.operand];
+                    stack_.push_back(CallMethod(object, site.method, instruction.arg, site.cache));
+                    break;
+                }
+
+                case OpCode::NewInstance: {
+                    const InstanceSite& site = chunk.instance_sites[instruction.operand];
+                    CallMethod(site.instance, runtime::INIT_METHOD_ID, instruction.arg, site.init_cache);
+                    stack_.push_back(site.instance);
+                    break;
+                }
+
+                case OpCode::Jump:
+                    ip = instruction.operand;
+                    break;
+
+                case OpCode::JumpIfFalse:
+                    if (!runtime::IsTrue(Pop())) {
+                        ip = instruction.operand;
+                    }
+                    break;
+
+                case OpCode::JumpIfTrue:
+                    if (runtime::IsTrue(Pop())) {
+                        ip = instruction.operand;
+                    }
+                    break;
+
+                case OpCode::JumpIfNotInstance:
+                    if (stack_.back().TryAs<runtime::ClassInstance>() == nullptr) {
+                        stack_.back() = ObjectHolder::None();
+                        ip = instruction.operand;
+                    }
+                    break;
+
+                case OpCode::Return: {
+                    // Compile завершает код инструкцией Return, остальные получены из return
+                    if (ip != chunk.code.size()) {
+                        frame.SetReturning();
+                    }
+                    ObjectHolder result = Pop();
+                    stack_.resize(base);
+                    return result;
+                }
+                }
+            }
+        }
+        catch (...) {
+            stack_.resize(base);
+            throw;
+        }
+    }
+
+    ObjectHolder VirtualMachine::CallMethod(const ObjectHolder& self, runtime::MethodId method, size_t arg_count,
+        runtime::MethodCache& cache) {
+        const size_t args_begin = stack_.size() - arg_count;
+        ObjectHolder result = Dispatcher::CallMethod(self, method, stack_.data() + args_begin, arg_count,
+            cache);
+        stack_.resize(args_begin);
+        return result;
+    }
+
+    const Chunk* VirtualMachine::GetMethodBody(const runtime::Method& method) {
+        auto [it, inserted] = method_chunks_.try_emplace(&method);
+        if (inserted) {
+            if (auto* body = dynamic_cast<ast::Statement*>(method.body.get())) {
+                it->second = make_unique<Chunk>(Compile(*body));
+            }
+        }
+        return it->second.get();
+    }
+
+    ObjectHolder VirtualMachine::RunMethodBody(const Chunk& chunk, runtime::Frame& frame) {
+        return Execute(chunk, frame);
+    }
+
+}  // namespace bytecode
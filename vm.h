@@ -0,0 +1,48 @@
+#pragma once
+
+#include "bytecode.h"
+#include "method_dispatch.h"
+#include "runtime.h"
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace bytecode {
+
+    // Стековая виртуальная машина, исполняющая байт-код, полученный функцией Compile.
+    // Тела методов компилируются при первом вызове. Методы, тела которых не являются
+    // узлами дерева разбора, выполняются через ClassInstance::Call (см. MethodDispatcher)
+    class VirtualMachine : private MethodDispatcher<VirtualMachine> {
+    public:
+        explicit VirtualMachine(runtime::Context& context);
+
+        // Выполняет chunk, храня переменные верхнего уровня в closure.
+        // Возвращает то же значение, что и Execute инструкции, из которой получен chunk
+        runtime::ObjectHolder Run(const Chunk& chunk, runtime::Closure& closure);
+        // Выполняет chunk в кадре frame. Если выполнена инструкция return из программы,
+        // отмечает это в кадре (Frame::SetReturning), как и Execute инструкций дерева разбора
+        runtime::ObjectHolder Run(const Chunk& chunk, runtime::Frame& frame);
+
+    private:
+        runtime::ObjectHolder Execute(const Chunk& chunk, runtime::Frame& frame);
+
+        friend class MethodDispatcher<VirtualMachine>;
+        using Dispatcher = MethodDispatcher<VirtualMachine>;
+
+        // Вызывает у экземпляра класса self метод method с arg_count аргументами, лежащими на вершине стека.
+        // Аргументы снимаются со стека. Метод ищется через кэш места вызова cache
+        runtime::ObjectHolder CallMethod(const runtime::ObjectHolder& self, runtime::MethodId method,
+            size_t arg_count, runtime::MethodCache& cache);
+
+        // Возвращает байт-код тела method или nullptr, если тело не является узлом дерева разбора
+        const Chunk* GetMethodBody(const runtime::Method& method);
+        runtime::ObjectHolder RunMethodBody(const Chunk& chunk, runtime::Frame& frame);
+
+        runtime::ObjectHolder Pop();
+
+        std::vector<runtime::ObjectHolder> stack_;
+        std::unordered_map<const runtime::Method*, std::unique_ptr<Chunk>> method_chunks_;
+    };
+
+}  // namespace bytecode
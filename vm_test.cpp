@@ -0,0 +1,296 @@
+#include "flat_ast.h"
+#include "lexer.h"
+#include "parse.h"
+#include "statement.h"
+#include "test_runner_p.h"
+#include "vm.h"
+
+using namespace std;
+
+namespace bytecode {
+
+    namespace {
+
+        string RunTreeWalker(const string& program) {
+            istringstream input(program);
+            parse::Lexer lexer(input);
+            auto tree = ParseProgram(lexer);
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            tree->Execute(closure, context);
+            return context.output.str();
+        }
+
+        string RunVirtualMachine(const string& program) {
+            istringstream input(program);
+            parse::Lexer lexer(input);
+            auto tree = ParseProgram(lexer);
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            Chunk chunk = Compile(*tree);
+            VirtualMachine(context).Run(chunk, closure);
+            return context.output.str();
+        }
+
+        string RunFlatEvaluator(const string& program) {
+            istringstream input(program);
+            parse::Lexer lexer(input);
+            auto tree = ParseProgram(lexer);
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            const flat::Program flat_program = flat::Flatten(*tree);
+            flat::Evaluator(context).Run(flat_program, closure);
+            return context.output.str();
+        }
+
+        // Выполняет программу обходом дерева, виртуальной машиной и вычислителем плоских деревьев,
+        // которые вызывают методы через общий MethodDispatcher, проверяет, что вывод совпадает,
+        // и возвращает его
+        string RunAllEngines(const string& program) {
+            string tree_output = RunTreeWalker(program);
+            ASSERT_EQUAL(RunVirtualMachine(program), tree_output);
+            ASSERT_EQUAL(RunFlatEvaluator(program), tree_output);
+            return tree_output;
+        }
+
+        // Возвращает текст ошибки выполнения программы способом run либо пустую строку, если ошибки нет
+        string GetRuntimeError(string (*run)(const string&), const string& program) {
+            try {
+                run(program);
+            }
+            catch (const runtime_error& e) {
+                return e.what();
+            }
+            return {};
+        }
+
+        // Проверяет, что программа завершается ошибкой выполнения и что виртуальная машина
+        // и вычислитель плоских деревьев сообщают ту же ошибку, что и обход дерева
+        void AssertRuntimeError(const string& program) {
+            const string error = GetRuntimeError(RunTreeWalker, program);
+            ASSERT(!error.empty());
+            ASSERT_EQUAL(GetRuntimeError(RunVirtualMachine, program), error);
+            ASSERT_EQUAL(GetRuntimeError(RunFlatEvaluator, program), error);
+        }
+
+        void TestArithmetics() {
+            ASSERT_EQUAL(RunAllEngines("print 1+2+3+4+5, 1*2*3*4*5, 1-2-3-4-5, 36/4/3, 2*5+10/2, -(3+4)\n"s),
+                "15 120 -13 3 15 -7\n"s);
+            const string program = R"(
+x = 6
+y = 4
+print x + y * 2, x - y, x / y, (x - 1) * (y + 1), x < y, x + 1 >= y * 2
+if x - 2 == y:
+  print 'equal'
+)"s;
+            ASSERT_EQUAL(RunAllEngines(program), "14 2 1 25 False False\nequal\n"s);
+        }
+
+        void TestVariablesAndStrings() {
+            const string program = R"(
+x = 4
+y = 'hello'
+z = y + ", " + "world"
+print x, y, z, str(x + 1), str(None), None
+x = y
+print x
+)"s;
+            ASSERT_EQUAL(RunAllEngines(program), "4 hello hello, world 5 None None\nhello\n"s);
+        }
+
+        void TestLogicalOperations() {
+            const string program = R"(
+a = 1
+b = 0
+print a or b, a and b, not a, not b, b or '', a and 'x'
+print 1 < 2, 2 < 1, 1 == 1, 'a' != 'b', 3 >= 3, 2 <= 1, 5 > 4
+if a and not b:
+  print 'yes'
+else:
+  print 'no'
+if b:
+  print 'unreachable'
+if a or 1 / 0:
+  print 'short circuit'
+)"s;
+            ASSERT_EQUAL(RunAllEngines(program),
+                "True False False True False True\nTrue False True True True False True\nyes\nshort circuit\n"s);
+        }
+
+        void TestClassesAndMethods() {
+            const string program = R"(
+class Counter:
+  def __init__(start):
+    self.value = start
+
+  def add(delta):
+    self.value = self.value + delta
+    return self.value
+
+c = Counter(10)
+print c.add(5), c.add(-3), c.value
+)"s;
+            ASSERT_EQUAL(RunAllEngines(program), "15 12 12\n"s);
+        }
+
+        void TestOperatorMethods() {
+            const string program = R"(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+  def __str__():
+    return '(' + str(self.x) + '; ' + str(self.y) + ')'
+
+  def __eq__(other):
+    return self.x == other.x and self.y == other.y
+
+  def __lt__(other):
+    return self.x < other.x
+
+  def __add__(other):
+    return '+' + str(other)
+
+p = Point(1, 2)
+q = Point(3, 2)
+print p, q, p == q, p != q, p < q, p > q, p <= q, p >= q
+print str(p) + '!', p + q
+)"s;
+            ASSERT_EQUAL(RunAllEngines(program),
+                "(1; 2) (3; 2) False True True False True False\n(1; 2)! +(3; 2)\n"s);
+        }
+
+        void TestInheritanceAndRecursion() {
+            const string program = R"(
+class Shape:
+  def __str__():
+    return "Shape " + self.name()
+
+  def name():
+    return "unknown"
+
+class Rect(Shape):
+  def name():
+    return "rect"
+
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+print Shape(), Rect()
+f = Fib()
+print f.calc(15)
+)"s;
+            ASSERT_EQUAL(RunAllEngines(program), "Shape unknown Shape rect\n610\n"s);
+        }
+
+        void TestRuntimeErrors() {
+            AssertRuntimeError("print 1 + 'a'\n"s);
+            AssertRuntimeError("print x\n"s);
+            AssertRuntimeError("print 1 < None\n"s);
+            AssertRuntimeError("print 1 / 0\n"s);
+            AssertRuntimeError("x = 0\nprint 2 * (1 / x)\n"s);
+            AssertRuntimeError("x = 'a'\nprint 1 - x\n"s);
+            AssertRuntimeError("print 2 * None\n"s);
+            AssertRuntimeError("x = 'a'\nprint 4 / x\n"s);
+            AssertRuntimeError("print -'a'\n"s);
+            AssertRuntimeError("class A:\n  def f():\n    return 1\na = A()\nprint a.f(1)\n"s);
+        }
+
+        // Методы __init__, __add__, __lt__ и __str__ ищутся через кэши мест операций один раз за выполнение
+        void TestOperatorCaches() {
+            const string program = R"(
+class Point:
+  def __init__(x):
+    self.x = x
+
+  def __str__():
+    return 'P' + str(self.x)
+
+  def __lt__(other):
+    return self.x < other.x
+
+  def __add__(other):
+    return self.x + other.x
+
+p = Point(1)
+q = Point(2)
+print p, p + q, p < q
+)"s;
+            istringstream input(program);
+            parse::Lexer lexer(input);
+            auto tree = ParseProgram(lexer);
+            Chunk chunk = Compile(*tree);
+            runtime::DummyContext context;
+            for (int i = 0; i < 3; ++i) {
+                runtime::Closure closure;
+                VirtualMachine(context).Run(chunk, closure);
+            }
+            ASSERT_EQUAL(context.output.str(), "P1 3 True\nP1 3 True\nP1 3 True\n"s);
+
+            auto assert_used_once_per_run = [](const runtime::MethodCache& cache) {
+                ASSERT_EQUAL(cache.GetStats().misses, 1U);
+                ASSERT_EQUAL(cache.GetStats().hits, 2U);
+            };
+            ASSERT_EQUAL(chunk.instance_sites.size(), 2U);
+            for (const InstanceSite& site : chunk.instance_sites) {
+                assert_used_once_per_run(site.init_cache);
+            }
+            ASSERT_EQUAL(chunk.compare_sites.size(), 1U);
+            assert_used_once_per_run(chunk.compare_sites.front().lt_cache);
+            ASSERT_EQUAL(chunk.compare_sites.front().eq_cache.GetStats().misses, 0U);
+            size_t operator_sites = 0;
+            for (const CallSite& site : chunk.call_sites) {
+                // Места вывода чисел и логических значений не обращаются к кэшу
+                if (site.method == runtime::ADD_METHOD_ID || site.cache.GetStats().misses > 0) {
+                    assert_used_once_per_run(site.cache);
+                    ++operator_sites;
+                }
+            }
+            // __add__ и __str__ для print p
+            ASSERT_EQUAL(operator_sites, 2U);
+        }
+
+        void TestNonAstMethodBody() {
+            struct Body : runtime::Executable {
+                runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context&) override {
+                    return closure.at("x"s);
+                }
+            };
+
+            vector<runtime::Method> methods;
+            methods.push_back({ "get"s, {"x"s}, make_unique<Body>() });
+            runtime::Class cls("Custom"s, std::move(methods), nullptr);
+
+            ast::Compound program;
+            program.AddStatement(make_unique<ast::Assignment>("c"s, make_unique<ast::NewInstance>(cls)));
+            vector<unique_ptr<ast::Statement>> args;
+            args.push_back(make_unique<ast::NumericConst>(42));
+            program.AddStatement(make_unique<ast::Print>(make_unique<ast::MethodCall>(
+                make_unique<ast::VariableValue>("c"s), "get"s, std::move(args))));
+
+            runtime::DummyContext context;
+            runtime::Closure closure;
+            Chunk chunk = Compile(program);
+            VirtualMachine(context).Run(chunk, closure);
+            ASSERT_EQUAL(context.output.str(), "42\n"s);
+        }
+
+    }  // namespace
+
+    void RunVirtualMachineTests(TestRunner& tr) {
+        RUN_TEST(tr, bytecode::TestArithmetics);
+        RUN_TEST(tr, bytecode::TestVariablesAndStrings);
+        RUN_TEST(tr, bytecode::TestLogicalOperations);
+        RUN_TEST(tr, bytecode::TestClassesAndMethods);
+        RUN_TEST(tr, bytecode::TestOperatorMethods);
+        RUN_TEST(tr, bytecode::TestInheritanceAndRecursion);
+        RUN_TEST(tr, bytecode::TestRuntimeErrors);
+        RUN_TEST(tr, bytecode::TestOperatorCaches);
+        RUN_TEST(tr, bytecode::TestNonAstMethodBody);
+    }
+
+}  // namespace bytecode